@@ -17,6 +17,7 @@
 # You should have received a copy of the GNU General Public License
 # along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
 
+import os
 import sys
 
 ninja_rules = '''
@@ -28,10 +29,10 @@ emcc = emcc
 
 rule compile
     depfile = $out.d
-    command = $cxx -MMD -MF $out.d $cppflags -c $in -o $out
+    command = $cxx -MMD -MF $out.d $cppflags $zstd_flags -c $in -o $out
 
 rule link
-    command = $cxx $in -o $out
+    command = $cxx $in -o $out -pthread $libs
 
 rule run_cp
     command = cp $in $out
@@ -50,14 +51,56 @@ rule create_archive
 
 rule emcc_compile
     depfile = $out.d
-    command = $emcc -MMD -MF $out.d -g $cppflags -c $in -o $out
+    command = $emcc -MMD -MF $out.d -g $cppflags -fPIC -s USE_ZLIB=1 -c $in -o $out
 
 rule emcc_nasm_compile
     depfile = $out.d
-    command = $emcc -MMD -MF $out.d -g $nasm_cppflags -c $in -o $out
+    command = $emcc -MMD -MF $out.d -g $nasm_cppflags -fPIC -c $in -o $out
+
+# The web build links the disassembler into the one module
+emcc_link_flags = -s EXTRA_EXPORTED_RUNTIME_METHODS='["ccall", "cwrap"]' -s ALLOW_MEMORY_GROWTH=1 -s USE_ZLIB=1
 
 rule emcc_link
-    command = $emcc -s "EXPORTED_FUNCTIONS=['_run_with_buffer']"  -s EXTRA_EXPORTED_RUNTIME_METHODS='["ccall", "cwrap"]' -s ALLOW_MEMORY_GROWTH=1 $in -o $out
+    command = $emcc $emcc_link_flags -s "EXPORTED_FUNCTIONS=[$exports]" $in -o $out
+
+# Variant in out/web/split with the disassembler in a side module
+# (disasm.wasm) next to object_explorer.js, fetched by the page when it first
+# shows code, see `loadDisassembler` in web/elf-explorer.js. Exports of the
+# main module are its entry points and what the side module imports, listed
+# by src/gen_wasm_exports.py. All of it is compiled as position independent
+# code, as the MAIN_MODULE and SIDE_MODULE links require.
+emcc_split_link_flags = -s MAIN_MODULE=2 -s EXTRA_EXPORTED_RUNTIME_METHODS='["ccall", "cwrap", "FS_createPreloadedFile"]' -s FORCE_FILESYSTEM=1 --use-preload-plugins -s ALLOW_MEMORY_GROWTH=1 -s USE_ZLIB=1
+emcc_side_link_flags = -s SIDE_MODULE=2 -s "EXPORTED_FUNCTIONS=['_DisasmCreateContext', '_DisasmDestroyContext', '_DisasmDecodeBatch', '_DisasmMnemonic', '_DisasmText']"
+
+rule emcc_split_compile
+    depfile = $out.d
+    command = $emcc -MMD -MF $out.d -g $cppflags -fPIC -DELFEXPLORER_DISASM_SIDE_MODULE -s USE_ZLIB=1 -c $in -o $out
+
+rule emcc_split_link
+    command = $emcc $emcc_split_link_flags -s EXPORTED_FUNCTIONS=@$exports $in -o $out
+
+rule emcc_side_link
+    command = $emcc $emcc_side_link_flags $in -o $out
+
+rule gen_wasm_exports
+    command = python3 src/gen_wasm_exports.py --out $out $in $exports
+
+# Threaded and SIMD variant in out/web/mt, loaded by the page instead of the
+# plain one when SharedArrayBuffer is available (needs cross origin isolation)
+emcc_mt_flags = -pthread -msimd128
+
+rule emcc_mt_compile
+    depfile = $out.d
+    command = $emcc -MMD -MF $out.d -g $cppflags $emcc_mt_flags -s USE_ZLIB=1 -c $in -o $out
+
+rule emcc_mt_nasm_compile
+    depfile = $out.d
+    command = $emcc -MMD -MF $out.d -g $nasm_cppflags $emcc_mt_flags -c $in -o $out
+
+# Linked as one module like the default build, dynamic linking is not
+# combined with threads
+rule emcc_mt_link
+    command = $emcc $emcc_link_flags -s "EXPORTED_FUNCTIONS=[$exports]" $emcc_mt_flags -s USE_PTHREADS=1 -s PTHREAD_POOL_SIZE=navigator.hardwareConcurrency $in -o $out
 
 build out/web/astronaut100.png: run_cp web/astronaut100.png
 build out/web/elf-explorer.js:  run_cp web/elf-explorer.js
@@ -68,6 +111,13 @@ build out/web/test.html:        run_cp web/test.html
 rule build_object_image
     command = python3 web/create-object-image.py --out $out --label $label
 
+rule gen_bench_object
+    command = python3 src/gen_bench_object.py --out $out $args
+
+rule run_bench
+    command = $in > $out
+    pool = console
+
 '''
 
 nasm_sources = [
@@ -95,12 +145,57 @@ fmt_sources = [
 ]
 
 objexp_sources = [
+    'src/debug_line.cpp',
+    'src/decompress.cpp',
+    'src/eh_frame.cpp',
+    'src/elf_diff.cpp',
     'src/elf_structs.cpp',
+    'src/function_index.cpp',
     'src/html_output.cpp',
     'src/input_buffer.cpp',
+    'src/name_index.cpp',
+    'src/pipeline.cpp',
+    'src/reference_index.cpp',
+    'src/stats.cpp',
+    'src/symbol_columns.cpp',
+    'src/table_data.cpp',
+    'src/alloc_counter.cpp',
     'src/elf_explorer.cpp',
 ]
 
+# Only built into the command line tool, not the web version
+native_sources = [
+    'src/comdat.cpp',
+    'src/http_server.cpp',
+    'src/serve.cpp',
+    'src/symbol_index.cpp',
+    'src/watch.cpp',
+]
+
+bench_sources = [
+    'src/elf_bench.cpp',
+]
+
+# Inputs for `ninja bench`, each sweeps one dimension of src/gen_bench_object.py
+bench_inputs = {
+    'baseline':        '',
+    'sections_1k':     '--sections 1000',
+    'sections_10k':    '--sections 10000',
+    'sections_60k':    '--sections 60000',
+    'sections_500k':   '--sections 500000',
+    'symbols_10k':     '--symbols 10000',
+    'symbols_100k':    '--symbols 100000',
+    'symbols_1m':      '--symbols 1000000',
+    'relocations_10k': '--relocations 10000',
+    'relocations_1m':  '--relocations 1000000',
+    'groups_1k':       '--groups 1000',
+    'groups_20k':      '--groups 20000',
+    'groups_100k':     '--groups 100000',
+    'code_64k':        '--code-bytes 65536',
+    'code_1m':         '--code-bytes 1048576',
+    'code_16m':        '--code-bytes 16777216',
+}
+
 examples = [
     'libfmt_format',
     'hello',
@@ -110,16 +205,47 @@ examples = [
     'static_fn',
 ]
 
+# Entry points of the wasm module, called from web/elf-explorer.js
+web_exports = [
+    '_run_with_buffer',
+    '_open_buffer',
+    '_next_html_chunk',
+    '_disasm_function',
+    '_table_data',
+    '_search_names',
+    '_symbol_references',
+    '_section_needs_disassembler',
+    '_function_needs_disassembler',
+    '_load_disassembler',
+]
+
 nasm_objects = [ 'out/cpp/' + src.replace( '.c', '.o' ) for src in nasm_sources ]
 fmt_objects = [ 'out/cpp/' + src.replace( '.cc', '.o' ) for src in fmt_sources ]
 objexp_objects = [ 'out/cpp/' + src.replace( '.cpp', '.o' ) for src in objexp_sources ]
+native_objects = [ 'out/cpp/' + src.replace( '.cpp', '.o' ) for src in native_sources ]
 
 emcc_nasm_objects = [ 'out/emcc/' + src.replace( '.c', '.o' ) for src in nasm_sources ]
 emcc_fmt_objects = [ 'out/emcc/' + src.replace( '.cc', '.o' ) for src in fmt_sources ]
 emcc_objexp_objects = [ 'out/emcc/' + src.replace( '.cpp', '.o' ) for src in objexp_sources ]
 
+emcc_split_fmt_objects = [ 'out/emcc-split/' + src.replace( '.cc', '.o' ) for src in fmt_sources ]
+emcc_split_objexp_objects = [ 'out/emcc-split/' + src.replace( '.cpp', '.o' ) for src in objexp_sources ]
+
+emcc_mt_nasm_objects = [ 'out/emcc-mt/' + src.replace( '.c', '.o' ) for src in nasm_sources ]
+emcc_mt_fmt_objects = [ 'out/emcc-mt/' + src.replace( '.cc', '.o' ) for src in fmt_sources ]
+emcc_mt_objexp_objects = [ 'out/emcc-mt/' + src.replace( '.cpp', '.o' ) for src in objexp_sources ]
+
+bench_objects = [ 'out/cpp/' + src.replace( '.cpp', '.o' ) for src in bench_sources ]
+bench_lib_objects = [ obj for obj in objexp_objects if obj != 'out/cpp/src/elf_explorer.o' ]
+
+# zstd compressed sections are only supported when its headers are installed,
+# the web version always does without
+have_zstd = os.path.exists( '/usr/include/zstd.h' )
+
 def main():
     with open( 'build.ninja', 'w' ) as ninja:
+        ninja.write( f'zstd_flags = {"-DELFEXPLORER_HAVE_ZSTD" if have_zstd else ""}\n' )
+        ninja.write( f'libs = -lz{" -lzstd" if have_zstd else ""}\n' )
         ninja.write( ninja_rules )
 
         for e in examples:
@@ -133,12 +259,21 @@ def main():
         for src, obj in zip( nasm_sources, emcc_nasm_objects ):
             ninja.write( f'build {obj}: emcc_nasm_compile {src}\n' )
 
+        for src, obj in zip( nasm_sources, emcc_mt_nasm_objects ):
+            ninja.write( f'build {obj}: emcc_mt_nasm_compile {src}\n' )
+
         for src, obj in zip( fmt_sources, fmt_objects ):
             ninja.write( f'build {obj}: compile {src}\n' )
 
         for src, obj in zip( fmt_sources, emcc_fmt_objects ):
             ninja.write( f'build {obj}: emcc_compile {src}\n' )
 
+        for src, obj in zip( fmt_sources, emcc_split_fmt_objects ):
+            ninja.write( f'build {obj}: emcc_split_compile {src}\n' )
+
+        for src, obj in zip( fmt_sources, emcc_mt_fmt_objects ):
+            ninja.write( f'build {obj}: emcc_mt_compile {src}\n' )
+
         ninja.write( f'build out/cpp/disasm_lib.a: create_archive {" ".join( nasm_objects )}\n' )
 
         for src, obj in zip( objexp_sources, objexp_objects ):
@@ -147,8 +282,55 @@ def main():
         for src, obj in zip( objexp_sources, emcc_objexp_objects ):
             ninja.write( f'build {obj}: emcc_compile {src}\n' )
 
-        ninja.write( f'build out/elf_explorer: link {" ".join( objexp_objects + fmt_objects ) } out/cpp/disasm_lib.a\n' )
+        for src, obj in zip( objexp_sources, emcc_split_objexp_objects ):
+            ninja.write( f'build {obj}: emcc_split_compile {src}\n' )
+
+        for src, obj in zip( objexp_sources, emcc_mt_objexp_objects ):
+            ninja.write( f'build {obj}: emcc_mt_compile {src}\n' )
+
+        for src, obj in zip( native_sources, native_objects ):
+            ninja.write( f'build {obj}: compile {src}\n' )
+
+        ninja.write( f'build out/elf_explorer: link {" ".join( objexp_objects + native_objects + fmt_objects ) } out/cpp/disasm_lib.a\n' )
+
         ninja.write( f'build out/web/object_explorer.js: emcc_link {" ".join( emcc_nasm_objects + emcc_objexp_objects + emcc_fmt_objects ) }\n' )
+        ninja.write( f'    exports = {", ".join( repr( e ) for e in web_exports )}\n' )
+
+        ninja.write( f'build out/web/split/disasm.wasm: emcc_side_link {" ".join( emcc_nasm_objects ) }\n' )
+        ninja.write( 'build out/emcc-split/exports.json: gen_wasm_exports out/web/split/disasm.wasm | src/gen_wasm_exports.py\n' )
+        ninja.write( f'    exports = {" ".join( web_exports )}\n' )
+        ninja.write( f'build out/web/split/object_explorer.js: emcc_split_link {" ".join( emcc_split_objexp_objects + emcc_split_fmt_objects ) } | out/emcc-split/exports.json\n' )
+        ninja.write( '    exports = out/emcc-split/exports.json\n' )
+
+        # The side module split is not built by default, its MAIN_MODULE link
+        # and the dlopen of disasm.wasm are yet to be tried with emcc and in
+        # browsers. Run with `ninja web-split`, the page loads it as
+        # test.html?split.
+        ninja.write( 'build web-split: phony out/web/split/object_explorer.js out/web/split/disasm.wasm\n' )
+
+        ninja.write( f'build out/web/mt/object_explorer.js: emcc_mt_link {" ".join( emcc_mt_nasm_objects + emcc_mt_objexp_objects + emcc_mt_fmt_objects ) }\n' )
+        ninja.write( f'    exports = {", ".join( repr( e ) for e in web_exports )}\n' )
+
+        # The threaded build is not built by default, run with `ninja web-mt`.
+        # It has never been linked with emcc nor loaded in a browser, so it is
+        # unbuilt and unsupported until then.
+        ninja.write( 'build web-mt: phony out/web/mt/object_explorer.js\n' )
+
+        # Benchmarks are not built by default, run with `ninja bench`
+        ninja.write( 'default out/elf_explorer out/web/object_explorer.js out/web/astronaut100.png out/web/elf-explorer.js out/web/enums.js out/web/style.css out/web/test.html ' )
+        ninja.write( ' '.join( f'out/web/objects/{e}.o out/web/{e}.o.gif' for e in examples ) + '\n' )
+
+        for src, obj in zip( bench_sources, bench_objects ):
+            ninja.write( f'build {obj}: compile {src}\n' )
+
+        ninja.write( f'build out/elf_bench: link {" ".join( bench_objects + bench_lib_objects + fmt_objects ) } out/cpp/disasm_lib.a\n' )
+
+        for name, args in bench_inputs.items():
+            ninja.write( f'build out/bench/{name}.o: gen_bench_object | src/gen_bench_object.py\n' )
+            ninja.write( f'    args = {args}\n' )
+
+        ninja.write( f'build out/bench/results.jsonl: run_bench out/elf_bench {" ".join( f"out/bench/{name}.o" for name in bench_inputs ) }\n' )
+        ninja.write( 'build bench: phony out/bench/results.jsonl\n' )
 
 
 if __name__ == "__main__":
@@ -0,0 +1,117 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Replaces global operator new/delete to count allocations for `--stats`.
+// Kept in its own translation unit so the replacements are never inlined
+// into code using them.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "stats.hpp"
+
+namespace {
+
+std::atomic< bool > g_count_allocations( false );
+std::atomic< uint64_t > g_allocation_count( 0 );
+std::atomic< uint64_t > g_allocation_bytes( 0 );
+
+} // namespace
+
+namespace elfexplorer {
+namespace stats {
+
+void CountAllocations( bool enable )
+{
+    g_count_allocations = enable;
+}
+
+uint64_t AllocationCount()
+{
+    return g_allocation_count.load();
+}
+
+uint64_t AllocationBytes()
+{
+    return g_allocation_bytes.load();
+}
+
+} // namespace stats
+} // namespace elfexplorer
+
+namespace {
+
+void CountAllocation( std::size_t size )
+{
+    if ( g_count_allocations.load( std::memory_order_relaxed ) )
+    {
+        g_allocation_count.fetch_add( 1, std::memory_order_relaxed );
+        g_allocation_bytes.fetch_add( size, std::memory_order_relaxed );
+    }
+}
+
+} // namespace
+
+// The rest of the operator new/delete family falls back to these, the over
+// aligned ones (e.g. pmr arena blocks) to the align_val_t overloads below
+void* operator new( std::size_t size )
+{
+    CountAllocation( size );
+
+    void *p = std::malloc( size ? size : 1 );
+    if ( p == nullptr )
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete( void *p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void *p, std::size_t ) noexcept
+{
+    std::free( p );
+}
+
+void* operator new( std::size_t size, std::align_val_t alignment )
+{
+    CountAllocation( size );
+
+    // aligned_alloc wants a multiple of the alignment
+    const std::size_t align = static_cast< std::size_t >( alignment );
+    void *p = std::aligned_alloc( align, ( ( size ? size : 1 ) + align - 1 ) & ~( align - 1 ) );
+    if ( p == nullptr )
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete( void *p, std::align_val_t ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void *p, std::size_t, std::align_val_t ) noexcept
+{
+    std::free( p );
+}
@@ -0,0 +1,91 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__ANCHOR_HPP__
+#define ELFEXPLORER__ANCHOR_HPP__
+
+#include <cstddef>
+
+#include <fmt/format.h>
+
+namespace elfexplorer {
+
+// Names of the link targets in the rendered html, formatted in place when
+// used as a format argument (fmt::to_string gives the name as a string).
+struct Anchor
+{
+    enum class Kind
+    {
+        Section,
+        SectionHeader,
+        Symbol,
+    };
+
+    static
+    Anchor ForSection( size_t idx )
+    {
+        return Anchor{ Kind::Section, idx, 0 };
+    }
+
+    static
+    Anchor ForSectionHeader( size_t idx )
+    {
+        return Anchor{ Kind::SectionHeader, idx, 0 };
+    }
+
+    static
+    Anchor ForSymbol( size_t section_idx, size_t symbol_idx )
+    {
+        return Anchor{ Kind::Symbol, section_idx, symbol_idx };
+    }
+
+    Kind m_kind;
+    size_t m_section_idx;
+    size_t m_symbol_idx;
+};
+
+} // namespace elfexplorer
+
+namespace fmt {
+
+template <>
+struct formatter< elfexplorer::Anchor >
+{
+    constexpr auto parse( format_parse_context &ctx )
+    {
+        return ctx.begin();
+    }
+
+    auto format( const elfexplorer::Anchor &a, format_context &ctx ) const
+    {
+        switch ( a.m_kind )
+        {
+        case elfexplorer::Anchor::Kind::Section:
+            return format_to( ctx.out(), "section-{}", a.m_section_idx );
+        case elfexplorer::Anchor::Kind::SectionHeader:
+            return format_to( ctx.out(), "section-header-{}", a.m_section_idx );
+        case elfexplorer::Anchor::Kind::Symbol:
+            break;
+        }
+        return format_to( ctx.out(), "section-{}-symbol-{}", a.m_section_idx, a.m_symbol_idx );
+    }
+};
+
+} // namespace fmt
+
+#endif // ELFEXPLORER__ANCHOR_HPP__
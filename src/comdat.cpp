@@ -0,0 +1,350 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "comdat.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include <fmt/format.h>
+
+#include "elf_structs.hpp"
+#include "hash.hpp"
+#include "input_buffer.hpp"
+#include "thread_pool.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+// One way a group was emitted, objects with the same contents for it share
+// a variant
+struct GroupVariant
+{
+    uint64_t m_hash;
+    uint64_t m_bytes; // Of one copy
+    size_t m_copies;
+    size_t m_example; // Index of the first object with this variant
+};
+
+struct GroupStats
+{
+    std::vector< GroupVariant > m_variants; // By their first object once scanned
+
+    size_t Copies() const
+    {
+        size_t res = 0;
+        for ( const GroupVariant &v : m_variants )
+        {
+            res += v.m_copies;
+        }
+        return res;
+    }
+
+    uint64_t TotalBytes() const
+    {
+        uint64_t res = 0;
+        for ( const GroupVariant &v : m_variants )
+        {
+            res += v.m_bytes * v.m_copies;
+        }
+        return res;
+    }
+
+    // Everything but the copy the linker keeps, taken as the largest one
+    uint64_t DuplicatedBytes() const
+    {
+        uint64_t kept = 0;
+        for ( const GroupVariant &v : m_variants )
+        {
+            kept = std::max( kept, v.m_bytes );
+        }
+        return TotalBytes() - kept;
+    }
+};
+
+// A COMDAT group of one object
+struct ObjectGroup
+{
+    std::string_view m_signature;
+    uint64_t m_hash;
+    uint64_t m_bytes;
+};
+
+const SymbolTable* LinkedSymbolTable( const ELF_File &elf, const SectionHeader &sh )
+{
+    if ( sh.m_asso_idx >= elf.m_sections.size() )
+    {
+        return nullptr;
+    }
+    return std::get_if< SymbolTable >( &elf.m_sections[ sh.m_asso_idx ].m_var );
+}
+
+// Name a relocation refers to. Section symbols are named after their section,
+// as their index in the symbol table differs from object to object.
+std::string_view RelocationTarget( const ELF_File &elf, const SymbolTable &symtab, uint32_t symbol_idx )
+{
+    if ( symbol_idx >= symtab.m_symbols.size() )
+    {
+        return {};
+    }
+    const Symbol &s = symtab.m_symbols[ symbol_idx ];
+    if ( s.m_type == SymbolType::STT_SECTION && s.m_section_idx < elf.m_sections.size() )
+    {
+        return elf.m_sections[ s.m_section_idx ].m_header.m_name;
+    }
+    return s.m_name;
+}
+
+// Hash of what the group contributes to the link: its members' headers and
+// contents, with relocations compared by the names they refer to
+uint64_t GroupHash( const InputBuffer &input, const ELF_File &elf, const GroupSection &group, uint64_t *bytes )
+{
+    uint64_t h = group.m_section_indices.size();
+    *bytes = 0;
+
+    for ( uint32_t member : group.m_section_indices )
+    {
+        if ( member >= elf.m_sections.size() )
+        {
+            continue;
+        }
+        const Section &sec = elf.m_sections[ member ];
+        const SectionHeader &sh = sec.m_header;
+
+        h = HashCombine( h, Hash64( sh.m_name ) );
+        h = HashCombine( h, static_cast< uint64_t >( sh.m_type ) );
+        h = HashCombine( h, static_cast< uint64_t >( sh.m_attrs ) );
+        h = HashCombine( h, sh.m_size );
+        h = HashCombine( h, sh.m_addr_align );
+
+        if ( sh.m_type == SectionType::SHT_NOBITS )
+        {
+            continue;
+        }
+        *bytes += sh.m_size;
+
+        const auto *reloc = std::get_if< RelocationEntries >( &sec.m_var );
+        const SymbolTable *symtab = reloc ? LinkedSymbolTable( elf, sh ) : nullptr;
+        if ( !symtab )
+        {
+            h = HashCombine( h, Hash64( SectionBytes( input, sh ) ) );
+            continue;
+        }
+
+        for ( const RelocationEntry &e : reloc->m_entries )
+        {
+            h = HashCombine( h, e.m_offset );
+            h = HashCombine( h, static_cast< uint64_t >( e.m_type ) );
+            h = HashCombine( h, static_cast< uint64_t >( e.m_addend ) );
+            h = HashCombine( h, Hash64( RelocationTarget( elf, *symtab, e.m_symbol ) ) );
+        }
+    }
+
+    return h;
+}
+
+class ComdatScanner
+{
+public:
+    explicit ComdatScanner( std::vector< std::string > files )
+        : m_files( std::move( files ) )
+    {
+    }
+
+    void Scan( size_t num_threads )
+    {
+        {
+            ThreadPool pool( num_threads ? num_threads : std::thread::hardware_concurrency() );
+            for ( size_t i = 0; i < m_files.size(); ++i )
+            {
+                pool.Submit( [ this, i ] { ScanObject( i ); } );
+            }
+        }
+
+        // Merged in the order the objects happened to be scanned, sorted so
+        // that the report is the same every run
+        for ( auto &[ signature, stats ] : m_groups )
+        {
+            std::sort( stats.m_variants.begin(), stats.m_variants.end(), []( const GroupVariant &a, const GroupVariant &b ) {
+                return a.m_example < b.m_example;
+            } );
+        }
+    }
+
+    void Print( fmt::memory_buffer &out, size_t top ) const
+    {
+        uint64_t total_bytes = 0;
+        uint64_t duplicated_bytes = 0;
+        size_t num_copies = 0;
+
+        std::vector< std::pair< std::string_view, const GroupStats* > > groups;
+        groups.reserve( m_groups.size() );
+        for ( const auto &[ signature, stats ] : m_groups )
+        {
+            groups.emplace_back( signature, &stats );
+            total_bytes += stats.TotalBytes();
+            duplicated_bytes += stats.DuplicatedBytes();
+            num_copies += stats.Copies();
+        }
+
+        fmt::format_to( fmt::appender( out ), "{} objects, {} COMDAT groups with {} distinct signatures\n", m_files.size() - m_num_failed, num_copies, groups.size() );
+        fmt::format_to( fmt::appender( out ), "{} bytes in groups, {} bytes ({:.1f}%) discarded by the linker\n",
+                        total_bytes, duplicated_bytes, total_bytes ? 100.0 * duplicated_bytes / total_bytes : 0.0 );
+
+        std::sort( groups.begin(), groups.end(), []( const auto &a, const auto &b ) {
+            uint64_t a_bytes = a.second->DuplicatedBytes();
+            uint64_t b_bytes = b.second->DuplicatedBytes();
+            return a_bytes != b_bytes ? a_bytes > b_bytes : a.first < b.first;
+        } );
+
+        fmt::format_to( fmt::appender( out ), "\nMost duplicated:\n{:>12} {:>8} {:>10}  {}\n", "Discarded", "Copies", "Bytes", "Signature" );
+        for ( size_t i = 0; i < std::min( top, groups.size() ); ++i )
+        {
+            const auto &[ signature, stats ] = groups[ i ];
+            if ( stats->DuplicatedBytes() == 0 )
+            {
+                break;
+            }
+            fmt::format_to( fmt::appender( out ), "{:>12} {:>8} {:>10}  {}\n", stats->DuplicatedBytes(), stats->Copies(), stats->m_variants[ 0 ].m_bytes, signature );
+        }
+
+        // Also the costliest ones first
+        bool header_printed = false;
+        for ( const auto &[ signature, stats ] : groups )
+        {
+            if ( stats->m_variants.size() < 2 )
+            {
+                continue;
+            }
+            if ( !header_printed )
+            {
+                fmt::format_to( fmt::appender( out ), "\nDiffering between objects (possible ODR violations):\n" );
+                header_printed = true;
+            }
+
+            fmt::format_to( fmt::appender( out ), "{} ({} variants)\n", signature, stats->m_variants.size() );
+            for ( const GroupVariant &v : stats->m_variants )
+            {
+                fmt::format_to( fmt::appender( out ), "  {:>8} copies of {:>10} bytes, e.g. {}\n", v.m_copies, v.m_bytes, m_files[ v.m_example ] );
+            }
+        }
+    }
+
+private:
+    void ScanObject( size_t file_idx )
+    {
+        const std::string &path = m_files[ file_idx ];
+
+        std::vector< ObjectGroup > groups;
+        try
+        {
+            InputBuffer input( path, ReadFile( path.c_str() ) );
+            ELF_File elf = ELF_File::LoadMetadataFrom( input );
+
+            for ( const Section &sec : elf.m_sections )
+            {
+                const auto *group = std::get_if< GroupSection >( &sec.m_var );
+                const SymbolTable *symtab = group ? LinkedSymbolTable( elf, sec.m_header ) : nullptr;
+                if ( !symtab || group->m_flags != GroupHandling::GRP_COMDAT || sec.m_header.m_info >= symtab->m_symbols.size() )
+                {
+                    continue;
+                }
+
+                ObjectGroup &g = groups.emplace_back();
+                g.m_hash = GroupHash( input, elf, *group, &g.m_bytes );
+
+                // Merged while the object is still alive
+                g.m_signature = symtab->m_symbols[ sec.m_header.m_info ].m_name;
+            }
+
+            Merge( file_idx, groups );
+        }
+        catch ( const std::exception &e )
+        {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            std::cerr << fmt::format( "{}: {}\n", path, e.what() );
+            ++m_num_failed;
+        }
+    }
+
+    void Merge( size_t file_idx, const std::vector< ObjectGroup > &groups )
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        for ( const ObjectGroup &g : groups )
+        {
+            auto it = m_groups.find( g.m_signature );
+            if ( it == m_groups.end() )
+            {
+                // Keys outlive the object the signature was read from
+                it = m_groups.emplace( m_signatures.emplace_back( g.m_signature ), GroupStats() ).first;
+            }
+
+            std::vector< GroupVariant > &variants = it->second.m_variants;
+            auto it_variant = std::find_if( variants.begin(), variants.end(), [ & ]( const GroupVariant &v ) { return v.m_hash == g.m_hash; } );
+            if ( it_variant == variants.end() )
+            {
+                variants.push_back( { g.m_hash, g.m_bytes, 1, file_idx } );
+            }
+            else
+            {
+                ++it_variant->m_copies;
+                it_variant->m_example = std::min( it_variant->m_example, file_idx );
+            }
+        }
+    }
+
+    std::vector< std::string > m_files;
+
+    std::mutex m_mutex;
+    std::deque< std::string > m_signatures;
+    std::unordered_map< std::string_view, GroupStats, StringHash > m_groups;
+    size_t m_num_failed = 0;
+};
+
+} // namespace
+
+int RunComdat( const ComdatOptions &options )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector< std::string > files;
+    for ( const std::string &root : options.m_roots )
+    {
+        std::vector< std::string > found = FindObjectFiles( root );
+        files.insert( files.end(), std::make_move_iterator( found.begin() ), std::make_move_iterator( found.end() ) );
+    }
+
+    ComdatScanner scanner( std::move( files ) );
+    scanner.Scan( options.m_num_threads );
+
+    fmt::memory_buffer out;
+    scanner.Print( out, options.m_top );
+    std::cout.write( out.data(), out.size() );
+
+    std::cerr << fmt::format( "Scanned in {:.1f} ms\n", MillisecondsSince( start ) );
+    return 0;
+}
+
+} // namespace elfexplorer
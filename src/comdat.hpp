@@ -0,0 +1,43 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__COMDAT_HPP__
+#define ELFEXPLORER__COMDAT_HPP__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace elfexplorer {
+
+struct ComdatOptions
+{
+    std::vector< std::string > m_roots; // Objects, or directories to search for them
+    size_t m_top = 20;                  // Groups listed by duplicated bytes
+    size_t m_num_threads = 0;           // Number of cores if 0
+};
+
+// Reads every object once and matches COMDAT groups across them by their
+// signature symbol. Prints to stdout the bytes the linker discards, the groups
+// discarding the most, and the groups whose copies differ between objects,
+// which usually means an ODR violation. Returns non zero on failure.
+int RunComdat( const ComdatOptions &options );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__COMDAT_HPP__
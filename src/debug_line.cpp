@@ -0,0 +1,552 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "debug_line.hpp"
+
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "dwarf_reader.hpp"
+#include "stats.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+// Forms and content types of the DWARF 5 directory and file tables
+constexpr uint64_t DW_FORM_block2    = 0x03;
+constexpr uint64_t DW_FORM_block4    = 0x04;
+constexpr uint64_t DW_FORM_data2     = 0x05;
+constexpr uint64_t DW_FORM_data4     = 0x06;
+constexpr uint64_t DW_FORM_data8     = 0x07;
+constexpr uint64_t DW_FORM_string    = 0x08;
+constexpr uint64_t DW_FORM_block     = 0x09;
+constexpr uint64_t DW_FORM_block1    = 0x0a;
+constexpr uint64_t DW_FORM_data1     = 0x0b;
+constexpr uint64_t DW_FORM_strp      = 0x0e;
+constexpr uint64_t DW_FORM_udata     = 0x0f;
+constexpr uint64_t DW_FORM_data16    = 0x1e;
+constexpr uint64_t DW_FORM_line_strp = 0x1f;
+
+constexpr uint64_t DW_LNCT_path            = 0x1;
+constexpr uint64_t DW_LNCT_directory_index = 0x2;
+
+constexpr uint8_t DW_LNS_copy               = 0x01;
+constexpr uint8_t DW_LNS_advance_pc         = 0x02;
+constexpr uint8_t DW_LNS_advance_line       = 0x03;
+constexpr uint8_t DW_LNS_set_file           = 0x04;
+constexpr uint8_t DW_LNS_const_add_pc       = 0x08;
+constexpr uint8_t DW_LNS_fixed_advance_pc   = 0x09;
+
+constexpr uint8_t DW_LNE_end_sequence = 0x01;
+constexpr uint8_t DW_LNE_set_address  = 0x02;
+constexpr uint8_t DW_LNE_define_file  = 0x03;
+
+std::string_view SectionData( const Section &sec )
+{
+    if ( const auto *progbits = std::get_if< ProgBitsSection >( &sec.m_var ) )
+    {
+        return progbits->m_data;
+    }
+    if ( const auto *compressed = std::get_if< CompressedSection >( &sec.m_var ) )
+    {
+        return compressed->Data();
+    }
+    throw std::runtime_error( fmt::format( "Section {} is not loaded", sec.m_header.m_name ) );
+}
+
+size_t FindByName( const std::pmr::vector< Section > &sections, std::string_view name )
+{
+    for ( size_t idx = 1; idx < sections.size(); ++idx )
+    {
+        if ( sections[ idx ].m_header.m_name == name && sections[ idx ].m_header.m_type == SectionType::SHT_PROGBITS )
+        {
+            return idx;
+        }
+    }
+    return 0;
+}
+
+bool IsRelocationFor( const SectionHeader &sh, size_t section_idx )
+{
+    return ( sh.m_type == SectionType::SHT_RELA || sh.m_type == SectionType::SHT_REL ) && sh.m_info == section_idx;
+}
+
+// A relocated field of .debug_line: the symbol's section, 0 if absolute, and
+// the value
+struct Relocated
+{
+    uint32_t m_section_idx;
+    uint64_t m_value;
+};
+
+// Applies the relocations of .debug_line to the fields read from it, sorted
+// by offset
+class Relocations
+{
+public:
+    Relocations( const ELF_File &elf, size_t section_idx )
+    {
+        for ( const Section &sec : elf.m_sections )
+        {
+            const auto *reloc = std::get_if< RelocationEntries >( &sec.m_var );
+            if ( !reloc || !IsRelocationFor( sec.m_header, section_idx ) || sec.m_header.m_asso_idx >= elf.m_sections.size() )
+            {
+                continue;
+            }
+            const auto *symtab = std::get_if< SymbolTable >( &elf.m_sections[ sec.m_header.m_asso_idx ].m_var );
+            ASSERT( symtab != nullptr || reloc->m_entries.empty() );
+            for ( const RelocationEntry &e : reloc->m_entries )
+            {
+                ASSERT( e.m_symbol < symtab->m_symbols.size() );
+                m_entries.push_back( Entry{ e.m_offset, &e, &symtab->m_symbols[ e.m_symbol ], reloc->m_has_addends } );
+            }
+        }
+
+        auto by_offset = []( const Entry &a, const Entry &b ) { return a.m_offset < b.m_offset; };
+        if ( !std::is_sorted( m_entries.begin(), m_entries.end(), by_offset ) )
+        {
+            std::stable_sort( m_entries.begin(), m_entries.end(), by_offset );
+        }
+    }
+
+    // `stored` is the value of the field at `offset` as read from the section
+    Relocated Apply( uint64_t offset, uint64_t stored ) const
+    {
+        auto it = std::lower_bound( m_entries.begin(), m_entries.end(), offset, []( const Entry &e, uint64_t offset ) { return e.m_offset < offset; } );
+        if ( it == m_entries.end() || it->m_offset != offset )
+        {
+            return Relocated{ 0, stored };
+        }
+        const uint32_t section_idx = it->m_symbol->m_section_idx < ReservedSectionIndexBase ? it->m_symbol->m_section_idx : 0;
+        return Relocated{ section_idx, it->m_symbol->m_value + ( it->m_has_addend ? it->m_entry->m_addend : stored ) };
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t m_offset;
+        const RelocationEntry *m_entry;
+        const Symbol *m_symbol;
+        bool m_has_addend;
+    };
+
+    std::vector< Entry > m_entries;
+};
+
+// The header of a line number program, the parts the rows are made from
+struct ProgramHeader
+{
+    uint16_t m_version;
+    uint8_t m_min_instruction_length;
+    int8_t m_line_base;
+    uint8_t m_line_range;
+    uint8_t m_opcode_base;
+    std::vector< uint8_t > m_standard_opcode_lengths;
+    std::vector< std::string > m_directories;
+    std::vector< std::string > m_files; // Joined with their directories
+};
+
+std::string JoinPath( std::string_view dir, std::string_view name )
+{
+    if ( dir.empty() || ( !name.empty() && name[ 0 ] == '/' ) )
+    {
+        return std::string( name );
+    }
+    std::string res( dir );
+    if ( res.back() != '/' )
+    {
+        res.push_back( '/' );
+    }
+    res.append( name );
+    return res;
+}
+
+} // namespace
+
+size_t LineTable::FindSection( const std::pmr::vector< Section > &sections )
+{
+    return FindByName( sections, ".debug_line" );
+}
+
+std::vector< uint32_t > LineTable::Dependencies( const std::pmr::vector< Section > &sections )
+{
+    std::vector< uint32_t > res;
+    const size_t debug_line_idx = FindSection( sections );
+    if ( debug_line_idx == 0 )
+    {
+        return res;
+    }
+
+    res.push_back( debug_line_idx );
+    for ( size_t idx = 1; idx < sections.size(); ++idx )
+    {
+        const SectionHeader &sh = sections[ idx ].m_header;
+        if ( IsRelocationFor( sh, debug_line_idx ) )
+        {
+            res.push_back( idx );
+            if ( sh.m_asso_idx != 0 && sh.m_asso_idx < sections.size() && std::find( res.begin(), res.end(), sh.m_asso_idx ) == res.end() )
+            {
+                res.push_back( sh.m_asso_idx );
+            }
+        }
+    }
+    for ( std::string_view name : { ".debug_line_str", ".debug_str" } )
+    {
+        if ( size_t idx = FindByName( sections, name ) )
+        {
+            res.push_back( idx );
+        }
+    }
+    return res;
+}
+
+LineTable::LineTable( const ELF_File &elf, size_t section_idx )
+{
+    const auto &sections = elf.m_sections;
+    ASSERT( section_idx != 0 && section_idx < sections.size() );
+    stats::ScopedPhase phase( "debug_line", sections[ section_idx ].m_header.m_name, sections[ section_idx ].m_header.m_size );
+
+    const std::string_view data = SectionData( sections[ section_idx ] );
+    const Relocations relocations( elf, section_idx );
+    const uint8_t address_size = elf.m_class == ElfClass::ELF32 ? 4 : 8;
+
+    const size_t line_str_idx = FindByName( sections, ".debug_line_str" );
+    const size_t str_idx = FindByName( sections, ".debug_str" );
+    auto string_at = [ & ]( size_t idx, uint64_t offset ) -> std::string_view
+    {
+        if ( idx == 0 )
+        {
+            throw std::runtime_error( "Missing string section" );
+        }
+        std::string_view strings = SectionData( sections[ idx ] );
+        ASSERT( offset < strings.size() );
+        return DwarfReader( strings.substr( offset ), elf.m_byte_order, address_size ).CString();
+    };
+
+    // Code sections by address, for linked files
+    std::vector< uint32_t > by_address;
+    for ( size_t idx = 1; idx < sections.size(); ++idx )
+    {
+        const SectionHeader &sh = sections[ idx ].m_header;
+        if ( ( sh.m_attrs & SectionFlags::SHF_EXECINSTR ) && ( sh.m_attrs & SectionFlags::SHF_ALLOC ) && sh.m_address != 0 )
+        {
+            by_address.push_back( idx );
+        }
+    }
+    std::sort( by_address.begin(), by_address.end(), [ & ]( uint32_t a, uint32_t b ) { return sections[ a ].m_header.m_address < sections[ b ].m_header.m_address; } );
+    auto resolve = [ & ]( const Relocated &r ) -> Relocated
+    {
+        if ( r.m_section_idx != 0 )
+        {
+            return r;
+        }
+        auto it = std::upper_bound( by_address.begin(), by_address.end(), r.m_value, [ & ]( uint64_t addr, uint32_t idx ) { return addr < sections[ idx ].m_header.m_address; } );
+        if ( it == by_address.begin() )
+        {
+            return r;
+        }
+        const SectionHeader &sh = sections[ *( it - 1 ) ].m_header;
+        return r.m_value - sh.m_address < sh.m_size ? Relocated{ *( it - 1 ), r.m_value - sh.m_address } : r;
+    };
+
+    std::unordered_map< std::string, uint32_t > file_ids;
+    auto file_id = [ & ]( const std::string &path )
+    {
+        auto [ it, inserted ] = file_ids.emplace( path, m_files.size() );
+        if ( inserted )
+        {
+            m_files.push_back( path );
+        }
+        return it->second;
+    };
+
+    DwarfReader c( data, elf.m_byte_order, address_size );
+    while ( !c.AtEnd() )
+    {
+        uint64_t length = c.Fixed< uint32_t >();
+        const bool dwarf64 = length == 0xffffffff;
+        if ( dwarf64 )
+        {
+            length = c.Fixed< uint64_t >();
+        }
+        ASSERT( length <= data.size() - c.Pos() );
+        const uint64_t end = c.Pos() + length;
+
+        ProgramHeader h;
+        h.m_version = c.Fixed< uint16_t >();
+        if ( h.m_version < 2 || h.m_version > 5 )
+        {
+            throw std::runtime_error( fmt::format( "Unsupported line table version {}", h.m_version ) );
+        }
+        uint8_t program_address_size = address_size;
+        if ( h.m_version >= 5 )
+        {
+            program_address_size = c.Fixed< uint8_t >();
+            c.Fixed< uint8_t >(); // Segment selector size
+        }
+        const uint64_t header_length = c.Fixed( dwarf64 ? 8 : 4 );
+        ASSERT( header_length <= end - c.Pos() );
+        const uint64_t program_begin = c.Pos() + header_length;
+
+        h.m_min_instruction_length = c.Fixed< uint8_t >();
+        if ( h.m_version >= 4 )
+        {
+            c.Fixed< uint8_t >(); // Maximum operations per instruction, for VLIW
+        }
+        c.Fixed< uint8_t >(); // Default is_stmt
+        h.m_line_base = static_cast< int8_t >( c.Fixed< uint8_t >() );
+        h.m_line_range = c.Fixed< uint8_t >();
+        h.m_opcode_base = c.Fixed< uint8_t >();
+        ASSERT( h.m_line_range != 0 && h.m_opcode_base != 0 );
+        for ( int i = 1; i < h.m_opcode_base; ++i )
+        {
+            h.m_standard_opcode_lengths.push_back( c.Fixed< uint8_t >() );
+        }
+
+        if ( h.m_version >= 5 )
+        {
+            // Entries described by a list of ( content type, form ) pairs
+            auto read_entries = [ & ]( auto &&add )
+            {
+                std::vector< std::pair< uint64_t, uint64_t > > format( c.Fixed< uint8_t >() );
+                for ( auto &[ type, form ] : format )
+                {
+                    type = c.ULEB128();
+                    form = c.ULEB128();
+                }
+                const uint64_t count = c.ULEB128();
+                for ( uint64_t i = 0; i < count; ++i )
+                {
+                    std::string_view path;
+                    uint64_t dir = 0;
+                    for ( const auto &[ type, form ] : format )
+                    {
+                        const uint64_t pos = c.Pos();
+                        std::string_view str;
+                        uint64_t value = 0;
+                        switch ( form )
+                        {
+                        case DW_FORM_string:    str = c.CString(); break;
+                        case DW_FORM_line_strp: str = string_at( line_str_idx, relocations.Apply( pos, c.Fixed( dwarf64 ? 8 : 4 ) ).m_value ); break;
+                        case DW_FORM_strp:      str = string_at( str_idx, relocations.Apply( pos, c.Fixed( dwarf64 ? 8 : 4 ) ).m_value ); break;
+                        case DW_FORM_udata:     value = c.ULEB128(); break;
+                        case DW_FORM_data1:     value = c.Fixed< uint8_t >(); break;
+                        case DW_FORM_data2:     value = c.Fixed< uint16_t >(); break;
+                        case DW_FORM_data4:     value = c.Fixed< uint32_t >(); break;
+                        case DW_FORM_data8:     value = c.Fixed< uint64_t >(); break;
+                        case DW_FORM_data16:    c.Bytes( 16 ); break;
+                        case DW_FORM_block:     c.Bytes( c.ULEB128() ); break;
+                        case DW_FORM_block1:    c.Bytes( c.Fixed< uint8_t >() ); break;
+                        case DW_FORM_block2:    c.Bytes( c.Fixed< uint16_t >() ); break;
+                        case DW_FORM_block4:    c.Bytes( c.Fixed< uint32_t >() ); break;
+                        default:
+                            throw std::runtime_error( fmt::format( "Unsupported form {:#x} in line table header", form ) );
+                        }
+                        if ( type == DW_LNCT_path )
+                        {
+                            path = str;
+                        }
+                        else if ( type == DW_LNCT_directory_index )
+                        {
+                            dir = value;
+                        }
+                    }
+                    add( path, dir );
+                }
+            };
+
+            // Directory 0 is the compilation directory, file 0 the primary
+            // source file
+            read_entries( [ & ]( std::string_view path, uint64_t ) { h.m_directories.emplace_back( path ); } );
+            read_entries( [ & ]( std::string_view path, uint64_t dir )
+            {
+                ASSERT( dir < h.m_directories.size() );
+                h.m_files.push_back( JoinPath( h.m_directories[ dir ], path ) );
+            } );
+        }
+        else
+        {
+            // Directory 0 is the compilation directory, which is not in the
+            // table, and the files are numbered from 1
+            h.m_directories.emplace_back();
+            for ( std::string_view dir = c.CString(); !dir.empty(); dir = c.CString() )
+            {
+                h.m_directories.emplace_back( dir );
+            }
+            h.m_files.emplace_back();
+            for ( std::string_view name = c.CString(); !name.empty(); name = c.CString() )
+            {
+                const uint64_t dir = c.ULEB128();
+                c.ULEB128(); // Modification time
+                c.ULEB128(); // Size
+                ASSERT( dir < h.m_directories.size() );
+                h.m_files.push_back( JoinPath( h.m_directories[ dir ], name ) );
+            }
+        }
+
+        // Ids in `m_files` of the files of the program, looked up once used
+        std::vector< uint32_t > files( h.m_files.size(), UINT32_MAX );
+        auto program_file = [ & ]( uint64_t file )
+        {
+            ASSERT( file < h.m_files.size() );
+            if ( files[ file ] == UINT32_MAX )
+            {
+                files[ file ] = file_id( h.m_files[ file ] );
+            }
+            return files[ file ];
+        };
+
+        // State machine registers, a row is added where the file or line
+        // changes
+        Relocated address{ 0, 0 };
+        uint64_t file = 1;
+        int64_t line = 1;
+        std::vector< Row > *rows = nullptr;
+        auto reset = [ & ]
+        {
+            address = Relocated{ 0, 0 };
+            file = 1;
+            line = 1;
+            rows = nullptr;
+        };
+        auto add_row = [ & ]
+        {
+            if ( rows == nullptr )
+            {
+                const Relocated code = resolve( address );
+                if ( code.m_section_idx == 0 )
+                {
+                    return;
+                }
+                address = code;
+                rows = &m_rows[ code.m_section_idx ];
+            }
+            const uint32_t id = program_file( file );
+            if ( rows->empty() || rows->back().m_file != id || rows->back().m_line != line )
+            {
+                rows->push_back( Row{ address.m_value, id, static_cast< uint32_t >( line ) } );
+            }
+        };
+
+        c.Seek( program_begin );
+        while ( c.Pos() < end )
+        {
+            const uint8_t op = c.Fixed< uint8_t >();
+            if ( op >= h.m_opcode_base )
+            {
+                const uint8_t adjusted = op - h.m_opcode_base;
+                address.m_value += ( adjusted / h.m_line_range ) * h.m_min_instruction_length;
+                line += h.m_line_base + adjusted % h.m_line_range;
+                add_row();
+                continue;
+            }
+
+            switch ( op )
+            {
+            case 0:
+            {
+                const uint64_t size = c.ULEB128();
+                ASSERT( size != 0 && size <= end - c.Pos() );
+                const uint64_t next = c.Pos() + size;
+                const uint8_t extended = c.Fixed< uint8_t >();
+                if ( extended == DW_LNE_end_sequence )
+                {
+                    reset();
+                }
+                else if ( extended == DW_LNE_set_address )
+                {
+                    ASSERT( size - 1 == program_address_size );
+                    const uint64_t pos = c.Pos();
+                    address = relocations.Apply( pos, c.Fixed( program_address_size ) );
+                    rows = nullptr;
+                }
+                else if ( extended == DW_LNE_define_file )
+                {
+                    std::string_view name = c.CString();
+                    const uint64_t dir = c.ULEB128();
+                    ASSERT( dir < h.m_directories.size() );
+                    h.m_files.push_back( JoinPath( h.m_directories[ dir ], name ) );
+                    files.push_back( UINT32_MAX );
+                }
+                c.Seek( next ); // Skipping the ones not needed, e.g. discriminators
+                break;
+            }
+            case DW_LNS_copy:
+                add_row();
+                break;
+            case DW_LNS_advance_pc:
+                address.m_value += c.ULEB128() * h.m_min_instruction_length;
+                break;
+            case DW_LNS_advance_line:
+                line += c.SLEB128();
+                break;
+            case DW_LNS_set_file:
+                file = c.ULEB128();
+                break;
+            case DW_LNS_const_add_pc:
+                address.m_value += ( ( 255 - h.m_opcode_base ) / h.m_line_range ) * h.m_min_instruction_length;
+                break;
+            case DW_LNS_fixed_advance_pc:
+                address.m_value += c.Fixed< uint16_t >();
+                break;
+            default:
+                // Operands are ULEB128s, known by count so that newer opcodes
+                // can be skipped
+                for ( int i = 0; i < h.m_standard_opcode_lengths[ op - 1 ]; ++i )
+                {
+                    c.ULEB128();
+                }
+                break;
+            }
+        }
+        c.Seek( end );
+    }
+
+    // Sequences are in any order, and rows of functions from different units
+    // in one section are interleaved. Of the rows at one offset the last is
+    // the line of the instruction there.
+    for ( auto &[ section, rows ] : m_rows )
+    {
+        std::stable_sort( rows.begin(), rows.end(), []( const Row &a, const Row &b ) { return a.m_offset < b.m_offset; } );
+        size_t size = 0;
+        for ( const Row &row : rows )
+        {
+            if ( size != 0 && rows[ size - 1 ].m_offset == row.m_offset )
+            {
+                --size;
+            }
+            if ( size == 0 || rows[ size - 1 ].m_file != row.m_file || rows[ size - 1 ].m_line != row.m_line )
+            {
+                rows[ size++ ] = row;
+            }
+        }
+        rows.resize( size );
+        rows.shrink_to_fit();
+    }
+}
+
+const std::vector< LineTable::Row >& LineTable::Rows( size_t section_idx ) const
+{
+    static const std::vector< Row > none;
+    auto it = m_rows.find( section_idx );
+    return it != m_rows.end() ? it->second : none;
+}
+
+} // namespace elfexplorer
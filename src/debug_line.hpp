@@ -0,0 +1,79 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__DEBUG_LINE_HPP__
+#define ELFEXPLORER__DEBUG_LINE_HPP__
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "elf_structs.hpp"
+
+namespace elfexplorer {
+
+// Source lines of the code from the line number programs in .debug_line
+// (DWARF 2 to 5). The programs are run once, keeping a row only where the
+// file or line changes, and the rows are stored per code section sorted by
+// offset. In object files the addresses of a program are relocations, they
+// are resolved to the section and offset of the code; in linked files they
+// are mapped through the section addresses.
+//
+// Decoding reads .debug_line, its relocations with their symbol tables and
+// the string sections, see `Dependencies`. The names are copied, so those can
+// be released once the table is built.
+class LineTable
+{
+public:
+    struct Row
+    {
+        uint64_t m_offset;
+        uint32_t m_file; // See `FileName`
+        uint32_t m_line;
+    };
+
+    // The .debug_line section, 0 if there is none
+    static size_t FindSection( const std::pmr::vector< Section > &sections );
+
+    // Sections to load before decoding, .debug_line included. Empty if there
+    // is no line info.
+    static std::vector< uint32_t > Dependencies( const std::pmr::vector< Section > &sections );
+
+    // Throws if the line info is malformed or uses forms not supported
+    LineTable( const ELF_File &elf, size_t section_idx );
+
+    // Sorted by offset, empty for sections without line info
+    const std::vector< Row >& Rows( size_t section_idx ) const;
+
+    // Path of the file, with its directory if the program gives one
+    std::string_view FileName( uint32_t file ) const
+    {
+        return m_files[ file ];
+    }
+
+private:
+    std::vector< std::string > m_files;
+    std::unordered_map< uint32_t, std::vector< Row > > m_rows;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__DEBUG_LINE_HPP__
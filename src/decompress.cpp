@@ -0,0 +1,180 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "decompress.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <zlib.h>
+
+#ifdef ELFEXPLORER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace elfexplorer {
+
+namespace {
+
+constexpr size_t ChunkSize = 64 * 1024;
+
+// Size of the next piece of output to decompress into, after `offset` bytes
+// of the expected `size`. Once all are there, one byte more shows whether
+// the data is larger (or lets an empty stream end).
+size_t NextOutSize( uint64_t offset, uint64_t size )
+{
+    return size - offset < ChunkSize ? size - offset + 1 : ChunkSize;
+}
+
+// Most a byte of payload can decompress to: deflate can not do more than
+// about 1032:1, a zstd RLE block is 4 bytes for up to 128 KiB. Sizes over
+// this are rejected before decompressing anything.
+uint64_t MaxRatio( CompressionType type )
+{
+    return type == CompressionType::ELFCOMPRESS_ZLIB ? 1032 : 32 * 1024;
+}
+
+std::string InflateZlib( std::string_view payload, uint64_t size )
+{
+    struct Stream : z_stream
+    {
+        Stream() : z_stream() {}
+        ~Stream() { inflateEnd( this ); }
+    } zs;
+    if ( inflateInit( &zs ) != Z_OK )
+    {
+        throw std::runtime_error( "Can not initialize zlib" );
+    }
+
+    zs.next_in = reinterpret_cast< Bytef* >( const_cast< char* >( payload.data() ) );
+
+    // Grows a chunk at a time as output is produced
+    std::string res;
+
+    uint64_t remaining_in = payload.size();
+    int ret = Z_OK;
+    while ( ret != Z_STREAM_END )
+    {
+        // uInt sized pieces of input, chunks of output
+        if ( zs.avail_in == 0 && remaining_in > 0 )
+        {
+            zs.avail_in = static_cast< uInt >( std::min< uint64_t >( remaining_in, ChunkSize ) );
+            remaining_in -= zs.avail_in;
+        }
+
+        const size_t offset = res.size();
+        const size_t out_size = NextOutSize( offset, size );
+        res.resize( offset + out_size );
+        zs.next_out = reinterpret_cast< Bytef* >( res.data() + offset );
+        zs.avail_out = static_cast< uInt >( out_size );
+
+        ret = inflate( &zs, Z_NO_FLUSH );
+        res.resize( offset + out_size - zs.avail_out );
+        if ( res.size() > size )
+        {
+            throw std::runtime_error( fmt::format( "Compressed data is larger than {} bytes", size ) );
+        }
+
+        if ( ret == Z_BUF_ERROR && zs.avail_in == 0 && remaining_in == 0 )
+        {
+            throw std::runtime_error( "Compressed data is truncated" );
+        }
+        if ( ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR )
+        {
+            throw std::runtime_error( fmt::format( "Invalid zlib data: {}", zs.msg ? zs.msg : "unknown error" ) );
+        }
+    }
+    return res;
+}
+
+#ifdef ELFEXPLORER_HAVE_ZSTD
+std::string DecompressZstd( std::string_view payload, uint64_t size )
+{
+    std::unique_ptr< ZSTD_DStream, size_t (*)( ZSTD_DStream* ) > stream( ZSTD_createDStream(), ZSTD_freeDStream );
+    ZSTD_DStream *zs = stream.get();
+    if ( zs == nullptr )
+    {
+        throw std::runtime_error( "Can not initialize zstd" );
+    }
+
+    // Grows a chunk at a time as output is produced
+    std::string res;
+
+    ZSTD_inBuffer in = { payload.data(), payload.size(), 0 };
+    size_t ret = 1;
+    while ( ret != 0 )
+    {
+        const size_t offset = res.size();
+        const size_t out_size = NextOutSize( offset, size );
+        res.resize( offset + out_size );
+        ZSTD_outBuffer out = { res.data() + offset, out_size, 0 };
+
+        ret = ZSTD_decompressStream( zs, &out, &in );
+        res.resize( offset + out.pos );
+
+        if ( ZSTD_isError( ret ) )
+        {
+            throw std::runtime_error( fmt::format( "Invalid zstd data: {}", ZSTD_getErrorName( ret ) ) );
+        }
+        if ( res.size() > size )
+        {
+            throw std::runtime_error( fmt::format( "Compressed data is larger than {} bytes", size ) );
+        }
+        if ( ret != 0 && in.pos == in.size && out.pos < out_size )
+        {
+            throw std::runtime_error( "Compressed data is truncated" );
+        }
+    }
+    return res;
+}
+#endif
+
+} // namespace
+
+std::string Decompress( CompressionType type, std::string_view payload, uint64_t size )
+{
+    if ( size / MaxRatio( type ) > payload.size() )
+    {
+        throw std::runtime_error( fmt::format( "Can not decompress {} bytes to {} bytes", payload.size(), size ) );
+    }
+
+    std::string res;
+    switch ( type )
+    {
+    case CompressionType::ELFCOMPRESS_ZLIB:
+        res = InflateZlib( payload, size );
+        break;
+#ifdef ELFEXPLORER_HAVE_ZSTD
+    case CompressionType::ELFCOMPRESS_ZSTD:
+        res = DecompressZstd( payload, size );
+        break;
+#endif
+    default:
+        throw std::runtime_error( fmt::format( "Unsupported compression type {}", static_cast< uint32_t >( type ) ) );
+    }
+
+    if ( res.size() != size )
+    {
+        throw std::runtime_error( fmt::format( "Decompressed {} bytes, expected {}", res.size(), size ) );
+    }
+    return res;
+}
+
+} // namespace elfexplorer
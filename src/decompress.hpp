@@ -0,0 +1,41 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__DECOMPRESS_HPP__
+#define ELFEXPLORER__DECOMPRESS_HPP__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "enums.hpp"
+
+namespace elfexplorer {
+
+// Decompresses the payload of a SHF_COMPRESSED section, which must be exactly
+// `size` bytes once decompressed, possibly none. Output is produced in fixed
+// size chunks and never grows past what the payload really decompresses to
+// (nor past `size`), so a corrupt or hostile header can't make it use more
+// memory than that. Sizes the payload could not decompress to are rejected
+// up front. Throws if the payload is invalid or the algorithm is not
+// supported by this build (zstd is optional).
+std::string Decompress( CompressionType type, std::string_view payload, uint64_t size );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__DECOMPRESS_HPP__
@@ -0,0 +1,159 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__DISASM_CONTEXT_HPP__
+#define ELFEXPLORER__DISASM_CONTEXT_HPP__
+
+#include <memory>
+#include <string_view>
+
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+#include <dlfcn.h>
+#endif
+
+#include "enums.hpp"
+#include "input_buffer.hpp"
+#include "wrap_nasm.h"
+
+namespace elfexplorer {
+
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+// The split web build (`ninja web-split`) has the disassembler in a side
+// module (disasm.wasm) so its instruction tables are only downloaded by pages
+// that show code. The page fetches it and calls `load_disassembler` before
+// anything is disassembled.
+struct DisasmLibrary
+{
+    decltype( &::DisasmCreateContext ) m_create_context = nullptr;
+    decltype( &::DisasmDestroyContext ) m_destroy_context = nullptr;
+    decltype( &::DisasmDecodeBatch ) m_decode_batch = nullptr;
+    decltype( &::DisasmMnemonic ) m_mnemonic = nullptr;
+    decltype( &::DisasmText ) m_text = nullptr;
+};
+
+inline DisasmLibrary disasm_library;
+
+// Returns false if the side module at `path` can not be loaded
+inline
+bool LoadDisasmLibrary( const char *path )
+{
+    void *handle = dlopen( path, RTLD_NOW );
+    if ( !handle )
+    {
+        return false;
+    }
+
+    DisasmLibrary lib;
+    lib.m_create_context = reinterpret_cast< decltype( lib.m_create_context ) >( dlsym( handle, "DisasmCreateContext" ) );
+    lib.m_destroy_context = reinterpret_cast< decltype( lib.m_destroy_context ) >( dlsym( handle, "DisasmDestroyContext" ) );
+    lib.m_decode_batch = reinterpret_cast< decltype( lib.m_decode_batch ) >( dlsym( handle, "DisasmDecodeBatch" ) );
+    lib.m_mnemonic = reinterpret_cast< decltype( lib.m_mnemonic ) >( dlsym( handle, "DisasmMnemonic" ) );
+    lib.m_text = reinterpret_cast< decltype( lib.m_text ) >( dlsym( handle, "DisasmText" ) );
+    if ( !lib.m_create_context || !lib.m_destroy_context || !lib.m_decode_batch || !lib.m_mnemonic || !lib.m_text )
+    {
+        return false;
+    }
+
+    disasm_library = lib;
+    return true;
+}
+
+inline
+bool DisasmLoaded()
+{
+    return disasm_library.m_create_context != nullptr;
+}
+#else
+// Linked in directly, in the native and the single module web builds
+inline
+bool DisasmLoaded()
+{
+    return true;
+}
+#endif
+
+// The disassembler decodes x86-64 only
+inline
+bool CanDisassemble( Machine machine )
+{
+    return machine == Machine::EM_X86_64;
+}
+
+// Disassembler context of the calling thread, created on first use
+inline
+DisasmContext* ThreadDisasmContext()
+{
+    struct Deleter
+    {
+        void operator()( DisasmContext *ctx ) const
+        {
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+            disasm_library.m_destroy_context( ctx );
+#else
+            DisasmDestroyContext( ctx );
+#endif
+        }
+    };
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+    ASSERT( DisasmLoaded() );
+    thread_local std::unique_ptr< DisasmContext, Deleter > ctx( disasm_library.m_create_context() );
+#else
+    thread_local std::unique_ptr< DisasmContext, Deleter > ctx( DisasmCreateContext() );
+#endif
+    return ctx.get();
+}
+
+// See `DisasmDecodeBatch`
+inline
+size_t DecodeBatch( DisasmContext *ctx, const unsigned char *data, uint64_t size, uint64_t begin, uint64_t end,
+                    DisasmInstruction *records, size_t max_records, uint64_t *next_offset )
+{
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+    return disasm_library.m_decode_batch( ctx, data, size, begin, end, records, max_records, next_offset );
+#else
+    return DisasmDecodeBatch( ctx, data, size, begin, end, records, max_records, next_offset );
+#endif
+}
+
+inline
+std::string_view Mnemonic( const DisasmContext *ctx, const DisasmInstruction &insn )
+{
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+    return disasm_library.m_mnemonic( ctx, insn.mnemonic_id );
+#else
+    return DisasmMnemonic( ctx, insn.mnemonic_id );
+#endif
+}
+
+inline
+std::string_view Operands( const DisasmContext *ctx, const DisasmInstruction &insn )
+{
+    if ( insn.text_size == 0 )
+    {
+        return {};
+    }
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+    return std::string_view( disasm_library.m_text( ctx ) + insn.text_begin, insn.text_size );
+#else
+    return std::string_view( DisasmText( ctx ) + insn.text_begin, insn.text_size );
+#endif
+}
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__DISASM_CONTEXT_HPP__
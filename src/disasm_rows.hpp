@@ -0,0 +1,164 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef ELFEXPLORER__DISASM_ROWS_HPP__
+#define ELFEXPLORER__DISASM_ROWS_HPP__
+
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+
+#include "disasm_context.hpp"
+#include "function_index.hpp"
+
+namespace elfexplorer {
+
+// Bytes a relocation patches, 0 for the ones only marking an instruction
+inline
+uint64_t RelocationSize( X64RelocationType type )
+{
+    switch ( type )
+    {
+    case X64RelocationType::R_X86_64_NONE:
+    case X64RelocationType::R_X86_64_TLSDESC_CALL:
+        return 0;
+    case X64RelocationType::R_X86_64_8:
+    case X64RelocationType::R_X86_64_PC8:
+        return 1;
+    case X64RelocationType::R_X86_64_16:
+    case X64RelocationType::R_X86_64_PC16:
+        return 2;
+    case X64RelocationType::R_X86_64_64:
+    case X64RelocationType::R_X86_64_DTPMOD64:
+    case X64RelocationType::R_X86_64_DTPOFF64:
+    case X64RelocationType::R_X86_64_TPOFF64:
+    case X64RelocationType::R_X86_64_PC64:
+    case X64RelocationType::R_X86_64_GOTOFF64:
+    case X64RelocationType::R_X86_64_GOT64:
+    case X64RelocationType::R_X86_64_GOTPCREL64:
+    case X64RelocationType::R_X86_64_GOTPC64:
+    case X64RelocationType::R_X86_64_GOTPLT64:
+    case X64RelocationType::R_X86_64_PLTOFF64:
+    case X64RelocationType::R_X86_64_SIZE64:
+    case X64RelocationType::R_X86_64_RELATIVE64:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+// A decoded instruction with the labels, source lines and relocations
+// starting within its bytes
+struct DisasmRow
+{
+    const DisasmContext *m_ctx;
+    const DisasmInstruction &m_insn;
+    FunctionIndex::Slice< FunctionIndex::Label > m_labels;
+    FunctionIndex::Slice< LineTable::Row > m_lines;
+    FunctionIndex::Slice< FunctionIndex::Relocation > m_relocations;
+
+    uint64_t End() const
+    {
+        return m_insn.offset + m_insn.length;
+    }
+
+    std::string_view Mnemonic() const
+    {
+        return elfexplorer::Mnemonic( m_ctx, m_insn );
+    }
+
+    std::string_view Operands() const
+    {
+        return elfexplorer::Operands( m_ctx, m_insn );
+    }
+
+    // Calls `byte( i )` for the offset of each byte of the instruction, with
+    // `reloc_begin( reloc )` before the first byte a relocation patches and
+    // `reloc_end( reloc )` after its last one. A relocation is cut at the end
+    // of the instruction and covers at least one byte. Overlapping ones are
+    // taken one after the other.
+    template < typename Byte, typename RelocBegin, typename RelocEnd >
+    void ForEachByte( const Byte &byte, const RelocBegin &reloc_begin, const RelocEnd &reloc_end ) const
+    {
+        const FunctionIndex::Relocation *reloc = m_relocations.begin();
+        bool in_reloc = false;
+        for ( uint64_t i = m_insn.offset; i < End(); ++i )
+        {
+            if ( !in_reloc && reloc != m_relocations.end() && reloc->m_offset <= i )
+            {
+                reloc_begin( *reloc );
+                in_reloc = true;
+            }
+            byte( i );
+            if ( in_reloc && ( i + 1 == End() || reloc->m_offset + std::max< uint64_t >( RelocationSize( reloc->m_entry->m_type ), 1 ) <= i + 1 ) )
+            {
+                reloc_end( *reloc++ );
+                in_reloc = false;
+            }
+        }
+        for ( ; reloc != m_relocations.end(); ++reloc )
+        {
+            reloc_begin( *reloc );
+            reloc_end( *reloc );
+        }
+    }
+};
+
+// Decodes the instructions starting in [ begin, end ) of `code` and calls
+// `f( row )` for each of them in order. `relocations`, `labels` and `lines`
+// are sorted by offset, the ones before `begin` are skipped and the ones
+// within an instruction are given with it.
+template < typename F >
+void ForEachDisasmRow( std::string_view code, uint64_t begin, uint64_t end,
+                       FunctionIndex::Slice< FunctionIndex::Relocation > relocations,
+                       FunctionIndex::Slice< FunctionIndex::Label > labels,
+                       FunctionIndex::Slice< LineTable::Row > lines, const F &f )
+{
+    // Takes the elements of `slice` before `offset` from its front
+    auto take = []( auto &slice, uint64_t offset )
+    {
+        auto first = slice.m_begin;
+        while ( slice.m_begin != slice.m_end && slice.m_begin->m_offset < offset )
+        {
+            ++slice.m_begin;
+        }
+        return std::remove_reference_t< decltype( slice ) >{ first, slice.m_begin };
+    };
+    take( relocations, begin );
+    take( labels, begin );
+    take( lines, begin );
+
+    DisasmContext *ctx = ThreadDisasmContext();
+    const auto *data = reinterpret_cast< const unsigned char* >( code.data() );
+    DisasmInstruction batch[ 1024 ];
+    for ( uint64_t offset = begin; offset < end; )
+    {
+        size_t count = DecodeBatch( ctx, data, code.size(), offset, end, batch, std::size( batch ), &offset );
+        for ( size_t k = 0; k < count; ++k )
+        {
+            const DisasmInstruction &insn = batch[ k ];
+            const uint64_t insn_end = insn.offset + insn.length;
+            f( DisasmRow{ ctx, insn, take( labels, insn_end ), take( lines, insn_end ), take( relocations, insn_end ) } );
+        }
+    }
+}
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__DISASM_ROWS_HPP__
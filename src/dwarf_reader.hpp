@@ -0,0 +1,145 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__DWARF_READER_HPP__
+#define ELFEXPLORER__DWARF_READER_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "input_buffer.hpp"
+
+namespace elfexplorer {
+
+// Reads the fields of DWARF sections (.eh_frame, .debug_line) in the byte
+// order of the file, throws on reading past the end
+class DwarfReader
+{
+public:
+    DwarfReader( std::string_view data, ByteOrder order, uint8_t address_size )
+        : m_data( data )
+        , m_order( order )
+        , m_address_size( address_size )
+    {
+    }
+
+    uint64_t Pos() const { return m_pos; }
+    bool AtEnd() const { return m_pos >= m_data.size(); }
+    uint8_t AddressSize() const { return m_address_size; }
+
+    void Seek( uint64_t pos )
+    {
+        ASSERT( pos <= m_data.size() );
+        m_pos = pos;
+    }
+
+    template < typename T >
+    T Fixed()
+    {
+        ASSERT( sizeof( T ) <= m_data.size() - m_pos );
+        T v;
+        std::memcpy( &v, m_data.data() + m_pos, sizeof( T ) );
+        m_pos += sizeof( T );
+        return m_order == HostByteOrder ? v : ByteSwap( v );
+    }
+
+    // Unsigned value of 1, 2, 4 or 8 bytes
+    uint64_t Fixed( uint8_t size )
+    {
+        switch ( size )
+        {
+        case 1: return Fixed< uint8_t >();
+        case 2: return Fixed< uint16_t >();
+        case 4: return Fixed< uint32_t >();
+        case 8: return Fixed< uint64_t >();
+        }
+        throw std::runtime_error( "Unsupported field size" );
+    }
+
+    uint64_t Address()
+    {
+        return Fixed( m_address_size );
+    }
+
+    uint64_t ULEB128()
+    {
+        uint64_t res = 0;
+        for ( unsigned shift = 0; ; shift += 7 )
+        {
+            const uint8_t b = Fixed< uint8_t >();
+            if ( shift < 64 )
+            {
+                res |= uint64_t( b & 0x7f ) << shift;
+            }
+            if ( !( b & 0x80 ) )
+            {
+                return res;
+            }
+        }
+    }
+
+    int64_t SLEB128()
+    {
+        uint64_t res = 0;
+        unsigned shift = 0;
+        uint8_t b;
+        do
+        {
+            b = Fixed< uint8_t >();
+            if ( shift < 64 )
+            {
+                res |= uint64_t( b & 0x7f ) << shift;
+            }
+            shift += 7;
+        } while ( b & 0x80 );
+
+        if ( shift < 64 && ( b & 0x40 ) )
+        {
+            res |= ~uint64_t( 0 ) << shift;
+        }
+        return static_cast< int64_t >( res );
+    }
+
+    std::string_view CString()
+    {
+        const size_t end = m_data.find( '\0', m_pos );
+        ASSERT( end != std::string_view::npos );
+        std::string_view res = m_data.substr( m_pos, end - m_pos );
+        m_pos = end + 1;
+        return res;
+    }
+
+    std::string_view Bytes( uint64_t size )
+    {
+        ASSERT( size <= m_data.size() - m_pos );
+        std::string_view res = m_data.substr( m_pos, size );
+        m_pos += size;
+        return res;
+    }
+
+private:
+    std::string_view m_data;
+    ByteOrder m_order;
+    uint8_t m_address_size;
+    uint64_t m_pos = 0;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__DWARF_READER_HPP__
@@ -0,0 +1,501 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "eh_frame.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+#include <fmt/format.h>
+
+#include "dwarf_reader.hpp"
+#include "elf_layout.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+// DW_EH_PE_* pointer encodings, the low bits give the format and the high
+// bits what the value is relative to
+constexpr uint8_t DW_EH_PE_absptr  = 0x00;
+constexpr uint8_t DW_EH_PE_uleb128 = 0x01;
+constexpr uint8_t DW_EH_PE_udata2  = 0x02;
+constexpr uint8_t DW_EH_PE_udata4  = 0x03;
+constexpr uint8_t DW_EH_PE_udata8  = 0x04;
+constexpr uint8_t DW_EH_PE_sleb128 = 0x09;
+constexpr uint8_t DW_EH_PE_sdata2  = 0x0a;
+constexpr uint8_t DW_EH_PE_sdata4  = 0x0b;
+constexpr uint8_t DW_EH_PE_sdata8  = 0x0c;
+
+// With linker relaxation the sizes of code are not known when assembling,
+// RISC-V objects store the range of an FDE as a pair of these relocations
+constexpr uint32_t R_RISCV_ADD32 = 35;
+constexpr uint32_t R_RISCV_SUB32 = 39;
+
+// The value as stored in the format of a DW_EH_PE_* encoding, what it is
+// relative to is up to the caller. Signed formats are sign extended.
+uint64_t ReadEncoded( DwarfReader &c, uint8_t encoding )
+{
+    switch ( encoding & 0x0f )
+    {
+    case DW_EH_PE_absptr:  return c.Address();
+    case DW_EH_PE_uleb128: return c.ULEB128();
+    case DW_EH_PE_udata2:  return c.Fixed< uint16_t >();
+    case DW_EH_PE_udata4:  return c.Fixed< uint32_t >();
+    case DW_EH_PE_udata8:  return c.Fixed< uint64_t >();
+    case DW_EH_PE_sleb128: return c.SLEB128();
+    case DW_EH_PE_sdata2:  return int16_t( c.Fixed< uint16_t >() );
+    case DW_EH_PE_sdata4:  return int32_t( c.Fixed< uint32_t >() );
+    case DW_EH_PE_sdata8:  return c.Fixed< uint64_t >();
+    }
+    throw std::runtime_error( fmt::format( "Unknown pointer encoding {:#x}", encoding ) );
+}
+
+uint8_t AddressSize( const ELF_File &elf )
+{
+    return elf.m_class == ElfClass::ELF32 ? 4 : 8;
+}
+
+struct EhFrameRelocation
+{
+    uint64_t m_offset;
+    const RelocationEntry *m_entry;
+    const SymbolTable *m_symtab;
+    bool m_has_addend;
+};
+
+// Relocations of the section from all the relocation sections for it, sorted
+// by offset
+std::vector< EhFrameRelocation > SectionRelocations( const ELF_File &elf, size_t section_idx )
+{
+    std::vector< EhFrameRelocation > res;
+    for ( const Section &sec : elf.m_sections )
+    {
+        const auto *reloc = std::get_if< RelocationEntries >( &sec.m_var );
+        if ( !reloc || sec.m_header.m_info != section_idx || sec.m_header.m_asso_idx >= elf.m_sections.size() )
+        {
+            continue;
+        }
+        const auto *symtab = std::get_if< SymbolTable >( &elf.m_sections[ sec.m_header.m_asso_idx ].m_var );
+        if ( !symtab )
+        {
+            continue;
+        }
+        for ( const RelocationEntry &e : reloc->m_entries )
+        {
+            res.push_back( EhFrameRelocation{ e.m_offset, &e, symtab, reloc->m_has_addends } );
+        }
+    }
+
+    auto by_offset = []( const EhFrameRelocation &a, const EhFrameRelocation &b ) { return a.m_offset < b.m_offset; };
+    if ( !std::is_sorted( res.begin(), res.end(), by_offset ) )
+    {
+        std::stable_sort( res.begin(), res.end(), by_offset );
+    }
+    return res;
+}
+
+EhFrame::Cie ReadCie( DwarfReader &c, std::string_view data, uint64_t offset, uint64_t end, uint8_t address_size )
+{
+    EhFrame::Cie cie{};
+    cie.m_offset = offset;
+    cie.m_version = c.Fixed< uint8_t >();
+    ASSERT( cie.m_version == 1 || cie.m_version == 3 );
+    cie.m_augmentation = c.CString();
+    if ( cie.m_augmentation.find( "eh" ) != std::string_view::npos )
+    {
+        c.Bytes( address_size ); // Obsolete exception handling data
+    }
+    cie.m_code_alignment = c.ULEB128();
+    cie.m_data_alignment = c.SLEB128();
+    cie.m_return_address_register = cie.m_version == 1 ? c.Fixed< uint8_t >() : c.ULEB128();
+    cie.m_fde_encoding = DW_EH_PE_absptr;
+
+    // Augmentation data, its size is given so the parts not needed here
+    // are skipped
+    if ( !cie.m_augmentation.empty() && cie.m_augmentation[ 0 ] == 'z' )
+    {
+        const uint64_t size = c.ULEB128();
+        ASSERT( size <= end - c.Pos() );
+        const uint64_t data_end = c.Pos() + size;
+        for ( char ch : cie.m_augmentation.substr( 1 ) )
+        {
+            if ( ch == 'R' )
+            {
+                cie.m_fde_encoding = c.Fixed< uint8_t >();
+            }
+            else if ( ch == 'L' )
+            {
+                c.Fixed< uint8_t >(); // LSDA encoding
+            }
+            else if ( ch == 'P' )
+            {
+                uint8_t encoding = c.Fixed< uint8_t >();
+                ReadEncoded( c, encoding ); // Personality routine
+            }
+            else if ( ch != 'S' && ch != 'B' && ch != 'G' )
+            {
+                break;
+            }
+        }
+        c.Seek( data_end );
+    }
+
+    ASSERT( c.Pos() <= end );
+    cie.m_instructions = data.substr( c.Pos(), end - c.Pos() );
+    return cie;
+}
+
+} // namespace
+
+bool EhFrame::IsEhFrame( const ELF_File &elf, size_t section_idx )
+{
+    const SectionHeader &sh = elf.m_sections[ section_idx ].m_header;
+    return sh.m_name == ".eh_frame" && ( sh.m_type == SectionType::SHT_PROGBITS || sh.m_type == SHT_X86_64_UNWIND )
+        && !( sh.m_attrs & SectionFlags::SHF_COMPRESSED );
+}
+
+size_t EhFrame::FindSection( const ELF_File &elf )
+{
+    for ( size_t idx = 1; idx < elf.m_sections.size(); ++idx )
+    {
+        if ( IsEhFrame( elf, idx ) )
+        {
+            return idx;
+        }
+    }
+    return 0;
+}
+
+EhFrame::EhFrame( const ELF_File &elf, size_t section_idx )
+    : m_elf( elf )
+    , m_section_idx( section_idx )
+{
+    ASSERT( section_idx < elf.m_sections.size() && IsEhFrame( elf, section_idx ) );
+    const ProgBitsSection *contents = std::get_if< ProgBitsSection >( &elf.m_sections[ section_idx ].m_var );
+    ASSERT( contents != nullptr );
+    const std::string_view data = contents->m_data;
+    const std::vector< EhFrameRelocation > relocations = SectionRelocations( elf, section_idx );
+
+    DwarfReader c( data, elf.m_byte_order, AddressSize( elf ) );
+    while ( !c.AtEnd() )
+    {
+        const uint64_t offset = c.Pos();
+        uint64_t length = c.Fixed< uint32_t >();
+        if ( length == 0 )
+        {
+            continue; // Terminator
+        }
+        if ( length == 0xffffffff )
+        {
+            length = c.Fixed< uint64_t >();
+        }
+        const uint64_t body = c.Pos();
+        ASSERT( length <= data.size() - body );
+        const uint64_t end = body + length;
+
+        // CIE id, or how far back the CIE of an FDE is
+        const uint32_t id = c.Fixed< uint32_t >();
+        if ( id == 0 )
+        {
+            m_cies.push_back( ReadCie( c, data, offset, end, AddressSize( elf ) ) );
+            c.Seek( end );
+            continue;
+        }
+
+        ASSERT( id <= body );
+        Fde fde{};
+        fde.m_offset = offset;
+        fde.m_cie_offset = body - id;
+        const Cie &cie = CieOf( fde );
+
+        // Objects have a relocation for the code address, the stored value
+        // is the addend for SHT_REL
+        const uint64_t begin_pos = c.Pos();
+        const uint64_t stored_begin = ReadEncoded( c, cie.m_fde_encoding );
+        const uint64_t size_pos = c.Pos();
+        fde.m_size = ReadEncoded( c, cie.m_fde_encoding & 0x0f );
+
+        auto relocations_at = [ & ]( uint64_t pos )
+        {
+            return std::lower_bound( relocations.begin(), relocations.end(), pos,
+                                     []( const EhFrameRelocation &r, uint64_t pos ) { return r.m_offset < pos; } );
+        };
+        if ( elf.m_machine == Machine::EM_RISCV )
+        {
+            for ( auto it = relocations_at( size_pos ); it != relocations.end() && it->m_offset == size_pos; ++it )
+            {
+                const uint32_t type = static_cast< uint32_t >( it->m_entry->m_type );
+                ASSERT( it->m_entry->m_symbol < it->m_symtab->m_symbols.size() );
+                const uint64_t value = it->m_symtab->m_symbols[ it->m_entry->m_symbol ].m_value + it->m_entry->m_addend;
+                fde.m_size += type == R_RISCV_ADD32 ? value : type == R_RISCV_SUB32 ? -value : 0;
+            }
+        }
+
+        auto reloc = relocations_at( begin_pos );
+        if ( reloc != relocations.end() && reloc->m_offset == begin_pos )
+        {
+            ASSERT( reloc->m_entry->m_symbol < reloc->m_symtab->m_symbols.size() );
+            const Symbol &s = reloc->m_symtab->m_symbols[ reloc->m_entry->m_symbol ];
+            if ( s.m_section_idx != 0 && s.m_section_idx < elf.m_sections.size() )
+            {
+                fde.m_section_idx = s.m_section_idx;
+                fde.m_begin = s.m_value + ( reloc->m_has_addend ? reloc->m_entry->m_addend : stored_begin );
+            }
+        }
+        else
+        {
+            fde.m_begin = stored_begin;
+        }
+
+        if ( !cie.m_augmentation.empty() && cie.m_augmentation[ 0 ] == 'z' )
+        {
+            c.Bytes( c.ULEB128() );
+        }
+        ASSERT( c.Pos() <= end );
+        fde.m_instructions = data.substr( c.Pos(), end - c.Pos() );
+        m_fdes.push_back( fde );
+        c.Seek( end );
+    }
+
+    for ( size_t i = 0; i < m_fdes.size(); ++i )
+    {
+        if ( m_fdes[ i ].m_section_idx != 0 )
+        {
+            m_by_code.push_back( i );
+        }
+    }
+    auto code = [ this ]( uint32_t i ) { return std::make_tuple( m_fdes[ i ].m_section_idx, m_fdes[ i ].m_begin ); };
+    std::stable_sort( m_by_code.begin(), m_by_code.end(), [ & ]( uint32_t a, uint32_t b ) { return code( a ) < code( b ); } );
+}
+
+const EhFrame::Cie& EhFrame::CieOf( const Fde &fde ) const
+{
+    auto it = std::lower_bound( m_cies.begin(), m_cies.end(), fde.m_cie_offset, []( const Cie &c, uint64_t offset ) { return c.m_offset < offset; } );
+    if ( it == m_cies.end() || it->m_offset != fde.m_cie_offset )
+    {
+        throw std::runtime_error( fmt::format( "No CIE at {:#x} for the FDE at {:#x}", fde.m_cie_offset, fde.m_offset ) );
+    }
+    return *it;
+}
+
+const EhFrame::Fde* EhFrame::Find( uint32_t section_idx, uint64_t offset ) const
+{
+    auto it = std::upper_bound( m_by_code.begin(), m_by_code.end(), std::make_tuple( section_idx, offset ), [ this ]( const auto &key, uint32_t i )
+    {
+        return key < std::make_tuple( m_fdes[ i ].m_section_idx, m_fdes[ i ].m_begin );
+    } );
+    if ( it == m_by_code.begin() )
+    {
+        return nullptr;
+    }
+    const Fde &fde = m_fdes[ *( it - 1 ) ];
+    return fde.m_section_idx == section_idx && offset - fde.m_begin < fde.m_size ? &fde : nullptr;
+}
+
+const std::vector< EhFrame::Function >& EhFrame::Functions() const
+{
+    std::call_once( m_functions_once, [ this ]
+    {
+        const auto &sections = m_elf.m_sections;
+        for ( size_t idx = 0; idx < sections.size(); ++idx )
+        {
+            const SymbolTable *symtab = std::get_if< SymbolTable >( &sections[ idx ].m_var );
+            if ( !symtab )
+            {
+                continue;
+            }
+            for ( size_t i = 0; i < symtab->m_symbols.size(); ++i )
+            {
+                const Symbol &s = symtab->m_symbols[ i ];
+                if ( s.m_type == SymbolType::STT_FUNC && s.m_section_idx != 0 && s.m_section_idx < sections.size()
+                  && ( sections[ s.m_section_idx ].m_header.m_attrs & SectionFlags::SHF_EXECINSTR ) )
+                {
+                    m_functions.push_back( Function{ s.m_section_idx, s.m_value, s.m_size, uint32_t( idx ), uint32_t( i ) } );
+                }
+            }
+        }
+        std::stable_sort( m_functions.begin(), m_functions.end(), []( const Function &a, const Function &b )
+        {
+            return std::tie( a.m_section_idx, a.m_value ) < std::tie( b.m_section_idx, b.m_value );
+        } );
+    } );
+    return m_functions;
+}
+
+const EhFrame::Function* EhFrame::FunctionOf( const Fde &fde ) const
+{
+    if ( fde.m_section_idx == 0 )
+    {
+        return nullptr;
+    }
+    const auto &functions = Functions();
+    auto it = std::lower_bound( functions.begin(), functions.end(), std::make_tuple( fde.m_section_idx, fde.m_begin ), []( const Function &f, const auto &key )
+    {
+        return std::make_tuple( f.m_section_idx, f.m_value ) < key;
+    } );
+    return it != functions.end() && it->m_section_idx == fde.m_section_idx && it->m_value == fde.m_begin ? &*it : nullptr;
+}
+
+std::vector< EhFrame::Function > EhFrame::FunctionsWithoutFde() const
+{
+    std::vector< Function > res;
+    for ( const Function &f : Functions() )
+    {
+        if ( f.m_size != 0 && !Find( f.m_section_idx, f.m_value ) )
+        {
+            res.push_back( f );
+        }
+    }
+    return res;
+}
+
+std::vector< EhFrame::Function > EhFrame::FindFunctions( std::string_view name ) const
+{
+    std::vector< Function > res;
+    for ( const Function &f : Functions() )
+    {
+        const auto &symtab = std::get< SymbolTable >( m_elf.m_sections[ f.m_symtab_idx ].m_var );
+        if ( symtab.m_symbols[ f.m_symbol_idx ].m_name == name )
+        {
+            res.push_back( f );
+        }
+    }
+    return res;
+}
+
+std::string EhFrame::Describe( const Cie &cie )
+{
+    return fmt::format( "version {}, augmentation \"{}\", code alignment {}, data alignment {}, return address r{}",
+                        cie.m_version, cie.m_augmentation, cie.m_code_alignment, cie.m_data_alignment, cie.m_return_address_register );
+}
+
+std::vector< std::string > EhFrame::Instructions( const Cie &cie, std::string_view instructions, uint64_t pc ) const
+{
+    std::vector< std::string > res;
+    DwarfReader c( instructions, m_elf.m_byte_order, AddressSize( m_elf ) );
+    const int64_t data_alignment = cie.m_data_alignment;
+
+    auto advance = [ & ]( const char *name, uint64_t delta )
+    {
+        pc += delta * cie.m_code_alignment;
+        res.push_back( fmt::format( "{}: {} to {:#x}", name, delta * cie.m_code_alignment, pc ) );
+    };
+    auto block = [ & ]( std::string prefix )
+    {
+        const uint64_t size = c.ULEB128();
+        c.Bytes( size );
+        res.push_back( fmt::format( "{}({} byte expression)", prefix, size ) );
+    };
+
+    while ( !c.AtEnd() )
+    {
+        const uint8_t op = c.Fixed< uint8_t >();
+        const uint8_t operand = op & 0x3f;
+        switch ( op >> 6 )
+        {
+        case 1:
+            advance( "DW_CFA_advance_loc", operand );
+            continue;
+        case 2:
+            res.push_back( fmt::format( "DW_CFA_offset: r{} at cfa{:+}", operand, int64_t( c.ULEB128() ) * data_alignment ) );
+            continue;
+        case 3:
+            res.push_back( fmt::format( "DW_CFA_restore: r{}", operand ) );
+            continue;
+        }
+
+        switch ( op )
+        {
+        case 0x00: res.push_back( "DW_CFA_nop" ); break;
+        case 0x01:
+            pc = ReadEncoded( c, cie.m_fde_encoding );
+            res.push_back( fmt::format( "DW_CFA_set_loc: {:#x}", pc ) );
+            break;
+        case 0x02: advance( "DW_CFA_advance_loc1", c.Fixed< uint8_t >() ); break;
+        case 0x03: advance( "DW_CFA_advance_loc2", c.Fixed< uint16_t >() ); break;
+        case 0x04: advance( "DW_CFA_advance_loc4", c.Fixed< uint32_t >() ); break;
+        case 0x05:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_offset_extended: r{} at cfa{:+}", reg, int64_t( c.ULEB128() ) * data_alignment ) );
+            break;
+        }
+        case 0x06: res.push_back( fmt::format( "DW_CFA_restore_extended: r{}", c.ULEB128() ) ); break;
+        case 0x07: res.push_back( fmt::format( "DW_CFA_undefined: r{}", c.ULEB128() ) ); break;
+        case 0x08: res.push_back( fmt::format( "DW_CFA_same_value: r{}", c.ULEB128() ) ); break;
+        case 0x09:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_register: r{} in r{}", reg, c.ULEB128() ) );
+            break;
+        }
+        case 0x0a: res.push_back( "DW_CFA_remember_state" ); break;
+        case 0x0b: res.push_back( "DW_CFA_restore_state" ); break;
+        case 0x0c:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_def_cfa: r{} ofs {}", reg, c.ULEB128() ) );
+            break;
+        }
+        case 0x0d: res.push_back( fmt::format( "DW_CFA_def_cfa_register: r{}", c.ULEB128() ) ); break;
+        case 0x0e: res.push_back( fmt::format( "DW_CFA_def_cfa_offset: {}", c.ULEB128() ) ); break;
+        case 0x0f: block( "DW_CFA_def_cfa_expression: " ); break;
+        case 0x10: block( fmt::format( "DW_CFA_expression: r{} ", c.ULEB128() ) ); break;
+        case 0x11:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_offset_extended_sf: r{} at cfa{:+}", reg, c.SLEB128() * data_alignment ) );
+            break;
+        }
+        case 0x12:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_def_cfa_sf: r{} ofs {}", reg, c.SLEB128() * data_alignment ) );
+            break;
+        }
+        case 0x13: res.push_back( fmt::format( "DW_CFA_def_cfa_offset_sf: {}", c.SLEB128() * data_alignment ) ); break;
+        case 0x14:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_val_offset: r{} is cfa{:+}", reg, int64_t( c.ULEB128() ) * data_alignment ) );
+            break;
+        }
+        case 0x15:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_val_offset_sf: r{} is cfa{:+}", reg, c.SLEB128() * data_alignment ) );
+            break;
+        }
+        case 0x16: block( fmt::format( "DW_CFA_val_expression: r{} ", c.ULEB128() ) ); break;
+        case 0x2d: res.push_back( "DW_CFA_GNU_window_save" ); break;
+        case 0x2e: res.push_back( fmt::format( "DW_CFA_GNU_args_size: {}", c.ULEB128() ) ); break;
+        case 0x2f:
+        {
+            const uint64_t reg = c.ULEB128();
+            res.push_back( fmt::format( "DW_CFA_GNU_negative_offset_extended: r{} at cfa{:+}", reg, -int64_t( c.ULEB128() ) * data_alignment ) );
+            break;
+        }
+        default:
+            throw std::runtime_error( fmt::format( "Unknown call frame instruction {:#x}", op ) );
+        }
+    }
+    return res;
+}
+
+} // namespace elfexplorer
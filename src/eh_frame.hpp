@@ -0,0 +1,137 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__EH_FRAME_HPP__
+#define ELFEXPLORER__EH_FRAME_HPP__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "elf_structs.hpp"
+
+namespace elfexplorer {
+
+// Records of an .eh_frame section: CIEs with what is common to the functions
+// of a compilation unit, and an FDE per function with the range of code it
+// covers and the call frame instructions for unwinding through it. In object
+// files the code address of an FDE is a relocation, it is resolved to the
+// section and offset of the code.
+//
+// Constructing reads the record headers only, the FDEs are sorted by the code
+// they cover for `Find`. The instructions are decoded when asked for, so
+// large sections stay cheap until an FDE is looked at. Thread safe, the model
+// must outlive the index.
+class EhFrame
+{
+public:
+    struct Cie
+    {
+        uint64_t m_offset;
+        uint8_t m_version;
+        std::string_view m_augmentation;
+        uint64_t m_code_alignment;
+        int64_t m_data_alignment;
+        uint64_t m_return_address_register;
+        uint8_t m_fde_encoding; // DW_EH_PE_*, of addresses in the FDEs
+        std::string_view m_instructions;
+    };
+
+    struct Fde
+    {
+        uint64_t m_offset;
+        uint64_t m_cie_offset;
+        uint32_t m_section_idx; // Of the code, 0 if there is no relocation
+        uint64_t m_begin;
+        uint64_t m_size;
+        std::string_view m_instructions;
+    };
+
+    // A function symbol, e.g. for the function an FDE is for
+    struct Function
+    {
+        uint32_t m_section_idx;
+        uint64_t m_value;
+        uint64_t m_size;
+        uint32_t m_symtab_idx;
+        uint32_t m_symbol_idx;
+    };
+
+    // True for the .eh_frame section (SHT_X86_64_UNWIND on x86-64 for llvm),
+    // from the section header only
+    static bool IsEhFrame( const ELF_File &elf, size_t section_idx );
+
+    // The first .eh_frame of the file, 0 if there is none
+    static size_t FindSection( const ELF_File &elf );
+
+    // The section must be loaded. Throws if the records are malformed.
+    EhFrame( const ELF_File &elf, size_t section_idx );
+
+    EhFrame( const EhFrame & ) = delete;
+    EhFrame& operator=( const EhFrame & ) = delete;
+
+    size_t SectionIndex() const { return m_section_idx; }
+
+    // In the order of the section
+    const std::vector< Cie >& Cies() const { return m_cies; }
+    const std::vector< Fde >& Fdes() const { return m_fdes; }
+
+    const Cie& CieOf( const Fde &fde ) const;
+
+    // The FDE covering the code at `offset` of a section, null if there is no
+    // unwind info for it. Binary search.
+    const Fde* Find( uint32_t section_idx, uint64_t offset ) const;
+
+    // The function starting where the FDE does, null if there is none
+    const Function* FunctionOf( const Fde &fde ) const;
+
+    // Functions with a size and without an FDE, by section and offset
+    std::vector< Function > FunctionsWithoutFde() const;
+
+    // Functions of the symbol tables with the given name
+    std::vector< Function > FindFunctions( std::string_view name ) const;
+
+    // Call frame instructions of a CIE or FDE, one line each, e.g.
+    // "DW_CFA_def_cfa_offset: 16". Advances are shown with the offset in the
+    // code they move to, from `pc` on. Relocations are not applied, so on
+    // RISC-V advances show as stored. Throws if they are malformed.
+    std::vector< std::string > Instructions( const Cie &cie, std::string_view instructions, uint64_t pc ) const;
+
+    // Version, augmentation, alignment factors and return address register
+    static std::string Describe( const Cie &cie );
+
+private:
+    // Function symbols by section and value, collected on first use
+    const std::vector< Function >& Functions() const;
+
+    const ELF_File &m_elf;
+    size_t m_section_idx;
+
+    std::vector< Cie > m_cies;
+    std::vector< Fde > m_fdes;
+    std::vector< uint32_t > m_by_code; // Indices of `m_fdes` by section and begin
+
+    mutable std::once_flag m_functions_once;
+    mutable std::vector< Function > m_functions;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__EH_FRAME_HPP__
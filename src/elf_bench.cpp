@@ -0,0 +1,165 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Times each processing phase separately on the given object files and prints
+// one json object per (file, phase) to stdout. Run via `ninja bench` which
+// generates the inputs with src/gen_bench_object.py.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "disasm_context.hpp"
+#include "elf_structs.hpp"
+#include "html_output.hpp"
+#include "input_buffer.hpp"
+#include "stats.hpp"
+
+using namespace elfexplorer;
+
+struct PhaseResult
+{
+    int iterations = 0;
+    double seconds = 0; // Fastest iteration
+};
+
+// Runs `fn` until at least `min_seconds` have passed (and at least
+// `min_iterations` times) and keeps the fastest run.
+template < typename Fn >
+static PhaseResult TimePhase( Fn &&fn, double min_seconds = 0.5, int min_iterations = 3 )
+{
+    using clock = std::chrono::steady_clock;
+
+    PhaseResult res;
+    res.seconds = 1e100;
+
+    auto start = clock::now();
+    while ( res.iterations < min_iterations || std::chrono::duration< double >( clock::now() - start ).count() < min_seconds )
+    {
+        auto it_start = clock::now();
+        fn();
+        double elapsed = std::chrono::duration< double >( clock::now() - it_start ).count();
+
+        res.seconds = std::min( res.seconds, elapsed );
+        ++res.iterations;
+    }
+    return res;
+}
+
+static void PrintResult( const std::string &file_name, std::string_view phase, const PhaseResult &r, uint64_t bytes, uint64_t records )
+{
+    fmt::print( R"({{"file": "{}", "phase": "{}", "iterations": {}, "seconds": {:.6f}, "bytes": {}, "records": {}, "mb_per_s": {:.2f}, "records_per_s": {:.0f}}})" "\n",
+                stats::JsonEscape( file_name ), phase, r.iterations, r.seconds, bytes, records,
+                bytes / r.seconds / 1e6, records / r.seconds );
+}
+
+static uint64_t CountRecords( const ELF_File &elf )
+{
+    uint64_t res = elf.m_sections.size();
+    for ( const Section &s : elf.m_sections )
+    {
+        if ( const auto *symtab = std::get_if< SymbolTable >( &s.m_var ) )
+        {
+            res += symtab->m_symbols.size();
+        }
+        else if ( const auto *relocs = std::get_if< RelocationEntries >( &s.m_var ) )
+        {
+            res += relocs->m_entries.size();
+        }
+        else if ( const auto *group = std::get_if< GroupSection >( &s.m_var ) )
+        {
+            res += group->m_section_indices.size();
+        }
+    }
+    return res;
+}
+
+static void BenchFile( const std::string &file_name )
+{
+    InputBuffer input( file_name, ReadFile( file_name.c_str() ) );
+    const uint64_t input_size = input.contents.size();
+
+    ELF_File elf = ELF_File::LoadFrom( input );
+    const uint64_t records = CountRecords( elf );
+
+    PhaseResult load = TimePhase( [ & ]()
+    {
+        ELF_File f = ELF_File::LoadFrom( input );
+    } );
+    PrintResult( file_name, "load", load, input_size, records );
+
+    PhaseResult render = TimePhase( [ & ]()
+    {
+        fmt::memory_buffer html_out;
+        RenderAsHTML( html_out, elf );
+    } );
+    PrintResult( file_name, "render", render, input_size, records );
+
+    uint64_t code_bytes = 0;
+    uint64_t instructions = 0;
+    DisasmContext *ctx = ThreadDisasmContext();
+    std::vector< DisasmInstruction > batch( 1024 );
+    PhaseResult disasm = TimePhase( [ & ]()
+    {
+        code_bytes = 0;
+        instructions = 0;
+        for ( const Section &s : elf.m_sections )
+        {
+            const auto *progbits = std::get_if< ProgBitsSection >( &s.m_var );
+            if ( progbits == nullptr || !progbits->m_is_executable )
+            {
+                continue;
+            }
+
+            const auto *data = reinterpret_cast< const unsigned char* >( progbits->m_data.data() );
+            for ( uint64_t offset = 0; offset < progbits->m_data.size(); )
+            {
+                instructions += DecodeBatch( ctx, data, progbits->m_data.size(), offset, progbits->m_data.size(),
+                                             batch.data(), batch.size(), &offset );
+            }
+            code_bytes += progbits->m_data.size();
+        }
+    } );
+    PrintResult( file_name, "disasm", disasm, code_bytes, instructions );
+
+    PhaseResult unread_scan = TimePhase( [ & ]()
+    {
+        auto ranges = FindUnreadRanges( input );
+    } );
+    PrintResult( file_name, "unread_scan", unread_scan, input_size, input_size );
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( argc < 2 )
+    {
+        std::cerr << "Usage: elf_bench <obj_file_name>...\n";
+        return 1;
+    }
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        BenchFile( argv[ i ] );
+    }
+
+    return 0;
+}
@@ -0,0 +1,726 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "elf_diff.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "disasm_context.hpp"
+#include "hash.hpp"
+#include "stats.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+template < typename... Args >
+void Write( fmt::memory_buffer &out, fmt::format_string< Args... > format_str, Args&&... args )
+{
+    fmt::format_to( fmt::appender( out ), format_str, std::forward< Args >( args )... );
+}
+
+struct Function
+{
+    std::string_view m_key;
+    uint64_t m_begin;
+    uint64_t m_end;
+};
+
+// Keys used to match sections, symbols and functions of one file against the
+// other, and the relocations applying to each section.
+struct ObjectIndex
+{
+    ObjectIndex( const InputBuffer &input, const ELF_File &elf );
+
+    // Contents of the section in the input, empty for SHT_NOBITS
+    std::string_view Data( size_t section_idx ) const;
+
+    // Hash of the relocations in [ begin, end ) of the section, relative to
+    // `begin` and with symbols identified by their key
+    uint64_t RelocsHash( size_t section_idx, uint64_t begin, uint64_t end ) const;
+
+    std::string_view SymbolKey( uint32_t symbol_idx ) const
+    {
+        return symbol_idx < m_symbol_keys.size() ? m_symbol_keys[ symbol_idx ] : std::string_view();
+    }
+
+    std::string SectionName( uint32_t section_idx ) const;
+
+    const InputBuffer &m_input;
+    const ELF_File &m_elf;
+    const SymbolTable *m_symtab = nullptr;
+
+    // Keys are names where possible, the rest are kept here
+    std::deque< std::string > m_key_storage;
+
+    std::vector< std::string_view > m_section_keys;
+    std::vector< std::string_view > m_symbol_keys; // Empty if the symbol can't be matched
+
+    std::vector< std::vector< RelocationEntry > > m_relocs; // Sorted by offset
+    std::vector< std::vector< Function > > m_functions; // Sorted by address
+};
+
+constexpr size_t NoMatch = std::numeric_limits< size_t >::max();
+
+// Matches the n-th occurrence of each key in `a` to the n-th occurrence in
+// `b`, returning the index in `b` for each element of `a`. Empty keys are
+// never matched. Both sides are usually in the same order, so the common
+// prefix is matched without hashing.
+static std::vector< size_t > MatchKeys( const std::vector< std::string_view > &a, const std::vector< std::string_view > &b )
+{
+    std::vector< size_t > res( a.size(), NoMatch );
+
+    size_t prefix = 0;
+    for ( ; prefix < a.size() && prefix < b.size() && a[ prefix ] == b[ prefix ]; ++prefix )
+    {
+        if ( !a[ prefix ].empty() )
+        {
+            res[ prefix ] = prefix;
+        }
+    }
+    if ( prefix == a.size() && prefix == b.size() )
+    {
+        return res;
+    }
+
+    // Occurrences of each key in the rest of `b`, chained through `next`
+    std::unordered_map< std::string_view, size_t, StringHash > first;
+    std::vector< size_t > next( b.size(), NoMatch );
+    first.reserve( b.size() - prefix );
+    for ( size_t j = b.size(); j-- > prefix; )
+    {
+        if ( b[ j ].empty() )
+        {
+            continue;
+        }
+        auto [ it, inserted ] = first.try_emplace( b[ j ], j );
+        if ( !inserted )
+        {
+            next[ j ] = it->second;
+            it->second = j;
+        }
+    }
+
+    for ( size_t i = prefix; i < a.size(); ++i )
+    {
+        if ( a[ i ].empty() )
+        {
+            continue;
+        }
+        auto it = first.find( a[ i ] );
+        if ( it != first.end() && it->second != NoMatch )
+        {
+            res[ i ] = it->second;
+            it->second = next[ it->second ];
+        }
+    }
+    return res;
+}
+
+// Elements of `b` not matched to anything in `a`
+static std::vector< bool > Unmatched( const std::vector< size_t > &match, size_t b_size )
+{
+    std::vector< bool > res( b_size, true );
+    for ( size_t j : match )
+    {
+        if ( j != NoMatch )
+        {
+            res[ j ] = false;
+        }
+    }
+    return res;
+}
+
+ObjectIndex::ObjectIndex( const InputBuffer &input, const ELF_File &elf )
+    : m_input( input )
+    , m_elf( elf )
+{
+    const auto &sections = elf.m_sections;
+    const size_t num_sections = sections.size();
+
+    for ( const Section &s : sections )
+    {
+        if ( const auto *symtab = std::get_if< SymbolTable >( &s.m_var ) )
+        {
+            m_symtab = symtab;
+            break;
+        }
+    }
+
+    // Sections of COMDAT groups are named the same in every group, so they
+    // are identified by the group signature as well
+    std::vector< std::string_view > signatures( num_sections );
+    for ( size_t i = 0; i < num_sections; ++i )
+    {
+        const auto *group = std::get_if< GroupSection >( &sections[ i ].m_var );
+        const SectionHeader &sh = sections[ i ].m_header;
+        if ( group == nullptr || sh.m_asso_idx >= num_sections )
+        {
+            continue;
+        }
+
+        const auto *symtab = std::get_if< SymbolTable >( &sections[ sh.m_asso_idx ].m_var );
+        if ( symtab == nullptr || sh.m_info >= symtab->m_symbols.size() )
+        {
+            continue;
+        }
+
+        std::string_view signature = symtab->m_symbols[ sh.m_info ].m_name;
+        signatures[ i ] = signature;
+        for ( uint32_t member : group->m_section_indices )
+        {
+            if ( member < num_sections )
+            {
+                signatures[ member ] = signature;
+            }
+        }
+    }
+
+    m_section_keys.resize( num_sections );
+    for ( size_t i = 1; i < num_sections; ++i )
+    {
+        if ( signatures[ i ].empty() )
+        {
+            m_section_keys[ i ] = sections[ i ].m_header.m_name;
+        }
+        else
+        {
+            m_section_keys[ i ] = m_key_storage.emplace_back( fmt::format( "{}[{}]", sections[ i ].m_header.m_name, signatures[ i ] ) );
+        }
+    }
+
+    m_relocs.resize( num_sections );
+    for ( const Section &s : sections )
+    {
+        const auto *relocs = std::get_if< RelocationEntries >( &s.m_var );
+        if ( relocs != nullptr && s.m_header.m_info < num_sections )
+        {
+            auto &target = m_relocs[ s.m_header.m_info ];
+            target.insert( target.end(), relocs->m_entries.begin(), relocs->m_entries.end() );
+        }
+    }
+    for ( auto &relocs : m_relocs )
+    {
+        std::sort( relocs.begin(), relocs.end(), []( const auto &a, const auto &b ){ return a.m_offset < b.m_offset; } );
+    }
+
+    if ( m_symtab == nullptr )
+    {
+        m_functions.resize( num_sections );
+        return;
+    }
+
+    const auto &symbols = m_symtab->m_symbols;
+    m_symbol_keys.resize( symbols.size() );
+    for ( size_t i = 1; i < symbols.size(); ++i )
+    {
+        const Symbol &sym = symbols[ i ];
+        if ( sym.m_type == SymbolType::STT_SECTION && sym.m_section_idx < num_sections )
+        {
+            m_symbol_keys[ i ] = m_key_storage.emplace_back( fmt::format( "section {}", m_section_keys[ sym.m_section_idx ] ) );
+        }
+        else
+        {
+            m_symbol_keys[ i ] = sym.m_name;
+        }
+    }
+
+    m_functions.resize( num_sections );
+    for ( size_t i = 1; i < symbols.size(); ++i )
+    {
+        const Symbol &sym = symbols[ i ];
+        if ( sym.m_type == SymbolType::STT_FUNC && sym.m_section_idx != 0 && sym.m_section_idx < num_sections && !m_symbol_keys[ i ].empty() )
+        {
+            m_functions[ sym.m_section_idx ].push_back( Function{ m_symbol_keys[ i ], sym.m_value, sym.m_value + sym.m_size } );
+        }
+    }
+    for ( size_t i = 0; i < num_sections; ++i )
+    {
+        auto &functions = m_functions[ i ];
+        auto by_address = []( const auto &a, const auto &b ){ return a.m_begin < b.m_begin; };
+        if ( !std::is_sorted( functions.begin(), functions.end(), by_address ) )
+        {
+            std::stable_sort( functions.begin(), functions.end(), by_address );
+        }
+
+        // Functions without size (usually hand written assembly) extend to
+        // the next one, and nothing reaches out of the section
+        const uint64_t section_size = sections[ i ].m_header.m_size;
+        for ( size_t j = 0; j < functions.size(); ++j )
+        {
+            Function &f = functions[ j ];
+            if ( f.m_begin == f.m_end )
+            {
+                f.m_end = j + 1 < functions.size() ? functions[ j + 1 ].m_begin : section_size;
+            }
+            f.m_end = std::min( f.m_end, section_size );
+            f.m_begin = std::min( f.m_begin, f.m_end );
+        }
+    }
+}
+
+std::string_view ObjectIndex::Data( size_t section_idx ) const
+{
+    const SectionHeader &sh = m_elf.m_sections[ section_idx ].m_header;
+    if ( sh.m_type == SectionType::SHT_NOBITS )
+    {
+        return {};
+    }
+    ASSERT( sh.m_offset <= m_input.contents.size() && sh.m_size <= m_input.contents.size() - sh.m_offset );
+    return std::string_view( reinterpret_cast< const char* >( m_input.contents.data() ) + sh.m_offset, sh.m_size );
+}
+
+uint64_t ObjectIndex::RelocsHash( size_t section_idx, uint64_t begin, uint64_t end ) const
+{
+    const auto &relocs = m_relocs[ section_idx ];
+    auto it = std::lower_bound( relocs.begin(), relocs.end(), begin, []( const auto &e, uint64_t offset ){ return e.m_offset < offset; } );
+
+    uint64_t h = 0;
+    for ( ; it != relocs.end() && it->m_offset < end; ++it )
+    {
+        h = HashCombine( h, it->m_offset - begin );
+        h = HashCombine( h, static_cast< uint64_t >( it->m_type ) );
+        h = HashCombine( h, Hash64( SymbolKey( it->m_symbol ) ) );
+        h = HashCombine( h, static_cast< uint64_t >( it->m_addend ) );
+    }
+    return h;
+}
+
+std::string ObjectIndex::SectionName( uint32_t section_idx ) const
+{
+    switch ( section_idx )
+    {
+    case 0: return "UND";
+    case ReservedSectionIndex( 0xfff1 ): return "ABS";
+    case ReservedSectionIndex( 0xfff2 ): return "COMMON";
+    }
+    if ( section_idx < m_section_keys.size() )
+    {
+        return std::string( m_section_keys[ section_idx ] );
+    }
+    return std::to_string( FileSectionIndex( section_idx ) );
+}
+
+class Differ
+{
+public:
+    Differ( fmt::memory_buffer &out, const ObjectIndex &a, const ObjectIndex &b )
+        : m_out( out )
+        , m_a( a )
+        , m_b( b )
+    {
+    }
+
+    void DiffSections()
+    {
+        const auto &a_sections = m_a.m_elf.m_sections;
+        const auto &b_sections = m_b.m_elf.m_sections;
+
+        std::vector< size_t > match = MatchKeys( m_a.m_section_keys, m_b.m_section_keys );
+        for ( size_t i = 1; i < a_sections.size(); ++i )
+        {
+            if ( !IsCompared( a_sections[ i ] ) )
+            {
+                continue;
+            }
+
+            if ( match[ i ] == NoMatch )
+            {
+                Write( m_out, "- section {}\n", m_a.m_section_keys[ i ] );
+                continue;
+            }
+
+            fmt::memory_buffer details;
+            DiffSection( details, i, match[ i ] );
+            if ( details.size() )
+            {
+                Write( m_out, "section {}\n", m_a.m_section_keys[ i ] );
+                Append( m_out, std::string_view( details.data(), details.size() ) );
+            }
+        }
+
+        std::vector< bool > added = Unmatched( match, b_sections.size() );
+        for ( size_t i = 1; i < b_sections.size(); ++i )
+        {
+            if ( added[ i ] && IsCompared( b_sections[ i ] ) )
+            {
+                Write( m_out, "+ section {}\n", m_b.m_section_keys[ i ] );
+            }
+        }
+    }
+
+    void DiffSymbols()
+    {
+        if ( m_a.m_symtab == nullptr || m_b.m_symtab == nullptr )
+        {
+            return;
+        }
+
+        std::vector< size_t > match = MatchKeys( m_a.m_symbol_keys, m_b.m_symbol_keys );
+        for ( size_t i = 1; i < m_a.m_symbol_keys.size(); ++i )
+        {
+            std::string_view key = m_a.m_symbol_keys[ i ];
+            if ( key.empty() )
+            {
+                continue;
+            }
+
+            if ( match[ i ] == NoMatch )
+            {
+                Write( m_out, "- symbol {}\n", key );
+                continue;
+            }
+
+            const Symbol &sa = m_a.m_symtab->m_symbols[ i ];
+            const Symbol &sb = m_b.m_symtab->m_symbols[ match[ i ] ];
+
+            fmt::memory_buffer details;
+            Compare( details, "binding", sa.m_binding, sb.m_binding );
+            Compare( details, "type", sa.m_type, sb.m_type );
+            Compare( details, "visibility", sa.m_visibility, sb.m_visibility );
+            Compare( details, "size", sa.m_size, sb.m_size );
+
+            bool defined_a = sa.m_section_idx != 0 && sa.m_section_idx < m_a.m_section_keys.size();
+            bool defined_b = sb.m_section_idx != 0 && sb.m_section_idx < m_b.m_section_keys.size();
+            if ( defined_a && defined_b
+                 ? m_a.m_section_keys[ sa.m_section_idx ] != m_b.m_section_keys[ sb.m_section_idx ]
+                 : sa.m_section_idx != sb.m_section_idx )
+            {
+                Write( details, "  section: {} -> {}\n", m_a.SectionName( sa.m_section_idx ), m_b.SectionName( sb.m_section_idx ) );
+            }
+
+            // Values of symbols defined in sections move whenever something
+            // before them changes, only values of special sections matter
+            if ( !defined_a && !defined_b )
+            {
+                Compare( details, "value", sa.m_value, sb.m_value );
+            }
+
+            if ( details.size() )
+            {
+                Write( m_out, "symbol {}\n", key );
+                Append( m_out, std::string_view( details.data(), details.size() ) );
+            }
+        }
+
+        std::vector< bool > added = Unmatched( match, m_b.m_symbol_keys.size() );
+        for ( size_t i = 1; i < m_b.m_symbol_keys.size(); ++i )
+        {
+            if ( added[ i ] && !m_b.m_symbol_keys[ i ].empty() )
+            {
+                Write( m_out, "+ symbol {}\n", m_b.m_symbol_keys[ i ] );
+            }
+        }
+    }
+
+private:
+    struct Line
+    {
+        uint64_t m_offset; // From the function start
+        std::string m_text;
+    };
+
+    // Symbols and relocations are compared on their own, by what they refer
+    // to rather than their indices
+    static bool IsCompared( const Section &s )
+    {
+        switch ( s.m_header.m_type )
+        {
+        case SectionType::SHT_SYMTAB:
+        case SectionType::SHT_STRTAB:
+        case SectionType::SHT_RELA:
+        case SectionType::SHT_REL:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    // Values are only turned into text when they differ
+    template < typename T >
+    static void Compare( fmt::memory_buffer &out, std::string_view what, const T &a, const T &b )
+    {
+        if ( a == b )
+        {
+            return;
+        }
+        if constexpr ( std::is_enum_v< T > )
+        {
+            Write( out, "  {}: {} -> {}\n", what, EnumText( a ), EnumText( b ) );
+        }
+        else
+        {
+            Write( out, "  {}: {} -> {}\n", what, a, b );
+        }
+    }
+
+    void DiffSection( fmt::memory_buffer &out, size_t a_idx, size_t b_idx )
+    {
+        const Section &sec_a = m_a.m_elf.m_sections[ a_idx ];
+        const Section &sec_b = m_b.m_elf.m_sections[ b_idx ];
+        const SectionHeader &ha = sec_a.m_header;
+        const SectionHeader &hb = sec_b.m_header;
+
+        Compare( out, "type", ha.m_type, hb.m_type );
+        if ( ha.m_attrs != hb.m_attrs )
+        {
+            Write( out, "  flags: {:#x} -> {:#x}\n", static_cast< uint64_t >( ha.m_attrs ), static_cast< uint64_t >( hb.m_attrs ) );
+        }
+        Compare( out, "size", ha.m_size, hb.m_size );
+        Compare( out, "addr_align", ha.m_addr_align, hb.m_addr_align );
+        Compare( out, "ent_size", ha.m_ent_size, hb.m_ent_size );
+
+        const auto *group_a = std::get_if< GroupSection >( &sec_a.m_var );
+        const auto *group_b = std::get_if< GroupSection >( &sec_b.m_var );
+        if ( group_a && group_b )
+        {
+            Compare( out, "members", GroupMembers( m_a, *group_a ), GroupMembers( m_b, *group_b ) );
+            return;
+        }
+
+        std::string_view data_a = m_a.Data( a_idx );
+        std::string_view data_b = m_b.Data( b_idx );
+        const uint64_t max_offset = std::numeric_limits< uint64_t >::max();
+
+        bool data_differs = data_a.size() != data_b.size() || Hash64( data_a ) != Hash64( data_b );
+        bool relocs_differ = m_a.RelocsHash( a_idx, 0, max_offset ) != m_b.RelocsHash( b_idx, 0, max_offset );
+        if ( !data_differs && !relocs_differ )
+        {
+            return;
+        }
+
+        if ( ( ha.m_attrs & SectionFlags::SHF_EXECINSTR ) && ( hb.m_attrs & SectionFlags::SHF_EXECINSTR )
+          && ( m_a.m_functions[ a_idx ].size() || m_b.m_functions[ b_idx ].size() ) )
+        {
+            if ( DiffFunctions( out, a_idx, b_idx ) )
+            {
+                return;
+            }
+            Append( out, "  contents differ outside of functions\n" );
+            return;
+        }
+
+        if ( data_differs )
+        {
+            auto [ it_a, it_b ] = std::mismatch( data_a.begin(), data_a.end(), data_b.begin(), data_b.end() );
+            Write( out, "  contents differ from offset {}\n", it_a - data_a.begin() );
+        }
+        if ( relocs_differ )
+        {
+            Append( out, "  relocations differ\n" );
+        }
+    }
+
+    static std::string GroupMembers( const ObjectIndex &obj, const GroupSection &group )
+    {
+        std::string res;
+        for ( uint32_t idx : group.m_section_indices )
+        {
+            res += res.empty() ? "" : ", ";
+            res += obj.SectionName( idx );
+        }
+        return res;
+    }
+
+    static void Append( fmt::memory_buffer &out, std::string_view s )
+    {
+        out.append( s.data(), s.data() + s.size() );
+    }
+
+    static uint64_t FunctionHash( const ObjectIndex &obj, size_t section_idx, const Function &f )
+    {
+        std::string_view code = obj.Data( section_idx ).substr( f.m_begin, f.m_end - f.m_begin );
+        return HashCombine( Hash64( code ), obj.RelocsHash( section_idx, f.m_begin, f.m_end ) );
+    }
+
+    // Returns whether any function differs
+    bool DiffFunctions( fmt::memory_buffer &out, size_t a_idx, size_t b_idx )
+    {
+        const auto &functions_a = m_a.m_functions[ a_idx ];
+        const auto &functions_b = m_b.m_functions[ b_idx ];
+
+        auto keys = []( const std::vector< Function > &functions )
+        {
+            std::vector< std::string_view > res;
+            res.reserve( functions.size() );
+            for ( const Function &f : functions )
+            {
+                res.push_back( f.m_key );
+            }
+            return res;
+        };
+        std::vector< size_t > match = MatchKeys( keys( functions_a ), keys( functions_b ) );
+
+        bool differs = false;
+        for ( size_t i = 0; i < functions_a.size(); ++i )
+        {
+            const Function &fa = functions_a[ i ];
+            if ( match[ i ] == NoMatch )
+            {
+                Write( out, "  - function {}\n", fa.m_key );
+                differs = true;
+                continue;
+            }
+
+            const Function &fb = functions_b[ match[ i ] ];
+            if ( FunctionHash( m_a, a_idx, fa ) != FunctionHash( m_b, b_idx, fb ) )
+            {
+                Write( out, "  function {}\n", fa.m_key );
+                if ( CanDisassemble( m_a.m_elf.m_machine ) && CanDisassemble( m_b.m_elf.m_machine ) )
+                {
+                    DiffDisassembly( out, Disassemble( m_a, a_idx, fa ), Disassemble( m_b, b_idx, fb ) );
+                }
+                differs = true;
+            }
+        }
+
+        std::vector< bool > added = Unmatched( match, functions_b.size() );
+        for ( size_t i = 0; i < functions_b.size(); ++i )
+        {
+            if ( added[ i ] )
+            {
+                Write( out, "  + function {}\n", functions_b[ i ].m_key );
+                differs = true;
+            }
+        }
+
+        return differs;
+    }
+
+    // Disassembly with offsets and branch targets relative to functions, so
+    // moved code compares equal
+    static std::vector< Line > Disassemble( const ObjectIndex &obj, size_t section_idx, const Function &f )
+    {
+        std::string_view code = obj.Data( section_idx );
+        const auto *data = reinterpret_cast< const unsigned char* >( code.data() );
+        const auto &relocs = obj.m_relocs[ section_idx ];
+        const auto &functions = obj.m_functions[ section_idx ];
+
+        auto reloc_it = std::lower_bound( relocs.begin(), relocs.end(), f.m_begin, []( const auto &e, uint64_t offset ){ return e.m_offset < offset; } );
+
+        std::vector< Line > res;
+        DisasmContext *ctx = ThreadDisasmContext();
+        DisasmInstruction batch[ 256 ];
+        for ( uint64_t offset = f.m_begin; offset < f.m_end; )
+        {
+            size_t count = DecodeBatch( ctx, data, code.size(), offset, f.m_end, batch, std::size( batch ), &offset );
+            for ( size_t k = 0; k < count; ++k )
+            {
+                const DisasmInstruction &insn = batch[ k ];
+
+                fmt::memory_buffer text;
+                Append( text, Mnemonic( ctx, insn ) );
+                if ( insn.has_target )
+                {
+                    auto fn = std::upper_bound( functions.begin(), functions.end(), insn.branch_target, []( uint64_t offset, const auto &func ){ return offset < func.m_begin; } );
+                    if ( fn != functions.begin() && insn.branch_target < ( fn - 1 )->m_end )
+                    {
+                        --fn;
+                        Write( text, " {}+{:#x}", fn->m_key, insn.branch_target - fn->m_begin );
+                    }
+                    else
+                    {
+                        Write( text, " {:#x}", insn.branch_target );
+                    }
+                }
+                else if ( insn.text_size )
+                {
+                    Write( text, " {}", Operands( ctx, insn ) );
+                }
+
+                for ( ; reloc_it != relocs.end() && reloc_it->m_offset < insn.offset + insn.length; ++reloc_it )
+                {
+                    Write( text, "  <{} {}{:+}>", EnumText( reloc_it->m_type ), obj.SymbolKey( reloc_it->m_symbol ), reloc_it->m_addend );
+                }
+
+                res.push_back( Line{ insn.offset - f.m_begin, fmt::to_string( text ) } );
+            }
+        }
+        return res;
+    }
+
+    // Prints the lines between the common prefix and suffix
+    static void DiffDisassembly( fmt::memory_buffer &out, const std::vector< Line > &a, const std::vector< Line > &b )
+    {
+        size_t prefix = 0;
+        while ( prefix < a.size() && prefix < b.size() && a[ prefix ].m_text == b[ prefix ].m_text )
+        {
+            ++prefix;
+        }
+
+        size_t suffix = 0;
+        while ( suffix < a.size() - prefix && suffix < b.size() - prefix
+             && a[ a.size() - 1 - suffix ].m_text == b[ b.size() - 1 - suffix ].m_text )
+        {
+            ++suffix;
+        }
+
+        if ( prefix + suffix == a.size() && prefix + suffix == b.size() )
+        {
+            Append( out, "    (same instructions, data between them differs)\n" );
+            return;
+        }
+
+        for ( size_t i = prefix; i + suffix < a.size(); ++i )
+        {
+            Write( out, "    - {:08x}  {}\n", a[ i ].m_offset, a[ i ].m_text );
+        }
+        for ( size_t i = prefix; i + suffix < b.size(); ++i )
+        {
+            Write( out, "    + {:08x}  {}\n", b[ i ].m_offset, b[ i ].m_text );
+        }
+    }
+
+    fmt::memory_buffer &m_out;
+    const ObjectIndex &m_a;
+    const ObjectIndex &m_b;
+};
+
+} // namespace
+
+bool DiffObjects( fmt::memory_buffer &out,
+                  const InputBuffer &old_input, const ELF_File &old_file,
+                  const InputBuffer &new_input, const ELF_File &new_file )
+{
+    stats::ScopedPhase phase( "diff", {}, old_input.contents.size() + new_input.contents.size() );
+
+    ObjectIndex a( old_input, old_file );
+    ObjectIndex b( new_input, new_file );
+
+    fmt::memory_buffer body;
+    Differ differ( body, a, b );
+    differ.DiffSections();
+    differ.DiffSymbols();
+
+    if ( body.size() == 0 )
+    {
+        return false;
+    }
+
+    Write( out, "--- {}\n+++ {}\n", old_input.file_name, new_input.file_name );
+    out.append( body.data(), body.data() + body.size() );
+    return true;
+}
+
+} // namespace elfexplorer
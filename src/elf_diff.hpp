@@ -0,0 +1,39 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__ELF_DIFF_HPP__
+#define ELFEXPLORER__ELF_DIFF_HPP__
+
+#include <fmt/format.h>
+
+#include "elf_structs.hpp"
+#include "input_buffer.hpp"
+
+namespace elfexplorer {
+
+// Writes a text report of the differences between two object files, loaded
+// with `ELF_File::LoadMetadataFrom`. Sections are matched by name and group
+// signature, symbols by name. Section contents are compared by hash, and only
+// changed functions are disassembled. Returns whether the files differ.
+bool DiffObjects( fmt::memory_buffer &out,
+                  const InputBuffer &old_input, const ELF_File &old_file,
+                  const InputBuffer &new_input, const ELF_File &new_file );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__ELF_DIFF_HPP__
@@ -17,110 +17,1111 @@
 
 
 #include <algorithm>
+#include <charconv>
 #include <cstring>
 #include <fstream>
 #include <ios>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
 #include <optional>
-#include <sstream>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include <fmt/format.h>
+
+#include "anchor.hpp"
+#include "comdat.hpp"
+#include "debug_line.hpp"
+#include "disasm_context.hpp"
+#include "eh_frame.hpp"
+#include "elf_diff.hpp"
 #include "elf_structs.hpp"
 #include "html_output.hpp"
+#include "name_index.hpp"
+#include "pipeline.hpp"
+#include "reference_index.hpp"
+#include "serve.hpp"
+#include "stats.hpp"
+#include "symbol_columns.hpp"
+#include "symbol_index.hpp"
+#include "table_data.hpp"
+
+#ifndef __EMSCRIPTEN__
+#include "watch.hpp"
+#endif
+
+#ifdef __EMSCRIPTEN_PTHREADS__
+#include <condition_variable>
+#include <mutex>
+
+#include "thread_pool.hpp"
+#endif
 
 using namespace elfexplorer;
 
-static std::vector< unsigned char > read_file( const char *file_name )
+std::vector< unsigned char > mem_data;
+std::string mem_result;
+
+static void PrintUsage()
 {
-    std::vector< unsigned char > contents;
+    std::cerr << "Usage: elf_explorer [options] <obj_file_name>\n"
+                 "       elf_explorer [options] --diff <old_obj_file> <new_obj_file>\n"
+                 "       elf_explorer --disasm <sym> <obj_file_name>\n"
+                 "       elf_explorer --symbols <query> <obj_file_name>\n"
+                 "       elf_explorer ( --cfi <sym> | --missing-cfi ) <obj_file_name>\n"
+                 "       elf_explorer --grep <text> [--demangle] <obj_file_name>\n"
+                 "       elf_explorer --refs <name> <obj_file_name>\n"
+                 "       elf_explorer --watch <dir> [--out <dir>]\n"
+                 "       elf_explorer --serve <port> [--web-root <dir>] [--cache-mb <n>] [--threads <n>]\n"
+                 "       elf_explorer --index <file> --scan <dir> [--threads <n>]\n"
+                 "       elf_explorer --index <file> ( --defined <sym> | --referenced <sym> | --multiple-weak )\n"
+                 "       elf_explorer --comdat <path> [--comdat <path> ...] [--top <n>] [--threads <n>]\n"
+                 "\n"
+                 "Options:\n"
+                 "  --stats           Print time spent per phase and section, peak rss and\n"
+                 "                    allocations to stderr\n"
+                 "  --trace <file>    With --stats, also write a chrome trace_event json file\n"
+                 "  --memory-budget <n>\n"
+                 "                    Load, render and release one section at a time, keeping\n"
+                 "                    memory use around <n> MB besides the section headers.\n"
+                 "                    Unread parts of the file and the Refs column of symbol\n"
+                 "                    tables are left out.\n"
+                 "  --compact         Render markup for pages running elf-explorer.js, with\n"
+                 "                    row ids and class names instead of inline handlers,\n"
+                 "                    anchors and styles\n"
+                 "  --disasm <sym>    Only disassemble the functions named <sym>, loading\n"
+                 "                    just the symbol tables and the sections they are in\n"
+                 "  --symbols <query> Print the symbols matching <query>, comma separated\n"
+                 "                    terms of bind=, type=, vis=, defined, undefined,\n"
+                 "                    min-size=<n>, sort=[-](index|value|size|name) and\n"
+                 "                    limit=<n>, e.g. type=STT_FUNC,sort=-size,limit=100\n"
+                 "  --cfi <sym>       Print the call frame instructions from .eh_frame for\n"
+                 "                    the functions named <sym>\n"
+                 "  --missing-cfi     Print the functions without unwind info in .eh_frame\n"
+                 "  --grep <text>     Print the sections and symbols whose name contains\n"
+                 "                    <text>, with the anchors of their rendered html\n"
+                 "  --demangle        With --grep, also match demangled C++ names\n"
+                 "  --refs <name>     Print the relocations referring to the symbols named\n"
+                 "                    <name>, or to the symbols defined in the sections\n"
+                 "                    named <name>, with the function each one is in\n"
+                 "  --diff <a> <b>    Print the sections, functions and symbols that differ,\n"
+                 "                    exits with 1 if there are differences\n"
+                 "  --watch <dir>     Render every .o file in <dir> to <name>.o.html and\n"
+                 "                    re-render changed sections whenever one is rewritten\n"
+                 "  --out <dir>       Output directory for --watch, defaults to <dir>\n"
+                 "  --serve <port>    Serve the web ui on localhost, rendering objects given\n"
+                 "                    by path on demand\n"
+                 "  --web-root <dir>  Web ui files for --serve, defaults to out/web\n"
+                 "  --cache-mb <n>    Memory for parsed objects kept by --serve, defaults\n"
+                 "                    to 1024\n"
+                 "  --threads <n>     Threads for --serve, --scan and --comdat, defaults to\n"
+                 "                    the number of cores\n"
+                 "  --index <file>    Symbol index of the objects in a directory tree\n"
+                 "  --scan <dir>      Create the index, or update it for changed objects\n"
+                 "  --defined <sym>   Print the objects defining <sym>\n"
+                 "  --referenced <sym>\n"
+                 "                    Print the objects with undefined references to <sym>\n"
+                 "  --multiple-weak   Print weak symbols defined by more than one object\n"
+                 "  --comdat <path>   Report COMDAT groups duplicated across the objects in\n"
+                 "                    <path>, and groups differing between objects\n"
+                 "  --top <n>         Most duplicated groups listed by --comdat, defaults\n"
+                 "                    to 20\n";
+}
 
-    std::ifstream input_file;
-    input_file.exceptions( std::ifstream::failbit | std::ifstream::badbit );
-    input_file.open( file_name, std::ios::binary | std::ios::ate );
-    auto file_size = input_file.tellg();
-    input_file.seekg( 0, std::ios::beg );
+// A whole decimal number within [ min, max ], `value` is left as is otherwise
+template < typename T >
+static bool ParseNumber( std::string_view s, T &value, T min = 0, T max = std::numeric_limits< T >::max() )
+{
+    T res;
+    auto [ end, ec ] = std::from_chars( s.data(), s.data() + s.size(), res );
+    if ( s.empty() || ec != std::errc() || end != s.data() + s.size() || res < min || res > max )
+    {
+        return false;
+    }
+    value = res;
+    return true;
+}
 
-    contents.resize( file_size );
-    input_file.read( (char*)contents.data(), file_size );
+// A number of megabytes, as bytes. 0 is rejected, it would be an empty cache
+// or budget.
+static bool ParseMegabytes( std::string_view s, size_t &bytes )
+{
+    size_t mb;
+    if ( !ParseNumber( s, mb, size_t( 1 ), std::numeric_limits< size_t >::max() >> 20 ) )
+    {
+        return false;
+    }
+    bytes = mb << 20;
+    return true;
+}
 
-    return contents;
+static InputBuffer ReadInput( const char *file_name )
+{
+    stats::ScopedPhase phase( "read" );
+    InputBuffer res( file_name, ReadFile( file_name ) );
+    phase.SetBytes( res.contents.size() );
+    return res;
 }
 
-std::vector< unsigned char > mem_data;
-std::string mem_result;
+static int RunDiff( const char *old_file_name, const char *new_file_name )
+{
+    InputBuffer old_input = ReadInput( old_file_name );
+    InputBuffer new_input = ReadInput( new_file_name );
+    ELF_File old_file = ELF_File::LoadMetadataFrom( old_input );
+    ELF_File new_file = ELF_File::LoadMetadataFrom( new_input );
 
-int my_main( int argc, char* argv[] )
+    fmt::memory_buffer out;
+    bool differs = DiffObjects( out, old_input, old_file, new_input, new_file );
+    std::cout.write( out.data(), out.size() );
+    return differs ? 1 : 0;
+}
+
+// Finds the functions in the symbol tables first, so only their sections, the
+// relocations for those and the line info are loaded, and decodes just the
+// functions' bytes
+static int RunDisasm( const char *file_name, std::string_view symbol )
 {
-    if ( argc != 2 )
+    InputBuffer input( file_name, FileContents::Map( file_name ), false );
+    SectionLoader loader( input, std::make_unique< std::pmr::monotonic_buffer_resource >() );
+    const ELF_File &elf = loader.File();
+
+    {
+        stats::ScopedPhase phase( "load" );
+
+        std::vector< size_t > code_sections;
+        for ( size_t idx = 0; idx < elf.m_sections.size(); ++idx )
+        {
+            if ( elf.m_sections[ idx ].m_header.m_type != SectionType::SHT_SYMTAB )
+            {
+                continue;
+            }
+            loader.Load( idx );
+            for ( const Symbol &s : std::get< SymbolTable >( elf.m_sections[ idx ].m_var ).m_symbols )
+            {
+                if ( s.m_name == symbol && s.m_section_idx < elf.m_sections.size() )
+                {
+                    code_sections.push_back( s.m_section_idx );
+                }
+            }
+        }
+        for ( size_t idx : code_sections )
+        {
+            loader.Load( idx );
+        }
+        for ( size_t idx = 0; idx < elf.m_sections.size(); ++idx )
+        {
+            const SectionHeader &sh = elf.m_sections[ idx ].m_header;
+            if ( ( sh.m_type == SectionType::SHT_RELA || sh.m_type == SectionType::SHT_REL )
+              && std::find( code_sections.begin(), code_sections.end(), sh.m_info ) != code_sections.end() )
+            {
+                loader.Load( idx );
+            }
+        }
+        for ( uint32_t idx : LineTable::Dependencies( elf.m_sections ) )
+        {
+            loader.Load( idx );
+        }
+    }
+
+    std::optional< FunctionIndex > index;
+    std::vector< FunctionIndex::Function > functions;
     {
-        std::cerr << "Usage: symbol_renamer <obj_file_name>\n";
+        stats::ScopedPhase phase( "function_index" );
+        index.emplace( elf );
+        functions = index->Find( symbol );
+    }
+    if ( functions.empty() )
+    {
+        std::cerr << fmt::format( "No function named {}\n", symbol );
         return 1;
     }
 
-    std::vector< unsigned char > obj_file_contents;
-    if ( argv[ 1 ] == std::string_view( "--mem-data" ) )
+    fmt::memory_buffer out;
     {
-        obj_file_contents = mem_data;
+        stats::ScopedPhase phase( "render" );
+        RenderDocumentHead( out );
+        for ( const FunctionIndex::Function &fn : functions )
+        {
+            RenderFunction( out, elf, *index, fn );
+        }
+        RenderDocumentTail( out );
     }
-    else
+    std::cout.write( out.data(), out.size() );
+    return 0;
+}
+
+// Loads the symbol tables, .eh_frame and its relocations only. Prints the CFI
+// of the functions named `symbol`, or with a null `symbol` the functions no
+// FDE covers.
+static int RunCfi( const char *file_name, const char *symbol )
+{
+    InputBuffer input( file_name, FileContents::Map( file_name ), false );
+    SectionLoader loader( input, std::make_unique< std::pmr::monotonic_buffer_resource >() );
+    const ELF_File &elf = loader.File();
+
+    const size_t eh_frame_idx = EhFrame::FindSection( elf );
+    if ( eh_frame_idx == 0 )
     {
-        obj_file_contents = read_file( argv[ 1 ] );
+        std::cerr << "No .eh_frame section\n";
+        return 1;
     }
 
-    InputBuffer input( argv[ 1 ], std::move( obj_file_contents ) ); // TODO first parameter can be removed
-    ELF_File file = ELF_File::LoadFrom( input );
+    {
+        stats::ScopedPhase phase( "load" );
+        loader.Load( eh_frame_idx );
+        for ( size_t idx = 0; idx < elf.m_sections.size(); ++idx )
+        {
+            const SectionHeader &sh = elf.m_sections[ idx ].m_header;
+            if ( sh.m_type == SectionType::SHT_SYMTAB
+              || ( ( sh.m_type == SectionType::SHT_RELA || sh.m_type == SectionType::SHT_REL ) && sh.m_info == eh_frame_idx ) )
+            {
+                loader.Load( idx );
+            }
+        }
+    }
 
-    std::stringstream html_out;
-    RenderAsHTML( html_out, file );
+    std::optional< EhFrame > eh_frame;
+    try
+    {
+        stats::ScopedPhase phase( "eh_frame" );
+        eh_frame.emplace( elf, eh_frame_idx );
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << fmt::format( "Can not decode .eh_frame: {}\n", e.what() );
+        return 1;
+    }
 
-    auto begin = input.m_read.begin();
-    auto end = input.m_read.end();
-    auto it = begin;
+    auto function_name = [ & ]( const EhFrame::Function &fn ) -> std::string_view
+    {
+        return std::get< SymbolTable >( elf.m_sections[ fn.m_symtab_idx ].m_var ).m_symbols[ fn.m_symbol_idx ].m_name;
+    };
 
-    while ( true )
+    fmt::memory_buffer out;
+    if ( symbol == nullptr )
     {
-        auto unread_begin = std::find( it, end, false );
-        if ( unread_begin == end )
+        stats::ScopedPhase phase( "missing_cfi" );
+        for ( const EhFrame::Function &fn : eh_frame->FunctionsWithoutFde() )
         {
-            break;
+            fmt::format_to( fmt::appender( out ), "{} ({}+{:#x}, {} bytes)\n",
+                            function_name( fn ), elf.m_sections[ fn.m_section_idx ].m_header.m_name, fn.m_value, fn.m_size );
         }
+        std::cout.write( out.data(), out.size() );
+        return 0;
+    }
 
-        auto unread_end = std::find( unread_begin, end, true );
-        ASSERT( unread_end != end );
-        it = unread_end + 1;
+    const std::vector< EhFrame::Function > functions = eh_frame->FindFunctions( symbol );
+    if ( functions.empty() )
+    {
+        std::cerr << fmt::format( "No function named {}\n", symbol );
+        return 1;
+    }
 
-        auto size = unread_end - unread_begin;
-        if ( size < 32 && std::all_of( unread_begin, unread_end, []( auto x ) { return x == 0; } ) )
+    int res = 0;
+    for ( const EhFrame::Function &fn : functions )
+    {
+        const EhFrame::Fde *fde = eh_frame->Find( fn.m_section_idx, fn.m_value );
+        if ( fde == nullptr )
         {
-            // Probably padding, TODO also verify `unread_end` is a section start and size < sec[-1].addr_align
+            fmt::format_to( fmt::appender( out ), "{} ({}+{:#x}): no FDE\n", function_name( fn ), elf.m_sections[ fn.m_section_idx ].m_header.m_name, fn.m_value );
+            res = 1;
             continue;
         }
 
-        std::cerr << "Unread [ " << unread_begin - begin << ", " << unread_end - begin << " )\n";
+        const EhFrame::Cie &cie = eh_frame->CieOf( *fde );
+        fmt::format_to( fmt::appender( out ), "{} ({}+{:#x})\n  CIE at {:#x}: {}\n",
+                        function_name( fn ), elf.m_sections[ fn.m_section_idx ].m_header.m_name, fn.m_value, cie.m_offset, EhFrame::Describe( cie ) );
+        try
+        {
+            for ( const std::string &line : eh_frame->Instructions( cie, cie.m_instructions, 0 ) )
+            {
+                fmt::format_to( fmt::appender( out ), "    {}\n", line );
+            }
+            fmt::format_to( fmt::appender( out ), "  FDE at {:#x}: pc {:#x}..{:#x}\n", fde->m_offset, fde->m_begin, fde->m_begin + fde->m_size );
+            for ( const std::string &line : eh_frame->Instructions( cie, fde->m_instructions, fde->m_begin ) )
+            {
+                fmt::format_to( fmt::appender( out ), "    {}\n", line );
+            }
+        }
+        catch ( const std::exception &e )
+        {
+            fmt::format_to( fmt::appender( out ), "    Can not decode: {}\n", e.what() );
+            res = 1;
+        }
+    }
+    std::cout.write( out.data(), out.size() );
+    return res;
+}
+
+// Only the section headers and the symbol table columns are read
+static int RunSymbols( const char *file_name, std::string_view query_text )
+{
+    SymbolQuery query;
+    try
+    {
+        query = SymbolQuery::Parse( query_text );
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    InputBuffer input( file_name, FileContents::Map( file_name ), false );
+    SectionLoader loader( input, std::make_unique< std::pmr::monotonic_buffer_resource >() );
+    const ELF_File &elf = loader.File();
+
+    fmt::memory_buffer out;
+    for ( size_t idx = 0; idx < elf.m_sections.size(); ++idx )
+    {
+        if ( elf.m_sections[ idx ].m_header.m_type != SectionType::SHT_SYMTAB )
+        {
+            continue;
+        }
+
+        SymbolColumns columns;
+        {
+            stats::ScopedPhase phase( "symbol_columns", elf.m_sections[ idx ].m_header.m_name, elf.m_sections[ idx ].m_header.m_size );
+            columns = SymbolColumns::Load( input, elf, idx );
+        }
+        std::vector< uint32_t > rows;
+        {
+            stats::ScopedPhase phase( "symbol_query", elf.m_sections[ idx ].m_header.m_name );
+            rows = RunSymbolQuery( columns, query );
+        }
+
+        fmt::format_to( fmt::appender( out ), "Section {} ({}), {} of {} symbols:\n", idx, elf.m_sections[ idx ].m_header.m_name, rows.size(), columns.size() );
+        for ( uint32_t i : rows )
+        {
+            fmt::format_to( fmt::appender( out ), "{:>8} {:016x} {:>10} {:<10} {:<11} {:<13} {:>6} {}\n",
+                            i, columns.m_value[ i ], columns.m_size[ i ],
+                            EnumText( SymbolBinding( columns.m_binding[ i ] ) ), EnumText( SymbolType( columns.m_type[ i ] ) ),
+                            EnumText( SymbolVisibility( columns.m_visibility[ i ] ) ), FileSectionIndex( columns.m_section_idx[ i ] ),
+                            columns.Name( i ) );
+        }
+    }
+    std::cout.write( out.data(), out.size() );
+    return 0;
+}
+
+// Loads the symbol tables only and searches their names and the section names
+static int RunGrep( const char *file_name, std::string_view text, bool demangle )
+{
+    InputBuffer input( file_name, FileContents::Map( file_name ), false );
+    SectionLoader loader( input, std::make_unique< std::pmr::monotonic_buffer_resource >() );
+    const ELF_File &elf = loader.File();
+
+    {
+        stats::ScopedPhase phase( "load" );
+        for ( size_t idx = 0; idx < elf.m_sections.size(); ++idx )
+        {
+            if ( elf.m_sections[ idx ].m_header.m_type == SectionType::SHT_SYMTAB )
+            {
+                loader.Load( idx );
+            }
+        }
+    }
+
+    std::optional< NameIndex > index;
+    {
+        stats::ScopedPhase phase( "name_index" );
+        index.emplace( elf, demangle );
+    }
+    std::vector< uint32_t > matches;
+    {
+        stats::ScopedPhase phase( "grep" );
+        matches = index->Search( text );
+    }
+
+    fmt::memory_buffer out;
+    for ( uint32_t id : matches )
+    {
+        const NameIndex::Entry &e = ( *index )[ id ];
+        const Anchor anchor = e.m_symbol_idx == NameIndex::NoSymbol ? Anchor::ForSection( e.m_section_idx ) : Anchor::ForSymbol( e.m_section_idx, e.m_symbol_idx );
+        fmt::format_to( fmt::appender( out ), "{:<24} {}", fmt::format( "{}", anchor ), index->Name( id ) );
+        if ( !index->Demangled( id ).empty() )
+        {
+            fmt::format_to( fmt::appender( out ), "  {}", index->Demangled( id ) );
+        }
+        out.push_back( '\n' );
+    }
+    std::cout.write( out.data(), out.size() );
+    return matches.empty() ? 1 : 0;
+}
+
+// Loads the symbol and relocation tables only. Lists the references to the
+// symbols named `name` and to the sections named `name`, e.g. to the
+// .rodata.str1.1 strings through its section symbol.
+static int RunRefs( const char *file_name, std::string_view name )
+{
+    InputBuffer input( file_name, FileContents::Map( file_name ), false );
+    SectionLoader loader( input, std::make_unique< std::pmr::monotonic_buffer_resource >() );
+    const ELF_File &elf = loader.File();
+    const auto &sections = elf.m_sections;
+
+    {
+        stats::ScopedPhase phase( "load" );
+        for ( size_t idx = 0; idx < sections.size(); ++idx )
+        {
+            const SectionType type = sections[ idx ].m_header.m_type;
+            if ( type == SectionType::SHT_SYMTAB || type == SectionType::SHT_RELA || type == SectionType::SHT_REL )
+            {
+                loader.Load( idx );
+            }
+        }
     }
 
-    // TODO clean up this creap
-    if ( argv[ 1 ] == std::string_view( "--mem-data" ) )
+    std::optional< ReferenceIndex > index;
     {
-        mem_result = html_out.str();
+        stats::ScopedPhase phase( "reference_index" );
+        index.emplace( elf );
     }
-    else
+    FunctionIndex functions( elf );
+
+    fmt::memory_buffer out;
+    size_t num_found = 0;
+    auto print = [ & ]( std::string_view what, ReferenceIndex::Slice refs )
+    {
+        ++num_found;
+        fmt::format_to( fmt::appender( out ), "{} ({}), {} references:\n", name, what, refs.size() );
+        for ( const ReferenceIndex::Reference &ref : refs )
+        {
+            const uint64_t offset = ref.m_entry->m_offset;
+            const std::string type = elf.m_machine == Machine::EM_X86_64 ? EnumText( ref.m_entry->m_type ) : fmt::format( "{}", static_cast< uint32_t >( ref.m_entry->m_type ) );
+            fmt::format_to( fmt::appender( out ), "  {}+{:#x} {}", sections[ ref.m_section_idx ].m_header.m_name, offset, type );
+
+            // In the last symbol defined at or before the offset
+            FunctionIndex::Slice< FunctionIndex::Label > labels = functions.Labels( ref.m_section_idx, 0, offset + 1 );
+            if ( labels.begin() != labels.end() )
+            {
+                const FunctionIndex::Label &label = labels.end()[ -1 ];
+                const Symbol &s = std::get< SymbolTable >( sections[ label.m_symtab_idx ].m_var ).m_symbols[ label.m_symbol_idx ];
+                fmt::format_to( fmt::appender( out ), " {}+{:#x}", s.m_name, offset - label.m_offset );
+            }
+            out.push_back( '\n' );
+        }
+    };
+
     {
-        std::cout << html_out.str();
+        stats::ScopedPhase phase( "refs" );
+        for ( size_t idx = 0; idx < sections.size(); ++idx )
+        {
+            if ( sections[ idx ].m_header.m_name == name )
+            {
+                print( fmt::format( "section {}", idx ), index->ToSection( idx ) );
+            }
+            const SymbolTable *symtab = std::get_if< SymbolTable >( &sections[ idx ].m_var );
+            for ( size_t i = 0; symtab && i < symtab->m_symbols.size(); ++i )
+            {
+                if ( symtab->m_symbols[ i ].m_name == name )
+                {
+                    print( fmt::format( "symbol {} of {}", i, sections[ idx ].m_header.m_name ), index->ToSymbol( idx, i ) );
+                }
+            }
+        }
     }
 
+    if ( num_found == 0 )
+    {
+        std::cerr << fmt::format( "No symbol or section named {}\n", name );
+        return 1;
+    }
+    std::cout.write( out.data(), out.size() );
     return 0;
 }
 
+// Prints the phases recorded, and writes them as a trace if a file name is
+// given. Returns the exit code of the command, or 1 if the trace can not be
+// written.
+static int ReportStats( const std::string &trace_file_name, int res )
+{
+    stats::PrintSummary( std::cerr );
+    if ( !trace_file_name.empty() && !stats::WriteChromeTrace( trace_file_name ) )
+    {
+        std::cerr << "Can not write trace to " << trace_file_name << "\n";
+        return res != 0 ? res : 1;
+    }
+    return res;
+}
+
+int my_main( int argc, char* argv[] )
+{
+    bool print_stats = false;
+    std::string trace_file_name;
+    const char *obj_file_name = nullptr;
+    const char *diff_file_names[ 2 ] = { nullptr, nullptr };
+    std::string watch_dir;
+    std::string watch_out_dir;
+    std::optional< ServeOptions > serve_options;
+    IndexOptions index_options;
+    int num_index_commands = 0;
+    ComdatOptions comdat_options;
+    size_t num_threads = 0;
+    size_t memory_budget = 0;
+    Markup markup = Markup::Full;
+    const char *disasm_symbol = nullptr;
+    const char *symbols_query = nullptr;
+    const char *cfi_symbol = nullptr;
+    bool missing_cfi = false;
+    const char *grep_text = nullptr;
+    bool demangle = false;
+    const char *refs_name = nullptr;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string_view arg = argv[ i ];
+        if ( arg == "--stats" )
+        {
+            print_stats = true;
+        }
+        else if ( arg == "--trace" && i + 1 < argc )
+        {
+            trace_file_name = argv[ ++i ];
+        }
+        else if ( arg == "--memory-budget" && i + 1 < argc )
+        {
+            if ( !ParseMegabytes( argv[ ++i ], memory_budget ) )
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if ( arg == "--compact" )
+        {
+            markup = Markup::Compact;
+        }
+        else if ( arg == "--symbols" && i + 1 < argc )
+        {
+            symbols_query = argv[ ++i ];
+        }
+        else if ( arg == "--disasm" && i + 1 < argc )
+        {
+            disasm_symbol = argv[ ++i ];
+        }
+        else if ( arg == "--cfi" && i + 1 < argc )
+        {
+            cfi_symbol = argv[ ++i ];
+        }
+        else if ( arg == "--missing-cfi" )
+        {
+            missing_cfi = true;
+        }
+        else if ( arg == "--grep" && i + 1 < argc )
+        {
+            grep_text = argv[ ++i ];
+        }
+        else if ( arg == "--demangle" )
+        {
+            demangle = true;
+        }
+        else if ( arg == "--refs" && i + 1 < argc )
+        {
+            refs_name = argv[ ++i ];
+        }
+        else if ( arg == "--diff" && i + 2 < argc )
+        {
+            diff_file_names[ 0 ] = argv[ ++i ];
+            diff_file_names[ 1 ] = argv[ ++i ];
+        }
+        else if ( arg == "--watch" && i + 1 < argc )
+        {
+            watch_dir = argv[ ++i ];
+        }
+        else if ( arg == "--out" && i + 1 < argc )
+        {
+            watch_out_dir = argv[ ++i ];
+        }
+        else if ( arg == "--serve" && i + 1 < argc )
+        {
+            serve_options.emplace();
+            if ( !ParseNumber( argv[ ++i ], serve_options->m_port, uint16_t( 1 ) ) )
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if ( arg == "--web-root" && serve_options && i + 1 < argc )
+        {
+            serve_options->m_web_root = argv[ ++i ];
+        }
+        else if ( arg == "--cache-mb" && serve_options && i + 1 < argc )
+        {
+            if ( !ParseMegabytes( argv[ ++i ], serve_options->m_cache_bytes ) )
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if ( arg == "--threads" && i + 1 < argc )
+        {
+            if ( !ParseNumber( argv[ ++i ], num_threads ) )
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if ( arg == "--index" && i + 1 < argc )
+        {
+            index_options.m_index_file = argv[ ++i ];
+        }
+        else if ( arg == "--scan" && i + 1 < argc )
+        {
+            index_options.m_scan_dir = argv[ ++i ];
+            ++num_index_commands;
+        }
+        else if ( arg == "--defined" && i + 1 < argc )
+        {
+            index_options.m_defined = argv[ ++i ];
+            ++num_index_commands;
+        }
+        else if ( arg == "--referenced" && i + 1 < argc )
+        {
+            index_options.m_referenced = argv[ ++i ];
+            ++num_index_commands;
+        }
+        else if ( arg == "--multiple-weak" )
+        {
+            index_options.m_multiple_weak = true;
+            ++num_index_commands;
+        }
+        else if ( arg == "--comdat" && i + 1 < argc )
+        {
+            comdat_options.m_roots.push_back( argv[ ++i ] );
+        }
+        else if ( arg == "--top" && !comdat_options.m_roots.empty() && i + 1 < argc )
+        {
+            if ( !ParseNumber( argv[ ++i ], comdat_options.m_top ) )
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if ( obj_file_name == nullptr && ( arg == "--mem-data" || arg.substr( 0, 2 ) != "--" ) )
+        {
+            obj_file_name = argv[ i ];
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    const bool no_input = obj_file_name == nullptr && diff_file_names[ 0 ] == nullptr;
+    if ( !watch_dir.empty() && no_input && !serve_options )
+    {
+#ifndef __EMSCRIPTEN__
+        return RunWatch( watch_dir, watch_out_dir.empty() ? watch_dir : watch_out_dir );
+#endif
+    }
+
+    if ( serve_options && no_input && watch_dir.empty() && watch_out_dir.empty() )
+    {
+        serve_options->m_num_threads = num_threads;
+#ifndef __EMSCRIPTEN__
+        return RunServer( *serve_options );
+#endif
+    }
+
+    const bool is_index_command = !index_options.m_index_file.empty() || num_index_commands != 0;
+    if ( is_index_command && num_index_commands == 1 && !index_options.m_index_file.empty() && no_input && watch_dir.empty() && !serve_options )
+    {
+        index_options.m_num_threads = num_threads;
+#ifndef __EMSCRIPTEN__
+        return RunIndex( index_options );
+#endif
+    }
+
+    const bool is_comdat_command = !comdat_options.m_roots.empty();
+    if ( is_comdat_command && no_input && watch_dir.empty() && !serve_options && !is_index_command )
+    {
+        comdat_options.m_num_threads = num_threads;
+#ifndef __EMSCRIPTEN__
+        return RunComdat( comdat_options );
+#endif
+    }
+
+    if ( ( obj_file_name == nullptr ) == ( diff_file_names[ 0 ] == nullptr ) || !watch_dir.empty() || !watch_out_dir.empty() || serve_options || is_index_command || is_comdat_command )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    const int num_file_commands = ( disasm_symbol != nullptr ) + ( symbols_query != nullptr ) + ( cfi_symbol != nullptr ) + missing_cfi + ( grep_text != nullptr ) + ( refs_name != nullptr );
+    if ( num_file_commands > 1 || ( num_file_commands == 1 && ( obj_file_name == nullptr || obj_file_name == std::string_view( "--mem-data" ) ) )
+      || ( demangle && grep_text == nullptr ) || ( !trace_file_name.empty() && !print_stats ) )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if ( print_stats )
+    {
+        stats::Enable();
+    }
+
+    auto run = [ & ]() -> int
+    {
+        if ( num_file_commands == 1 )
+        {
+            return disasm_symbol != nullptr ? RunDisasm( obj_file_name, disasm_symbol )
+                 : symbols_query != nullptr ? RunSymbols( obj_file_name, symbols_query )
+                 : grep_text != nullptr ? RunGrep( obj_file_name, grep_text, demangle )
+                 : refs_name != nullptr ? RunRefs( obj_file_name, refs_name )
+                 : RunCfi( obj_file_name, cfi_symbol );
+        }
+
+        if ( diff_file_names[ 0 ] != nullptr )
+        {
+            return RunDiff( diff_file_names[ 0 ], diff_file_names[ 1 ] );
+        }
+
+        if ( memory_budget != 0 && obj_file_name != std::string_view( "--mem-data" ) )
+        {
+            InputBuffer input( obj_file_name, FileContents::Map( obj_file_name ), false );
+            RenderPipelined( std::cout, input, memory_budget, markup );
+            return 0;
+        }
+
+        std::vector< unsigned char > obj_file_contents;
+        if ( obj_file_name == std::string_view( "--mem-data" ) )
+        {
+            obj_file_contents = mem_data;
+        }
+        else
+        {
+            stats::ScopedPhase phase( "read" );
+            obj_file_contents = ReadFile( obj_file_name );
+            phase.SetBytes( obj_file_contents.size() );
+        }
+
+        InputBuffer input( obj_file_name, std::move( obj_file_contents ) ); // TODO first parameter can be removed
+        ELF_File file = ELF_File::LoadFrom( input );
+
+        // Symbol tables count the references to each symbol
+        std::optional< ReferenceIndex > references;
+        {
+            stats::ScopedPhase phase( "reference_index" );
+            references.emplace( file );
+        }
+
+        fmt::memory_buffer html_out;
+        RenderAsHTML( html_out, file, markup, &*references );
+
+        {
+            stats::ScopedPhase phase( "unread_scan", {}, input.contents.size() );
+            for ( const auto &[ unread_begin, unread_end ] : FindUnreadRanges( input ) )
+            {
+                std::cerr << "Unread [ " << unread_begin << ", " << unread_end << " )\n";
+            }
+        }
+
+        // TODO clean up this creap
+        if ( obj_file_name == std::string_view( "--mem-data" ) )
+        {
+            mem_result = fmt::to_string( html_out );
+        }
+        else
+        {
+            stats::ScopedPhase phase( "write_output", {}, html_out.size() );
+            std::cout.write( html_out.data(), html_out.size() );
+        }
+
+        return 0;
+    };
+
+    const int res = run();
+    return print_stats ? ReportStats( trace_file_name, res ) : res;
+}
+
 int main( int argc, char* argv[] )
 {
     return my_main( argc, argv );
 }
 
+// Whether rendering section `idx` decodes instructions
+static bool DisassemblesSection( const ELF_File &elf, size_t idx )
+{
+    if ( idx >= elf.m_sections.size() || !CanDisassemble( elf.m_machine ) )
+    {
+        return false;
+    }
+    const ProgBitsSection *code = std::get_if< ProgBitsSection >( &elf.m_sections[ idx ].m_var );
+    return code && code->m_is_executable && !EhFrame::IsEhFrame( elf, idx );
+}
+
+// The web ui keeps the parsed file around and pulls the rendered html one
+// chunk at a time, see `streamPageWith` in elf-explorer.js
+struct StreamingSession
+{
+    StreamingSession( ELF_File &&file_, size_t virtual_table_rows )
+        : file( std::move( file_ ) )
+        , functions( file )
+        , references( file )
+        , renderer( file, virtual_table_rows, &functions, Markup::Compact, &references )
+#ifdef __EMSCRIPTEN_PTHREADS__
+        , rendered( renderer.NumChunks() )
+        , pool( std::thread::hardware_concurrency() )
+#endif
+    {
+#ifdef __EMSCRIPTEN_PTHREADS__
+        SubmitAhead();
+#endif
+    }
+
+    // Sets `chunk` to the next one, returns false when there is nothing left
+    // to render
+    bool NextChunk()
+    {
+#ifdef __EMSCRIPTEN_PTHREADS__
+        if ( next >= rendered.size() )
+        {
+            return false;
+        }
+        {
+            std::unique_lock< std::mutex > lock( mutex );
+            cv.wait( lock, [ this ] { return rendered[ next ].has_value(); } );
+            chunk = std::move( *rendered[ next ] );
+            rendered[ next ].reset();
+        }
+        ++next;
+        SubmitAhead();
+        return true;
+#else
+        fmt::memory_buffer html_out;
+        if ( !renderer.RenderNextChunk( html_out ) )
+        {
+            return false;
+        }
+        chunk = fmt::to_string( html_out );
+        return true;
+#endif
+    }
+
+    ELF_File file;
+
+    // Shared by the rendered sections, expanded functions and code tables,
+    // its tables are built on first use
+    FunctionIndex functions;
+    // Counted in the symbol tables, so built before rendering
+    ReferenceIndex references;
+    HTMLChunkRenderer renderer;
+    std::string chunk;
+
+    std::string function_html;
+    std::string table;
+    std::string search_html;
+    std::string references_html;
+
+    const FunctionIndex& Functions()
+    {
+        return functions;
+    }
+
+    // Built on the first search
+    const NameIndex& Names()
+    {
+        if ( !names )
+        {
+            names.emplace( file );
+        }
+        return *names;
+    }
+
+    const ReferenceIndex& References()
+    {
+        return references;
+    }
+
+    std::optional< NameIndex > names;
+
+#ifdef __EMSCRIPTEN_PTHREADS__
+    // The threaded build renders a few chunks ahead on the worker pool (section
+    // decoding and disassembly being most of the time) while the page inserts
+    // the current one. Lookahead is bounded so the rendered html does not all
+    // pile up in memory. Stops before the first chunk with code until the page
+    // has loaded the disassembler, which it does before pulling that chunk.
+    void SubmitAhead()
+    {
+        while ( submitted < std::min( rendered.size(), next + 2 * pool.NumThreads() )
+             && ( DisasmLoaded() || !DisassemblesSection( file, submitted ) ) )
+        {
+            SubmitNext();
+        }
+    }
+
+    void SubmitNext()
+    {
+        size_t idx = submitted++;
+        pool.Submit( [ this, idx ]
+        {
+            fmt::memory_buffer html_out;
+            renderer.RenderChunk( html_out, idx );
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                rendered[ idx ] = fmt::to_string( html_out );
+            }
+            cv.notify_all();
+        } );
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector< std::optional< std::string > > rendered;
+    size_t submitted = 0;
+    size_t next = 0;
+
+    // Last, so the workers are joined before anything they use goes away
+    ThreadPool pool;
+#endif
+};
+
+static std::unique_ptr< StreamingSession > streaming_session;
+
 extern "C" {
 
+// Tables with at least `virtual_table_rows` rows (never if 0) are left for
+// the page to show from `table_data`
+void open_buffer( const char *data, size_t size, uint32_t virtual_table_rows )
+{
+    streaming_session.reset();
+
+    InputBuffer input( "--mem-data", std::vector< unsigned char >( reinterpret_cast< const unsigned char * >( data ),
+                                                                  reinterpret_cast< const unsigned char * >( data ) + size ) );
+    streaming_session = std::make_unique< StreamingSession >( ELF_File::LoadFrom( input ), virtual_table_rows );
+}
+
+// Returns an empty string when there is nothing left to render
+const char* next_html_chunk()
+{
+    if ( !streaming_session )
+    {
+        return "";
+    }
+
+    if ( !streaming_session->NextChunk() )
+    {
+        return "";
+    }
+
+    return streaming_session->chunk.c_str();
+}
+
+// Disassembly of the function defined by a symbol, for expanding it in the
+// page. Returns an empty string if the symbol is not a function.
+const char* disasm_function( uint32_t symtab_idx, uint32_t symbol_idx )
+{
+    if ( !streaming_session )
+    {
+        return "";
+    }
+
+    StreamingSession &session = *streaming_session;
+    std::optional< FunctionIndex::Function > fn = session.Functions().ForSymbol( symtab_idx, symbol_idx );
+    if ( !fn )
+    {
+        return "";
+    }
+
+    ScopedMarkup markup( Markup::Compact );
+    fmt::memory_buffer html_out;
+    RenderFunction( html_out, session.file, session.Functions(), *fn );
+    session.function_html = fmt::to_string( html_out );
+    return session.function_html.c_str();
+}
+
+// The page loads the disassembler side module, see `loadDisassembler` in
+// elf-explorer.js, before pulling the chunk of a section or the table rows
+// or a function for which these return true
+bool section_needs_disassembler( uint32_t section_idx )
+{
+    return streaming_session && !DisasmLoaded() && DisassemblesSection( streaming_session->file, section_idx );
+}
+
+bool function_needs_disassembler( uint32_t symtab_idx, uint32_t symbol_idx )
+{
+    if ( !streaming_session )
+    {
+        return false;
+    }
+    std::optional< FunctionIndex::Function > fn = streaming_session->Functions().ForSymbol( symtab_idx, symbol_idx );
+    return fn && section_needs_disassembler( fn->m_section_idx );
+}
+
+// Called once the page has written the side module to `path`, returns false
+// if it can not be loaded
+bool load_disassembler( const char *path )
+{
+#ifdef ELFEXPLORER_DISASM_SIDE_MODULE
+    if ( !DisasmLoaded() && !LoadDisasmLibrary( path ) )
+    {
+        return false;
+    }
+#ifdef __EMSCRIPTEN_PTHREADS__
+    if ( streaming_session )
+    {
+        streaming_session->SubmitAhead();
+    }
+#endif
+#else
+    (void)path;
+#endif
+    return true;
+}
+
+// Links to at most `limit` sections and symbols whose name contains `text`,
+// for the search box of the page
+const char* search_names( const char *text, uint32_t limit )
+{
+    if ( !streaming_session )
+    {
+        return "";
+    }
+
+    StreamingSession &session = *streaming_session;
+    fmt::memory_buffer html_out;
+    RenderNameMatches( html_out, session.file, session.Names(), session.Names().Search( text, limit ) );
+    session.search_html = fmt::to_string( html_out );
+    return session.search_html.c_str();
+}
+
+// Relocations referring to a symbol, shown with the symbol when it is clicked.
+// Returns an empty string if there are none.
+const char* symbol_references( uint32_t symtab_idx, uint32_t symbol_idx )
+{
+    if ( !streaming_session )
+    {
+        return "";
+    }
+
+    StreamingSession &session = *streaming_session;
+    ScopedMarkup markup( Markup::Compact );
+    fmt::memory_buffer html_out;
+    RenderReferences( html_out, session.file, session.Functions(), session.References().ToSymbol( symtab_idx, symbol_idx ) );
+    session.references_html = fmt::to_string( html_out );
+    return session.references_html.c_str();
+}
+
+// Rows of a table section packed by column as described in table_data.hpp,
+// valid until the next call. Null if the section has no rows.
+const char* table_data( uint32_t section_idx )
+{
+    if ( !streaming_session )
+    {
+        return nullptr;
+    }
+
+    StreamingSession &session = *streaming_session;
+    if ( !EncodeTable( session.table, session.file, session.Functions(), section_idx, &session.References() ) )
+    {
+        return nullptr;
+    }
+    return session.table.data();
+}
+
 char* run_with_buffer( const char *data, uint64_t size )
 {
     mem_data.assign( reinterpret_cast< const unsigned char * >( data ),
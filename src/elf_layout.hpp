@@ -0,0 +1,155 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef ELFEXPLORER__ELF_LAYOUT_HPP__
+#define ELFEXPLORER__ELF_LAYOUT_HPP__
+
+#include <cstdint>
+
+#include "elf_structs.hpp"
+
+namespace elfexplorer {
+
+constexpr uint16_t SHN_LORESERVE = 0xff00;
+constexpr uint16_t SHN_XINDEX = 0xffff;
+
+// Type of .eh_frame in x86-64 objects from llvm, laid out like SHT_PROGBITS
+constexpr SectionType SHT_X86_64_UNWIND = SectionType( 0x70000001 );
+
+// Offsets of the fields of the records that differ between ELF32 and ELF64.
+// `Addr` is the type of addresses, offsets and sizes (and the Xword fields of
+// ELF64).
+template < ElfClass Class >
+struct ElfLayout;
+
+template <>
+struct ElfLayout< ElfClass::ELF64 >
+{
+    using Addr = uint64_t;
+
+    // Elf64_Ehdr
+    static constexpr uint16_t EhdrSize = 64;
+    static constexpr uint64_t E_Entry     = 0x18;
+    static constexpr uint64_t E_PhOff     = 0x20;
+    static constexpr uint64_t E_ShOff     = 0x28;
+    static constexpr uint64_t E_Flags     = 0x30;
+    static constexpr uint64_t E_EhSize    = 0x34;
+    static constexpr uint64_t E_PhEntSize = 0x36;
+    static constexpr uint64_t E_PhNum     = 0x38;
+    static constexpr uint64_t E_ShEntSize = 0x3a;
+    static constexpr uint64_t E_ShNum     = 0x3c;
+    static constexpr uint64_t E_ShStrNdx  = 0x3e;
+
+    // Elf64_Shdr
+    static constexpr uint64_t ShdrSize = 64;
+    static constexpr uint64_t Sh_Name      = 0x00;
+    static constexpr uint64_t Sh_Type      = 0x04;
+    static constexpr uint64_t Sh_Flags     = 0x08;
+    static constexpr uint64_t Sh_Addr      = 0x10;
+    static constexpr uint64_t Sh_Offset    = 0x18;
+    static constexpr uint64_t Sh_Size      = 0x20;
+    static constexpr uint64_t Sh_Link      = 0x28;
+    static constexpr uint64_t Sh_Info      = 0x2c;
+    static constexpr uint64_t Sh_AddrAlign = 0x30;
+    static constexpr uint64_t Sh_EntSize   = 0x38;
+
+    // Elf64_Sym
+    static constexpr uint64_t SymSize = 24;
+    static constexpr uint64_t St_Name  = 0x00;
+    static constexpr uint64_t St_Info  = 0x04;
+    static constexpr uint64_t St_Other = 0x05;
+    static constexpr uint64_t St_Shndx = 0x06;
+    static constexpr uint64_t St_Value = 0x08;
+    static constexpr uint64_t St_Size  = 0x10;
+
+    // Elf64_Rel and Elf64_Rela
+    static constexpr uint64_t RelSize = 16;
+    static constexpr uint64_t RelaSize = 24;
+    static constexpr uint64_t R_Offset = 0x00;
+    static constexpr uint64_t R_Info   = 0x08;
+    static constexpr uint64_t R_Addend = 0x10;
+
+    static uint32_t RelocationSymbol( Addr info ) { return info >> 32; }
+    static uint32_t RelocationType( Addr info ) { return info & 0xffffffff; }
+
+    // Elf64_Chdr, with 4 reserved bytes after the type
+    static constexpr uint64_t ChdrSize = 24;
+    static constexpr uint64_t Ch_Size      = 0x08;
+    static constexpr uint64_t Ch_AddrAlign = 0x10;
+};
+
+template <>
+struct ElfLayout< ElfClass::ELF32 >
+{
+    using Addr = uint32_t;
+
+    // Elf32_Ehdr
+    static constexpr uint16_t EhdrSize = 52;
+    static constexpr uint64_t E_Entry     = 0x18;
+    static constexpr uint64_t E_PhOff     = 0x1c;
+    static constexpr uint64_t E_ShOff     = 0x20;
+    static constexpr uint64_t E_Flags     = 0x24;
+    static constexpr uint64_t E_EhSize    = 0x28;
+    static constexpr uint64_t E_PhEntSize = 0x2a;
+    static constexpr uint64_t E_PhNum     = 0x2c;
+    static constexpr uint64_t E_ShEntSize = 0x2e;
+    static constexpr uint64_t E_ShNum     = 0x30;
+    static constexpr uint64_t E_ShStrNdx  = 0x32;
+
+    // Elf32_Shdr
+    static constexpr uint64_t ShdrSize = 40;
+    static constexpr uint64_t Sh_Name      = 0x00;
+    static constexpr uint64_t Sh_Type      = 0x04;
+    static constexpr uint64_t Sh_Flags     = 0x08;
+    static constexpr uint64_t Sh_Addr      = 0x0c;
+    static constexpr uint64_t Sh_Offset    = 0x10;
+    static constexpr uint64_t Sh_Size      = 0x14;
+    static constexpr uint64_t Sh_Link      = 0x18;
+    static constexpr uint64_t Sh_Info      = 0x1c;
+    static constexpr uint64_t Sh_AddrAlign = 0x20;
+    static constexpr uint64_t Sh_EntSize   = 0x24;
+
+    // Elf32_Sym, value and size come before info
+    static constexpr uint64_t SymSize = 16;
+    static constexpr uint64_t St_Name  = 0x00;
+    static constexpr uint64_t St_Value = 0x04;
+    static constexpr uint64_t St_Size  = 0x08;
+    static constexpr uint64_t St_Info  = 0x0c;
+    static constexpr uint64_t St_Other = 0x0d;
+    static constexpr uint64_t St_Shndx = 0x0e;
+
+    // Elf32_Rel and Elf32_Rela
+    static constexpr uint64_t RelSize = 8;
+    static constexpr uint64_t RelaSize = 12;
+    static constexpr uint64_t R_Offset = 0x00;
+    static constexpr uint64_t R_Info   = 0x04;
+    static constexpr uint64_t R_Addend = 0x08;
+
+    static uint32_t RelocationSymbol( Addr info ) { return info >> 8; }
+    static uint32_t RelocationType( Addr info ) { return info & 0xff; }
+
+    // Elf32_Chdr
+    static constexpr uint64_t ChdrSize = 12;
+    static constexpr uint64_t Ch_Size      = 0x04;
+    static constexpr uint64_t Ch_AddrAlign = 0x08;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__ELF_LAYOUT_HPP__
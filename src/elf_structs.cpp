@@ -19,6 +19,14 @@
 #include "elf_structs.hpp"
 
 #include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+#include <fmt/format.h>
+
+#include "decompress.hpp"
+#include "elf_layout.hpp"
+#include "stats.hpp"
 
 namespace elfexplorer {
 
@@ -59,65 +67,87 @@ ScopeGuard RunAtExit( std::function< void() > fn )
     return ScopeGuard( fn );
 }
 
-static StringTable LoadStringTable( InputBuffer &input, uint64_t section_offset, uint64_t size )
+static StringTable LoadStringTable( InputBuffer &input, std::pmr::memory_resource *mr, uint64_t section_offset, uint64_t size )
 {
-    StringTable res;
-    for ( uint64_t i = 0; i < size; ++i )
-    {
-        (void)input.U8At( section_offset + i ); // Set read
-    }
-    res.m_str.assign( (const char*)input.contents.data() + section_offset, size );
+    StringTable res( mr );
+    res.m_str = input.StringViewAt( section_offset, size );
     return res;
 }
 
-static Symbol LoadSymbol( InputBuffer &input, const StringTable &strtab, uint64_t offset )
+// Loading state that does not depend on the ELF class or byte order, the
+// loading itself is done by `ELF_LoaderFor`
+struct ELF_Loader
 {
-    Symbol res;
+    ELF_Loader( InputBuffer &input, ELF_File &file )
+        : m_input( input )
+        , m_mr( file.m_sections.get_allocator().resource() )
+        , m_file( file )
+        , m_sections( file.m_sections )
+    {
+    }
 
-    res.m_name = strtab.StringAtOffset( input.U32At( offset ) );
-    uint8_t info = input.U8At( offset + 4 );
-    res.m_binding = static_cast< SymbolBinding >( info >> 4 );
-    res.m_type = static_cast< SymbolType >( info & 15 );
-    res.m_visibility = static_cast< SymbolVisibility >( input.U8At( offset + 5 ) );
-    res.m_section_idx = input.U16At( offset + 6 );
-    res.m_value = input.U64At( offset + 8 );
-    res.m_size = input.U64At( offset + 16 );
+    virtual ~ELF_Loader() = default;
 
-    return res;
-}
+    virtual void LoadFileHeader() = 0;
+    virtual void LoadSectionHeaders() = 0;
+    virtual void LoadSection( size_t idx ) = 0;
 
-static SectionHeader LoadSectionHeader( InputBuffer &input, StringTable &shstrtab, uint64_t offset )
-{
-    SectionHeader res;
-    res.m_name = shstrtab.StringAtOffset( input.U32At( offset + 0x00 ) );
-    res.m_type = static_cast< SectionType >( input.U32At( offset + 0x04 ) );
-    res.m_attrs      = SectionFlags( input.U64At( offset + 0x08 ) );
-    res.m_address    = input.U64At( offset + 0x10 );
-    res.m_offset     = input.U64At( offset + 0x18 );
-    res.m_size       = input.U64At( offset + 0x20 );
-    res.m_asso_idx   = input.U32At( offset + 0x28 );
-    res.m_info       = input.U32At( offset + 0x2c );
-    res.m_addr_align = input.U64At( offset + 0x30 );
-    res.m_ent_size   = input.U64At( offset + 0x38 );
-    return res;
-}
+    void LoadSections()
+    {
+        // Load actual section data
+        // TODO recursively load dependent sections first
+        for ( size_t i = 1; i < m_sections.size(); ++i )
+        {
+            LoadSection( i );
+        }
+    }
 
-struct ELF_Loader
+    InputBuffer &m_input;
+    std::pmr::memory_resource *m_mr;
+    bool m_load_data = true; // Copy contents of data sections into the model
+
+    uint64_t m_section_header_offset;
+    uint16_t m_section_header_entry_size;
+    uint64_t m_section_header_num_entries;
+    uint32_t m_section_names_header_index;
+
+    std::vector< bool > m_section_loading;
+    std::vector< bool > m_section_loaded;
+    std::vector< uint32_t > m_loaded_sections;
+    std::unordered_map< uint32_t, uint32_t > m_symtab_shndx; // Symbol table to its SHT_SYMTAB_SHNDX section
+    ELF_File &m_file;
+    std::pmr::vector< Section > &m_sections;
+};
+
+// Every field is read with its size and byte order known at compile time, so
+// reads are a load (and a byte swap for the other byte order) each.
+template < ElfClass Class, ByteOrder Order >
+struct ELF_LoaderFor : ELF_Loader
 {
-    ELF_Loader( InputBuffer &input )
-        : m_input( input )
+    using Layout = ElfLayout< Class >;
+    using Addr = typename Layout::Addr;
+
+    using ELF_Loader::ELF_Loader;
+
+    template < typename T >
+    T Read( uint64_t offset ) const
+    {
+        return m_input.ReadAt< T, Order >( offset );
+    }
+
+    Addr ReadAddr( uint64_t offset ) const
     {
+        return Read< Addr >( offset );
     }
 
-    void LoadFileHeader()
+    void LoadFileHeader() override
     {
         ASSERT( m_input.U8At( 0 ) == 0x7F );
         ASSERT( m_input.U8At( 1 ) == 'E' );
         ASSERT( m_input.U8At( 2 ) == 'L' );
         ASSERT( m_input.U8At( 3 ) == 'F' );
 
-        ASSERT( m_input.U8At( 4 ) == 2 ); // 64-bit
-        ASSERT( m_input.U8At( 5 ) == 1 ); // Little-Endian
+        // Class and byte order at 4 and 5 were checked to pick the loader
         ASSERT( m_input.U8At( 6 ) == 1 ); // ELF version 1
         ASSERT( m_input.U8At( 7 ) == 0 || m_input.U8At( 7 ) == 3 ); // Not sure why this is 0
         ASSERT( m_input.U8At( 8 ) == 0 ); // Unused
@@ -127,50 +157,99 @@ struct ELF_Loader
             ASSERT( m_input.U8At( i ) == 0 ); // Force read these bytes ...
         }
 
-        ASSERT( m_input.U16At( 0x10 ) == 1 ); // ET_REL (relocatable file)
-        ASSERT( m_input.U16At( 0x12 ) == 0x3E ); // x86-64
+        ASSERT( Read< uint16_t >( 0x10 ) == 1 ); // ET_REL (relocatable file)
+        m_file.m_machine = static_cast< Machine >( Read< uint16_t >( 0x12 ) );
 
-        ASSERT( m_input.U32At( 0x14 ) == 1 ); // ELF v1
+        ASSERT( Read< uint32_t >( 0x14 ) == 1 ); // ELF v1
 
-        ASSERT( m_input.U64At( 0x18 ) == 0 ); // Entry point offset
-        ASSERT( m_input.U64At( 0x20 ) == 0 ); // Program header offset
+        ASSERT( ReadAddr( Layout::E_Entry ) == 0 ); // Entry point offset
+        ASSERT( ReadAddr( Layout::E_PhOff ) == 0 ); // Program header offset
 
-        m_section_header_offset = m_input.U64At( 0x28 );
-        ASSERT( m_input.U32At( 0x30 ) == 0 ); // Flags
+        m_section_header_offset = ReadAddr( Layout::E_ShOff );
+        Read< uint32_t >( Layout::E_Flags ); // Machine specific, e.g. the EABI version on ARM
 
-        ASSERT( m_input.U16At( 0x34 ) == 64 ); // ELF Header size
-        ASSERT( m_input.U16At( 0x36 ) == 0 ); // Size of program header
-        ASSERT( m_input.U16At( 0x38 ) == 0 ); // program header num entries
+        ASSERT( Read< uint16_t >( Layout::E_EhSize ) == Layout::EhdrSize ); // ELF Header size
+        ASSERT( Read< uint16_t >( Layout::E_PhEntSize ) == 0 ); // Size of program header
+        ASSERT( Read< uint16_t >( Layout::E_PhNum ) == 0 ); // program header num entries
 
-        m_section_header_entry_size = m_input.U16At( 0x3A );
-        m_section_header_num_entries = m_input.U16At( 0x3C );
-        m_section_names_header_index = m_input.U16At( 0x3E );
+        m_section_header_entry_size = Read< uint16_t >( Layout::E_ShEntSize );
+        m_section_header_num_entries = Read< uint16_t >( Layout::E_ShNum );
+        m_section_names_header_index = Read< uint16_t >( Layout::E_ShStrNdx );
+
+        // Extended numbering, the values that don't fit are in the null
+        // section header
+        if ( m_section_header_num_entries == 0 && m_section_header_offset != 0 )
+        {
+            m_section_header_num_entries = ReadAddr( m_section_header_offset + Layout::Sh_Size );
+        }
+        if ( m_section_names_header_index == SHN_XINDEX )
+        {
+            m_section_names_header_index = Read< uint32_t >( m_section_header_offset + Layout::Sh_Link );
+        }
+        if ( m_section_header_num_entries != 0 )
+        {
+            const uint64_t file_size = m_input.contents.size();
+            ASSERT( m_section_header_entry_size >= Layout::ShdrSize );
+            ASSERT( m_section_header_offset <= file_size );
+            ASSERT( m_section_header_num_entries <= ( file_size - m_section_header_offset ) / m_section_header_entry_size );
+        }
+        ASSERT( m_section_names_header_index < m_section_header_num_entries );
     }
 
-    void LoadSectionHeaders()
+    void LoadSectionHeaders() override
     {
         uint64_t shstrtab_header_offset = m_section_header_offset + m_section_header_entry_size * m_section_names_header_index;
-        uint64_t shstrtab_offset = m_input.U64At( shstrtab_header_offset + 0x18 );
-        uint64_t shstrtab_len = m_input.U64At( shstrtab_header_offset + 0x20 );
-        StringTable shstrtab = LoadStringTable( m_input, shstrtab_offset, shstrtab_len );
+        uint64_t shstrtab_offset = ReadAddr( shstrtab_header_offset + Layout::Sh_Offset );
+        uint64_t shstrtab_len = ReadAddr( shstrtab_header_offset + Layout::Sh_Size );
+        StringTable shstrtab = LoadStringTable( m_input, std::pmr::get_default_resource(), shstrtab_offset, shstrtab_len );
 
-        m_sections.resize( m_section_header_num_entries );
+        m_sections.reserve( m_section_header_num_entries );
         m_section_loading.resize( m_section_header_num_entries, false );
+        m_section_loaded.resize( m_section_header_num_entries, false );
 
-        for ( int i = 0; i < m_section_header_num_entries; ++i )
+        for ( uint64_t i = 0; i < m_section_header_num_entries; ++i )
         {
-            m_sections[ i ].m_header = LoadSectionHeader( m_input, shstrtab, m_section_header_offset + m_section_header_entry_size * i );
+            m_sections.emplace_back( m_mr );
+            m_sections[ i ].m_header = LoadSectionHeader( shstrtab, m_section_header_offset + m_section_header_entry_size * i );
+
+            if ( m_sections[ i ].m_header.m_type == SectionType::SHT_SYMTAB_SHNDX )
+            {
+                m_symtab_shndx[ m_sections[ i ].m_header.m_asso_idx ] = i;
+            }
         }
     }
 
-    void LoadSections()
+    SectionHeader LoadSectionHeader( const StringTable &shstrtab, uint64_t offset )
     {
-        // Load actual section data
-        // TODO recursively load dependent sections first
-        for ( size_t i = 1; i < m_sections.size(); ++i )
-        {
-            LoadSection( i );
-        }
+        SectionHeader res( m_mr );
+        res.m_name = shstrtab.StringAtOffset( Read< uint32_t >( offset + Layout::Sh_Name ) );
+        res.m_type = static_cast< SectionType >( Read< uint32_t >( offset + Layout::Sh_Type ) );
+        res.m_attrs      = SectionFlags( ReadAddr( offset + Layout::Sh_Flags ) );
+        res.m_address    = ReadAddr( offset + Layout::Sh_Addr );
+        res.m_offset     = ReadAddr( offset + Layout::Sh_Offset );
+        res.m_size       = ReadAddr( offset + Layout::Sh_Size );
+        res.m_asso_idx   = Read< uint32_t >( offset + Layout::Sh_Link );
+        res.m_info       = Read< uint32_t >( offset + Layout::Sh_Info );
+        res.m_addr_align = ReadAddr( offset + Layout::Sh_AddrAlign );
+        res.m_ent_size   = ReadAddr( offset + Layout::Sh_EntSize );
+        return res;
+    }
+
+    Symbol LoadSymbol( const StringTable &strtab, uint64_t offset )
+    {
+        Symbol res( m_mr );
+
+        res.m_name = strtab.StringAtOffset( Read< uint32_t >( offset + Layout::St_Name ) );
+        uint8_t info = Read< uint8_t >( offset + Layout::St_Info );
+        res.m_binding = static_cast< SymbolBinding >( info >> 4 );
+        res.m_type = static_cast< SymbolType >( info & 15 );
+        res.m_visibility = static_cast< SymbolVisibility >( Read< uint8_t >( offset + Layout::St_Other ) );
+        uint16_t shndx = Read< uint16_t >( offset + Layout::St_Shndx );
+        res.m_section_idx = shndx >= SHN_LORESERVE ? ReservedSectionIndex( shndx ) : shndx;
+        res.m_value = ReadAddr( offset + Layout::St_Value );
+        res.m_size = ReadAddr( offset + Layout::St_Size );
+
+        return res;
     }
 
     const Section& GetSection( size_t idx )
@@ -179,30 +258,40 @@ struct ELF_Loader
         return m_sections[ idx ];
     }
 
-    void LoadSection( size_t idx )
+    void LoadSection( size_t idx ) override
     {
         ASSERT( m_section_loading[ idx ] == false );
 
         m_section_loading[ idx ] = true;
         auto sg = RunAtExit( [ this, idx ](){ this->m_section_loading[ idx ] = false; } );
 
-        if ( ! std::holds_alternative< std::monostate >( m_sections[ idx ].m_var ) )
+        if ( m_section_loaded[ idx ] )
         {
             return;
         }
+        m_section_loaded[ idx ] = true;
+        m_loaded_sections.push_back( idx );
 
         const SectionHeader &sh = m_sections[ idx ].m_header;
+        stats::ScopedPhase phase( "load_section", sh.m_name, sh.m_size );
+
+        if ( ( sh.m_attrs & SectionFlags::SHF_COMPRESSED ) && sh.m_type != SectionType::SHT_NOBITS )
+        {
+            LoadCompressedSection( idx );
+            return;
+        }
 
-        switch ( sh.m_type )
+        // Unwind info is laid out like any other data
+        switch ( sh.m_type == SHT_X86_64_UNWIND ? SectionType::SHT_PROGBITS : sh.m_type )
         {
         case SectionType::SHT_STRTAB:
         {
-            m_sections[ idx ].m_var = LoadStringTable( m_input, sh.m_offset, sh.m_size );
+            m_sections[ idx ].m_var = LoadStringTable( m_input, m_mr, sh.m_offset, sh.m_size );
             break;
         }
         case SectionType::SHT_SYMTAB:
         {
-            ASSERT( sh.m_ent_size == 24 );
+            ASSERT( sh.m_ent_size == Layout::SymSize );
 
             // Get strtab used
             const StringTable &strtab = [ this, &sh ]() -> const StringTable&
@@ -212,103 +301,272 @@ struct ELF_Loader
                 return std::get< StringTable >( s.m_var );
             }();
 
-            SymbolTable &symtab = m_sections[ idx ].m_var.emplace< SymbolTable >();
+            SymbolTable &symtab = m_sections[ idx ].m_var.emplace< SymbolTable >( m_mr );
 
             symtab.m_symbols.reserve( sh.m_size / sh.m_ent_size );
 
-            for ( uint64_t i = 0; i * 24 < sh.m_size; ++i )
+            for ( uint64_t i = 0; i * Layout::SymSize < sh.m_size; ++i )
             {
-                symtab.m_symbols.emplace_back( LoadSymbol( m_input, strtab, sh.m_offset + 24 * i ) );
+                symtab.m_symbols.emplace_back( LoadSymbol( strtab, sh.m_offset + Layout::SymSize * i ) );
+            }
+
+            // Indices that don't fit in 16 bits are in the SHT_SYMTAB_SHNDX section
+            auto shndx_it = m_symtab_shndx.find( idx );
+            if ( shndx_it != m_symtab_shndx.end() )
+            {
+                const Section &shndx = GetSection( shndx_it->second );
+                ASSERT( std::holds_alternative< SymbolSectionIndices >( shndx.m_var ) );
+                const auto &indices = std::get< SymbolSectionIndices >( shndx.m_var ).m_indices;
+                ASSERT( indices.size() == symtab.m_symbols.size() );
+
+                for ( size_t i = 0; i < indices.size(); ++i )
+                {
+                    if ( symtab.m_symbols[ i ].m_section_idx == ReservedSectionIndex( SHN_XINDEX ) )
+                    {
+                        symtab.m_symbols[ i ].m_section_idx = indices[ i ];
+                    }
+                }
             }
 
             break;
         }
         case SectionType::SHT_RELA:
         {
-            ASSERT( sh.m_ent_size == 24 );
-            ASSERT( sh.m_size % 24 == 0 );
-
-            RelocationEntries &entries = m_sections[ idx ].m_var.emplace< RelocationEntries >();
-            entries.m_entries.resize( sh.m_size / 24 );
-
-            for ( uint64_t i = 0; sh.m_offset + 24 * i < sh.m_offset + sh.m_size; ++i )
+            LoadRelocations( idx, true );
+            break;
+        }
+        case SectionType::SHT_REL:
+        {
+            LoadRelocations( idx, false );
+            break;
+        }
+        case SectionType::SHT_SYMTAB_SHNDX:
+        {
+            ASSERT( sh.m_size % 4 == 0 );
+            auto &s = m_sections[ idx ].m_var.emplace< SymbolSectionIndices >( m_mr );
+            s.m_indices.resize( sh.m_size / 4 );
+            for ( size_t i = 0; i < s.m_indices.size(); ++i )
             {
-                uint64_t ent_offset = sh.m_offset + 24 * i;
-
-                entries.m_entries[ i ].m_offset = m_input.U64At( ent_offset + 0x00 );
-                entries.m_entries[ i ].m_type   = static_cast< X64RelocationType >( m_input.U32At( ent_offset + 0x08 ) );
-                entries.m_entries[ i ].m_symbol = m_input.U32At( ent_offset + 0x0c );
-                entries.m_entries[ i ].m_addend = m_input.U64At( ent_offset + 0x10 );
+                s.m_indices[ i ] = Read< uint32_t >( sh.m_offset + 4 * i );
             }
             break;
         }
         case SectionType::SHT_GROUP:
         {
             ASSERT( sh.m_size % 4 == 0 );
-            GroupSection &group = m_sections[ idx ].m_var.emplace< GroupSection >();
+            GroupSection &group = m_sections[ idx ].m_var.emplace< GroupSection >( m_mr );
 
-            group.m_flags = static_cast< GroupHandling >( m_input.U32At( sh.m_offset ) );
+            group.m_flags = static_cast< GroupHandling >( Read< uint32_t >( sh.m_offset ) );
 
             uint64_t it = sh.m_offset + 4;
             uint64_t end = sh.m_offset + sh.m_size;
 
             for ( ; it != end; it += 4 )
             {
-                group.m_section_indices.push_back( m_input.U32At( it ) );
+                group.m_section_indices.push_back( Read< uint32_t >( it ) );
             }
             break;
         }
         case SectionType::SHT_NOBITS:
         {
-            auto &s = m_sections[ idx ].m_var.emplace< NoBitsSection >();
-            s.m_data = m_input.StringViewAt( sh.m_offset, sh.m_size );
+            auto &s = m_sections[ idx ].m_var.emplace< NoBitsSection >( m_mr );
+            if ( m_load_data )
+            {
+                s.m_data = m_input.StringViewAt( sh.m_offset, sh.m_size );
+            }
             break;
         }
         case SectionType::SHT_INIT_ARRAY:
         {
-            auto &s = m_sections[ idx ].m_var.emplace< InitArraySection >();
-            s.m_data = m_input.StringViewAt( sh.m_offset, sh.m_size );
+            auto &s = m_sections[ idx ].m_var.emplace< InitArraySection >( m_mr );
+            if ( m_load_data )
+            {
+                s.m_data = m_input.StringViewAt( sh.m_offset, sh.m_size );
+            }
             break;
         }
         case SectionType::SHT_PROGBITS:
         {
-            auto &s = m_sections[ idx ].m_var.emplace< ProgBitsSection >();
-            s.m_data = m_input.StringViewAt( sh.m_offset, sh.m_size );
+            auto &s = m_sections[ idx ].m_var.emplace< ProgBitsSection >( m_mr );
+            if ( m_load_data )
+            {
+                s.m_data = m_input.StringViewAt( sh.m_offset, sh.m_size );
+            }
             s.m_is_executable = ( sh.m_attrs & SectionFlags::SHF_EXECINSTR );
             break;
         }
         default:
-            std::cerr << "Skipping unhandled section of type " << sh.m_type << "\n";
+            std::cerr << fmt::format( "Skipping unhandled section of type {}\n", sh.m_type );
         }
     }
 
-    InputBuffer &m_input;
+    // SHT_REL leaves the addends in the contents being relocated
+    void LoadRelocations( size_t idx, bool with_addends )
+    {
+        const SectionHeader &sh = m_sections[ idx ].m_header;
+        const uint64_t ent_size = with_addends ? Layout::RelaSize : Layout::RelSize;
+        ASSERT( sh.m_ent_size == ent_size );
+        ASSERT( sh.m_size % ent_size == 0 );
 
-    uint64_t m_section_header_offset;
-    uint16_t m_section_header_entry_size;
-    uint16_t m_section_header_num_entries;
-    uint16_t m_section_names_header_index;
+        RelocationEntries &entries = m_sections[ idx ].m_var.emplace< RelocationEntries >( m_mr );
+        entries.m_has_addends = with_addends;
+        entries.m_entries.resize( sh.m_size / ent_size );
 
-    std::vector< bool > m_section_loading;
-    std::vector< Section > m_sections;
+        for ( uint64_t i = 0; i < entries.m_entries.size(); ++i )
+        {
+            uint64_t ent_offset = sh.m_offset + ent_size * i;
+            Addr info = ReadAddr( ent_offset + Layout::R_Info );
+
+            RelocationEntry &e = entries.m_entries[ i ];
+            e.m_offset = ReadAddr( ent_offset + Layout::R_Offset );
+            e.m_type   = static_cast< X64RelocationType >( Layout::RelocationType( info ) );
+            e.m_symbol = Layout::RelocationSymbol( info );
+            e.m_addend = with_addends ? static_cast< std::make_signed_t< Addr > >( ReadAddr( ent_offset + Layout::R_Addend ) ) : 0;
+        }
+    }
+
+    // Elf_Chdr followed by the compressed contents
+    void LoadCompressedSection( size_t idx )
+    {
+        const SectionHeader &sh = m_sections[ idx ].m_header;
+        ASSERT( sh.m_size >= Layout::ChdrSize );
+
+        auto &s = m_sections[ idx ].m_var.emplace< CompressedSection >( m_mr );
+        s.m_section_type = sh.m_type;
+        s.m_compression = static_cast< CompressionType >( Read< uint32_t >( sh.m_offset ) );
+        if constexpr ( Class == ElfClass::ELF64 )
+        {
+            Read< uint32_t >( sh.m_offset + 0x04 ); // Reserved
+        }
+        s.m_size = ReadAddr( sh.m_offset + Layout::Ch_Size );
+        s.m_addr_align = ReadAddr( sh.m_offset + Layout::Ch_AddrAlign );
+        if ( m_load_data )
+        {
+            s.m_payload = m_input.StringViewAt( sh.m_offset + Layout::ChdrSize, sh.m_size - Layout::ChdrSize );
+        }
+    }
 };
 
-ELF_File ELF_File::LoadFrom( InputBuffer &input )
+// The class and byte order are read once from e_ident, everything after is
+// loaded by the loader for them
+static std::unique_ptr< ELF_Loader > CreateLoader( InputBuffer &input, ELF_File &file )
+{
+    const uint8_t elf_class = input.U8At( 4 );
+    const uint8_t byte_order = input.U8At( 5 );
+    ASSERT( elf_class == 1 || elf_class == 2 ); // 32 or 64-bit
+    ASSERT( byte_order == 1 || byte_order == 2 ); // Little or big endian
+
+    file.m_class = elf_class == 1 ? ElfClass::ELF32 : ElfClass::ELF64;
+    file.m_byte_order = byte_order == 1 ? ByteOrder::Little : ByteOrder::Big;
+
+    switch ( elf_class * 2 + byte_order )
+    {
+    case 1 * 2 + 1: return std::make_unique< ELF_LoaderFor< ElfClass::ELF32, ByteOrder::Little > >( input, file );
+    case 1 * 2 + 2: return std::make_unique< ELF_LoaderFor< ElfClass::ELF32, ByteOrder::Big > >( input, file );
+    case 2 * 2 + 1: return std::make_unique< ELF_LoaderFor< ElfClass::ELF64, ByteOrder::Little > >( input, file );
+    default:        return std::make_unique< ELF_LoaderFor< ElfClass::ELF64, ByteOrder::Big > >( input, file );
+    }
+}
+
+ELF_File::ELF_File( std::unique_ptr< std::pmr::memory_resource > arena )
+    : m_arena( std::move( arena ) )
+    , m_sections( m_arena.get() )
 {
-    ELF_Loader loader( input );
+}
 
-    loader.LoadFileHeader();
-    loader.LoadSectionHeaders();
-    loader.LoadSections();
+static ELF_File Load( InputBuffer &input, size_t arena_size, bool load_data )
+{
+    ELF_File res( std::make_unique< std::pmr::monotonic_buffer_resource >( std::max< size_t >( arena_size, 4096 ) ) );
+
+    std::unique_ptr< ELF_Loader > loader = CreateLoader( input, res );
+    loader->m_load_data = load_data;
+
+    {
+        stats::ScopedPhase phase( "parse_headers" );
+        loader->LoadFileHeader();
+        loader->LoadSectionHeaders();
+    }
+    loader->LoadSections();
 
-    ELF_File res;
-    res.m_sections = std::move( loader.m_sections );
     return res;
 }
 
+ELF_File ELF_File::LoadFrom( InputBuffer &input )
+{
+    // The model is usually about as large as the input, start with an arena
+    // that size to avoid growing it a few times while loading.
+    return Load( input, input.contents.size(), true );
+}
+
+ELF_File ELF_File::LoadMetadataFrom( InputBuffer &input )
+{
+    // Only tables are loaded, which is a fraction of the input
+    return Load( input, input.contents.size() / 8, false );
+}
+
+SectionLoader::SectionLoader( InputBuffer &input, std::unique_ptr< std::pmr::memory_resource > mr )
+    : m_file( std::move( mr ) )
+    , m_loader( CreateLoader( input, m_file ) )
+{
+    stats::ScopedPhase phase( "parse_headers" );
+    m_loader->LoadFileHeader();
+    m_loader->LoadSectionHeaders();
+}
+
+SectionLoader::~SectionLoader() = default;
+
+void SectionLoader::Load( size_t idx )
+{
+    ASSERT( idx < m_file.m_sections.size() );
+    m_loader->LoadSection( idx );
+}
+
+void SectionLoader::Release( size_t idx )
+{
+    if ( !m_loader->m_section_loaded[ idx ] )
+    {
+        return;
+    }
+
+    m_file.m_sections[ idx ].m_var.emplace< std::monostate >();
+    m_loader->m_section_loaded[ idx ] = false;
+
+    auto &loaded = m_loader->m_loaded_sections;
+    loaded.erase( std::find( loaded.begin(), loaded.end(), idx ) );
+}
+
+const std::vector< uint32_t >& SectionLoader::LoadedSections() const
+{
+    return m_loader->m_loaded_sections;
+}
+
 std::string_view StringTable::StringAtOffset( uint64_t string_offset ) const
 {
     return m_str.data() + string_offset;
 }
 
+std::string_view CompressedSection::Data() const
+{
+    Decompressed &d = *m_decompressed;
+    std::lock_guard< std::mutex > lock( d.m_mutex );
+    if ( !d.m_done )
+    {
+        try
+        {
+            d.m_data = Decompress( m_compression, m_payload, m_size );
+        }
+        catch ( const std::exception &e )
+        {
+            d.m_error = e.what();
+        }
+        d.m_done = true;
+    }
+
+    if ( !d.m_error.empty() )
+    {
+        throw std::runtime_error( d.m_error );
+    }
+    return d.m_data;
+}
+
 } // namespace elfexplorer
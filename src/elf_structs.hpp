@@ -22,8 +22,12 @@
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
@@ -33,27 +37,94 @@
 
 namespace elfexplorer {
 
+// The parsed model is allocated from a per file arena (see `ELF_File`), so
+// every type owning memory takes the memory resource to allocate from.
+
 struct StringTable
 {
+    explicit StringTable( std::pmr::memory_resource *mr )
+        : m_str( mr )
+    {
+    }
+
     std::string_view StringAtOffset( uint64_t string_offset ) const;
 
-    std::string m_str;
+    std::pmr::string m_str;
 };
 
+// Values of `Symbol::m_section_idx` that are not section indices. With
+// extended numbering real indices reach the reserved 16 bit range too
+// (SHN_LORESERVE and up), so reserved values are moved above any index,
+// e.g. SHN_ABS ( 0xfff1 ) is `ReservedSectionIndex( 0xfff1 )`.
+constexpr uint32_t ReservedSectionIndexBase = 0xffff0000;
+
+constexpr uint32_t ReservedSectionIndex( uint16_t shndx )
+{
+    return ReservedSectionIndexBase + shndx;
+}
+
+// The index as written in the symbol, e.g. 0xfff1 for SHN_ABS
+constexpr uint32_t FileSectionIndex( uint32_t section_idx )
+{
+    return section_idx >= ReservedSectionIndexBase ? section_idx - ReservedSectionIndexBase : section_idx;
+}
+
 struct Symbol
 {
-    std::string m_name;
+    explicit Symbol( std::pmr::memory_resource *mr )
+        : m_name( mr )
+    {
+    }
+
+    std::pmr::string m_name;
     SymbolBinding m_binding;
     SymbolType m_type;
     SymbolVisibility m_visibility;
-    uint16_t m_section_idx;
+    uint32_t m_section_idx; // See `ReservedSectionIndex`
     uint64_t m_value;
     uint64_t m_size;
 };
 
+// Contents of a SHF_COMPRESSED section. Only the compressed payload is kept
+// when loading, it is decompressed the first time the contents are used and
+// kept for the lifetime of the model.
+struct CompressedSection
+{
+    explicit CompressedSection( std::pmr::memory_resource *mr )
+        : m_payload( mr )
+        , m_decompressed( std::make_shared< Decompressed >() )
+    {
+    }
+
+    // Decompresses on the first call, may be called from several threads.
+    // Throws if the payload can't be decompressed, on every call.
+    std::string_view Data() const;
+
+    SectionType m_section_type;
+    CompressionType m_compression;
+    uint64_t m_size; // Decompressed
+    uint64_t m_addr_align;
+    std::pmr::string m_payload; // Empty if loaded without data
+
+private:
+    struct Decompressed
+    {
+        std::mutex m_mutex;
+        bool m_done = false;
+        std::string m_data;
+        std::string m_error;
+    };
+    std::shared_ptr< Decompressed > m_decompressed;
+};
+
 struct SectionHeader
 {
-    std::string m_name;
+    explicit SectionHeader( std::pmr::memory_resource *mr )
+        : m_name( mr )
+    {
+    }
+
+    std::pmr::string m_name;
     SectionType m_type;
     SectionFlags m_attrs;
     uint64_t m_address;
@@ -67,7 +138,12 @@ struct SectionHeader
 
 struct SymbolTable
 {
-    std::vector< Symbol > m_symbols;
+    explicit SymbolTable( std::pmr::memory_resource *mr )
+        : m_symbols( mr )
+    {
+    }
+
+    std::pmr::vector< Symbol > m_symbols;
 };
 
 struct RelocationEntry
@@ -80,33 +156,78 @@ struct RelocationEntry
 
 struct RelocationEntries
 {
-    std::vector< RelocationEntry > m_entries;
+    explicit RelocationEntries( std::pmr::memory_resource *mr )
+        : m_entries( mr )
+    {
+    }
+
+    bool m_has_addends = true; // SHT_REL keeps them in the relocated contents, they are 0 here
+
+    std::pmr::vector< RelocationEntry > m_entries;
 };
 
 struct GroupSection
 {
+    explicit GroupSection( std::pmr::memory_resource *mr )
+        : m_section_indices( mr )
+    {
+    }
+
     GroupHandling m_flags;
-    std::vector< uint32_t > m_section_indices;
+    std::pmr::vector< uint32_t > m_section_indices;
+};
+
+// SHT_SYMTAB_SHNDX, section indices of the symbols in the linked symbol table
+// that don't fit in their 16 bit field. These are already resolved in the
+// symbols.
+struct SymbolSectionIndices
+{
+    explicit SymbolSectionIndices( std::pmr::memory_resource *mr )
+        : m_indices( mr )
+    {
+    }
+
+    std::pmr::vector< uint32_t > m_indices;
 };
 
 struct NoBitsSection
 {
-    std::string m_data;
+    explicit NoBitsSection( std::pmr::memory_resource *mr )
+        : m_data( mr )
+    {
+    }
+
+    std::pmr::string m_data;
 };
 
 struct InitArraySection
 {
-    std::string m_data;
+    explicit InitArraySection( std::pmr::memory_resource *mr )
+        : m_data( mr )
+    {
+    }
+
+    std::pmr::string m_data;
 };
 
 struct ProgBitsSection
 {
-    std::string m_data;
+    explicit ProgBitsSection( std::pmr::memory_resource *mr )
+        : m_data( mr )
+    {
+    }
+
+    std::pmr::string m_data;
     bool m_is_executable = false; // TODO this can be used from section header
 };
 
 struct Section
 {
+    explicit Section( std::pmr::memory_resource *mr )
+        : m_header( mr )
+    {
+    }
+
     SectionHeader m_header;
 
     std::variant< std::monostate
@@ -117,14 +238,73 @@ struct Section
                 , NoBitsSection
                 , InitArraySection
                 , ProgBitsSection
+                , CompressedSection
+                , SymbolSectionIndices
     > m_var;
 };
 
+enum class ElfClass
+{
+    ELF32,
+    ELF64,
+};
+
 struct ELF_File
 {
     static ELF_File LoadFrom( InputBuffer & );
 
-    std::vector< Section > m_sections;
+    // Loads headers, symbols, relocations and groups, but leaves `m_data` of
+    // data sections empty. Their contents can be used from the input.
+    static ELF_File LoadMetadataFrom( InputBuffer & );
+
+    explicit ELF_File( std::unique_ptr< std::pmr::memory_resource > arena );
+
+    // Moving the containers to another arena would copy them, so the model
+    // can only be move constructed.
+    ELF_File( ELF_File && ) = default;
+    ELF_File& operator=( ELF_File && ) = delete;
+
+    // Loading is bump pointer allocation from the arena, and everything is
+    // released at once when the file is destroyed (`SectionLoader` uses one
+    // that frees as sections are released). Declared first so it outlives
+    // the containers allocated from it.
+    std::unique_ptr< std::pmr::memory_resource > m_arena;
+
+    ElfClass m_class = ElfClass::ELF64;
+    ByteOrder m_byte_order = ByteOrder::Little;
+    Machine m_machine = Machine::EM_X86_64;
+
+    std::pmr::vector< Section > m_sections;
+};
+
+struct ELF_Loader;
+
+// Loads the sections of a file one at a time and drops them again, for files
+// larger than memory. Section headers are loaded up front. A section is
+// loaded along with the sections it is read from, e.g. the string table of a
+// symbol table, which stay loaded until released too.
+class SectionLoader
+{
+public:
+    // `mr` should free memory on deallocation for `Release` to give it back
+    SectionLoader( InputBuffer &input, std::unique_ptr< std::pmr::memory_resource > mr );
+    ~SectionLoader();
+
+    const ELF_File& File() const { return m_file; }
+
+    // Does nothing if the section is already loaded
+    void Load( size_t idx );
+
+    // Takes the contents of the section out of the model, only its header
+    // stays. It is loaded again if needed later.
+    void Release( size_t idx );
+
+    // Sections with contents in the model, in the order they were loaded
+    const std::vector< uint32_t >& LoadedSections() const;
+
+private:
+    ELF_File m_file;
+    std::unique_ptr< ELF_Loader > m_loader;
 };
 
 } // namspace elfexplorer
@@ -0,0 +1,290 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#include "function_index.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace elfexplorer {
+
+namespace {
+
+const ProgBitsSection* CodeSection( const ELF_File &elf, size_t idx )
+{
+    if ( idx >= elf.m_sections.size() )
+    {
+        return nullptr;
+    }
+    const ProgBitsSection *code = std::get_if< ProgBitsSection >( &elf.m_sections[ idx ].m_var );
+    return code && code->m_is_executable ? code : nullptr;
+}
+
+template < typename It >
+void SortByOffset( It first, It last )
+{
+    auto by_offset = []( const auto &a, const auto &b ) { return a.m_offset < b.m_offset; };
+
+    // Usually written in order already
+    if ( !std::is_sorted( first, last, by_offset ) )
+    {
+        std::stable_sort( first, last, by_offset );
+    }
+}
+
+template < typename T >
+FunctionIndex::Slice< T > OffsetRange( const T *first, const T *last, uint64_t begin, uint64_t end )
+{
+    auto less = []( const T &a, uint64_t offset ) { return a.m_offset < offset; };
+    first = std::lower_bound( first, last, begin, less );
+    return { first, std::lower_bound( first, last, end, less ) };
+}
+
+template < typename T >
+FunctionIndex::Slice< T > OffsetRange( const std::vector< T > &v, uint64_t begin, uint64_t end )
+{
+    return OffsetRange( v.data(), v.data() + v.size(), begin, end );
+}
+
+// Turns counts into the start of each range, with the total at the end
+void CountsToStarts( std::vector< uint32_t > &starts )
+{
+    starts.push_back( 0 );
+    std::exclusive_scan( starts.begin(), starts.end(), starts.begin(), uint32_t( 0 ) );
+}
+
+} // namespace
+
+FunctionIndex::FunctionIndex( const ELF_File &elf )
+    : m_elf( elf )
+{
+}
+
+std::vector< FunctionIndex::Function > FunctionIndex::Find( std::string_view name ) const
+{
+    std::vector< Function > res;
+    for ( size_t idx = 0; idx < m_elf.m_sections.size(); ++idx )
+    {
+        const SymbolTable *symtab = std::get_if< SymbolTable >( &m_elf.m_sections[ idx ].m_var );
+        if ( !symtab )
+        {
+            continue;
+        }
+        for ( size_t i = 0; i < symtab->m_symbols.size(); ++i )
+        {
+            if ( symtab->m_symbols[ i ].m_name != name )
+            {
+                continue;
+            }
+            if ( auto fn = ForSymbol( idx, i ) )
+            {
+                res.push_back( *fn );
+            }
+        }
+    }
+    return res;
+}
+
+std::optional< FunctionIndex::Function > FunctionIndex::ForSymbol( size_t symtab_idx, size_t symbol_idx ) const
+{
+    if ( symtab_idx >= m_elf.m_sections.size() )
+    {
+        return std::nullopt;
+    }
+    const SymbolTable *symtab = std::get_if< SymbolTable >( &m_elf.m_sections[ symtab_idx ].m_var );
+    if ( !symtab || symbol_idx >= symtab->m_symbols.size() )
+    {
+        return std::nullopt;
+    }
+
+    const Symbol &s = symtab->m_symbols[ symbol_idx ];
+    const ProgBitsSection *code = CodeSection( m_elf, s.m_section_idx );
+    if ( s.m_type != SymbolType::STT_FUNC || s.m_size == 0 || !code
+      || s.m_value > code->m_data.size() || s.m_size > code->m_data.size() - s.m_value )
+    {
+        return std::nullopt;
+    }
+
+    return Function{ s.m_section_idx, symtab_idx, symbol_idx, s.m_value, s.m_value + s.m_size };
+}
+
+FunctionIndex::Slice< FunctionIndex::Relocation > FunctionIndex::Relocations( size_t section_idx, uint64_t begin, uint64_t end ) const
+{
+    return OffsetRange( SectionRelocations( section_idx ), begin, end );
+}
+
+FunctionIndex::Slice< FunctionIndex::Label > FunctionIndex::Labels( size_t section_idx, uint64_t begin, uint64_t end ) const
+{
+    const Buckets &buckets = AllSections();
+    if ( section_idx + 1 >= buckets.m_label_starts.size() )
+    {
+        return { nullptr, nullptr };
+    }
+    const Label *labels = buckets.m_labels.data();
+    return OffsetRange( labels + buckets.m_label_starts[ section_idx ], labels + buckets.m_label_starts[ section_idx + 1 ], begin, end );
+}
+
+FunctionIndex::Slice< LineTable::Row > FunctionIndex::SourceLines( size_t section_idx, uint64_t begin, uint64_t end ) const
+{
+    const LineTable *lines = Lines();
+    if ( !lines )
+    {
+        return { nullptr, nullptr };
+    }
+    return OffsetRange( lines->Rows( section_idx ), begin, end );
+}
+
+const LineTable* FunctionIndex::Lines() const
+{
+    std::call_once( m_lines_once, [ this ]
+    {
+        const size_t debug_line_idx = LineTable::FindSection( m_elf.m_sections );
+        if ( debug_line_idx == 0 )
+        {
+            return;
+        }
+        try
+        {
+            m_lines = std::make_unique< const LineTable >( m_elf, debug_line_idx );
+        }
+        catch ( const std::exception & )
+        {
+            // Shown without source lines
+        }
+    } );
+    return m_lines.get();
+}
+
+void FunctionIndex::ReleaseTables( size_t section_idx )
+{
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_relocations.erase( section_idx );
+}
+
+const FunctionIndex::Buckets& FunctionIndex::AllSections() const
+{
+    std::call_once( m_buckets_once, [ this ]
+    {
+        const auto &sections = m_elf.m_sections;
+
+        auto is_label = [ &sections ]( const Symbol &s )
+        {
+            return s.m_section_idx < sections.size() && !s.m_name.empty()
+                && s.m_type != SymbolType::STT_SECTION && s.m_type != SymbolType::STT_FILE;
+        };
+
+        // Counted first, then filled in through copies of the starts
+        auto res = std::make_unique< Buckets >();
+        res->m_label_starts.assign( sections.size(), 0 );
+        res->m_reloc_starts.assign( sections.size(), 0 );
+        for ( size_t idx = 0; idx < sections.size(); ++idx )
+        {
+            const SectionHeader &sh = sections[ idx ].m_header;
+            if ( const SymbolTable *symtab = std::get_if< SymbolTable >( &sections[ idx ].m_var ) )
+            {
+                for ( const Symbol &s : symtab->m_symbols )
+                {
+                    if ( is_label( s ) )
+                    {
+                        ++res->m_label_starts[ s.m_section_idx ];
+                    }
+                }
+            }
+            if ( ( sh.m_type == SectionType::SHT_RELA || sh.m_type == SectionType::SHT_REL ) && sh.m_info < sections.size() )
+            {
+                ++res->m_reloc_starts[ sh.m_info ];
+            }
+        }
+        CountsToStarts( res->m_label_starts );
+        CountsToStarts( res->m_reloc_starts );
+
+        res->m_labels.resize( res->m_label_starts.back() );
+        res->m_reloc_sections.resize( res->m_reloc_starts.back() );
+        std::vector< uint32_t > label_pos( res->m_label_starts.begin(), res->m_label_starts.end() - 1 );
+        std::vector< uint32_t > reloc_pos( res->m_reloc_starts.begin(), res->m_reloc_starts.end() - 1 );
+        for ( size_t idx = 0; idx < sections.size(); ++idx )
+        {
+            const SectionHeader &sh = sections[ idx ].m_header;
+            if ( const SymbolTable *symtab = std::get_if< SymbolTable >( &sections[ idx ].m_var ) )
+            {
+                for ( size_t i = 0; i < symtab->m_symbols.size(); ++i )
+                {
+                    const Symbol &s = symtab->m_symbols[ i ];
+                    if ( is_label( s ) )
+                    {
+                        res->m_labels[ label_pos[ s.m_section_idx ]++ ] = Label{ s.m_value, uint32_t( idx ), uint32_t( i ) };
+                    }
+                }
+            }
+            if ( ( sh.m_type == SectionType::SHT_RELA || sh.m_type == SectionType::SHT_REL ) && sh.m_info < sections.size() )
+            {
+                res->m_reloc_sections[ reloc_pos[ sh.m_info ]++ ] = uint32_t( idx );
+            }
+        }
+
+        for ( size_t idx = 0; idx < sections.size(); ++idx )
+        {
+            SortByOffset( res->m_labels.begin() + res->m_label_starts[ idx ], res->m_labels.begin() + res->m_label_starts[ idx + 1 ] );
+        }
+
+        m_buckets = std::move( res );
+    } );
+    return *m_buckets;
+}
+
+const std::vector< FunctionIndex::Relocation >& FunctionIndex::SectionRelocations( size_t section_idx ) const
+{
+    const Buckets &buckets = AllSections();
+
+    std::lock_guard< std::mutex > lock( m_mutex );
+
+    std::unique_ptr< const std::vector< Relocation > > &relocations = m_relocations[ section_idx ];
+    if ( relocations )
+    {
+        return *relocations;
+    }
+
+    auto res = std::make_unique< std::vector< Relocation > >();
+    const auto &sections = m_elf.m_sections;
+    if ( section_idx + 1 < buckets.m_reloc_starts.size() )
+    {
+        for ( size_t i = buckets.m_reloc_starts[ section_idx ]; i < buckets.m_reloc_starts[ section_idx + 1 ]; ++i )
+        {
+            const SectionHeader &sh = sections[ buckets.m_reloc_sections[ i ] ].m_header;
+            const RelocationEntries *reloc = std::get_if< RelocationEntries >( &sections[ buckets.m_reloc_sections[ i ] ].m_var );
+            if ( !reloc || sh.m_asso_idx >= sections.size() )
+            {
+                continue;
+            }
+            const SymbolTable *symtab = std::get_if< SymbolTable >( &sections[ sh.m_asso_idx ].m_var );
+            ASSERT( symtab != nullptr || reloc->m_entries.empty() );
+
+            for ( const RelocationEntry &e : reloc->m_entries )
+            {
+                res->push_back( Relocation{ e.m_offset, &e, symtab } );
+            }
+        }
+    }
+    SortByOffset( res->begin(), res->end() );
+
+    relocations = std::move( res );
+    return *relocations;
+}
+
+} // namespace elfexplorer
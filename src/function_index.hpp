@@ -0,0 +1,143 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef ELFEXPLORER__FUNCTION_INDEX_HPP__
+#define ELFEXPLORER__FUNCTION_INDEX_HPP__
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "debug_line.hpp"
+#include "elf_structs.hpp"
+
+namespace elfexplorer {
+
+// Lookup tables for disassembling a single function without decoding the
+// whole section it is in. The symbol table gives where each function starts,
+// which is a point the instruction stream can be decoded from. On first use
+// the labels of all sections are collected in one pass over the symbol
+// tables, bucketed by the section they are defined in, along with the
+// relocation sections applying to each section. The relocations of a section
+// are then collected from its own relocation sections on its first use, so
+// the index stays linear in the number of sections. Both are sorted by
+// offset and found by binary search. Source lines are decoded for all
+// sections at once, when the first are asked for. Thread safe, the model must
+// outlive the index.
+class FunctionIndex
+{
+public:
+    struct Function
+    {
+        size_t m_section_idx; // Section containing the code
+        size_t m_symtab_idx;
+        size_t m_symbol_idx;
+        uint64_t m_begin;
+        uint64_t m_end;
+    };
+
+    struct Relocation
+    {
+        uint64_t m_offset;
+        const RelocationEntry *m_entry;
+        const SymbolTable *m_symtab;
+    };
+
+    // A symbol defined in code, shown as a label before the instruction at
+    // its offset. Kept small, a section can have millions.
+    struct Label
+    {
+        uint64_t m_offset;
+        uint32_t m_symtab_idx;
+        uint32_t m_symbol_idx;
+    };
+
+    template < typename T >
+    struct Slice
+    {
+        const T* begin() const { return m_begin; }
+        const T* end() const { return m_end; }
+
+        const T *m_begin;
+        const T *m_end;
+    };
+
+    explicit FunctionIndex( const ELF_File &elf );
+
+    FunctionIndex( const FunctionIndex & ) = delete;
+    FunctionIndex& operator=( const FunctionIndex & ) = delete;
+
+    // Functions with the given symbol name, there can be more than one e.g.
+    // for static functions of different translation units. Scans the symbol
+    // tables.
+    std::vector< Function > Find( std::string_view name ) const;
+
+    // The function defined by the symbol, nullopt if the symbol is not a
+    // function with a size in an executable section
+    std::optional< Function > ForSymbol( size_t symtab_idx, size_t symbol_idx ) const;
+
+    // Sorted by offset, those within [ begin, end ) of the section. The
+    // symbol tables must be loaded by the first call.
+    Slice< Relocation > Relocations( size_t section_idx, uint64_t begin, uint64_t end ) const;
+    Slice< Label > Labels( size_t section_idx, uint64_t begin, uint64_t end ) const;
+    Slice< LineTable::Row > SourceLines( size_t section_idx, uint64_t begin, uint64_t end ) const;
+
+    // Line info from .debug_line, null if there is none or it can not be
+    // decoded. The sections in `LineTable::Dependencies` must be loaded by
+    // the first call.
+    const LineTable* Lines() const;
+
+    // Drops the relocations collected for the section, which point into its
+    // relocation and symbol table sections. Collected again on the next use,
+    // e.g. after those are loaded again. Labels only hold indices and are
+    // kept.
+    void ReleaseTables( size_t section_idx );
+
+private:
+    // Labels and relocation section indices of all sections, the ones of
+    // section `i` in [ starts[ i ], starts[ i + 1 ] )
+    struct Buckets
+    {
+        std::vector< Label > m_labels; // Sorted by offset within each section
+        std::vector< uint32_t > m_label_starts;
+        std::vector< uint32_t > m_reloc_sections;
+        std::vector< uint32_t > m_reloc_starts;
+    };
+
+    const Buckets& AllSections() const;
+    const std::vector< Relocation >& SectionRelocations( size_t section_idx ) const;
+
+    const ELF_File &m_elf;
+
+    mutable std::once_flag m_buckets_once;
+    mutable std::unique_ptr< const Buckets > m_buckets;
+
+    mutable std::mutex m_mutex;
+    mutable std::unordered_map< size_t, std::unique_ptr< const std::vector< Relocation > > > m_relocations;
+
+    mutable std::once_flag m_lines_once;
+    mutable std::unique_ptr< const LineTable > m_lines;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__FUNCTION_INDEX_HPP__
@@ -0,0 +1,217 @@
+#! /usr/bin/python3
+#
+# Copyright 2019 Mustafa Serdar Sanli
+#
+# This file is part of ELF Explorer.
+#
+# ELF Explorer is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# ELF Explorer is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+# Generates synthetic x86-64 relocatable objects for benchmarking. The layout
+# mimics what gcc emits:
+#
+#   null, .text, .rela.text, .data, .rela.data, [ .rodata.N ]...,
+#   [ .group, .text.grpN ]..., .symtab, .strtab, .shstrtab, section headers
+#
+# .text is filled with small functions calling an external symbol, each call
+# having a relocation. Relocations that do not fit into .text go to .data as
+# R_X86_64_64 entries.
+
+import argparse
+import struct
+
+SHT_PROGBITS = 1
+SHT_SYMTAB   = 2
+SHT_STRTAB   = 3
+SHT_RELA     = 4
+SHT_GROUP    = 17
+SHT_SYMTAB_SHNDX = 18
+
+# Indices from SHN_LORESERVE up don't fit in 16 bit fields, which then hold
+# SHN_XINDEX with the real index stored elsewhere
+SHN_LORESERVE = 0xff00
+SHN_XINDEX    = 0xffff
+
+SHF_WRITE     = 1 << 0
+SHF_ALLOC     = 1 << 1
+SHF_EXECINSTR = 1 << 2
+SHF_INFO_LINK = 1 << 6
+SHF_GROUP     = 1 << 9
+
+STB_LOCAL  = 0
+STB_GLOBAL = 1
+STB_WEAK   = 2
+
+STT_NOTYPE  = 0
+STT_FUNC    = 2
+STT_SECTION = 3
+
+R_X86_64_64    = 1
+R_X86_64_PLT32 = 4
+
+GRP_COMDAT = 1
+
+# push rbp; mov rbp, rsp; call <rel32>; pop rbp; ret; padded to 16 bytes with nops
+FUNCTION_CODE = bytes( [ 0x55, 0x48, 0x89, 0xe5, 0xe8, 0, 0, 0, 0, 0x5d, 0xc3 ] ).ljust( 16, b'\x90' )
+FUNCTION_CALL_OFFSET = 5
+GROUP_FUNCTION_CODE = bytes( [ 0x31, 0xc0, 0xc3 ] ) # xor eax, eax; ret
+
+class StringTable:
+    def __init__( self ):
+        self.data = bytearray( b'\0' )
+        self.offsets = {}
+
+    def add( self, s ):
+        if s not in self.offsets:
+            self.offsets[ s ] = len( self.data )
+            self.data += s.encode() + b'\0'
+        return self.offsets[ s ]
+
+class Section:
+    def __init__( self, name, sh_type, flags = 0, data = b'', link = 0, info = 0, align = 1, entsize = 0 ):
+        self.name = name
+        self.sh_type = sh_type
+        self.flags = flags
+        self.data = data
+        self.link = link
+        self.info = info
+        self.align = align
+        self.entsize = entsize
+
+# Returns the entry and the section index, which goes to the SHT_SYMTAB_SHNDX
+# section if it doesn't fit
+def symbol( name, binding, sym_type, shndx, value = 0, size = 0 ):
+    field = SHN_XINDEX if shndx >= SHN_LORESERVE else shndx
+    return struct.pack( '<IBBHQQ', name, ( binding << 4 ) | sym_type, 0, field, value, size ), shndx
+
+def rela( offset, sym, rel_type, addend ):
+    return struct.pack( '<QQq', offset, ( sym << 32 ) | rel_type, addend )
+
+def generate( args ):
+    num_functions = max( 1, args.code_bytes // len( FUNCTION_CODE ) )
+    num_code_relocs = min( args.relocations, num_functions )
+    num_data_relocs = args.relocations - num_code_relocs
+
+    # Section indices are fixed up front so symbols and groups can refer to them
+    text_idx = 1
+    data_idx = 3
+    first_rodata_idx = 5
+    first_group_idx = first_rodata_idx + args.sections
+    symtab_idx = first_group_idx + 2 * args.groups
+    has_shndx = first_group_idx + 2 * args.groups > SHN_LORESERVE # Group members are referred by symbols
+    shndx_idx = symtab_idx + 1
+    strtab_idx = symtab_idx + 1 + has_shndx
+    shstrtab_idx = strtab_idx + 1
+    num_sections = shstrtab_idx + 1
+
+    strtab = StringTable()
+
+    # Local symbols first, then functions, group signatures and undefined
+    # externals as globals
+    symbols = [ symbol( 0, STB_LOCAL, STT_NOTYPE, 0 ) ]
+    symbols.append( symbol( 0, STB_LOCAL, STT_SECTION, text_idx ) )
+    symbols.append( symbol( 0, STB_LOCAL, STT_SECTION, data_idx ) )
+    num_locals = len( symbols )
+
+    for i in range( num_functions ):
+        symbols.append( symbol( strtab.add( f'bench_fn_{i}' ), STB_GLOBAL, STT_FUNC, text_idx, i * len( FUNCTION_CODE ), 11 ) )
+
+    first_signature_sym = len( symbols )
+    for i in range( args.groups ):
+        symbols.append( symbol( strtab.add( f'_Z14bench_inline_{i}v' ), STB_WEAK, STT_FUNC, first_group_idx + 2 * i + 1, 0, len( GROUP_FUNCTION_CODE ) ) )
+
+    first_extern_sym = len( symbols )
+    num_externs = max( 1, args.symbols - len( symbols ) )
+    for i in range( num_externs ):
+        symbols.append( symbol( strtab.add( f'bench_extern_{i}' ), STB_GLOBAL, STT_NOTYPE, 0 ) )
+
+    text = bytearray( FUNCTION_CODE * num_functions )
+    text += b'\x90' * ( args.code_bytes - len( text ) ) if args.code_bytes > len( text ) else b''
+
+    text_relocs = bytearray()
+    for i in range( num_code_relocs ):
+        sym = first_extern_sym + i % num_externs
+        text_relocs += rela( i * len( FUNCTION_CODE ) + FUNCTION_CALL_OFFSET, sym, R_X86_64_PLT32, -4 )
+
+    data = bytearray( 8 * num_data_relocs )
+    data_relocs = bytearray()
+    for i in range( num_data_relocs ):
+        sym = first_extern_sym + i % num_externs
+        data_relocs += rela( 8 * i, sym, R_X86_64_64, 0 )
+
+    sections = [ None ]
+    sections.append( Section( '.text', SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, text, align = 16 ) )
+    sections.append( Section( '.rela.text', SHT_RELA, SHF_INFO_LINK, text_relocs, link = symtab_idx, info = text_idx, align = 8, entsize = 24 ) )
+    sections.append( Section( '.data', SHT_PROGBITS, SHF_WRITE | SHF_ALLOC, data, align = 8 ) )
+    sections.append( Section( '.rela.data', SHT_RELA, SHF_INFO_LINK, data_relocs, link = symtab_idx, info = data_idx, align = 8, entsize = 24 ) )
+
+    for i in range( args.sections ):
+        sections.append( Section( f'.rodata.bench_{i}', SHT_PROGBITS, SHF_ALLOC, struct.pack( '<QQ', i, i * i ), align = 8 ) )
+
+    for i in range( args.groups ):
+        member_idx = first_group_idx + 2 * i + 1
+        sections.append( Section( '.group', SHT_GROUP, 0, struct.pack( '<II', GRP_COMDAT, member_idx ),
+                                  link = symtab_idx, info = first_signature_sym + i, align = 4, entsize = 4 ) )
+        sections.append( Section( f'.text._Z14bench_inline_{i}v', SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR | SHF_GROUP, GROUP_FUNCTION_CODE ) )
+
+    sections.append( Section( '.symtab', SHT_SYMTAB, 0, b''.join( entry for entry, _ in symbols ), link = strtab_idx, info = num_locals, align = 8, entsize = 24 ) )
+    if has_shndx:
+        shndx = b''.join( struct.pack( '<I', idx if idx >= SHN_LORESERVE else 0 ) for _, idx in symbols )
+        sections.append( Section( '.symtab_shndx', SHT_SYMTAB_SHNDX, 0, shndx, link = symtab_idx, align = 4, entsize = 4 ) )
+    sections.append( Section( '.strtab', SHT_STRTAB, 0, strtab.data ) )
+    shstrtab = StringTable()
+    shstrtab_section = Section( '.shstrtab', SHT_STRTAB, 0 )
+    sections.append( shstrtab_section )
+    assert len( sections ) == num_sections
+
+    names = [ shstrtab.add( s.name ) if s else 0 for s in sections ]
+    shstrtab_section.data = shstrtab.data
+
+    # Lay out section contents after the elf header, followed by the headers
+    out = bytearray( 64 )
+    offsets = [ 0 ]
+    for s in sections[ 1: ]:
+        out += b'\0' * ( -len( out ) % s.align )
+        offsets.append( len( out ) )
+        out += s.data
+
+    out += b'\0' * ( -len( out ) % 8 )
+    section_header_offset = len( out )
+    # The null section holds the section count and string table index if
+    # they don't fit in the elf header
+    e_shnum = num_sections if num_sections < SHN_LORESERVE else 0
+    e_shstrndx = shstrtab_idx if shstrtab_idx < SHN_LORESERVE else SHN_XINDEX
+    out += struct.pack( '<IIQQQQIIQQ', 0, 0, 0, 0, 0, num_sections if e_shnum == 0 else 0, shstrtab_idx if e_shstrndx == SHN_XINDEX else 0, 0, 0, 0 )
+    for s, name, offset in zip( sections[ 1: ], names[ 1: ], offsets[ 1: ] ):
+        out += struct.pack( '<IIQQQQIIQQ', name, s.sh_type, s.flags, 0, offset, len( s.data ), s.link, s.info, s.align, s.entsize )
+
+    e_ident = b'\x7fELF' + bytes( [ 2, 1, 1, 0 ] ) + b'\0' * 8
+    out[ 0:64 ] = e_ident + struct.pack( '<HHIQQQIHHHHHH', 1, 0x3E, 1, 0, 0, section_header_offset, 0, 64, 0, 0, 64, e_shnum, e_shstrndx )
+
+    return out
+
+def main():
+    parser = argparse.ArgumentParser( description = 'Create synthetic object files for benchmarking.' )
+    parser.add_argument( '--out', required = True, help = 'output file name' )
+    parser.add_argument( '--sections', type = int, default = 0, help = 'number of extra data sections' )
+    parser.add_argument( '--symbols', type = int, default = 100, help = 'total number of symbols (at least one per function)' )
+    parser.add_argument( '--relocations', type = int, default = 100, help = 'number of relocations' )
+    parser.add_argument( '--groups', type = int, default = 0, help = 'number of COMDAT group sections' )
+    parser.add_argument( '--code-bytes', type = int, default = 4096, help = 'size of the .text section' )
+    args = parser.parse_args()
+
+    with open( args.out, 'wb' ) as f:
+        f.write( generate( args ) )
+
+if __name__ == "__main__":
+    main()
@@ -127,7 +127,36 @@ Enums = [
             ( 'R_X86_64_REX_GOTPCRELX',   42, 'Load from 32 bit signed pc relative offset to GOT entry with REX prefix, relaxable.' ),
             ( 'R_X86_64_NUM',             43 ),
         ],
-    )
+    ),
+    Enum( name = 'CompressionType',
+        int_type = 'uint32_t',
+        values = [
+            ( 'ELFCOMPRESS_ZLIB', 1, 'ZLIB/DEFLATE algorithm' ),
+            ( 'ELFCOMPRESS_ZSTD', 2, 'Zstandard algorithm' ),
+        ],
+    ),
+    Enum( name = 'Machine',
+        int_type = 'uint16_t',
+        values = [
+            ( 'EM_NONE',      0, 'No machine' ),
+            ( 'EM_SPARC',     2, 'SUN SPARC' ),
+            ( 'EM_386',       3, 'Intel 80386' ),
+            ( 'EM_68K',       4, 'Motorola m68k family' ),
+            ( 'EM_MIPS',      8, 'MIPS R3000 big-endian' ),
+            ( 'EM_PPC',      20, 'PowerPC' ),
+            ( 'EM_PPC64',    21, 'PowerPC 64-bit' ),
+            ( 'EM_S390',     22, 'IBM S390' ),
+            ( 'EM_ARM',      40, 'ARM' ),
+            ( 'EM_SH',       42, 'Hitachi SH' ),
+            ( 'EM_SPARCV9',  43, 'SPARC v9 64-bit' ),
+            ( 'EM_X86_64',   62, 'AMD x86-64 architecture' ),
+            ( 'EM_AVR',      83, 'Atmel AVR 8-bit microcontroller' ),
+            ( 'EM_XTENSA',   94, 'Tensilica Xtensa Architecture' ),
+            ( 'EM_MSP430',  105, 'Texas Instruments msp430' ),
+            ( 'EM_AARCH64', 183, 'ARM AARCH64' ),
+            ( 'EM_RISCV',   243, 'RISC-V' ),
+        ],
+    ),
 ]
 
 
@@ -156,11 +185,60 @@ Bitfields = [
     ),
 ]
 
+def enum_html( value ):
+    if len( value ) == 2:
+        return value[0]
+    return f"<span class=\\\"enum-val\\\" onclick=\\\"javascript:addPopup(event, '{value[0]}' );\\\">{value[0]}</span>"
+
+# Compact markup leaves the click to the delegated handler in elf-explorer.js
+def enum_compact_html( value ):
+    if len( value ) == 2:
+        return value[0]
+    return f"<span class=\\\"e\\\">{value[0]}</span>"
+
+def gen_html_tables( out, name, by_index ):
+    for table, html in ( ( f'{name}Html', enum_html ), ( f'{name}CompactHtml', enum_compact_html ) ):
+        out.append( f"constexpr std::string_view {table}[] = {{" )
+        for i in range( max( by_index ) + 1 ):
+            if i in by_index:
+                out.append( f"    \"{html( by_index[ i ] )}\"," )
+            else:
+                out.append( "    \"\"," )
+        out.append( "};" )
+        out.append( "" )
+
+def gen_formatter( out, type_name, format_body ):
+    out.append( "namespace fmt {" )
+    out.append( "" )
+    out.append( "template <>" )
+    out.append( f"struct formatter< {type_name} > : formatter< std::string_view >" )
+    out.append( "{" )
+    out.append( f"    auto format( {type_name} v, format_context &ctx ) const" )
+    out.append( "    {" )
+    out.extend( format_body )
+    out.append( "    }" )
+    out.append( "};" )
+    out.append( "" )
+    out.append( "} // namespace fmt" )
+    out.append( "" )
+
+# Enums are rendered through constexpr tables indexed by value, holding the
+# html fragment for each known value (empty for gaps), one table per markup.
+# Bitfields use tables indexed by bit position.
 def gen_enums_hpp():
     out = []
-    out.append( '#include <iostream>' )
+    out.append( '#ifndef ELFEXPLORER__ENUMS_HPP__' )
+    out.append( '#define ELFEXPLORER__ENUMS_HPP__' )
     out.append( '' )
-    out.append( 'std::string escape( const std::string &s );' )
+    out.append( '#include <cstdint>' )
+    out.append( '#include <iterator>' )
+    out.append( '#include <string>' )
+    out.append( '#include <string_view>' )
+    out.append( '' )
+    out.append( '#include <fmt/format.h>' )
+    out.append( '' )
+    out.append( '// Set while rendering compact markup, see `ScopedMarkup` in html_output.hpp' )
+    out.append( 'inline thread_local bool t_compact_html = false;' )
     out.append( '' )
 
     for e in Enums:
@@ -170,22 +248,47 @@ def gen_enums_hpp():
             out.append( f"    {v[0]} = {v[1]}," )
         out.append( "};" )
         out.append( "" )
+
+        by_value = { v[1]: v for v in e.values }
+        gen_html_tables( out, e.name, by_value )
+
+        # Plain names for text output
+        out.append( f"constexpr std::string_view {e.name}Names[] = {{" )
+        for i in range( max( by_value ) + 1 ):
+            out.append( f"    \"{by_value[ i ][ 0 ] if i in by_value else ''}\"," )
+        out.append( "};" )
+        out.append( "" )
+
+        out.append( "inline" )
+        out.append( f"std::string_view EnumName( {e.name} v )" )
+        out.append( "{" )
+        out.append( f"    auto idx = static_cast< {e.int_type} >( v );" )
+        out.append( f"    return idx < std::size( {e.name}Names ) ? {e.name}Names[ idx ] : std::string_view();" )
+        out.append( "}" )
+        out.append( "" )
+
+        out.append( "// The name, or the number for values without one" )
         out.append( "inline" )
-        out.append( f"std::ostream& operator<<( std::ostream &out, {e.name} e )" )
+        out.append( f"std::string EnumText( {e.name} v )" )
         out.append( "{" )
-        out.append( "    switch( e )" )
+        out.append( "    std::string_view name = EnumName( v );" )
+        out.append( "    if ( name.empty() )" )
         out.append( "    {" )
-        for v in e.values:
-            out.append( f"    case {e.name}::{v[0]}:" )
-            if len( v ) == 2:
-                out.append( f"        out << \"{v[0]}\";" )
-            else:
-                out.append( f"        out << \"<span class=\\\"enum-val\\\" onclick=\\\"javascript:addPopup(event, '{v[0]}' );\\\">{v[0]}</span>\";" )
-            out.append( f"        return out;" )
+        out.append( "        return fmt::format( \"Unknown( {} )\", static_cast< uint64_t >( v ) );" )
         out.append( "    }" )
-        out.append( "    out << \"Unknown( \" << static_cast< int >( e ) << \" )\";" )
-        out.append( "    return out;" )
+        out.append( "    return std::string( name );" )
         out.append( "}" )
+        out.append( "" )
+
+        gen_formatter( out, e.name, [
+            f"        auto idx = static_cast< {e.int_type} >( v );",
+            f"        const std::string_view *html = t_compact_html ? {e.name}CompactHtml : {e.name}Html;",
+            f"        if ( idx < std::size( {e.name}Html ) && !html[ idx ].empty() )",
+            "        {",
+            "            return formatter< std::string_view >::format( html[ idx ], ctx );",
+            "        }",
+            "        return format_to( ctx.out(), \"Unknown( {} )\", static_cast< int >( idx ) );",
+        ] )
 
     for b in Bitfields:
         out.append( f"enum class {b.name} : {b.int_type}" )
@@ -202,37 +305,44 @@ def gen_enums_hpp():
         out.append( "}" )
         out.append( "" )
 
-        out.append( "inline" )
-        out.append( f"std::ostream& operator<<( std::ostream &out, {b.name} b )" )
-        out.append( "{" )
-        out.append( f"    bool need_separator = false;" )
-
+        by_bit = {}
         for v in b.values:
-            out.append( f"    if ( b & {b.name}::{v[0]} )" )
-            out.append(  "    {" )
-            out.append(  "        if ( need_separator )" )
-            out.append(  "        {" )
-            out.append(  "            out << \" | \";" )
-            out.append(  "        }" )
-            out.append(  "        need_separator = true;" )
-            if len( v ) == 2:
-                out.append( f"        out << \"{v[0]}\";" )
-            else:
-                out.append( f"        out << \"<span class=\\\"enum-val\\\" onclick=\\\"javascript:addPopup(event, '{v[0]}' );\\\">{v[0]}</span>\";" )
-            out.append( f"        b = static_cast< {b.name} >( static_cast< { b.int_type } >( b ) - {v[1]} );" )
-            out.append(  "    }" )
+            assert v[1] != 0 and v[1] & ( v[1] - 1 ) == 0, f'{v[0]} is not a single bit'
+            by_bit[ v[1].bit_length() - 1 ] = v
+        gen_html_tables( out, b.name, by_bit )
 
-        out.append( f"    if ( static_cast< {b.int_type} >( b ) != 0 )" )
-        out.append( "    {" )
-        out.append( "        if ( need_separator )" )
-        out.append( "        {" )
-        out.append( "            out << \" | \";" )
-        out.append( "        }" )
-        out.append( "        out << \"Unknown( \" << static_cast< int >( b ) << \" )\";" )
-        out.append( "    }" )
-        out.append( "    return out;" )
-        out.append( "}" )
-        out.append( "" )
+        gen_formatter( out, b.name, [
+            f"        uint64_t bits = static_cast< {b.int_type} >( v );",
+            f"        const std::string_view *html = t_compact_html ? {b.name}CompactHtml : {b.name}Html;",
+            "        uint64_t unknown = 0;",
+            "        bool need_separator = false;",
+            "        for ( ; bits != 0; bits &= bits - 1 )",
+            "        {",
+            "            int bit = __builtin_ctzll( bits );",
+            f"            if ( bit >= int( std::size( {b.name}Html ) ) || html[ bit ].empty() )",
+            "            {",
+            "                unknown |= uint64_t( 1 ) << bit;",
+            "                continue;",
+            "            }",
+            "            if ( need_separator )",
+            "            {",
+            "                ctx.advance_to( formatter< std::string_view >::format( \" | \", ctx ) );",
+            "            }",
+            "            need_separator = true;",
+            "            ctx.advance_to( formatter< std::string_view >::format( html[ bit ], ctx ) );",
+            "        }",
+            "        if ( unknown != 0 )",
+            "        {",
+            "            if ( need_separator )",
+            "            {",
+            "                ctx.advance_to( formatter< std::string_view >::format( \" | \", ctx ) );",
+            "            }",
+            "            ctx.advance_to( format_to( ctx.out(), \"Unknown( {} )\", static_cast< int >( unknown ) ) );",
+            "        }",
+            "        return ctx.out();",
+        ] )
+
+    out.append( '#endif // ELFEXPLORER__ENUMS_HPP__' )
 
     with open( 'out/gen/enums.hpp', 'w' ) as f:
         f.write( '\n'.join( out ) + '\n' )
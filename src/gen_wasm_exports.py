@@ -0,0 +1,131 @@
+#! /usr/bin/python3
+#
+# Copyright 2019 Mustafa Serdar Sanli
+#
+# This file is part of ELF Explorer.
+#
+# ELF Explorer is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# ELF Explorer is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+# Writes the EXPORTED_FUNCTIONS list of the web build's main module: the given
+# entry points plus whatever the disassembler side module imports from it.
+# The main module is linked with MAIN_MODULE=2, which drops everything not
+# exported, so libc functions only used by the side module must be listed.
+
+import argparse
+import json
+
+WASM_MAGIC = b'\0asm'
+IMPORT_SECTION = 2
+
+KIND_FUNCTION = 0
+KIND_TABLE    = 1
+KIND_MEMORY   = 2
+KIND_GLOBAL   = 3
+KIND_TAG      = 4
+
+
+class Reader:
+    def __init__( self, data ):
+        self.data = data
+        self.pos = 0
+
+    def byte( self ):
+        self.pos += 1
+        return self.data[ self.pos - 1 ]
+
+    def uleb128( self ):
+        res = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            res |= ( b & 0x7f ) << shift
+            shift += 7
+            if b & 0x80 == 0:
+                return res
+
+    def name( self ):
+        size = self.uleb128()
+        self.pos += size
+        return self.data[ self.pos - size : self.pos ].decode()
+
+    def limits( self ):
+        flags = self.byte()
+        self.uleb128()
+        if flags & 1:
+            self.uleb128()
+
+
+# Symbols the module imports: functions from `env`, and the functions and data
+# it takes the address of through `GOT.func` and `GOT.mem`
+def imported_symbols( data ):
+    if data[ :4 ] != WASM_MAGIC:
+        raise ValueError( 'not a wasm module' )
+
+    r = Reader( data )
+    r.pos = 8
+    while r.pos < len( data ):
+        section_id = r.byte()
+        size = r.uleb128()
+        end = r.pos + size
+        if section_id != IMPORT_SECTION:
+            r.pos = end
+            continue
+
+        symbols = []
+        for _ in range( r.uleb128() ):
+            module = r.name()
+            field = r.name()
+            kind = r.byte()
+            if kind == KIND_FUNCTION:
+                r.uleb128()
+                if module == 'env':
+                    symbols.append( field )
+            elif kind == KIND_TABLE:
+                r.byte()
+                r.limits()
+            elif kind == KIND_MEMORY:
+                r.limits()
+            elif kind == KIND_GLOBAL:
+                r.byte()
+                r.byte()
+                if module in ( 'GOT.func', 'GOT.mem' ):
+                    symbols.append( field )
+            elif kind == KIND_TAG:
+                r.byte()
+                r.uleb128()
+            else:
+                raise ValueError( f'unknown import kind {kind}' )
+        return symbols
+
+    return []
+
+
+def main():
+    parser = argparse.ArgumentParser( description = 'List the exports of the main wasm module.' )
+    parser.add_argument( '--out', required = True, help = 'output file name' )
+    parser.add_argument( 'side_module', help = 'side module loaded at run time' )
+    parser.add_argument( 'exports', nargs = '*', help = 'entry points of the main module, e.g. _open_buffer' )
+    args = parser.parse_args()
+
+    with open( args.side_module, 'rb' ) as f:
+        symbols = imported_symbols( f.read() )
+
+    exports = sorted( set( args.exports ) | { '_' + s for s in symbols } )
+    with open( args.out, 'w' ) as f:
+        json.dump( exports, f, indent = 4 )
+        f.write( '\n' )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,159 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__HASH_HPP__
+#define ELFEXPLORER__HASH_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace elfexplorer {
+
+// 64-bit non-cryptographic hash (xxHash64). Hashes are only compared within
+// one process, so loads use the host byte order.
+
+namespace hash_detail {
+
+constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t Prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t RotL( uint64_t x, int r )
+{
+    return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+inline uint64_t Load64( const unsigned char *p )
+{
+    uint64_t res;
+    std::memcpy( &res, p, 8 );
+    return res;
+}
+
+inline uint32_t Load32( const unsigned char *p )
+{
+    uint32_t res;
+    std::memcpy( &res, p, 4 );
+    return res;
+}
+
+inline uint64_t Round( uint64_t acc, uint64_t input )
+{
+    acc += input * Prime2;
+    acc = RotL( acc, 31 );
+    return acc * Prime1;
+}
+
+inline uint64_t MergeRound( uint64_t acc, uint64_t val )
+{
+    acc ^= Round( 0, val );
+    return acc * Prime1 + Prime4;
+}
+
+} // namespace hash_detail
+
+inline
+uint64_t Hash64( const void *data, size_t size, uint64_t seed = 0 )
+{
+    using namespace hash_detail;
+
+    const unsigned char *p = static_cast< const unsigned char* >( data );
+    const unsigned char *end = p + size;
+    uint64_t h;
+
+    if ( size >= 32 )
+    {
+        uint64_t v1 = seed + Prime1 + Prime2;
+        uint64_t v2 = seed + Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - Prime1;
+
+        for ( ; end - p >= 32; p += 32 )
+        {
+            v1 = Round( v1, Load64( p ) );
+            v2 = Round( v2, Load64( p + 8 ) );
+            v3 = Round( v3, Load64( p + 16 ) );
+            v4 = Round( v4, Load64( p + 24 ) );
+        }
+
+        h = RotL( v1, 1 ) + RotL( v2, 7 ) + RotL( v3, 12 ) + RotL( v4, 18 );
+        h = MergeRound( h, v1 );
+        h = MergeRound( h, v2 );
+        h = MergeRound( h, v3 );
+        h = MergeRound( h, v4 );
+    }
+    else
+    {
+        h = seed + Prime5;
+    }
+
+    h += size;
+
+    for ( ; end - p >= 8; p += 8 )
+    {
+        h ^= Round( 0, Load64( p ) );
+        h = RotL( h, 27 ) * Prime1 + Prime4;
+    }
+    if ( end - p >= 4 )
+    {
+        h ^= Load32( p ) * Prime1;
+        h = RotL( h, 23 ) * Prime2 + Prime3;
+        p += 4;
+    }
+    for ( ; p != end; ++p )
+    {
+        h ^= *p * Prime5;
+        h = RotL( h, 11 ) * Prime1;
+    }
+
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline
+uint64_t Hash64( std::string_view s, uint64_t seed = 0 )
+{
+    return Hash64( s.data(), s.size(), seed );
+}
+
+inline
+uint64_t HashCombine( uint64_t h, uint64_t value )
+{
+    return hash_detail::MergeRound( h, value );
+}
+
+// For unordered containers keyed by strings
+struct StringHash
+{
+    size_t operator()( std::string_view s ) const
+    {
+        return Hash64( s );
+    }
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__HASH_HPP__
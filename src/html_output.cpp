@@ -18,142 +18,234 @@
 
 #include "html_output.hpp"
 
-// TODO usa fmtlib and remove ios & iomanip
-#include <ios>
-#include <iomanip>
-
-#include <sstream>
-
 #include <cxxabi.h>
+#include <optional>
 
 #include <fmt/format.h>
 
-#include "wrap_nasm.h"
+#include "anchor.hpp"
+#include "disasm_context.hpp"
+#include "disasm_rows.hpp"
+#include "eh_frame.hpp"
+#include "stats.hpp"
 
 namespace elfexplorer {
 
-struct Anchor
+// Everything is formatted straight into the output buffer, these keep the
+// call sites short.
+template < typename... Args >
+static void Write( fmt::memory_buffer &out, fmt::format_string< Args... > format_str, Args&&... args )
 {
-    static
-    std::string ForSection( size_t idx )
+    fmt::format_to( fmt::appender( out ), format_str, std::forward< Args >( args )... );
+}
+
+static void Append( fmt::memory_buffer &out, std::string_view s )
+{
+    out.append( s.data(), s.data() + s.size() );
+}
+
+// Calls `append` with the html escaped `s` in pieces, unescaped runs are
+// passed in one go
+template < typename F >
+static void ForEachEscapedPiece( std::string_view s, F append )
+{
+    size_t run_begin = 0;
+    for ( size_t i = 0; i < s.size(); ++i )
     {
-        return fmt::format( "section-{}", idx );
+        std::string_view replacement;
+        switch ( s[ i ] )
+        {
+        case '<': replacement = "&lt;"; break;
+        case '>': replacement = "&gt;"; break;
+        case '&': replacement = "&amp;"; break;
+        case '"': replacement = "&quot;"; break;
+        default: continue;
+        }
+
+        append( s.substr( run_begin, i - run_begin ) );
+        append( replacement );
+        run_begin = i + 1;
     }
+    append( s.substr( run_begin ) );
+}
 
-    static
-    std::string ForSectionHeader( size_t idx )
+static void AppendEscaped( fmt::memory_buffer &out, std::string_view s )
+{
+    ForEachEscapedPiece( s, [ &out ]( std::string_view piece ) { Append( out, piece ); } );
+}
+
+static thread_local ScopedOutputFlush *t_output_flush = nullptr;
+
+ScopedOutputFlush::ScopedOutputFlush( std::function< void( fmt::memory_buffer& ) > flush, size_t threshold )
+    : m_flush( std::move( flush ) )
+    , m_threshold( threshold )
+    , m_prev( t_output_flush )
+{
+    t_output_flush = this;
+}
+
+ScopedOutputFlush::~ScopedOutputFlush()
+{
+    t_output_flush = m_prev;
+}
+
+ScopedMarkup::ScopedMarkup( Markup markup )
+    : m_prev( t_compact_html )
+{
+    t_compact_html = ( markup == Markup::Compact );
+}
+
+ScopedMarkup::~ScopedMarkup()
+{
+    t_compact_html = m_prev;
+}
+
+// Called between rows of long tables and dumps, see `ScopedOutputFlush`
+static void FlushIfLarge( fmt::memory_buffer &out )
+{
+    if ( t_output_flush && out.size() >= t_output_flush->m_threshold )
+    {
+        t_output_flush->m_flush( out );
+        out.clear();
+    }
+}
+
+// Formats as the html escaped string
+struct Escaped
+{
+    std::string_view s;
+};
+
+// Relocation types are machine specific, only x86-64 ones are known by name
+struct RelocationTypeText
+{
+    X64RelocationType m_type;
+    Machine m_machine;
+};
+
+} // namespace elfexplorer
+
+namespace fmt {
+
+template <>
+struct formatter< elfexplorer::Escaped > : formatter< std::string_view >
+{
+    auto format( const elfexplorer::Escaped &e, format_context &ctx ) const
     {
-        return fmt::format( "section-header-{}", idx );
+        elfexplorer::ForEachEscapedPiece( e.s, [ & ]( std::string_view piece )
+        {
+            ctx.advance_to( formatter< std::string_view >::format( piece, ctx ) );
+        } );
+        return ctx.out();
     }
+};
 
-    static
-    std::string ForSymbol( size_t section_idx, size_t symbol_idx )
+template <>
+struct formatter< elfexplorer::RelocationTypeText > : formatter< X64RelocationType >
+{
+    auto format( const elfexplorer::RelocationTypeText &t, format_context &ctx ) const
     {
-        return fmt::format( "section-{}-symbol-{}", section_idx, symbol_idx );
+        if ( t.m_machine == Machine::EM_X86_64 )
+        {
+            return formatter< X64RelocationType >::format( t.m_type, ctx );
+        }
+        return format_to( ctx.out(), "{}", static_cast< uint32_t >( t.m_type ) );
     }
 };
 
+} // namespace fmt
+
+namespace elfexplorer {
+
 struct Link
 {
     static
-    std::string ToSection( const std::vector< Section > &sections, size_t idx )
+    void ToSection( fmt::memory_buffer &out, const std::pmr::vector< Section > &sections, size_t idx )
     {
-        if ( idx <= 0 || idx > sections.size() )
+        if ( idx <= 0 || idx >= sections.size() )
         {
-            return fmt::format( "{}", idx );
+            Write( out, "{}", idx );
+            return;
         }
-        return fmt::format( R"(<a href="#{}">Section {} ({})</a>)", Anchor::ForSection( idx ), idx, escape( sections[ idx ].m_header.m_name ) );
+        Write( out, R"(<a href="#{}">Section {} ({})</a>)", Anchor::ForSection( idx ), idx, Escaped{ sections[ idx ].m_header.m_name } );
     }
 
     static
-    std::string ToSymbol( const std::vector< Section > &sections, size_t section_idx, size_t symbol_idx )
+    void ToSymbol( fmt::memory_buffer &out, const std::pmr::vector< Section > &sections, size_t section_idx, size_t symbol_idx )
     {
-        if ( section_idx == 0 || section_idx > sections.size() )
+        if ( section_idx == 0 || section_idx >= sections.size() )
         {
-            return fmt::format( "Symbol {}", symbol_idx );
+            Write( out, "Symbol {}", symbol_idx );
+            return;
         }
-        const Section &sec = sections.at( section_idx );
+        const Section &sec = sections[ section_idx ];
 
         if ( ! std::holds_alternative< SymbolTable >( sec.m_var ) )
         {
-            return fmt::format( "Symbol {}", symbol_idx );
+            Write( out, "Symbol {}", symbol_idx );
+            return;
         }
 
         const SymbolTable &symtab = std::get< SymbolTable >( sec.m_var );
 
-        if ( symbol_idx == 0 || symbol_idx > symtab.m_symbols.size() )
+        if ( symbol_idx == 0 || symbol_idx >= symtab.m_symbols.size() )
         {
-            return fmt::format( "Symbol {}", symbol_idx );
+            Write( out, "Symbol {}", symbol_idx );
+            return;
         }
 
-        const std::string &sym_name =  symtab.m_symbols[ symbol_idx ].m_name;
+        std::string_view sym_name = symtab.m_symbols[ symbol_idx ].m_name;
         if ( sym_name.size() )
         {
-            return fmt::format( R"(<a href="#{}">Symbol {} ({})</a>)", Anchor::ForSymbol( section_idx, symbol_idx ), symbol_idx, escape( sym_name ) );
+            Write( out, R"(<a href="#{}">Symbol {} ({})</a>)", Anchor::ForSymbol( section_idx, symbol_idx ), symbol_idx, Escaped{ sym_name } );
         }
         else
         {
-            return fmt::format( R"(<a href="#{}">Symbol {}</a>)", Anchor::ForSymbol( section_idx, symbol_idx ), symbol_idx );
+            Write( out, R"(<a href="#{}">Symbol {}</a>)", Anchor::ForSymbol( section_idx, symbol_idx ), symbol_idx );
         }
     }
 };
 
-static void RenderAsStringTable( std::ostream &html_out, std::string_view s )
+static void RenderAsStringTable( fmt::memory_buffer &out, std::string_view s )
 {
     if ( s.size() == 0 )
     {
         return;
     }
 
-    html_out << "<table class=\"sticky-header\"><tr><th>String Offset</th><th>Value</th></tr>";
+    Append( out, "<table class=\"sticky-header\"><tr><th>String Offset</th><th>Value</th></tr>" );
 
-    bool row_open = false;
-    for ( size_t i = 0; i < s.size(); ++i )
+    // One row per nul terminated string, the last row stays open if the table
+    // is not nul terminated.
+    for ( size_t i = 0; i < s.size(); )
     {
-        if ( !row_open )
-        {
-            html_out << "<tr><td>" << i << "</td><td>";
-            row_open = true;
-        }
+        size_t end = std::min( s.find( '\0', i ), s.size() );
 
-        if ( s[ i ] == 0 )
+        Write( out, "<tr><td>{}</td><td>", i );
+        AppendEscaped( out, s.substr( i, end - i ) ); // TODO assert that this is always a printable char
+        if ( end < s.size() )
         {
-            html_out << "</td></tr>";
-            row_open = false;
-        }
-        else
-        {
-            html_out << escape( std::string( 1, s[ i ] ) ); // TODO assert that this is always a printable char
+            Append( out, "</td></tr>" );
         }
+        i = end + 1;
+        FlushIfLarge( out );
     }
 
-    html_out << "</table>";
+    Append( out, "</table>" );
     // TODO assert row_open == false
 }
 
-std::string escape( const std::string &s )
+std::string escape( std::string_view s )
 {
-    std::string res;
-
-    for ( char c : s )
-    {
-        switch ( c )
-        {
-        case '<': res += "&lt;"; break;
-        case '>': res += "&gt;"; break;
-        case '&': res += "&amp;"; break;
-        case '"': res += "&quot;"; break;
-        default: res += c;
-        }
-    }
-
-    return res;
+    fmt::memory_buffer out;
+    AppendEscaped( out, s );
+    return fmt::to_string( out );
 }
 
-static void RenderSectionHeaders( std::ostream &html_out,
-                           const std::vector< Section > &sections )
+static void RenderSectionHeaders( fmt::memory_buffer &out,
+                           const std::pmr::vector< Section > &sections )
 {
-    html_out << R"(
+    Append( out, R"(
 <table class="sticky-header" border="1" cellspacing="0" cellpadding="3" style="word-break: break-all;">
   <thead>
     <tr>
@@ -171,59 +263,79 @@ static void RenderSectionHeaders( std::ostream &html_out,
     </tr>
   </thead>
   <tbody>
-)";
+)" );
 
     for ( size_t i = 1; i != sections.size(); ++i )
     {
         const SectionHeader &sh = sections[ i ].m_header;
 
-        html_out << "<tr>"
-                 << "<td><a class=\"sticky-anchor\" name=\"" << Anchor::ForSectionHeader( i ) << "\"></a><a href=\"#" << Anchor::ForSectionHeader( i ) << "\">" << i << "</a></td>"
-                 << "<td>" << escape( sh.m_name ) << "</td>"
-                 << "<td>" << sh.m_type << "</td>"
-                 << "<td>" << sh.m_attrs << "</td>"
-                 << "<td>" << sh.m_address << "</td>"
-                 << "<td><a href=\"#" << Anchor::ForSection( i ) << "\">" << sh.m_offset << "</a></td>"
-                 << "<td>" << sh.m_size << "</td>"
-                 << "<td>" << Link::ToSection( sections, sh.m_asso_idx ) << "</td>";
+        if ( t_compact_html )
+        {
+            Write( out, "<tr id=\"{}\"><td>{}</td>", Anchor::ForSectionHeader( i ), i );
+        }
+        else
+        {
+            Write( out, "<tr><td><a class=\"sticky-anchor\" name=\"{0}\"></a><a href=\"#{0}\">{1}</a></td>", Anchor::ForSectionHeader( i ), i );
+        }
+        Write( out, "<td>{0}</td>"
+                    "<td>{1}</td>"
+                    "<td>{2}</td>"
+                    "<td>{3}</td>"
+                    "<td><a href=\"#{4}\">{5}</a></td>"
+                    "<td>{6}</td>"
+                    "<td>",
+               Escaped{ sh.m_name }, sh.m_type, sh.m_attrs, sh.m_address, Anchor::ForSection( i ), sh.m_offset, sh.m_size );
+        Link::ToSection( out, sections, sh.m_asso_idx );
+        Append( out, "</td><td>" );
 
         if ( sh.m_type == SectionType::SHT_GROUP )
         {
-            html_out << "<td>" << Link::ToSymbol( sections, sh.m_asso_idx, sh.m_info ) << "</td>";
+            Link::ToSymbol( out, sections, sh.m_asso_idx, sh.m_info );
         }
         else
         {
-            html_out << "<td>" << sh.m_info << "</td>";
+            Write( out, "{}", sh.m_info );
         }
 
-        html_out << "<td>" << sh.m_addr_align << "</td>"
-                 << "<td>" << sh.m_ent_size << "</td>"
-                 << "</tr>";
+        Write( out, "</td><td>{}</td><td>{}</td></tr>", sh.m_addr_align, sh.m_ent_size );
+        FlushIfLarge( out );
     }
-    html_out << "</tbody></table>";
+    Append( out, "</tbody></table>" );
 }
 
-static void RenderSectionTitle( std::ostream &html_out, const std::vector< Section > &sections, size_t i )
+static void RenderSectionTitle( fmt::memory_buffer &out, const std::pmr::vector< Section > &sections, size_t i )
 {
     const SectionHeader &sh = sections[ i ].m_header;
 
-    html_out << R"(<div class="section-title">)";
-    html_out << R"(<table style="text-align: left;" border="0" cellspacing="0">)";
-    html_out << "<tr><th colspan=\"2\"><a style=\"font-size: 200%;\" name=\"" << Anchor::ForSection( i ) << "\">Section " << i << ": " << escape( sh.m_name ) << "</a></th></tr>";
-    html_out << "<tr><th>Name</th><td>" << escape( sh.m_name ) << "</td></tr>";
-    html_out << "<tr><th>Type</th><td>" << sh.m_type << "</td></tr>";
-    html_out << "<tr><th>Attrs</th><td>" << sh.m_attrs << "</td></tr>";
-    html_out << "<tr><th>Address</th><td>" << sh.m_address << "</td></tr>";
-    html_out << "<tr><th>Size</th><td>" << sh.m_size << "</td></tr>";
-    html_out << "<tr><th>Asso Idx</th><td>" << Link::ToSection( sections, sh.m_asso_idx ) << "</td></tr>";
-    html_out << "<tr><th>Info</th><td>" << sh.m_info << "</td></tr>";
-    html_out << "<tr><th>Addr Align</th><td>" << sh.m_addr_align << "</td></tr>";
-    html_out << "<tr><th>Ent Size</th><td>" << sh.m_ent_size << "</td></tr>";
-    html_out << R"(</table>)";
-    html_out << R"(</div>)";
+    Append( out, R"(<div class="section-title">)" );
+    if ( t_compact_html )
+    {
+        Write( out, "<table><tr><th colspan=\"2\" id=\"{}\">Section {}: {}</th></tr>", Anchor::ForSection( i ), i, Escaped{ sh.m_name } );
+    }
+    else
+    {
+        Append( out, R"(<table style="text-align: left;" border="0" cellspacing="0">)" );
+        Write( out, "<tr><th colspan=\"2\"><a style=\"font-size: 200%;\" name=\"{}\">Section {}: {}</a></th></tr>", Anchor::ForSection( i ), i, Escaped{ sh.m_name } );
+    }
+    Write( out, "<tr><th>Name</th><td>{}</td></tr>", Escaped{ sh.m_name } );
+    Write( out, "<tr><th>Type</th><td>{}</td></tr>", sh.m_type );
+    Write( out, "<tr><th>Attrs</th><td>{}</td></tr>", sh.m_attrs );
+    Write( out, "<tr><th>Address</th><td>{}</td></tr>", sh.m_address );
+    Write( out, "<tr><th>Size</th><td>{}</td></tr>", sh.m_size );
+    Append( out, "<tr><th>Asso Idx</th><td>" );
+    Link::ToSection( out, sections, sh.m_asso_idx );
+    Append( out, "</td></tr>" );
+    Write( out, "<tr><th>Info</th><td>{}</td></tr>", sh.m_info );
+    Write( out, "<tr><th>Addr Align</th><td>{}</td></tr>", sh.m_addr_align );
+    Write( out, "<tr><th>Ent Size</th><td>{}</td></tr>", sh.m_ent_size );
+    Append( out, R"(</table>)" );
+    Append( out, R"(</div>)" );
 }
 
-static void RenderBinaryData( std::ostream &html_out, std::string_view s )
+// Lower case hex digits of each byte value
+static constexpr char HexDigits[] = "0123456789abcdef";
+
+static void RenderBinaryData( fmt::memory_buffer &out, std::string_view s )
 {
     if ( s.size() == 0 )
     {
@@ -231,51 +343,195 @@ static void RenderBinaryData( std::ostream &html_out, std::string_view s )
     }
 
     const int indent = 4;
-    html_out << "<pre style=\"padding-left: 100px;\">";
-    for ( uint64_t i = 0; i < s.size(); i += 20 )
+    const int bytes_per_line = 20;
+    Append( out, t_compact_html ? "<pre class=\"b\">" : "<pre style=\"padding-left: 100px;\">" );
+    for ( uint64_t i = 0; i < s.size(); i += bytes_per_line )
     {
-        std::stringstream render_print;
-        std::stringstream render_hex;
+        Append( out, std::string_view( "    ", indent ) );
 
-        uint64_t j = 0;
-        for ( ; j < 20 && j + i < s.size(); ++j )
+        uint64_t line_size = std::min< uint64_t >( bytes_per_line, s.size() - i );
+        for ( uint64_t j = 0; j < line_size; ++j )
         {
-            auto hex = []( int a ) -> char
-            {
-                if ( a < 10 ) return '0' + a;
-                return a - 10 + 'a';
-            };
-
             uint8_t c = s[ i + j ];
             if ( isprint( c ) )
             {
-                render_print << escape( std::string( 1, c ) );
+                AppendEscaped( out, std::string_view( &s[ i + j ], 1 ) );
             }
             else
             {
-                render_print << '.';
+                out.push_back( '.' );
             }
-            render_hex << " " << hex( c / 16 ) << hex( c % 16 );
         }
-        for ( ; j < 20 ; ++j )
+        for ( uint64_t j = line_size; j < bytes_per_line; ++j )
         {
-            render_print << " ";
+            out.push_back( ' ' );
         }
 
-        html_out << std::string( indent, ' ' ) << render_print.str() << "  " << render_hex.str() << "\n";
+        Append( out, "  " );
+        for ( uint64_t j = 0; j < line_size; ++j )
+        {
+            uint8_t c = s[ i + j ];
+            char hex[ 3 ] = { ' ', HexDigits[ c / 16 ], HexDigits[ c % 16 ] };
+            out.append( hex, hex + 3 );
+        }
+        out.push_back( '\n' );
+        FlushIfLarge( out );
     }
-    html_out << "</pre>";
+    Append( out, "</pre>" );
+}
+
+// With `references`, a last column counts the relocations referring to the
+// symbol
+static void RenderSymbolRow( fmt::memory_buffer &out, const SymbolTable &symtab, size_t section_idx, size_t i, const ReferenceIndex *references )
+{
+    const Symbol &s = symtab.m_symbols[ i ];
+    if ( t_compact_html )
+    {
+        Write( out, "<tr id=\"{}\"><td>{}</td>", Anchor::ForSymbol( section_idx, i ), i );
+    }
+    else
+    {
+        Write( out, "<td><a class=\"sticky-anchor\" name=\"{0}\"></a><a href=\"#{0}\">{1}</a></td>", Anchor::ForSymbol( section_idx, i ), i );
+    }
+    Write( out, "<td>{}</td>"
+                "<td>{}</td>"
+                "<td>{}</td>"
+                "<td>{}</td>"
+                "<td>{}</td>"
+                "<td>{}</td>"
+                "<td>{}</td>",
+           Escaped{ s.m_name }, s.m_binding, s.m_type, s.m_visibility, FileSectionIndex( s.m_section_idx ), s.m_value, s.m_size );
+    if ( references )
+    {
+        Write( out, "<td>{}</td>", references->ToSymbol( section_idx, i ).size() );
+    }
+    Append( out, "</tr>" );
+    FlushIfLarge( out );
+}
+
+static void RenderSymbolRows( fmt::memory_buffer &out, const SymbolTable &symtab, size_t section_idx, size_t begin, size_t end, const ReferenceIndex *references )
+{
+    for ( size_t i = begin; i < end; ++i )
+    {
+        RenderSymbolRow( out, symtab, section_idx, i, references );
+    }
+}
+
+static const SymbolTable& RelocationSymbols( const std::pmr::vector< Section > &sections, size_t reloc_section_idx )
+{
+    const SectionHeader &sh = sections[ reloc_section_idx ].m_header;
+    return std::get< SymbolTable >( sections[ sh.m_asso_idx ].m_var ); // TODO assert
+}
+
+// The symbol names link to their row in the symbol table `symtab_idx`, which
+// has the references to the symbol
+static void RenderRelocationRows( fmt::memory_buffer &out, const RelocationEntries &reloc, const SymbolTable &symtab, size_t symtab_idx, Machine machine, size_t begin, size_t end )
+{
+    for ( size_t entry_idx = begin; entry_idx < end; ++entry_idx )
+    {
+        const RelocationEntry &entry = reloc.m_entries[ entry_idx ];
+
+        const std::string_view name = symtab.m_symbols[ entry.m_symbol ].m_name;
+        Write( out, "<tr><td>{}</td><td>{}</td>", entry_idx, entry.m_offset );
+        if ( name.empty() )
+        {
+            Append( out, "<td></td>" );
+        }
+        else
+        {
+            Write( out, "<td><a href=\"#{}\">{}</a></td>", Anchor::ForSymbol( symtab_idx, entry.m_symbol ), Escaped{ name } );
+        }
+        Write( out, "<td>{}</td>", RelocationTypeText{ entry.m_type, machine } );
+        if ( reloc.m_has_addends )
+        {
+            Write( out, "<td>{}</td></tr>", entry.m_addend );
+        }
+        else
+        {
+            Append( out, "<td></td></tr>" );
+        }
+        FlushIfLarge( out );
+    }
+}
+
+// Instructions starting in [ begin, end ) of `code`, with the relocated bytes
+// highlighted, a row naming each label before the instruction at its offset
+// and a row with the source line where it changes. All are sorted by offset,
+// `line_table` gives the file names of the lines.
+static void RenderDisassembly( fmt::memory_buffer &out, const std::pmr::vector< Section > &sections, std::string_view code, uint64_t begin, uint64_t end,
+                               FunctionIndex::Slice< FunctionIndex::Relocation > relocations,
+                               FunctionIndex::Slice< FunctionIndex::Label > labels,
+                               FunctionIndex::Slice< LineTable::Row > lines, const LineTable *line_table )
+{
+    Append( out, "<div class=\"assembly-code\"><table>" );
+
+    ForEachDisasmRow( code, begin, end, relocations, labels, lines, [ & ]( const DisasmRow &row )
+    {
+        // Labels inside an instruction are shown before it
+        for ( const FunctionIndex::Label &label : row.m_labels )
+        {
+            const SymbolTable &symtab = std::get< SymbolTable >( sections[ label.m_symtab_idx ].m_var );
+            Write( out, "<tr class=\"disasm-label\"><td colspan=\"3\"><a href=\"#{}\">{}</a>:</td></tr>",
+                   Anchor::ForSymbol( label.m_symtab_idx, label.m_symbol_idx ), Escaped{ symtab.m_symbols[ label.m_symbol_idx ].m_name } );
+        }
+        for ( const LineTable::Row &line : row.m_lines )
+        {
+            Write( out, "<tr class=\"disasm-line\"><td colspan=\"3\">{}:{}</td></tr>", Escaped{ line_table->FileName( line.m_file ) }, line.m_line );
+        }
+
+        Write( out, "<tr><td>{:08}</td><td>", row.m_insn.offset );
+        row.ForEachByte(
+            [ & ]( uint64_t i )
+            {
+                uint8_t c = code[ i ];
+                char hex[ 3 ] = { HexDigits[ c / 16 ], HexDigits[ c % 16 ], ' ' };
+                out.append( hex, hex + 3 );
+            },
+            [ & ]( const FunctionIndex::Relocation & )
+            {
+                Append( out, t_compact_html ? R"(<span class="r">)" : R"(<span style="color:red; cursor: pointer;">)" );
+            },
+            [ & ]( const FunctionIndex::Relocation &reloc )
+            {
+                const RelocationEntry &e = *reloc.m_entry;
+                Write( out, "&lt;{} , {} , {}&gt;", e.m_type, Escaped{ reloc.m_symtab->m_symbols[ e.m_symbol ].m_name }, e.m_addend );
+                Append( out, R"(</span>)" );
+            } );
+
+        Write( out, "</td><td>{}{}{}</td></tr>", row.Mnemonic(), row.m_insn.text_size ? " " : "", Escaped{ row.Operands() } );
+        FlushIfLarge( out );
+    } );
+
+    Append( out, "</table></div>" );
 }
 
 struct SectionHtmlRenderer
 {
-    SectionHtmlRenderer( std::ostream &html_out_, const std::vector< Section > &sections, size_t sec_idx )
-        : html_out( html_out_ )
-        , m_sections( sections )
+    SectionHtmlRenderer( fmt::memory_buffer &out_, const ELF_File &elf, const FunctionIndex &functions, const ReferenceIndex *references,
+                         size_t sec_idx, size_t virtual_table_rows )
+        : out( out_ )
+        , m_elf( elf )
+        , m_functions( functions )
+        , m_references( references )
+        , m_sections( elf.m_sections )
+        , m_machine( elf.m_machine )
         , m_cur_section_idx( sec_idx )
+        , m_virtual_table_rows( virtual_table_rows )
     {
     }
 
+    // Long tables are left for the page to fill in from `EncodeTable`,
+    // returns true if the placeholder was written instead of the rows
+    bool RenderVirtualTable( size_t num_rows )
+    {
+        if ( m_virtual_table_rows == 0 || num_rows < m_virtual_table_rows )
+        {
+            return false;
+        }
+        Write( out, "<div class=\"virtual-table\" data-section=\"{}\"></div>", m_cur_section_idx );
+        return true;
+    }
+
     void operator()( const std::monostate & )
     {
         std::cerr << "<script>console.log( 'unknown section' );</script>\n";
@@ -283,101 +539,180 @@ struct SectionHtmlRenderer
 
     void operator()( const NoBitsSection &s )
     {
-        RenderBinaryData( html_out, s.m_data );
+        RenderBinaryData( out, s.m_data );
     }
 
     void operator()( const ProgBitsSection &s )
     {
-        if ( s.m_is_executable )
+        if ( EhFrame::IsEhFrame( m_elf, m_cur_section_idx ) )
         {
-            struct State
-            {
-                std::vector< RelocationEntry > reloc_entries;
-                std::vector< RelocationEntry >::const_iterator reloc_it;
-                int reloc_size = 4; // TODO this should be derived by reloc type
-                const SymbolTable *symtab = nullptr;
-
-                std::string_view data;
-                std::stringstream disasm_out;
-            };
-            State state;
-            state.data = s.m_data;
-
-            // Check next section for relocation entries
-            // TODO this is wrong! it could be in another section
-            // TODO also check if there could be multiple relocation sections for a progbits section
-            if ( m_sections[ m_cur_section_idx + 1 ].m_header.m_type == SectionType::SHT_RELA
-              && m_sections[ m_cur_section_idx + 1 ].m_header.m_info == m_cur_section_idx )
+            RenderEhFrame( s );
+        }
+        else if ( s.m_is_executable && CanDisassemble( m_machine ) )
+        {
+            // Rows are not known before decoding, instructions average about
+            // 4 bytes
+            if ( RenderVirtualTable( s.m_data.size() / 4 ) )
             {
-                state.reloc_entries = std::get< RelocationEntries >( m_sections[ m_cur_section_idx + 1 ].m_var ).m_entries;
+                return;
+            }
+
+            stats::ScopedPhase phase( "disasm", m_sections[ m_cur_section_idx ].m_header.m_name, s.m_data.size() );
 
-                uint32_t symtab_idx = m_sections[ m_cur_section_idx + 1 ].m_header.m_asso_idx;
-                if ( symtab_idx < m_sections.size() )
+            // Relocations from every section applying to this one, and the
+            // symbols of all symbol tables as labels
+            RenderDisassembly( out, m_sections, s.m_data, 0, s.m_data.size(),
+                               m_functions.Relocations( m_cur_section_idx, 0, s.m_data.size() ),
+                               m_functions.Labels( m_cur_section_idx, 0, s.m_data.size() ),
+                               m_functions.SourceLines( m_cur_section_idx, 0, s.m_data.size() ), m_functions.Lines() );
+        }
+        else
+        {
+            RenderBinaryData( out, s.m_data );
+        }
+    }
+
+    // A row per record with the decoded instructions, the FDEs link to the
+    // function they are for
+    void RenderEhFrame( const ProgBitsSection &s )
+    {
+        std::optional< EhFrame > eh_frame;
+        try
+        {
+            stats::ScopedPhase phase( "eh_frame", m_sections[ m_cur_section_idx ].m_header.m_name, s.m_data.size() );
+            eh_frame.emplace( m_elf, m_cur_section_idx );
+        }
+        catch ( const std::exception &e )
+        {
+            Write( out, "<p>Can not decode: {}</p>", Escaped{ e.what() } );
+            RenderBinaryData( out, s.m_data );
+            return;
+        }
+
+        const auto &cies = eh_frame->Cies();
+        const auto &fdes = eh_frame->Fdes();
+        if ( RenderVirtualTable( cies.size() + fdes.size() ) )
+        {
+            return;
+        }
+
+        auto instructions = [ & ]( const EhFrame::Cie &cie, std::string_view data, uint64_t pc )
+        {
+            Append( out, "<pre>" );
+            try
+            {
+                for ( const std::string &line : eh_frame->Instructions( cie, data, pc ) )
                 {
-                    if ( std::holds_alternative< SymbolTable >( m_sections[ symtab_idx ].m_var ) )
-                    {
-                        state.symtab = &std::get< SymbolTable >( m_sections[ symtab_idx ].m_var );
-                    }
+                    Write( out, "{}\n", Escaped{ line } );
                 }
             }
-            if ( state.reloc_entries.size() )
+            catch ( const std::exception &e )
             {
-                ASSERT( state.symtab != nullptr );
+                Write( out, "Can not decode: {}", Escaped{ e.what() } );
             }
+            Append( out, "</pre>" );
+        };
 
-            std::sort( state.reloc_entries.begin(), state.reloc_entries.end(), []( const auto &a, const auto &b ){ return a.m_offset < b.m_offset; } );
-            state.reloc_it = state.reloc_entries.cbegin();
+        Append( out, "<table class=\"sticky-header\" border=\"1\" cellspacing=\"0\" cellpadding=\"3\">"
+                     "<tr><th>Offset</th><th>Record</th><th>Code</th><th>Function</th><th>Instructions</th></tr>" );
 
-            auto fp = []( int offset, int len, char *instruction_str, void *user_data )
+        // Both in the order of the section, merged back
+        size_t cie_idx = 0;
+        size_t fde_idx = 0;
+        while ( cie_idx < cies.size() || fde_idx < fdes.size() )
+        {
+            if ( fde_idx == fdes.size() || ( cie_idx < cies.size() && cies[ cie_idx ].m_offset < fdes[ fde_idx ].m_offset ) )
             {
-                State &st = *reinterpret_cast< State* >( user_data );
-
-                st.disasm_out << "<tr><td>" << std::setw( 8 ) << std::setfill( '0' ) << offset << "</td><td>";
-                for ( int i = 0; i < len; ++i )
+                const EhFrame::Cie &cie = cies[ cie_idx++ ];
+                Write( out, "<tr><td>{:#x}</td><td>CIE: {}</td><td></td><td></td><td>", cie.m_offset, Escaped{ EhFrame::Describe( cie ) } );
+                instructions( cie, cie.m_instructions, 0 );
+                Append( out, "</td></tr>" );
+            }
+            else
+            {
+                const EhFrame::Fde &fde = fdes[ fde_idx++ ];
+                Write( out, "<tr><td>{:#x}</td><td>FDE, CIE at {:#x}</td><td>", fde.m_offset, fde.m_cie_offset );
+                if ( fde.m_section_idx != 0 )
+                {
+                    Link::ToSection( out, m_sections, fde.m_section_idx );
+                }
+                Write( out, " {:#x} .. {:#x}</td><td>", fde.m_begin, fde.m_begin + fde.m_size );
+                if ( const EhFrame::Function *fn = eh_frame->FunctionOf( fde ) )
                 {
-                    // TODO assert reloc size <= instruction size
-                    if ( st.reloc_it != st.reloc_entries.cend() && st.reloc_it->m_offset == size_t( offset + i ) )
-                    {
-                        st.disasm_out << R"(<span style="color:red; cursor: pointer;">)";
-                    }
-                    st.disasm_out << std::hex << std::setw( 2 ) << (int)static_cast< unsigned char >( st.data[ offset + i ] ) << " " << std::dec;
-                    if ( st.reloc_it != st.reloc_entries.cend() && st.reloc_it->m_offset + st.reloc_size - 1 == size_t( offset + i ) )
-                    {
-                        const RelocationEntry &e = *st.reloc_it;
-                        st.disasm_out << "&lt;" << e.m_type << " , " << st.symtab->m_symbols[ e.m_symbol ].m_name << " , " << e.m_addend  << "&gt;";
-                        st.disasm_out << R"(</span>)";
-                        ++st.reloc_it;
-                    }
+                    Link::ToSymbol( out, m_sections, fn->m_symtab_idx, fn->m_symbol_idx );
                 }
+                Append( out, "</td><td>" );
+                instructions( eh_frame->CieOf( fde ), fde.m_instructions, fde.m_begin );
+                Append( out, "</td></tr>" );
+            }
+            FlushIfLarge( out );
+        }
+        Append( out, "</table>" );
+    }
 
-                st.disasm_out << "</td><td>" << escape( instruction_str ) << "</td></tr>";
-            };
+    void operator()( const SymbolSectionIndices &s )
+    {
+        const size_t symtab_idx = m_sections[ m_cur_section_idx ].m_header.m_asso_idx;
 
-            DisasmExecutableSection( reinterpret_cast< unsigned char* >( const_cast< char* >( s.m_data.data() ) ), s.m_data.size(), fp, static_cast< void* >( &state ) );
+        Append( out, "<table class=\"sticky-header\" border=\"1\" cellspacing=\"0\" cellpadding=\"3\"><tr><th>Symbol</th><th>Section</th></tr>" );
+        for ( size_t i = 0; i < s.m_indices.size(); ++i )
+        {
+            if ( s.m_indices[ i ] == 0 )
+            {
+                continue;
+            }
+            Append( out, "<tr><td>" );
+            Link::ToSymbol( out, m_sections, symtab_idx, i );
+            Append( out, "</td><td>" );
+            Link::ToSection( out, m_sections, s.m_indices[ i ] );
+            Append( out, "</td></tr>" );
+            FlushIfLarge( out );
+        }
+        Append( out, "</table>" );
+    }
 
-            html_out << "<div class=\"assembly-code\"><table>" << state.disasm_out.str() << "</table></div>";
+    void operator()( const CompressedSection &s )
+    {
+        Write( out, "<table border=\"1\" cellpadding=\"3\" cellspacing=\"0\">"
+                    "<tr><th>Compression</th><td>{}</td></tr>"
+                    "<tr><th>Size</th><td>{}</td></tr>"
+                    "<tr><th>Addr Align</th><td>{}</td></tr>"
+                    "</table>",
+               s.m_compression, s.m_size, s.m_addr_align );
+
+        std::string_view data;
+        try
+        {
+            stats::ScopedPhase phase( "decompress", m_sections[ m_cur_section_idx ].m_header.m_name, s.m_size );
+            data = s.Data();
         }
-        else
+        catch ( const std::exception &e )
         {
-            RenderBinaryData( html_out, s.m_data );
+            Write( out, "<p>Can not decompress: {}</p>", Escaped{ e.what() } );
+            return;
         }
+        RenderBinaryData( out, data );
     }
 
     void operator()( const InitArraySection &s )
     {
-        RenderBinaryData( html_out, s.m_data );
+        RenderBinaryData( out, s.m_data );
     }
 
     void operator()( const StringTable &strtab )
     {
-        RenderAsStringTable( html_out, strtab.m_str );
+        RenderAsStringTable( out, strtab.m_str );
     }
 
     void operator()( const SymbolTable &symtab )
     {
-        const std::vector< Symbol > &symbols = symtab.m_symbols;
+        const auto &symbols = symtab.m_symbols;
+        if ( RenderVirtualTable( symbols.size() ) )
+        {
+            return;
+        }
 
-        html_out << R"(
+        Append( out, R"(
     <table class="sticky-header" border="1" cellspacing="0" style="word-break: break-all;">
       <thead>
         <tr>
@@ -388,102 +723,243 @@ struct SectionHtmlRenderer
           <th>Visibility</th>
           <th>Section Idx</th>
           <th>Value</th>
-          <th>Size</th>
+          <th>Size</th>)" );
+        if ( m_references )
+        {
+            Append( out, "<th>Refs</th>" );
+        }
+        Append( out, R"(
         </tr>
       </thead>
       <tbody>
-    )";
+    )" );
 
-        for ( size_t i = 0; i < symbols.size(); ++i )
-        {
-            const Symbol &s = symbols[ i ];
-            html_out << "<td>"
-                           "<a class=\"sticky-anchor\" name=\"" << Anchor::ForSymbol( m_cur_section_idx, i ) << "\"></a>"
-                           "<a href=\"#" << Anchor::ForSymbol( m_cur_section_idx, i ) << "\">" << i << "</a>"
-                        "</td>"
-                     << "<td>" << escape( s.m_name ) << "</td>"
-                     << "<td>" << s.m_binding << "</td>"
-                     << "<td>" << s.m_type << "</td>"
-                     << "<td>" << s.m_visibility << "</td>"
-                     << "<td>" << s.m_section_idx << "</td>"
-                     << "<td>" << s.m_value << "</td>"
-                     << "<td>" << s.m_size << "</td>"
-                     << "</tr>";
-        }
-        html_out << "</tbody></table>";
+        RenderSymbolRows( out, symtab, m_cur_section_idx, 0, symbols.size(), m_references );
+        Append( out, "</tbody></table>" );
     }
 
     void operator()( const GroupSection &group )
     {
         ASSERT( group.m_flags == GroupHandling::GRP_COMDAT ); // ( no other option known )
 
-        html_out << "<table border=\"1\" cellpadding=\"3\" cellspacing=\"0\"><tr><th>Flags</th><td>" << group.m_flags << "</td></tr>";
+        Write( out, "<table border=\"1\" cellpadding=\"3\" cellspacing=\"0\"><tr><th>Flags</th><td>{}</td></tr>", group.m_flags );
 
         for ( size_t i = 0; i < group.m_section_indices.size(); ++i )
         {
             uint32_t sec_idx = group.m_section_indices[ i ];
-            html_out << "<tr>";
+            Append( out, "<tr>" );
             if ( i == 0 )
             {
-                html_out << "<th rowspan=\"" << group.m_section_indices.size() << "\">Sections</th>";
+                Write( out, "<th rowspan=\"{}\">Sections</th>", group.m_section_indices.size() );
             }
-            html_out << "<td>" << Link::ToSection( m_sections, sec_idx ) << "</td>";
+            Append( out, "<td>" );
+            Link::ToSection( out, m_sections, sec_idx );
+            Append( out, "</td>" );
         }
 
-        html_out << "</table>";
+        Append( out, "</table>" );
     }
 
     void operator()( const RelocationEntries &reloc )
     {
-        const SectionHeader &sh = m_sections[ m_cur_section_idx ].m_header;
-        const SymbolTable &symtab = std::get< SymbolTable >( m_sections[ sh.m_asso_idx ].m_var ); // TODO assert
-
-        html_out << "<table class=\"sticky-header\" border=\"1\" cellspacing=\"0\" cellpadding=\"3\"><tr><th>Relocation Entry</th><th>Offset</th><th>Sym</th><th>Type</th><th>Addend</th></tr>";
-        for ( size_t entry_idx = 0; entry_idx < reloc.m_entries.size(); ++entry_idx )
+        if ( RenderVirtualTable( reloc.m_entries.size() ) )
         {
-            const RelocationEntry &entry = reloc.m_entries[ entry_idx ];
-
-            html_out << "<tr>"
-                     << "<td>" << entry_idx << "</td>"
-                     << "<td>" << entry.m_offset << "</td>"
-                     // TODO create info popup for symbols (demangled value etc.)
-                     // and show that on click
-                     << "<td>" << escape( symtab.m_symbols[ entry.m_symbol ].m_name ) << "</td>"
-                     << "<td>" << entry.m_type << "</td>"
-                     << "<td>" << entry.m_addend << "</td>"
-                     << "</tr>";
+            return;
         }
-        html_out << "</table>";
+
+        const SymbolTable &symtab = RelocationSymbols( m_sections, m_cur_section_idx );
+
+        Append( out, "<table class=\"sticky-header\" border=\"1\" cellspacing=\"0\" cellpadding=\"3\"><tr><th>Relocation Entry</th><th>Offset</th><th>Sym</th><th>Type</th><th>Addend</th></tr>" );
+        RenderRelocationRows( out, reloc, symtab, m_sections[ m_cur_section_idx ].m_header.m_asso_idx, m_machine, 0, reloc.m_entries.size() );
+        Append( out, "</table>" );
     }
 
-    std::ostream &html_out;
-    const std::vector< Section > m_sections;
+    fmt::memory_buffer &out;
+    const ELF_File &m_elf;
+    const FunctionIndex &m_functions;
+    const ReferenceIndex *m_references;
+    const std::pmr::vector< Section > &m_sections;
+    Machine m_machine;
     size_t m_cur_section_idx;
+    size_t m_virtual_table_rows;
 };
 
-void RenderAsHTML( std::ostream &html_out, const ELF_File &elf )
+HTMLChunkRenderer::HTMLChunkRenderer( const ELF_File &elf, size_t virtual_table_rows, const FunctionIndex *functions, Markup markup,
+                                      const ReferenceIndex *references )
+    : m_elf( elf )
+    , m_virtual_table_rows( virtual_table_rows )
+    , m_own_functions( functions ? nullptr : std::make_unique< FunctionIndex >( elf ) )
+    , m_functions( functions ? functions : m_own_functions.get() )
+    , m_references( references )
+    , m_markup( markup )
+{
+}
+
+bool HTMLChunkRenderer::RenderNextChunk( fmt::memory_buffer &out )
+{
+    if ( m_next_chunk >= NumChunks() )
+    {
+        return false;
+    }
+
+    RenderChunk( out, m_next_chunk++ );
+    return true;
+}
+
+size_t HTMLChunkRenderer::NumChunks() const
+{
+    return std::max< size_t >( m_elf.m_sections.size(), 1 );
+}
+
+void HTMLChunkRenderer::RenderChunk( fmt::memory_buffer &out, size_t chunk ) const
 {
-    html_out << R"(<!doctype html>
+    ScopedMarkup markup( m_markup );
+
+    if ( chunk == 0 )
+    {
+        stats::ScopedPhase phase( "render", "section headers" );
+        Append( out, "<h2>Section Headers</h2>" );
+        RenderSectionHeaders( out, m_elf.m_sections );
+        return;
+    }
+
+    stats::ScopedPhase phase( "render", m_elf.m_sections[ chunk ].m_header.m_name, m_elf.m_sections[ chunk ].m_header.m_size );
+    RenderSectionTitle( out, m_elf.m_sections, chunk );
+    std::visit( SectionHtmlRenderer( out, m_elf, *m_functions, m_references, chunk, m_virtual_table_rows ), m_elf.m_sections[ chunk ].m_var );
+}
+
+bool RenderRows( fmt::memory_buffer &out, const ELF_File &elf, size_t section_idx, size_t begin, size_t end, const ReferenceIndex *references )
+{
+    if ( section_idx >= elf.m_sections.size() )
+    {
+        return false;
+    }
+
+    const Section &sec = elf.m_sections[ section_idx ];
+    if ( const auto *symtab = std::get_if< SymbolTable >( &sec.m_var ) )
+    {
+        end = std::min( end, symtab->m_symbols.size() );
+        RenderSymbolRows( out, *symtab, section_idx, std::min( begin, end ), end, references );
+        return true;
+    }
+    if ( const auto *reloc = std::get_if< RelocationEntries >( &sec.m_var ) )
+    {
+        end = std::min( end, reloc->m_entries.size() );
+        RenderRelocationRows( out, *reloc, RelocationSymbols( elf.m_sections, section_idx ), sec.m_header.m_asso_idx, elf.m_machine, std::min( begin, end ), end );
+        return true;
+    }
+    return false;
+}
+
+void RenderFunction( fmt::memory_buffer &out, const ELF_File &elf, const FunctionIndex &index, const FunctionIndex::Function &fn )
+{
+    const auto &code = std::get< ProgBitsSection >( elf.m_sections[ fn.m_section_idx ].m_var ).m_data;
+    if ( !CanDisassemble( elf.m_machine ) )
+    {
+        RenderBinaryData( out, std::string_view( code ).substr( fn.m_begin, fn.m_end - fn.m_begin ) );
+        return;
+    }
+
+    RenderDisassembly( out, elf.m_sections, code, fn.m_begin, fn.m_end,
+                       index.Relocations( fn.m_section_idx, fn.m_begin, fn.m_end ),
+                       index.Labels( fn.m_section_idx, fn.m_begin, fn.m_end ),
+                       index.SourceLines( fn.m_section_idx, fn.m_begin, fn.m_end ), index.Lines() );
+}
+
+void RenderNameMatches( fmt::memory_buffer &out, const ELF_File &elf, const NameIndex &index, const std::vector< uint32_t > &matches )
+{
+    for ( uint32_t id : matches )
+    {
+        const NameIndex::Entry &e = index[ id ];
+        if ( e.m_symbol_idx == NameIndex::NoSymbol )
+        {
+            Write( out, R"(<div class="name-match"><a href="#{}">{}</a> <span class="name-match-where">section {}</span></div>)",
+                   Anchor::ForSection( e.m_section_idx ), Escaped{ index.Name( id ) }, e.m_section_idx );
+            continue;
+        }
+
+        Write( out, R"(<div class="name-match"><a href="#{}">{}</a>)", Anchor::ForSymbol( e.m_section_idx, e.m_symbol_idx ), Escaped{ index.Name( id ) } );
+        if ( !index.Demangled( id ).empty() )
+        {
+            Write( out, R"( <span class="name-match-demangled">{}</span>)", Escaped{ index.Demangled( id ) } );
+        }
+        Write( out, R"( <span class="name-match-where">symbol {} of {}</span></div>)", e.m_symbol_idx, Escaped{ elf.m_sections[ e.m_section_idx ].m_header.m_name } );
+    }
+}
+
+void RenderReferences( fmt::memory_buffer &out, const ELF_File &elf, const FunctionIndex &functions, ReferenceIndex::Slice refs )
+{
+    if ( refs.empty() )
+    {
+        return;
+    }
+
+    Write( out, R"(<div class="references">Referred to by {} relocation{}:)", refs.size(), refs.size() == 1 ? "" : "s" );
+    for ( const ReferenceIndex::Reference &ref : refs )
+    {
+        const uint64_t offset = ref.m_entry->m_offset;
+        Write( out, R"(<div class="reference"><a href="#{}">{}</a>+{:#x} {})",
+               Anchor::ForSection( ref.m_section_idx ), Escaped{ elf.m_sections[ ref.m_section_idx ].m_header.m_name }, offset,
+               RelocationTypeText{ ref.m_entry->m_type, elf.m_machine } );
+
+        FunctionIndex::Slice< FunctionIndex::Label > labels = functions.Labels( ref.m_section_idx, 0, offset + 1 );
+        if ( labels.begin() != labels.end() )
+        {
+            const FunctionIndex::Label &label = labels.end()[ -1 ];
+            const Symbol &s = std::get< SymbolTable >( elf.m_sections[ label.m_symtab_idx ].m_var ).m_symbols[ label.m_symbol_idx ];
+            Write( out, R"( in <a href="#{}">{}</a>+{:#x})", Anchor::ForSymbol( label.m_symtab_idx, label.m_symbol_idx ), Escaped{ s.m_name }, offset - label.m_offset );
+        }
+        Append( out, "</div>" );
+    }
+    Append( out, "</div>" );
+}
+
+bool RenderSymbolRows( fmt::memory_buffer &out, const ELF_File &elf, size_t section_idx, const std::vector< uint32_t > &rows, size_t begin, size_t end,
+                       const ReferenceIndex *references )
+{
+    const SymbolTable *symtab = section_idx < elf.m_sections.size() ? std::get_if< SymbolTable >( &elf.m_sections[ section_idx ].m_var ) : nullptr;
+    if ( !symtab )
+    {
+        return false;
+    }
+
+    end = std::min( end, rows.size() );
+    for ( size_t i = std::min( begin, end ); i < end; ++i )
+    {
+        ASSERT( rows[ i ] < symtab->m_symbols.size() );
+        RenderSymbolRow( out, *symtab, section_idx, rows[ i ], references );
+    }
+    return true;
+}
+
+void RenderDocumentHead( fmt::memory_buffer &out )
+{
+    Append( out, R"(<!doctype html>
 <html>
   <head>
     <link rel="stylesheet" type="text/css" href="style.css">
   </head>
   <body>
-)";
+)" );
+}
+
+void RenderDocumentTail( fmt::memory_buffer &out )
+{
+    Append( out, R"(
+</body></html>
+)" );
+}
 
-    html_out << "<h2>Section Headers</h2>";
-    RenderSectionHeaders( html_out, elf.m_sections );
+void RenderAsHTML( fmt::memory_buffer &out, const ELF_File &elf, Markup markup, const ReferenceIndex *references )
+{
+    RenderDocumentHead( out );
 
-    for ( size_t i = 1; i < elf.m_sections.size(); ++i )
+    HTMLChunkRenderer renderer( elf, 0, nullptr, markup, references );
+    while ( renderer.RenderNextChunk( out ) )
     {
-        RenderSectionTitle( html_out, elf.m_sections, i );
-
-        std::visit( SectionHtmlRenderer( html_out, elf.m_sections, i ), elf.m_sections[ i ].m_var );
     }
 
-    html_out << R"(
-</body></html>
-)";
+    RenderDocumentTail( out );
 }
 
 } // namespace elfexplorer
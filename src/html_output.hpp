@@ -19,17 +19,132 @@
 #ifndef ELFEXPLORER__HTML_OUTPUT_HPP__
 #define ELFEXPLORER__HTML_OUTPUT_HPP__
 
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <fmt/format.h>
+
 #include "elf_structs.hpp"
+#include "function_index.hpp"
+#include "name_index.hpp"
+#include "reference_index.hpp"
 
 namespace elfexplorer {
 
-void RenderAsHTML( std::ostream &html_out, const ELF_File &elf );
+// `Compact` markup is for pages running web/elf-explorer.js. Enum values are
+// `<span class="e">` handled by its delegated click handler instead of each
+// having an inline one, rows are link targets by `id` instead of a pair of
+// anchors, and inline styles are classes from style.css.
+enum class Markup
+{
+    Full,
+    Compact,
+};
+
+// While alive, html rendered on this thread uses `markup`
+class ScopedMarkup
+{
+public:
+    explicit ScopedMarkup( Markup markup );
+    ~ScopedMarkup();
+
+    ScopedMarkup( const ScopedMarkup & ) = delete;
+    ScopedMarkup& operator=( const ScopedMarkup & ) = delete;
+
+private:
+    bool m_prev;
+};
+
+// Symbol tables get a column counting the references to each symbol if
+// `references` is given
+void RenderAsHTML( fmt::memory_buffer &out, const ELF_File &elf, Markup markup = Markup::Full, const ReferenceIndex *references = nullptr );
+
+// Html around the chunks below, written by `RenderAsHTML`
+void RenderDocumentHead( fmt::memory_buffer &out );
+void RenderDocumentTail( fmt::memory_buffer &out );
+
+// Renders the same contents as `RenderAsHTML` one piece at a time, so that
+// the web ui can show the section headers before the rest is rendered. Each
+// chunk is a self contained html fragment to be appended to the page body:
+// the section header table first, then one chunk per section.
+//
+// Tables with at least `virtual_table_rows` rows (never if 0) are rendered as
+// an empty `<div class="virtual-table" data-section="N">`, for the page to
+// show from the columns given by `EncodeTable`.
+//
+// Source lines in the disassembly come from `functions`, which can be shared
+// so the line table is decoded once for the file. A new one is made if not
+// given. Symbol tables get a column counting the references to each symbol
+// if `references` is given.
+class HTMLChunkRenderer
+{
+public:
+    explicit HTMLChunkRenderer( const ELF_File &elf, size_t virtual_table_rows = 0, const FunctionIndex *functions = nullptr, Markup markup = Markup::Full,
+                                const ReferenceIndex *references = nullptr );
+
+    // Returns false when there is nothing left to render
+    bool RenderNextChunk( fmt::memory_buffer &out );
+
+    // Chunks can also be rendered on their own, chunk 0 being the section
+    // header table and chunk i section i
+    size_t NumChunks() const;
+    void RenderChunk( fmt::memory_buffer &out, size_t chunk ) const;
+
+private:
+    const ELF_File &m_elf;
+    size_t m_virtual_table_rows;
+    std::unique_ptr< FunctionIndex > m_own_functions;
+    const FunctionIndex *m_functions;
+    const ReferenceIndex *m_references;
+    Markup m_markup;
+    size_t m_next_chunk = 0;
+};
+
+// Renders rows [ begin, end ) of a symbol or relocation table, as the `<tr>`
+// elements of the table in the section's chunk rendered with the same
+// `references`. Returns false if the section has no rows.
+bool RenderRows( fmt::memory_buffer &out, const ELF_File &elf, size_t section_idx, size_t begin, size_t end, const ReferenceIndex *references = nullptr );
+
+// Renders the symbols `rows[ begin ]` to `rows[ end - 1 ]` of a symbol table
+// like `RenderRows` does, e.g. the result of a `SymbolQuery`. Returns false if
+// the section is not a symbol table.
+bool RenderSymbolRows( fmt::memory_buffer &out, const ELF_File &elf, size_t section_idx, const std::vector< uint32_t > &rows, size_t begin, size_t end,
+                       const ReferenceIndex *references = nullptr );
+
+// Disassembly of a single function, decoding only its own bytes, with
+// relocations, the labels of the symbols defined in it and source lines. Raw
+// bytes for machines that can't be disassembled.
+void RenderFunction( fmt::memory_buffer &out, const ELF_File &elf, const FunctionIndex &index, const FunctionIndex::Function &fn );
+
+// Links to the sections and symbols found by `NameIndex::Search`, one per
+// line with the demangled name and the symbol table of symbols
+void RenderNameMatches( fmt::memory_buffer &out, const ELF_File &elf, const NameIndex &index, const std::vector< uint32_t > &matches );
+
+// Links to the places the relocations in `refs` apply to, one per line with
+// their type and the symbol defined before them. Nothing if `refs` is empty.
+void RenderReferences( fmt::memory_buffer &out, const ELF_File &elf, const FunctionIndex &functions, ReferenceIndex::Slice refs );
+
+// While alive, html rendered on this thread is handed to `m_flush` whenever
+// the output grows past `m_threshold` bytes, also in the middle of a section,
+// and the output is cleared. Keeps the memory for rendering a large section
+// bounded when the chunks are written out in order anyway.
+struct ScopedOutputFlush
+{
+    ScopedOutputFlush( std::function< void( fmt::memory_buffer& ) > flush, size_t threshold );
+    ~ScopedOutputFlush();
+
+    ScopedOutputFlush( const ScopedOutputFlush & ) = delete;
+    ScopedOutputFlush& operator=( const ScopedOutputFlush & ) = delete;
+
+    std::function< void( fmt::memory_buffer& ) > m_flush;
+    size_t m_threshold;
+    ScopedOutputFlush *m_prev;
+};
 
-std::string escape( const std::string &s );
+std::string escape( std::string_view s );
 
 } // namespace elfexplorer
 
@@ -0,0 +1,327 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "http_server.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "thread_pool.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+constexpr size_t MaxRequestSize = 16 * 1024;
+
+int HexValue( char c )
+{
+    if ( c >= '0' && c <= '9' ) return c - '0';
+    if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+}
+
+// Decodes %xx escapes, and '+' as space if `is_query`
+std::string UrlDecode( std::string_view s, bool is_query )
+{
+    std::string res;
+    res.reserve( s.size() );
+    for ( size_t i = 0; i < s.size(); ++i )
+    {
+        if ( s[ i ] == '%' && i + 2 < s.size() && HexValue( s[ i + 1 ] ) >= 0 && HexValue( s[ i + 2 ] ) >= 0 )
+        {
+            res.push_back( static_cast< char >( HexValue( s[ i + 1 ] ) * 16 + HexValue( s[ i + 2 ] ) ) );
+            i += 2;
+        }
+        else if ( s[ i ] == '+' && is_query )
+        {
+            res.push_back( ' ' );
+        }
+        else
+        {
+            res.push_back( s[ i ] );
+        }
+    }
+    return res;
+}
+
+bool ParseRequestLine( std::string_view head, HttpRequest &req )
+{
+    std::string_view line = head.substr( 0, head.find( "\r\n" ) );
+
+    size_t method_end = line.find( ' ' );
+    if ( method_end == std::string_view::npos )
+    {
+        return false;
+    }
+    size_t target_end = line.find( ' ', method_end + 1 );
+    if ( target_end == std::string_view::npos )
+    {
+        return false;
+    }
+
+    req.m_method = line.substr( 0, method_end );
+    std::string_view target = line.substr( method_end + 1, target_end - method_end - 1 );
+
+    size_t query_begin = target.find( '?' );
+    req.m_path = UrlDecode( target.substr( 0, query_begin ), false );
+    if ( query_begin == std::string_view::npos )
+    {
+        return true;
+    }
+
+    std::string_view query = target.substr( query_begin + 1 );
+    while ( !query.empty() )
+    {
+        std::string_view param = query.substr( 0, query.find( '&' ) );
+        query.remove_prefix( std::min( param.size() + 1, query.size() ) );
+
+        size_t eq = param.find( '=' );
+        std::string value = eq == std::string_view::npos ? std::string() : UrlDecode( param.substr( eq + 1 ), true );
+        req.m_query[ UrlDecode( param.substr( 0, eq ), true ) ] = std::move( value );
+    }
+    return true;
+}
+
+// Value of the header `name` in the request head, without the surrounding
+// whitespace. Empty if there is no such header.
+std::string_view HeaderValue( std::string_view head, std::string_view name )
+{
+    size_t line_begin = head.find( "\r\n" );
+    while ( line_begin != std::string_view::npos )
+    {
+        line_begin += 2;
+        size_t line_end = head.find( "\r\n", line_begin );
+        std::string_view line = head.substr( line_begin, line_end == std::string_view::npos ? std::string_view::npos : line_end - line_begin );
+        line_begin = line_end;
+
+        size_t colon = line.find( ':' );
+        if ( colon != name.size() )
+        {
+            continue;
+        }
+        bool same = true;
+        for ( size_t i = 0; i < colon; ++i )
+        {
+            same = same && std::tolower( static_cast< unsigned char >( line[ i ] ) ) == std::tolower( static_cast< unsigned char >( name[ i ] ) );
+        }
+        if ( !same )
+        {
+            continue;
+        }
+
+        std::string_view value = line.substr( colon + 1 );
+        while ( !value.empty() && ( value.front() == ' ' || value.front() == '\t' ) )
+        {
+            value.remove_prefix( 1 );
+        }
+        while ( !value.empty() && ( value.back() == ' ' || value.back() == '\t' ) )
+        {
+            value.remove_suffix( 1 );
+        }
+        return value;
+    }
+    return {};
+}
+
+// Browsers send the host name of the page's url. A page of another site that
+// resolves its own name to 127.0.0.1 still sends its own name.
+bool IsLocalHost( std::string_view host, uint16_t port )
+{
+    return host == fmt::format( "127.0.0.1:{}", port ) || host == fmt::format( "localhost:{}", port );
+}
+
+std::string_view StatusText( int status )
+{
+    switch ( status )
+    {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    default:  return "Internal Server Error";
+    }
+}
+
+bool WriteAll( int fd, const char *data, size_t size )
+{
+    while ( size > 0 )
+    {
+        ssize_t n = send( fd, data, size, MSG_NOSIGNAL );
+        if ( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( n <= 0 )
+        {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void HandleConnection( int fd, uint16_t port, const HttpHandler &handler )
+{
+    // Slow or stuck clients only hold a pool thread for a while
+    timeval timeout = { 5, 0 };
+    setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+
+    std::string head;
+    size_t head_end = std::string::npos;
+    char buf[ 4096 ];
+    while ( head_end == std::string::npos && head.size() < MaxRequestSize )
+    {
+        ssize_t n = recv( fd, buf, sizeof( buf ), 0 );
+        if ( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( n <= 0 )
+        {
+            return;
+        }
+        head.append( buf, n );
+        head_end = head.find( "\r\n\r\n" );
+    }
+
+    HttpRequest req;
+    HttpResponse res;
+    if ( head_end == std::string::npos || !ParseRequestLine( head, req ) )
+    {
+        res = ErrorResponse( 400, "Malformed request" );
+    }
+    else if ( !IsLocalHost( HeaderValue( std::string_view( head ).substr( 0, head_end ), "Host" ), port ) )
+    {
+        res = ErrorResponse( 403, "Only requests to 127.0.0.1 or localhost are served" );
+    }
+    else if ( req.m_method != "GET" )
+    {
+        res = ErrorResponse( 405, "Only GET is supported" );
+    }
+    else
+    {
+        try
+        {
+            res = handler( req );
+        }
+        catch ( const std::exception &e )
+        {
+            res = ErrorResponse( 500, e.what() );
+        }
+    }
+
+    std::string header = fmt::format( "HTTP/1.1 {} {}\r\n"
+                                      "Content-Type: {}\r\n"
+                                      "Content-Length: {}\r\n"
+                                      "Cache-Control: no-store\r\n"
+                                      // Cross origin isolation, the threaded web build needs
+                                      // SharedArrayBuffer which is only available with these
+                                      "Cross-Origin-Opener-Policy: same-origin\r\n"
+                                      "Cross-Origin-Embedder-Policy: require-corp\r\n"
+                                      "Connection: close\r\n"
+                                      "\r\n",
+                                      res.m_status, StatusText( res.m_status ), res.m_content_type, res.m_body.size() );
+    if ( WriteAll( fd, header.data(), header.size() ) )
+    {
+        WriteAll( fd, res.m_body.data(), res.m_body.size() );
+    }
+}
+
+} // namespace
+
+HttpResponse ErrorResponse( int status, std::string_view message )
+{
+    HttpResponse res;
+    res.m_status = status;
+    res.m_content_type = "text/plain; charset=utf-8";
+    res.m_body = fmt::format( "{}\n", message );
+    return res;
+}
+
+std::string_view HttpRequest::Param( std::string_view name ) const
+{
+    auto it = m_query.find( name );
+    return it == m_query.end() ? std::string_view() : std::string_view( it->second );
+}
+
+int RunHttpServer( uint16_t port, size_t num_threads, const HttpHandler &handler )
+{
+    int listen_fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( listen_fd < 0 )
+    {
+        std::cerr << fmt::format( "Can not create socket: {}\n", std::strerror( errno ) );
+        return 1;
+    }
+
+    int one = 1;
+    setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+
+    // Any file readable by the user can be rendered, so only local clients
+    // are accepted
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    if ( bind( listen_fd, reinterpret_cast< sockaddr* >( &addr ), sizeof( addr ) ) < 0 || listen( listen_fd, 128 ) < 0 )
+    {
+        std::cerr << fmt::format( "Can not listen on port {}: {}\n", port, std::strerror( errno ) );
+        close( listen_fd );
+        return 1;
+    }
+
+    ThreadPool pool( num_threads );
+    std::cerr << fmt::format( "Serving on http://127.0.0.1:{}/ with {} threads\n", port, pool.NumThreads() );
+
+    while ( true )
+    {
+        int fd = accept4( listen_fd, nullptr, nullptr, SOCK_CLOEXEC );
+        if ( fd < 0 )
+        {
+            if ( errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE )
+            {
+                continue;
+            }
+            std::cerr << fmt::format( "Can not accept connections: {}\n", std::strerror( errno ) );
+            close( listen_fd );
+            return 1;
+        }
+
+        pool.Submit( [ fd, port, &handler ]
+        {
+            HandleConnection( fd, port, handler );
+            close( fd );
+        } );
+    }
+}
+
+} // namespace elfexplorer
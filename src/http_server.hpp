@@ -0,0 +1,62 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__HTTP_SERVER_HPP__
+#define ELFEXPLORER__HTTP_SERVER_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace elfexplorer {
+
+struct HttpRequest
+{
+    std::string m_method;
+    std::string m_path; // Decoded, without the query string
+    std::map< std::string, std::string, std::less<> > m_query;
+
+    // Empty if the query has no such parameter
+    std::string_view Param( std::string_view name ) const;
+};
+
+struct HttpResponse
+{
+    int m_status = 200;
+    std::string m_content_type = "text/html; charset=utf-8";
+    std::string m_body;
+};
+
+using HttpHandler = std::function< HttpResponse( const HttpRequest & ) >;
+
+// Plain text response with `message` as the body
+HttpResponse ErrorResponse( int status, std::string_view message );
+
+// Minimal HTTP/1.1 server for localhost use: GET requests only, one request
+// per connection. Requests whose `Host` is not 127.0.0.1 or localhost with
+// `port` are refused, so pages of other sites can't reach the server through
+// DNS rebinding. Connections are accepted on the calling thread and handled
+// on a pool of `num_threads` threads, so the handler must be thread safe.
+// Runs until the socket fails, returns non zero if it can't be set up.
+int RunHttpServer( uint16_t port, size_t num_threads, const HttpHandler &handler );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__HTTP_SERVER_HPP__
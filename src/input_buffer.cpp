@@ -18,69 +18,212 @@
 
 #include "input_buffer.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "elf_structs.hpp"
+
 namespace elfexplorer {
 
-InputBuffer::InputBuffer( std::string file_name_, std::vector< unsigned char > &&contents_ )
+FileContents::FileContents( std::vector< unsigned char > &&data )
+    : m_data( std::move( data ) )
+{
+}
+
+FileContents FileContents::Map( const std::string &file_name )
+{
+    int fd = open( file_name.c_str(), O_RDONLY | O_CLOEXEC );
+    struct stat st;
+    if ( fd < 0 || fstat( fd, &st ) != 0 )
+    {
+        int err = errno;
+        if ( fd >= 0 )
+        {
+            close( fd );
+        }
+        throw std::runtime_error( "Can not open " + file_name + ": " + std::strerror( err ) );
+    }
+
+    FileContents res;
+    if ( st.st_size > 0 )
+    {
+        void *mapping = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( mapping == MAP_FAILED )
+        {
+            int err = errno;
+            close( fd );
+            throw std::runtime_error( "Can not map " + file_name + ": " + std::strerror( err ) );
+        }
+        res.m_mapping = mapping;
+        res.m_mapping_size = st.st_size;
+    }
+    close( fd );
+    return res;
+}
+
+FileContents::FileContents( FileContents &&other )
+    : m_data( std::move( other.m_data ) )
+    , m_mapping( std::exchange( other.m_mapping, nullptr ) )
+    , m_mapping_size( std::exchange( other.m_mapping_size, 0 ) )
+{
+}
+
+FileContents& FileContents::operator=( FileContents &&other )
+{
+    std::swap( m_data, other.m_data );
+    std::swap( m_mapping, other.m_mapping );
+    std::swap( m_mapping_size, other.m_mapping_size );
+    return *this;
+}
+
+FileContents::~FileContents()
+{
+    if ( m_mapping )
+    {
+        munmap( m_mapping, m_mapping_size );
+    }
+}
+
+void FileContents::DropPages() const
+{
+    if ( m_mapping )
+    {
+        madvise( m_mapping, m_mapping_size, MADV_DONTNEED );
+    }
+}
+
+InputBuffer::InputBuffer( std::string file_name_, FileContents &&contents_, bool track_reads )
     : contents( std::move( contents_ ) )
-    , m_read( contents.size(), false )
+    , m_read( track_reads ? contents.size() : 0, false )
     , file_name( std::move( file_name_ ) )
 {
 }
 
-void InputBuffer::SetRead( uint64_t offset ) const
+void InputBuffer::SetReadRange( uint64_t offset, uint64_t size ) const
 {
-    m_read[ offset ] = true;
+    auto begin = m_read.begin() + offset;
+    std::fill( begin, begin + size, true );
 }
 
 std::string_view InputBuffer::StringViewAt( uint64_t offset, uint64_t size ) const
 {
-    for ( uint64_t i = 0; i < size; ++i )
+    ASSERT( offset <= contents.size() && size <= contents.size() - offset );
+    SetRead( offset, size );
+    return std::string_view( (const char*)contents.data() + offset, size );
+}
+
+std::vector< unsigned char > ReadFile( const char *file_name )
+{
+    std::vector< unsigned char > contents;
+
+    std::ifstream input_file;
+    input_file.exceptions( std::ifstream::failbit | std::ifstream::badbit );
+    input_file.open( file_name, std::ios::binary | std::ios::ate );
+    auto file_size = input_file.tellg();
+    input_file.seekg( 0, std::ios::beg );
+
+    contents.resize( file_size );
+    input_file.read( (char*)contents.data(), file_size );
+
+    return contents;
+}
+
+void WriteFileAtomically( const std::string &file_name, std::string_view contents )
+{
+    std::string tmp_file_name = file_name + ".tmp";
     {
-        SetRead( offset + i );
+        std::ofstream out;
+        out.exceptions( std::ofstream::failbit | std::ofstream::badbit );
+        out.open( tmp_file_name, std::ios::binary );
+        out.write( contents.data(), contents.size() );
+    }
+
+    // Readers see either the old or the new file, never a partial one
+    if ( std::rename( tmp_file_name.c_str(), file_name.c_str() ) != 0 )
+    {
+        throw std::runtime_error( "Can not rename " + tmp_file_name + ": " + std::strerror( errno ) );
     }
-    return std::string_view( (const char*)contents.data() + offset, size );
 }
 
-uint8_t InputBuffer::U8At( uint64_t offset ) const
+std::vector< std::string > FindObjectFiles( const std::string &root )
 {
-    ASSERT( offset + 1 <= contents.size() );
-    SetRead( offset );
-    uint8_t res = contents[ offset ];
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    if ( fs::is_regular_file( root, ec ) )
+    {
+        return { root };
+    }
+
+    std::vector< std::string > res;
+    for ( fs::recursive_directory_iterator it( root, fs::directory_options::skip_permission_denied, ec ), end; !ec && it != end; it.increment( ec ) )
+    {
+        if ( it->path().extension() == ".o" && it->is_regular_file( ec ) )
+        {
+            res.push_back( it->path().string() );
+        }
+    }
+    if ( ec )
+    {
+        throw std::runtime_error( "Can not scan " + root + ": " + ec.message() );
+    }
+
+    std::sort( res.begin(), res.end() );
     return res;
 }
 
-uint16_t InputBuffer::U16At( uint64_t offset ) const
+std::string_view SectionBytes( const InputBuffer &input, const SectionHeader &sh )
 {
-    ASSERT( offset + 2 <= contents.size() );
-    uint16_t res = 0;
-    res <<= 8; res += U8At( offset + 1 );
-    res <<= 8; res += U8At( offset + 0 );
-    return res;
+    const uint64_t file_size = input.contents.size();
+    uint64_t begin = std::min( sh.m_offset, file_size );
+    uint64_t size = std::min( sh.m_size, file_size - begin );
+    return std::string_view( reinterpret_cast< const char* >( input.contents.data() ) + begin, size );
 }
 
-uint32_t InputBuffer::U32At( uint64_t offset ) const
+double MillisecondsSince( std::chrono::steady_clock::time_point start )
 {
-    ASSERT( offset + 4 <= contents.size() );
-    uint32_t res = 0;
-    res <<= 8; res += U8At( offset + 3 );
-    res <<= 8; res += U8At( offset + 2 );
-    res <<= 8; res += U8At( offset + 1 );
-    res <<= 8; res += U8At( offset + 0 );
-    return res;
+    return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
 }
 
-uint64_t InputBuffer::U64At( uint64_t offset ) const
+std::vector< std::pair< uint64_t, uint64_t > > FindUnreadRanges( const InputBuffer &input )
 {
-    ASSERT( offset + 8 <= contents.size() );
-    uint64_t res = 0;
-    res <<= 8; res += U8At( offset + 7 );
-    res <<= 8; res += U8At( offset + 6 );
-    res <<= 8; res += U8At( offset + 5 );
-    res <<= 8; res += U8At( offset + 4 );
-    res <<= 8; res += U8At( offset + 3 );
-    res <<= 8; res += U8At( offset + 2 );
-    res <<= 8; res += U8At( offset + 1 );
-    res <<= 8; res += U8At( offset + 0 );
+    std::vector< std::pair< uint64_t, uint64_t > > res;
+
+    auto begin = input.m_read.begin();
+    auto end = input.m_read.end();
+    auto it = begin;
+
+    while ( true )
+    {
+        auto unread_begin = std::find( it, end, false );
+        if ( unread_begin == end )
+        {
+            break;
+        }
+
+        auto unread_end = std::find( unread_begin, end, true );
+        ASSERT( unread_end != end );
+        it = unread_end + 1;
+
+        auto size = unread_end - unread_begin;
+        if ( size < 32 && std::all_of( unread_begin, unread_end, []( auto x ) { return x == 0; } ) )
+        {
+            // Probably padding, TODO also verify `unread_end` is a section start and size < sec[-1].addr_align
+            continue;
+        }
+
+        res.emplace_back( unread_begin - begin, unread_end - begin );
+    }
+
     return res;
 }
 
@@ -19,9 +19,13 @@
 #ifndef ELFEXPLORER__INPUT_BUFFER_HPP__
 #define ELFEXPLORER__INPUT_BUFFER_HPP__
 
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 // TODO move this
@@ -34,28 +38,132 @@
 
 namespace elfexplorer {
 
+struct SectionHeader;
+
+// Bytes of an input file, either read into memory or mapped
+class FileContents
+{
+public:
+    FileContents() = default;
+    FileContents( std::vector< unsigned char > &&data );
+
+    // Maps the file read only, throws if it can't be opened
+    static FileContents Map( const std::string &file_name );
+
+    FileContents( FileContents &&other );
+    FileContents& operator=( FileContents &&other );
+    ~FileContents();
+
+    const unsigned char* data() const { return m_mapping ? static_cast< const unsigned char* >( m_mapping ) : m_data.data(); }
+    size_t size() const { return m_mapping ? m_mapping_size : m_data.size(); }
+    const unsigned char& operator[]( size_t idx ) const { return data()[ idx ]; }
+
+    // Takes the pages of a mapped file out of memory, they are read from the
+    // file again on the next access. Does nothing if the file was read.
+    void DropPages() const;
+
+private:
+    std::vector< unsigned char > m_data;
+    void *m_mapping = nullptr;
+    size_t m_mapping_size = 0;
+};
+
+enum class ByteOrder
+{
+    Little,
+    Big,
+};
+
+constexpr ByteOrder HostByteOrder = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ ? ByteOrder::Big : ByteOrder::Little;
+
+template < typename T >
+T ByteSwap( T v )
+{
+    static_assert( sizeof( T ) == 1 || sizeof( T ) == 2 || sizeof( T ) == 4 || sizeof( T ) == 8 );
+    if constexpr ( sizeof( T ) == 2 )
+    {
+        return static_cast< T >( __builtin_bswap16( v ) );
+    }
+    else if constexpr ( sizeof( T ) == 4 )
+    {
+        return static_cast< T >( __builtin_bswap32( v ) );
+    }
+    else if constexpr ( sizeof( T ) == 8 )
+    {
+        return static_cast< T >( __builtin_bswap64( v ) );
+    }
+    return v;
+}
+
 class InputBuffer
 {
 public:
-    InputBuffer( std::string file_name_, std::vector< unsigned char > &&contents_ );
+    // Bytes read while loading are recorded for `FindUnreadRanges`, which
+    // takes a bit per byte of input unless `track_reads` is false
+    InputBuffer( std::string file_name_, FileContents &&contents_, bool track_reads = true );
+
+    // Reads an unsigned integer stored in `Order`, a bounds check and a load
+    // (swapped if needed)
+    template < typename T, ByteOrder Order >
+    T ReadAt( uint64_t offset ) const
+    {
+        ASSERT( offset <= contents.size() && sizeof( T ) <= contents.size() - offset );
+        SetRead( offset, sizeof( T ) );
+
+        T res;
+        std::memcpy( &res, contents.data() + offset, sizeof( T ) );
+        if constexpr ( Order != HostByteOrder )
+        {
+            res = ByteSwap( res );
+        }
+        return res;
+    }
 
     // Reading data in little endian
-    uint8_t U8At( uint64_t offset ) const;
-    uint16_t U16At( uint64_t offset ) const;
-    uint32_t U32At( uint64_t offset ) const;
-    uint64_t U64At( uint64_t offset ) const;
+    uint8_t U8At( uint64_t offset ) const { return ReadAt< uint8_t, ByteOrder::Little >( offset ); }
+    uint16_t U16At( uint64_t offset ) const { return ReadAt< uint16_t, ByteOrder::Little >( offset ); }
+    uint32_t U32At( uint64_t offset ) const { return ReadAt< uint32_t, ByteOrder::Little >( offset ); }
+    uint64_t U64At( uint64_t offset ) const { return ReadAt< uint64_t, ByteOrder::Little >( offset ); }
 
     std::string_view StringViewAt( uint64_t offset, uint64_t size ) const;
 
 private:
-    void SetRead( uint64_t offset ) const;
+    // Marks [ offset, offset + size ) as read
+    void SetRead( uint64_t offset, uint64_t size ) const
+    {
+        if ( !m_read.empty() )
+        {
+            SetReadRange( offset, size );
+        }
+    }
+
+    void SetReadRange( uint64_t offset, uint64_t size ) const;
 
 public: // TODO make private
-    std::vector< unsigned char > contents;
-    mutable std::vector< bool > m_read; // Mark all the read bytes
+    FileContents contents;
+    mutable std::vector< bool > m_read; // Mark all the read bytes, empty if not tracked
     std::string file_name;
 };
 
+std::vector< unsigned char > ReadFile( const char *file_name );
+
+// Writes through a temporary file renamed over `file_name`
+void WriteFileAtomically( const std::string &file_name, std::string_view contents );
+
+// `.o` files under the directory `root`, sorted. Returns `root` itself if it
+// is a file. Throws if it can't be read.
+std::vector< std::string > FindObjectFiles( const std::string &root );
+
+// Bytes of the section in the input, clamped to the file
+std::string_view SectionBytes( const InputBuffer &input, const SectionHeader &sh );
+
+// For the timings the directory scanning commands print
+double MillisecondsSince( std::chrono::steady_clock::time_point start );
+
+// Returns the [ begin, end ) ranges of the input that were never read while
+// loading, ignoring short zero paddings.
+std::vector< std::pair< uint64_t, uint64_t > > FindUnreadRanges( const InputBuffer &input );
+
 } // namespace elfexplorer
 
 #endif // ELFEXPLORER__INPUT_BUFFER_HPP__
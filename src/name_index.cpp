@@ -0,0 +1,336 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "name_index.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
+
+#include <cxxabi.h>
+
+#include "stats.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+// Names are split into 256 partitions by the first byte of their trigrams, so
+// posting lists can be put together one partition per thread
+constexpr size_t NumPartitions = 256;
+
+// Calls `f( part )` for each of [ 0, num_parts ) on `num_threads` threads
+template < typename F >
+void ParallelFor( size_t num_parts, size_t num_threads, const F &f )
+{
+#ifdef __EMSCRIPTEN__
+    (void)num_threads;
+    for ( size_t part = 0; part < num_parts; ++part )
+    {
+        f( part );
+    }
+#else
+    std::atomic< size_t > next = 0;
+    auto worker = [ & ]
+    {
+        for ( size_t part = next++; part < num_parts; part = next++ )
+        {
+            f( part );
+        }
+    };
+
+    std::vector< std::thread > threads;
+    for ( size_t i = 1; i < std::min( num_threads, num_parts ); ++i )
+    {
+        threads.emplace_back( worker );
+    }
+    worker();
+    for ( std::thread &t : threads )
+    {
+        t.join();
+    }
+#endif
+}
+
+uint32_t Trigram( std::string_view s, size_t pos )
+{
+    return uint32_t( uint8_t( s[ pos ] ) ) << 16 | uint32_t( uint8_t( s[ pos + 1 ] ) ) << 8 | uint8_t( s[ pos + 2 ] );
+}
+
+void AppendTrigrams( std::vector< uint32_t > &res, std::string_view s )
+{
+    for ( size_t pos = 0; pos + 3 <= s.size(); ++pos )
+    {
+        res.push_back( Trigram( s, pos ) );
+    }
+}
+
+void SortUnique( std::vector< uint32_t > &v )
+{
+    std::sort( v.begin(), v.end() );
+    v.erase( std::unique( v.begin(), v.end() ), v.end() );
+}
+
+// Empty if `name` is not a mangled C++ name
+std::string Demangle( const char *name )
+{
+    if ( name[ 0 ] != '_' || name[ 1 ] != 'Z' )
+    {
+        return {};
+    }
+    int status = 0;
+    std::unique_ptr< char, decltype( &std::free ) > res( abi::__cxa_demangle( name, nullptr, nullptr, &status ), &std::free );
+    return status == 0 && res ? std::string( res.get() ) : std::string();
+}
+
+} // namespace
+
+NameIndex::NameIndex( const ELF_File &elf, bool demangle, size_t num_threads )
+{
+#ifndef __EMSCRIPTEN__
+    if ( num_threads == 0 )
+    {
+        num_threads = std::max( std::thread::hardware_concurrency(), 1u );
+    }
+#endif
+    num_threads = std::max< size_t >( num_threads, 1 );
+
+    std::vector< const char* > c_names;
+    for ( size_t idx = 0; idx < elf.m_sections.size(); ++idx )
+    {
+        const std::pmr::string &name = elf.m_sections[ idx ].m_header.m_name;
+        if ( !name.empty() )
+        {
+            m_entries.push_back( Entry{ uint32_t( idx ), NoSymbol } );
+            c_names.push_back( name.c_str() );
+            m_names.push_back( name );
+        }
+    }
+    for ( size_t idx = 0; idx < elf.m_sections.size(); ++idx )
+    {
+        const SymbolTable *symtab = std::get_if< SymbolTable >( &elf.m_sections[ idx ].m_var );
+        if ( !symtab )
+        {
+            continue;
+        }
+        for ( size_t i = 0; i < symtab->m_symbols.size(); ++i )
+        {
+            const std::pmr::string &name = symtab->m_symbols[ i ].m_name;
+            if ( !name.empty() )
+            {
+                m_entries.push_back( Entry{ uint32_t( idx ), uint32_t( i ) } );
+                c_names.push_back( name.c_str() );
+                m_names.push_back( name );
+            }
+        }
+    }
+
+    const size_t num_names = m_names.size();
+    const size_t num_parts = std::min( num_threads, std::max< size_t >( num_names / 4096, 1 ) );
+    auto part_begin = [ & ]( size_t part ) { return num_names * part / num_parts; };
+
+    if ( demangle )
+    {
+        stats::ScopedPhase phase( "name_index", "demangle" );
+        m_demangled.resize( num_names );
+        ParallelFor( num_parts, num_threads, [ & ]( size_t part )
+        {
+            for ( size_t id = part_begin( part ); id < part_begin( part + 1 ); ++id )
+            {
+                m_demangled[ id ] = Demangle( c_names[ id ] );
+            }
+        } );
+    }
+
+    // Low 16 bits of the trigram and the name, per part and partition. Parts
+    // are ranges of names in order, so concatenating them keeps each posting
+    // list sorted.
+    std::vector< std::vector< uint64_t > > postings( num_parts * NumPartitions );
+    {
+        stats::ScopedPhase phase( "name_index", "trigrams" );
+        ParallelFor( num_parts, num_threads, [ & ]( size_t part )
+        {
+            std::vector< uint32_t > trigrams;
+            for ( size_t id = part_begin( part ); id < part_begin( part + 1 ); ++id )
+            {
+                trigrams.clear();
+                AppendTrigrams( trigrams, m_names[ id ] );
+                if ( demangle )
+                {
+                    AppendTrigrams( trigrams, m_demangled[ id ] );
+                }
+                SortUnique( trigrams );
+                for ( uint32_t t : trigrams )
+                {
+                    postings[ part * NumPartitions + ( t >> 16 ) ].push_back( uint64_t( t & 0xffff ) << 32 | id );
+                }
+            }
+        } );
+    }
+
+    // Posting lists of each partition go to their own range of `m_postings`,
+    // ordered by a counting sort on the low bits of the trigrams
+    std::vector< size_t > partition_begin( NumPartitions + 1, 0 );
+    for ( size_t p = 0; p < NumPartitions; ++p )
+    {
+        partition_begin[ p + 1 ] = partition_begin[ p ];
+        for ( size_t part = 0; part < num_parts; ++part )
+        {
+            partition_begin[ p + 1 ] += postings[ part * NumPartitions + p ].size();
+        }
+    }
+    m_postings.resize( partition_begin.back() );
+
+    std::vector< std::vector< uint32_t > > partition_trigrams( NumPartitions );
+    std::vector< std::vector< uint32_t > > partition_starts( NumPartitions );
+    {
+        stats::ScopedPhase phase( "name_index", "posting_lists" );
+        ParallelFor( NumPartitions, num_threads, [ & ]( size_t p )
+        {
+            if ( partition_begin[ p ] == partition_begin[ p + 1 ] )
+            {
+                return;
+            }
+
+            std::vector< uint32_t > pos( 1 << 16, 0 );
+            for ( size_t part = 0; part < num_parts; ++part )
+            {
+                for ( uint64_t v : postings[ part * NumPartitions + p ] )
+                {
+                    ++pos[ v >> 32 ];
+                }
+            }
+
+            uint32_t start = partition_begin[ p ];
+            for ( uint32_t low = 0; low < pos.size(); ++low )
+            {
+                if ( pos[ low ] != 0 )
+                {
+                    partition_trigrams[ p ].push_back( uint32_t( p ) << 16 | low );
+                    partition_starts[ p ].push_back( start );
+                }
+                std::swap( start, pos[ low ] );
+                start += pos[ low ];
+            }
+
+            for ( size_t part = 0; part < num_parts; ++part )
+            {
+                for ( uint64_t v : postings[ part * NumPartitions + p ] )
+                {
+                    m_postings[ pos[ v >> 32 ]++ ] = uint32_t( v );
+                }
+                std::vector< uint64_t >().swap( postings[ part * NumPartitions + p ] );
+            }
+        } );
+    }
+
+    for ( size_t p = 0; p < NumPartitions; ++p )
+    {
+        m_trigrams.insert( m_trigrams.end(), partition_trigrams[ p ].begin(), partition_trigrams[ p ].end() );
+        m_starts.insert( m_starts.end(), partition_starts[ p ].begin(), partition_starts[ p ].end() );
+    }
+    m_starts.push_back( m_postings.size() );
+}
+
+bool NameIndex::Matches( uint32_t id, std::string_view text ) const
+{
+    return m_names[ id ].find( text ) != std::string_view::npos
+        || ( !m_demangled.empty() && m_demangled[ id ].find( text ) != std::string::npos );
+}
+
+std::vector< uint32_t > NameIndex::Search( std::string_view text, size_t limit ) const
+{
+    std::vector< uint32_t > res;
+
+    // Too short to have a trigram, every name is compared
+    if ( text.size() < 3 )
+    {
+        for ( uint32_t id = 0; id < m_names.size() && res.size() < limit; ++id )
+        {
+            if ( Matches( id, text ) )
+            {
+                res.push_back( id );
+            }
+        }
+        return res;
+    }
+
+    std::vector< uint32_t > trigrams;
+    AppendTrigrams( trigrams, text );
+    SortUnique( trigrams );
+
+    struct List
+    {
+        const uint32_t *m_begin;
+        const uint32_t *m_end;
+    };
+    std::vector< List > lists;
+    for ( uint32_t t : trigrams )
+    {
+        auto it = std::lower_bound( m_trigrams.begin(), m_trigrams.end(), t );
+        if ( it == m_trigrams.end() || *it != t )
+        {
+            return res;
+        }
+        const size_t i = it - m_trigrams.begin();
+        lists.push_back( List{ m_postings.data() + m_starts[ i ], m_postings.data() + m_starts[ i + 1 ] } );
+    }
+    std::sort( lists.begin(), lists.end(), []( const List &a, const List &b ) { return a.m_end - a.m_begin < b.m_end - b.m_begin; } );
+
+    // Candidates only shrink, the longer lists are searched for them rather
+    // than walked
+    std::vector< uint32_t > candidates( lists[ 0 ].m_begin, lists[ 0 ].m_end );
+    for ( size_t i = 1; i < lists.size() && !candidates.empty(); ++i )
+    {
+        const uint32_t *pos = lists[ i ].m_begin;
+        size_t kept = 0;
+        for ( uint32_t id : candidates )
+        {
+            pos = std::lower_bound( pos, lists[ i ].m_end, id );
+            if ( pos == lists[ i ].m_end )
+            {
+                break;
+            }
+            if ( *pos == id )
+            {
+                candidates[ kept++ ] = id;
+            }
+        }
+        candidates.resize( kept );
+    }
+
+    for ( uint32_t id : candidates )
+    {
+        if ( res.size() == limit )
+        {
+            break;
+        }
+        if ( Matches( id, text ) )
+        {
+            res.push_back( id );
+        }
+    }
+    return res;
+}
+
+} // namespace elfexplorer
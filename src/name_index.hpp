@@ -0,0 +1,94 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__NAME_INDEX_HPP__
+#define ELFEXPLORER__NAME_INDEX_HPP__
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "elf_structs.hpp"
+
+namespace elfexplorer {
+
+// Substring search over the names of the sections and of the symbols in the
+// loaded symbol tables. Every name is split into trigrams (3 byte substrings),
+// and each trigram has a posting list of the names containing it. A query
+// intersects the lists of its trigrams, shortest first, and only compares the
+// names left with the query. Case sensitive, like `grep`.
+class NameIndex
+{
+public:
+    static constexpr uint32_t NoSymbol = std::numeric_limits< uint32_t >::max();
+
+    struct Entry
+    {
+        uint32_t m_section_idx; // Of the symbol table for symbols
+        uint32_t m_symbol_idx;  // NoSymbol for section names
+    };
+
+    // With `demangle`, C++ symbols also match by their demangled names.
+    // Trigrams are collected on `num_threads` threads, 0 for the number of
+    // cores (the web build always uses one). Names point into `elf`.
+    NameIndex( const ELF_File &elf, bool demangle = false, size_t num_threads = 0 );
+
+    // Entries whose name contains `text` in increasing order, section names
+    // first then the symbols of each table in order. At most `limit` of them.
+    std::vector< uint32_t > Search( std::string_view text, size_t limit = std::numeric_limits< size_t >::max() ) const;
+
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    const Entry& operator[]( uint32_t id ) const
+    {
+        return m_entries[ id ];
+    }
+
+    std::string_view Name( uint32_t id ) const
+    {
+        return m_names[ id ];
+    }
+
+    // Empty if the name is not a mangled C++ name or demangling is off
+    std::string_view Demangled( uint32_t id ) const
+    {
+        return m_demangled.empty() ? std::string_view() : m_demangled[ id ];
+    }
+
+private:
+    bool Matches( uint32_t id, std::string_view text ) const;
+
+    std::vector< Entry > m_entries;
+    std::vector< std::string_view > m_names;
+    std::vector< std::string > m_demangled; // Empty without demangling
+
+    // Posting lists stored back to back: the names containing `m_trigrams[ i ]`
+    // are `m_postings[ m_starts[ i ] ]` to `m_postings[ m_starts[ i + 1 ] - 1 ]`
+    std::vector< uint32_t > m_trigrams; // Sorted
+    std::vector< uint32_t > m_starts;
+    std::vector< uint32_t > m_postings;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__NAME_INDEX_HPP__
@@ -0,0 +1,252 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "debug_line.hpp"
+#include "elf_layout.hpp"
+#include "elf_structs.hpp"
+#include "function_index.hpp"
+#include "html_output.hpp"
+#include "stats.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+// Frees on deallocation, unlike the arena `ELF_File` normally uses, and
+// counts the bytes in use
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t BytesInUse() const
+    {
+        return m_bytes_in_use;
+    }
+
+private:
+    void* do_allocate( size_t bytes, size_t alignment ) override
+    {
+        void *res = std::pmr::new_delete_resource()->allocate( bytes, alignment );
+        m_bytes_in_use += bytes;
+        return res;
+    }
+
+    void do_deallocate( void *p, size_t bytes, size_t alignment ) override
+    {
+        m_bytes_in_use -= bytes;
+        std::pmr::new_delete_resource()->deallocate( p, bytes, alignment );
+    }
+
+    bool do_is_equal( const std::pmr::memory_resource &other ) const noexcept override
+    {
+        return this == &other;
+    }
+
+    size_t m_bytes_in_use = 0;
+};
+
+// Sections the html of chunk `chunk` shows names or rows from, besides the
+// section itself. Follows what `HTMLChunkRenderer` looks up, and is worked
+// out from the headers only so it is known before anything is loaded.
+std::vector< uint32_t > RenderDependencies( const std::pmr::vector< Section > &sections, size_t chunk )
+{
+    std::vector< uint32_t > res;
+    auto add = [ & ]( uint32_t idx )
+    {
+        if ( idx != 0 && idx != chunk && idx < sections.size() )
+        {
+            res.push_back( idx );
+        }
+    };
+
+    // Signature symbols of groups in the section header table
+    if ( chunk == 0 )
+    {
+        for ( const Section &sec : sections )
+        {
+            if ( sec.m_header.m_type == SectionType::SHT_GROUP )
+            {
+                add( sec.m_header.m_asso_idx );
+            }
+        }
+        return res;
+    }
+
+    const SectionHeader &sh = sections[ chunk ].m_header;
+    if ( sh.m_attrs & SectionFlags::SHF_COMPRESSED )
+    {
+        return res;
+    }
+
+    switch ( sh.m_type == SHT_X86_64_UNWIND ? SectionType::SHT_PROGBITS : sh.m_type )
+    {
+    case SectionType::SHT_RELA:
+    case SectionType::SHT_REL:
+    case SectionType::SHT_SYMTAB_SHNDX:
+        add( sh.m_asso_idx );
+        break;
+    case SectionType::SHT_PROGBITS:
+        // FDEs with the function symbols their code address is relocated
+        // to, and code with its relocations and the symbols of all symbol
+        // tables as labels
+        if ( sh.m_name == ".eh_frame" || ( sh.m_attrs & SectionFlags::SHF_EXECINSTR ) )
+        {
+            for ( size_t idx = 1; idx < sections.size(); ++idx )
+            {
+                const SectionHeader &other = sections[ idx ].m_header;
+                if ( ( other.m_type == SectionType::SHT_RELA || other.m_type == SectionType::SHT_REL ) && other.m_info == chunk )
+                {
+                    add( idx );
+                    if ( other.m_asso_idx < sections.size() && sections[ other.m_asso_idx ].m_header.m_type != SectionType::SHT_SYMTAB )
+                    {
+                        add( other.m_asso_idx );
+                    }
+                }
+                else if ( other.m_type == SectionType::SHT_SYMTAB )
+                {
+                    add( idx );
+                }
+            }
+        }
+        // Source lines are decoded for all code with the first code section,
+        // and kept by the renderer
+        if ( sh.m_attrs & SectionFlags::SHF_EXECINSTR )
+        {
+            size_t first_code = 1;
+            while ( first_code < chunk && ( sections[ first_code ].m_header.m_type != SectionType::SHT_PROGBITS
+                                         || !( sections[ first_code ].m_header.m_attrs & SectionFlags::SHF_EXECINSTR ) ) )
+            {
+                ++first_code;
+            }
+            if ( first_code == chunk )
+            {
+                for ( uint32_t idx : LineTable::Dependencies( sections ) )
+                {
+                    add( idx );
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return res;
+}
+
+} // namespace
+
+void RenderPipelined( std::ostream &out, InputBuffer &input, size_t memory_budget, Markup markup )
+{
+    auto model_memory = std::make_unique< CountingResource >();
+    const CountingResource &model = *model_memory;
+    SectionLoader loader( input, std::move( model_memory ) );
+    const std::pmr::vector< Section > &sections = loader.File().m_sections;
+    const size_t header_bytes = model.BytesInUse();
+
+    FunctionIndex functions( loader.File() );
+    HTMLChunkRenderer renderer( loader.File(), 0, &functions, markup );
+    const size_t num_chunks = renderer.NumChunks();
+
+    std::vector< std::vector< uint32_t > > dependencies( num_chunks );
+    std::vector< size_t > last_use( sections.size() ); // Last chunk using each section
+    for ( size_t chunk = 0; chunk < num_chunks; ++chunk )
+    {
+        dependencies[ chunk ] = RenderDependencies( sections, chunk );
+        if ( chunk < sections.size() )
+        {
+            last_use[ chunk ] = std::max( last_use[ chunk ], chunk );
+        }
+        for ( uint32_t dep : dependencies[ chunk ] )
+        {
+            last_use[ dep ] = std::max( last_use[ dep ], chunk );
+        }
+    }
+
+    // Rough split of the budget, html is written out in pieces of an eighth
+    const size_t flush_threshold = std::max< size_t >( memory_budget / 8, 64 * 1024 );
+    const size_t model_limit = memory_budget / 2;
+    const size_t mapped_limit = memory_budget / 4;
+
+    auto write = [ &out ]( fmt::memory_buffer &html )
+    {
+        stats::ScopedPhase phase( "write_output", {}, html.size() );
+        out.write( html.data(), html.size() );
+    };
+    ScopedOutputFlush flush( write, flush_threshold );
+
+    fmt::memory_buffer html;
+    RenderDocumentHead( html );
+
+    uint64_t mapped_bytes = 0;
+    std::vector< uint32_t > to_release;
+    for ( size_t chunk = 0; chunk < num_chunks; ++chunk )
+    {
+        if ( chunk != 0 )
+        {
+            loader.Load( chunk );
+            mapped_bytes += sections[ chunk ].m_header.m_size;
+        }
+        for ( uint32_t dep : dependencies[ chunk ] )
+        {
+            loader.Load( dep );
+            mapped_bytes += sections[ dep ].m_header.m_size;
+        }
+
+        renderer.RenderChunk( html, chunk );
+        functions.ReleaseTables( chunk ); // Points into sections released below
+        write( html );
+        html.clear();
+
+        // Sections no later chunk uses. Over budget, also the ones still to
+        // be used, which are then loaded again.
+        stats::ScopedPhase phase( "release" );
+        const bool over_budget = model.BytesInUse() - header_bytes > model_limit;
+        to_release.clear();
+        for ( uint32_t idx : loader.LoadedSections() )
+        {
+            if ( over_budget || last_use[ idx ] <= chunk )
+            {
+                to_release.push_back( idx );
+            }
+        }
+        for ( uint32_t idx : to_release )
+        {
+            loader.Release( idx );
+        }
+
+        if ( mapped_bytes > mapped_limit )
+        {
+            input.contents.DropPages();
+            mapped_bytes = 0;
+        }
+    }
+
+    RenderDocumentTail( html );
+    write( html );
+    out.flush();
+}
+
+} // namespace elfexplorer
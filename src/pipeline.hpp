@@ -0,0 +1,47 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__PIPELINE_HPP__
+#define ELFEXPLORER__PIPELINE_HPP__
+
+#include <cstddef>
+#include <ostream>
+
+#include "html_output.hpp"
+#include "input_buffer.hpp"
+
+namespace elfexplorer {
+
+// Renders the same html as `RenderAsHTML`, but loads, renders, writes out and
+// releases one section at a time so that objects larger than memory can be
+// rendered. Tables other sections refer to (e.g. a symbol table used by
+// relocations) stay loaded only until the last section using them is
+// rendered. Memory is kept around `memory_budget` bytes, on top of the
+// section headers, by
+//
+//   - writing html to `out` while it is rendered, also within a section
+//   - loading shared tables again when needed if keeping them goes over budget
+//   - dropping pages of a mapped input (`FileContents::Map`) every now and then
+//
+// A single section still has to fit, as its contents are copied into the
+// model. Reads of `input` had better not be tracked, see `InputBuffer`.
+void RenderPipelined( std::ostream &out, InputBuffer &input, size_t memory_budget, Markup markup = Markup::Full );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__PIPELINE_HPP__
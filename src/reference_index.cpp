@@ -0,0 +1,147 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#include "reference_index.hpp"
+
+#include <numeric>
+
+namespace elfexplorer {
+
+namespace {
+
+// Calls `f( section_idx, entry, symtab, symbol_idx )` for each relocation of
+// the loaded relocation sections referring to a symbol
+template < typename F >
+void ForEachRelocation( const ELF_File &elf, const F &f )
+{
+    const auto &sections = elf.m_sections;
+    for ( size_t idx = 0; idx < sections.size(); ++idx )
+    {
+        const SectionHeader &sh = sections[ idx ].m_header;
+        const RelocationEntries *reloc = std::get_if< RelocationEntries >( &sections[ idx ].m_var );
+        if ( !reloc || sh.m_info >= sections.size() || sh.m_asso_idx >= sections.size() )
+        {
+            continue;
+        }
+        const SymbolTable *symtab = std::get_if< SymbolTable >( &sections[ sh.m_asso_idx ].m_var );
+        if ( !symtab )
+        {
+            continue;
+        }
+
+        for ( const RelocationEntry &e : reloc->m_entries )
+        {
+            // Symbol 0 is STN_UNDEF, the relocation has no symbol
+            if ( e.m_symbol != 0 && e.m_symbol < symtab->m_symbols.size() )
+            {
+                f( uint32_t( sh.m_info ), e, sh.m_asso_idx, e.m_symbol );
+            }
+        }
+    }
+}
+
+// Turns counts into the start of each range, with the total at the end
+void CountsToStarts( std::vector< uint32_t > &starts )
+{
+    starts.push_back( 0 );
+    std::exclusive_scan( starts.begin(), starts.end(), starts.begin(), uint32_t( 0 ) );
+}
+
+} // namespace
+
+ReferenceIndex::ReferenceIndex( const ELF_File &elf )
+{
+    const auto &sections = elf.m_sections;
+
+    uint32_t num_symbols = 0;
+    m_symtab_ids.resize( sections.size() );
+    for ( size_t idx = 0; idx < sections.size(); ++idx )
+    {
+        m_symtab_ids[ idx ] = num_symbols;
+        if ( const SymbolTable *symtab = std::get_if< SymbolTable >( &sections[ idx ].m_var ) )
+        {
+            num_symbols += symtab->m_symbols.size();
+        }
+    }
+
+    // The section a symbol is defined in, 0 for undefined, absolute and
+    // common symbols
+    auto defined_in = [ & ]( size_t symtab_idx, uint32_t symbol_idx ) -> uint32_t
+    {
+        const Symbol &s = std::get< SymbolTable >( sections[ symtab_idx ].m_var ).m_symbols[ symbol_idx ];
+        return s.m_section_idx < sections.size() ? s.m_section_idx : 0;
+    };
+
+    m_symbol_starts.assign( num_symbols, 0 );
+    m_section_starts.assign( sections.size(), 0 );
+    ForEachRelocation( elf, [ & ]( uint32_t, const RelocationEntry &, size_t symtab_idx, uint32_t symbol_idx )
+    {
+        ++m_symbol_starts[ m_symtab_ids[ symtab_idx ] + symbol_idx ];
+        if ( uint32_t section_idx = defined_in( symtab_idx, symbol_idx ) )
+        {
+            ++m_section_starts[ section_idx ];
+        }
+    } );
+    CountsToStarts( m_symbol_starts );
+    CountsToStarts( m_section_starts );
+
+    // Filled in through copies of the starts, each ends up at the start of
+    // the next range
+    m_symbol_refs.resize( m_symbol_starts.back() );
+    m_section_refs.resize( m_section_starts.back() );
+    std::vector< uint32_t > symbol_pos( m_symbol_starts.begin(), m_symbol_starts.end() - 1 );
+    std::vector< uint32_t > section_pos( m_section_starts.begin(), m_section_starts.end() - 1 );
+    ForEachRelocation( elf, [ & ]( uint32_t section_idx, const RelocationEntry &e, size_t symtab_idx, uint32_t symbol_idx )
+    {
+        const Reference ref{ &e, section_idx };
+        m_symbol_refs[ symbol_pos[ m_symtab_ids[ symtab_idx ] + symbol_idx ]++ ] = ref;
+        if ( uint32_t defined = defined_in( symtab_idx, symbol_idx ) )
+        {
+            m_section_refs[ section_pos[ defined ]++ ] = ref;
+        }
+    } );
+}
+
+ReferenceIndex::Slice ReferenceIndex::ToSymbol( size_t symtab_idx, size_t symbol_idx ) const
+{
+    if ( symtab_idx >= m_symtab_ids.size() )
+    {
+        return { nullptr, nullptr };
+    }
+    const size_t id = m_symtab_ids[ symtab_idx ] + symbol_idx;
+    const size_t next_table = symtab_idx + 1 < m_symtab_ids.size() ? m_symtab_ids[ symtab_idx + 1 ] : m_symbol_starts.size() - 1;
+    if ( id >= next_table )
+    {
+        return { nullptr, nullptr };
+    }
+    const Reference *refs = m_symbol_refs.data();
+    return { refs + m_symbol_starts[ id ], refs + m_symbol_starts[ id + 1 ] };
+}
+
+ReferenceIndex::Slice ReferenceIndex::ToSection( size_t section_idx ) const
+{
+    if ( section_idx + 1 >= m_section_starts.size() )
+    {
+        return { nullptr, nullptr };
+    }
+    const Reference *refs = m_section_refs.data();
+    return { refs + m_section_starts[ section_idx ], refs + m_section_starts[ section_idx + 1 ] };
+}
+
+} // namespace elfexplorer
@@ -0,0 +1,85 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef ELFEXPLORER__REFERENCE_INDEX_HPP__
+#define ELFEXPLORER__REFERENCE_INDEX_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "elf_structs.hpp"
+
+namespace elfexplorer {
+
+// Relocations read backwards, from the symbol they refer to (and the section
+// that symbol is defined in) to the places referring to it. Built in one pass
+// over the loaded relocation sections counting references per symbol and per
+// section, and one filling them in, each stored back to back in a single
+// array. After that the references to a symbol are a lookup. The model must
+// outlive the index.
+class ReferenceIndex
+{
+public:
+    struct Reference
+    {
+        const RelocationEntry *m_entry; // Offset, type and addend
+        uint32_t m_section_idx;         // Section the relocation applies to
+    };
+
+    struct Slice
+    {
+        const Reference* begin() const { return m_begin; }
+        const Reference* end() const { return m_end; }
+        size_t size() const { return m_end - m_begin; }
+        bool empty() const { return m_begin == m_end; }
+
+        const Reference *m_begin;
+        const Reference *m_end;
+    };
+
+    explicit ReferenceIndex( const ELF_File &elf );
+
+    // Relocations referring to a symbol of the table `symtab_idx`, in the
+    // order of the sections they apply to and then of the relocations
+    Slice ToSymbol( size_t symtab_idx, size_t symbol_idx ) const;
+
+    // Relocations referring to any symbol defined in the section, including
+    // its section symbol, in the same order
+    Slice ToSection( size_t section_idx ) const;
+
+    size_t size() const
+    {
+        return m_symbol_refs.size();
+    }
+
+private:
+    // Ids of the symbols of `symtab_idx` start at `m_symtab_ids[ symtab_idx ]`
+    std::vector< uint32_t > m_symtab_ids;
+
+    // References to symbol id `i` are `m_symbol_refs[ m_symbol_starts[ i ] ]`
+    // to `m_symbol_refs[ m_symbol_starts[ i + 1 ] - 1 ]`, likewise per section
+    std::vector< uint32_t > m_symbol_starts;
+    std::vector< Reference > m_symbol_refs;
+    std::vector< uint32_t > m_section_starts;
+    std::vector< Reference > m_section_refs;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__REFERENCE_INDEX_HPP__
@@ -0,0 +1,625 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "serve.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <fmt/format.h>
+
+#include "elf_structs.hpp"
+#include "function_index.hpp"
+#include "html_output.hpp"
+#include "http_server.hpp"
+#include "input_buffer.hpp"
+#include "name_index.hpp"
+#include "reference_index.hpp"
+#include "symbol_columns.hpp"
+#include "table_data.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+// An object and the model parsed from it, which points into its contents
+struct ParsedFile
+{
+    explicit ParsedFile( InputBuffer &&input )
+        : m_input( std::move( input ) )
+        , m_elf( ELF_File::LoadFrom( m_input ) )
+    {
+    }
+
+    // Contents and the model, which is usually about as large as the input
+    size_t MemoryEstimate() const
+    {
+        return m_input.contents.size() * 2;
+    }
+
+    // Built on the first request showing code
+    const FunctionIndex& Functions() const
+    {
+        std::call_once( m_functions_once, [ this ] { m_functions = std::make_unique< const FunctionIndex >( m_elf ); } );
+        return *m_functions;
+    }
+
+    // Built on the first search, on all cores
+    const NameIndex& Names() const
+    {
+        std::call_once( m_names_once, [ this ] { m_names = std::make_unique< const NameIndex >( m_elf ); } );
+        return *m_names;
+    }
+
+    // Built on the first request, symbol tables show the number of references
+    const ReferenceIndex& References() const
+    {
+        std::call_once( m_references_once, [ this ] { m_references = std::make_unique< const ReferenceIndex >( m_elf ); } );
+        return *m_references;
+    }
+
+    // Rows of a symbol table matching a query, in display order. The columns
+    // of a table are read on its first query. The last few results are kept,
+    // as a table view asks for consecutive ranges of the same query.
+    std::shared_ptr< const std::vector< uint32_t > > QueryRows( size_t symtab_idx, std::string_view query_text ) const
+    {
+        const SymbolQuery query = SymbolQuery::Parse( query_text );
+
+        std::shared_ptr< const SymbolColumns > columns;
+        {
+            std::lock_guard< std::mutex > lock( m_query_mutex );
+            for ( const QueryResult &r : m_query_results )
+            {
+                if ( r.m_symtab_idx == symtab_idx && r.m_query == query_text )
+                {
+                    return r.m_rows;
+                }
+            }
+            auto it = m_columns.find( symtab_idx );
+            if ( it != m_columns.end() )
+            {
+                columns = it->second;
+            }
+        }
+
+        if ( !columns )
+        {
+            columns = std::make_shared< const SymbolColumns >( SymbolColumns::Load( m_input, m_elf, symtab_idx ) );
+        }
+        auto rows = std::make_shared< const std::vector< uint32_t > >( RunSymbolQuery( *columns, query ) );
+
+        std::lock_guard< std::mutex > lock( m_query_mutex );
+        m_columns.emplace( symtab_idx, columns );
+        m_query_results.push_front( QueryResult{ symtab_idx, std::string( query_text ), rows } );
+        if ( m_query_results.size() > 4 )
+        {
+            m_query_results.pop_back();
+        }
+        return rows;
+    }
+
+    InputBuffer m_input;
+    ELF_File m_elf;
+
+private:
+    mutable std::once_flag m_functions_once;
+    mutable std::unique_ptr< const FunctionIndex > m_functions;
+    mutable std::once_flag m_names_once;
+    mutable std::unique_ptr< const NameIndex > m_names;
+    mutable std::once_flag m_references_once;
+    mutable std::unique_ptr< const ReferenceIndex > m_references;
+
+    struct QueryResult
+    {
+        size_t m_symtab_idx;
+        std::string m_query;
+        std::shared_ptr< const std::vector< uint32_t > > m_rows;
+    };
+
+    mutable std::mutex m_query_mutex;
+    mutable std::unordered_map< size_t, std::shared_ptr< const SymbolColumns > > m_columns;
+    mutable std::deque< QueryResult > m_query_results;
+};
+
+using ParsedFilePtr = std::shared_ptr< const ParsedFile >;
+
+// Parsed files by path, evicting the least recently used ones once their
+// estimated size exceeds the capacity. A file is parsed again when its
+// mtime or size changes. Concurrent requests for a file that is being
+// parsed wait for that instead of parsing it again.
+class ParsedFileCache
+{
+public:
+    struct Counters
+    {
+        uint64_t m_hits = 0;
+        uint64_t m_misses = 0;
+        uint64_t m_evictions = 0;
+        size_t m_files = 0;
+        size_t m_bytes = 0;
+    };
+
+    explicit ParsedFileCache( size_t capacity_bytes )
+        : m_capacity_bytes( capacity_bytes )
+    {
+    }
+
+    // Null if there is no such file, throws if it can't be parsed
+    ParsedFilePtr Get( const std::string &path )
+    {
+        struct stat st;
+        if ( stat( path.c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) )
+        {
+            return nullptr;
+        }
+        const int64_t mtime_ns = int64_t( st.st_mtim.tv_sec ) * 1000000000 + st.st_mtim.tv_nsec;
+        const uint64_t size = st.st_size;
+
+        std::promise< ParsedFilePtr > promise;
+        uint64_t generation;
+        {
+            std::unique_lock< std::mutex > lock( m_mutex );
+
+            auto it = m_index.find( path );
+            if ( it != m_index.end() )
+            {
+                Entry &entry = *it->second;
+                if ( entry.m_mtime_ns == mtime_ns && entry.m_size == size )
+                {
+                    ++m_counters.m_hits;
+                    m_lru.splice( m_lru.begin(), m_lru, it->second );
+                    std::shared_future< ParsedFilePtr > file = entry.m_file;
+                    lock.unlock();
+                    return file.get();
+                }
+                Erase( it->second ); // Stale
+            }
+
+            ++m_counters.m_misses;
+            generation = ++m_last_generation;
+            m_lru.push_front( Entry{ path, mtime_ns, size, generation, promise.get_future().share(), 0 } );
+            m_index[ path ] = m_lru.begin();
+        }
+
+        ParsedFilePtr file;
+        try
+        {
+            // Without read marks, request threads read the input concurrently
+            file = std::make_shared< const ParsedFile >( InputBuffer( path, ReadFile( path.c_str() ), false ) );
+        }
+        catch ( ... )
+        {
+            promise.set_exception( std::current_exception() );
+            std::lock_guard< std::mutex > lock( m_mutex );
+            if ( auto it = Find( path, generation ) )
+            {
+                Erase( *it );
+            }
+            throw;
+        }
+
+        promise.set_value( file );
+
+        std::lock_guard< std::mutex > lock( m_mutex );
+        if ( auto it = Find( path, generation ) )
+        {
+            ( *it )->m_bytes = file->MemoryEstimate();
+            m_counters.m_bytes += ( *it )->m_bytes;
+            EvictToCapacity();
+        }
+        return file;
+    }
+
+    Counters GetCounters() const
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        Counters res = m_counters;
+        res.m_files = m_lru.size();
+        return res;
+    }
+
+    size_t Capacity() const
+    {
+        return m_capacity_bytes;
+    }
+
+private:
+    struct Entry
+    {
+        std::string m_path;
+        int64_t m_mtime_ns;
+        uint64_t m_size;
+        uint64_t m_generation;
+        std::shared_future< ParsedFilePtr > m_file;
+        size_t m_bytes; // 0 while being parsed
+    };
+    using EntryIt = std::list< Entry >::iterator;
+
+    // The entry inserted for a load, unless it was replaced meanwhile
+    std::optional< EntryIt > Find( const std::string &path, uint64_t generation )
+    {
+        auto it = m_index.find( path );
+        if ( it == m_index.end() || it->second->m_generation != generation )
+        {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    void Erase( EntryIt it )
+    {
+        m_counters.m_bytes -= it->m_bytes;
+        m_index.erase( it->m_path );
+        m_lru.erase( it );
+    }
+
+    // Requests holding an evicted file keep it alive until they are done.
+    // The most recent file is kept even if it is larger than the capacity.
+    void EvictToCapacity()
+    {
+        auto it = m_lru.end();
+        while ( m_counters.m_bytes > m_capacity_bytes && it != std::next( m_lru.begin() ) )
+        {
+            --it;
+            if ( it->m_bytes == 0 )
+            {
+                continue;
+            }
+            ++m_counters.m_evictions;
+            Erase( it++ );
+        }
+    }
+
+    const size_t m_capacity_bytes;
+
+    mutable std::mutex m_mutex;
+    std::list< Entry > m_lru; // Most recently used first
+    std::unordered_map< std::string, EntryIt > m_index;
+    uint64_t m_last_generation = 0;
+    Counters m_counters;
+};
+
+// Latencies of the most recent requests
+class LatencyRecorder
+{
+public:
+    void Record( double ms )
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        if ( m_samples.size() < MaxSamples )
+        {
+            m_samples.push_back( ms );
+        }
+        else
+        {
+            m_samples[ m_num_requests % MaxSamples ] = ms;
+        }
+        ++m_num_requests;
+    }
+
+    void WriteJson( fmt::memory_buffer &out ) const
+    {
+        std::vector< double > samples;
+        uint64_t num_requests;
+        {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            samples = m_samples;
+            num_requests = m_num_requests;
+        }
+        std::sort( samples.begin(), samples.end() );
+
+        auto percentile = [ & ]( double p )
+        {
+            return samples.empty() ? 0.0 : samples[ std::min( samples.size() - 1, size_t( p * samples.size() ) ) ];
+        };
+        fmt::format_to( fmt::appender( out ), "\"requests\": {}, \"latency_ms\": {{ \"samples\": {}, \"p50\": {:.3f}, \"p90\": {:.3f}, \"p99\": {:.3f}, \"max\": {:.3f} }}",
+                        num_requests, samples.size(), percentile( 0.5 ), percentile( 0.9 ), percentile( 0.99 ), samples.empty() ? 0.0 : samples.back() );
+    }
+
+private:
+    static constexpr size_t MaxSamples = 8192;
+
+    mutable std::mutex m_mutex;
+    std::vector< double > m_samples;
+    uint64_t m_num_requests = 0;
+};
+
+bool ParseIndex( std::string_view s, size_t &value )
+{
+    auto [ end, ec ] = std::from_chars( s.data(), s.data() + s.size(), value );
+    return ec == std::errc() && end == s.data() + s.size() && !s.empty();
+}
+
+std::string_view ContentType( std::string_view path )
+{
+    static const std::pair< std::string_view, std::string_view > types[] = {
+        { ".html", "text/html; charset=utf-8" },
+        { ".js",   "application/javascript" },
+        { ".css",  "text/css" },
+        { ".png",  "image/png" },
+        { ".gif",  "image/gif" },
+        { ".wasm", "application/wasm" },
+    };
+    for ( const auto &[ ext, type ] : types )
+    {
+        if ( path.size() >= ext.size() && path.substr( path.size() - ext.size() ) == ext )
+        {
+            return type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+class Server
+{
+public:
+    explicit Server( const ServeOptions &options )
+        : m_web_root( options.m_web_root )
+        , m_cache( options.m_cache_bytes )
+    {
+    }
+
+    HttpResponse Handle( const HttpRequest &req )
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto record = [ & ]
+        {
+            m_latencies.Record( std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() );
+        };
+
+        try
+        {
+            HttpResponse res = Route( req );
+            record();
+            return res;
+        }
+        catch ( ... )
+        {
+            record();
+            throw;
+        }
+    }
+
+private:
+    HttpResponse Route( const HttpRequest &req )
+    {
+        std::string_view path = req.m_path;
+        if ( path == "/api/stats" )
+        {
+            return Stats();
+        }
+        if ( path.substr( 0, 5 ) != "/api/" )
+        {
+            return StaticFile( path );
+        }
+
+        std::string_view file_name = req.Param( "file" );
+        if ( file_name.empty() )
+        {
+            return ErrorResponse( 400, "Missing file parameter" );
+        }
+        ParsedFilePtr file = m_cache.Get( std::string( file_name ) );
+        if ( !file )
+        {
+            return ErrorResponse( 404, fmt::format( "No such file: {}", file_name ) );
+        }
+        const ELF_File &elf = file->m_elf;
+        size_t virtual_rows = 0;
+        if ( !req.Param( "virtual_rows" ).empty() && !ParseIndex( req.Param( "virtual_rows" ), virtual_rows ) )
+        {
+            return ErrorResponse( 400, "Invalid virtual_rows parameter" );
+        }
+        // Pages of the web ui ask for `compact=1`, see `Markup`
+        const Markup markup = req.Param( "compact" ) == "1" ? Markup::Compact : Markup::Full;
+        ScopedMarkup scoped_markup( markup );
+        // Symbol tables count the references to each symbol
+        const ReferenceIndex *references = &file->References();
+        HTMLChunkRenderer renderer( elf, virtual_rows, &file->Functions(), markup, references );
+
+        HttpResponse res;
+        fmt::memory_buffer out;
+        if ( path == "/api/info" )
+        {
+            res.m_content_type = "application/json";
+            fmt::format_to( fmt::appender( out ), "{{ \"sections\": {} }}\n", elf.m_sections.size() );
+        }
+        else if ( path == "/api/headers" )
+        {
+            renderer.RenderChunk( out, 0 );
+        }
+        else if ( path == "/api/section" )
+        {
+            size_t idx;
+            if ( !ParseIndex( req.Param( "idx" ), idx ) || idx == 0 || idx >= renderer.NumChunks() )
+            {
+                return ErrorResponse( 404, "No such section" );
+            }
+            renderer.RenderChunk( out, idx );
+        }
+        else if ( path == "/api/rows" && req.Param( "query" ).empty() )
+        {
+            size_t section_idx, begin, end;
+            if ( !ParseIndex( req.Param( "section" ), section_idx ) || !ParseIndex( req.Param( "begin" ), begin ) || !ParseIndex( req.Param( "end" ), end ) )
+            {
+                return ErrorResponse( 400, "Expected section, begin and end parameters" );
+            }
+            if ( !RenderRows( out, elf, section_idx, begin, end, references ) )
+            {
+                return ErrorResponse( 404, "Section has no rows" );
+            }
+        }
+        else if ( path == "/api/rows" || path == "/api/query" )
+        {
+            size_t section_idx, begin = 0, end = 0;
+            if ( !ParseIndex( req.Param( "section" ), section_idx )
+              || ( path == "/api/rows" && ( !ParseIndex( req.Param( "begin" ), begin ) || !ParseIndex( req.Param( "end" ), end ) ) ) )
+            {
+                return ErrorResponse( 400, "Expected section, begin and end parameters" );
+            }
+            if ( section_idx >= elf.m_sections.size() || !std::holds_alternative< SymbolTable >( elf.m_sections[ section_idx ].m_var ) )
+            {
+                return ErrorResponse( 404, "Section is not a symbol table" );
+            }
+
+            std::shared_ptr< const std::vector< uint32_t > > rows;
+            try
+            {
+                rows = file->QueryRows( section_idx, req.Param( "query" ) );
+            }
+            catch ( const std::exception &e )
+            {
+                return ErrorResponse( 400, e.what() );
+            }
+
+            if ( path == "/api/query" )
+            {
+                res.m_content_type = "application/json";
+                fmt::format_to( fmt::appender( out ), "{{ \"rows\": {} }}\n", rows->size() );
+            }
+            else
+            {
+                RenderSymbolRows( out, elf, section_idx, *rows, begin, end, references );
+            }
+        }
+        else if ( path == "/api/function" )
+        {
+            size_t section_idx, symbol_idx;
+            if ( !ParseIndex( req.Param( "section" ), section_idx ) || !ParseIndex( req.Param( "symbol" ), symbol_idx ) )
+            {
+                return ErrorResponse( 400, "Expected section and symbol parameters" );
+            }
+            std::optional< FunctionIndex::Function > fn = file->Functions().ForSymbol( section_idx, symbol_idx );
+            if ( !fn )
+            {
+                return ErrorResponse( 404, "Symbol is not a function" );
+            }
+            RenderFunction( out, elf, file->Functions(), *fn );
+        }
+        else if ( path == "/api/references" )
+        {
+            size_t section_idx, symbol_idx;
+            if ( !ParseIndex( req.Param( "section" ), section_idx ) || !ParseIndex( req.Param( "symbol" ), symbol_idx ) )
+            {
+                return ErrorResponse( 400, "Expected section and symbol parameters" );
+            }
+            RenderReferences( out, elf, file->Functions(), references->ToSymbol( section_idx, symbol_idx ) );
+        }
+        else if ( path == "/api/search" )
+        {
+            size_t limit = std::numeric_limits< size_t >::max();
+            if ( !req.Param( "limit" ).empty() && !ParseIndex( req.Param( "limit" ), limit ) )
+            {
+                return ErrorResponse( 400, "Invalid limit parameter" );
+            }
+            RenderNameMatches( out, elf, file->Names(), file->Names().Search( req.Param( "q" ), limit ) );
+        }
+        else if ( path == "/api/table" )
+        {
+            size_t section_idx;
+            if ( !ParseIndex( req.Param( "section" ), section_idx ) )
+            {
+                return ErrorResponse( 400, "Expected section parameter" );
+            }
+            std::string table;
+            if ( !EncodeTable( table, elf, file->Functions(), section_idx, references ) )
+            {
+                return ErrorResponse( 404, "Section has no rows" );
+            }
+            res.m_content_type = "application/octet-stream";
+            res.m_body = std::move( table );
+            return res;
+        }
+        else
+        {
+            return ErrorResponse( 404, "No such endpoint" );
+        }
+
+        res.m_body = fmt::to_string( out );
+        return res;
+    }
+
+    HttpResponse StaticFile( std::string_view path )
+    {
+        if ( path == "/" )
+        {
+            path = "/test.html";
+        }
+        if ( path.find( ".." ) != std::string_view::npos )
+        {
+            return ErrorResponse( 404, "Not found" );
+        }
+
+        std::ifstream file( fmt::format( "{}{}", m_web_root, path ), std::ios::binary );
+        if ( !file )
+        {
+            return ErrorResponse( 404, "Not found" );
+        }
+
+        HttpResponse res;
+        res.m_content_type = ContentType( path );
+        res.m_body.assign( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() );
+        return res;
+    }
+
+    HttpResponse Stats() const
+    {
+        ParsedFileCache::Counters c = m_cache.GetCounters();
+
+        fmt::memory_buffer out;
+        fmt::format_to( fmt::appender( out ), "{{ \"cache\": {{ \"hits\": {}, \"misses\": {}, \"evictions\": {}, \"files\": {}, \"bytes\": {}, \"capacity_bytes\": {} }}, ",
+                        c.m_hits, c.m_misses, c.m_evictions, c.m_files, c.m_bytes, m_cache.Capacity() );
+        m_latencies.WriteJson( out );
+        out.append( std::string_view( " }\n" ) );
+
+        HttpResponse res;
+        res.m_content_type = "application/json";
+        res.m_body = fmt::to_string( out );
+        return res;
+    }
+
+    std::string m_web_root;
+    ParsedFileCache m_cache;
+    LatencyRecorder m_latencies;
+};
+
+} // namespace
+
+int RunServer( const ServeOptions &options )
+{
+    Server server( options );
+    size_t num_threads = options.m_num_threads ? options.m_num_threads : std::thread::hardware_concurrency();
+    return RunHttpServer( options.m_port, num_threads, [ &server ]( const HttpRequest &req ) { return server.Handle( req ); } );
+}
+
+} // namespace elfexplorer
@@ -0,0 +1,67 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__SERVE_HPP__
+#define ELFEXPLORER__SERVE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace elfexplorer {
+
+struct ServeOptions
+{
+    uint16_t m_port = 0;
+    std::string m_web_root = "out/web";
+    size_t m_cache_bytes = size_t( 1024 ) << 20;
+    size_t m_num_threads = 0; // Number of cores if 0
+};
+
+// Serves the web ui from `m_web_root` and renders objects on demand, keeping
+// the parsed files of recent requests in memory. Endpoints, `file` being a
+// path on the local machine:
+//
+//   /api/info?file=F                          {"sections": N} as json
+//   /api/headers?file=F                       Section header table
+//   /api/section?file=F&idx=N                 Section N, tables with at
+//                                             least `virtual_rows` rows (if
+//                                             given) left empty for the page
+//                                             to fill in from /api/table
+//   /api/table?file=F&section=N               Rows of a symbol, relocation,
+//                                             .eh_frame or code section
+//                                             packed by column, see
+//                                             `EncodeTable`
+//   /api/rows?file=F&section=N&begin=B&end=E  Rows [ B, E ) of a symbol or
+//                                             relocation table
+//   /api/rows?...&query=Q                     Rows [ B, E ) of the symbols
+//                                             matching Q, see `SymbolQuery`
+//   /api/query?file=F&section=N&query=Q       {"rows": N} matching Q as json
+//   /api/function?file=F&section=N&symbol=S   Disassembly of the function
+//                                             defined by symbol S of symbol
+//                                             table N
+//   /api/references?file=F&section=N&symbol=S Relocations referring to
+//                                             symbol S of symbol table N
+//   /api/stats                                Cache counters and latencies
+//
+// Runs until the socket fails, returns non zero if it can't be set up.
+int RunServer( const ServeOptions &options );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__SERVE_HPP__
@@ -0,0 +1,209 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <fmt/format.h>
+
+namespace elfexplorer {
+namespace stats {
+
+bool g_enabled = false;
+
+namespace {
+
+struct Event
+{
+    const char *name;
+    std::string detail;
+    uint64_t bytes;
+    int64_t start_us;
+    int64_t duration_us;
+    int thread;
+};
+
+std::mutex g_events_mutex;
+std::vector< Event > g_events;
+std::chrono::steady_clock::time_point g_start;
+
+int ThreadNumber()
+{
+    static std::atomic< int > next_thread( 0 );
+    thread_local int thread_number = next_thread++;
+    return thread_number;
+}
+
+int64_t MicrosecondsSinceStart( std::chrono::steady_clock::time_point t )
+{
+    return std::chrono::duration_cast< std::chrono::microseconds >( t - g_start ).count();
+}
+
+} // namespace
+
+std::string JsonEscape( std::string_view s )
+{
+    std::string res;
+    for ( char c : s )
+    {
+        switch ( c )
+        {
+        case '"': res += "\\\""; break;
+        case '\\': res += "\\\\"; break;
+        default:
+            if ( static_cast< unsigned char >( c ) < 0x20 )
+            {
+                res += fmt::format( "\\u{:04x}", c );
+            }
+            else
+            {
+                res += c;
+            }
+        }
+    }
+    return res;
+}
+
+void Enable()
+{
+    g_start = std::chrono::steady_clock::now();
+    g_enabled = true;
+    CountAllocations( true );
+}
+
+void ScopedPhase::Begin( const char *name, std::string_view detail, uint64_t bytes )
+{
+    m_name = name;
+    m_detail = detail;
+    m_bytes = bytes;
+    m_start = std::chrono::steady_clock::now();
+}
+
+void ScopedPhase::End()
+{
+    auto end = std::chrono::steady_clock::now();
+
+    Event ev;
+    ev.name = m_name;
+    ev.detail = std::move( m_detail );
+    ev.bytes = m_bytes;
+    ev.start_us = MicrosecondsSinceStart( m_start );
+    ev.duration_us = MicrosecondsSinceStart( end ) - ev.start_us;
+    ev.thread = ThreadNumber();
+
+    std::lock_guard< std::mutex > lock( g_events_mutex );
+    g_events.push_back( std::move( ev ) );
+}
+
+void PrintSummary( std::ostream &out )
+{
+    std::lock_guard< std::mutex > lock( g_events_mutex );
+
+    struct PhaseTotal
+    {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+        int64_t duration_us = 0;
+        std::vector< const Event* > events;
+    };
+
+    // Phases are ordered by first occurrence
+    std::vector< const char* > order;
+    std::map< std::string_view, PhaseTotal > totals;
+    for ( const Event &ev : g_events )
+    {
+        auto [ it, inserted ] = totals.try_emplace( ev.name );
+        if ( inserted )
+        {
+            order.push_back( ev.name );
+        }
+        it->second.count += 1;
+        it->second.bytes += ev.bytes;
+        it->second.duration_us += ev.duration_us;
+        it->second.events.push_back( &ev );
+    }
+
+    out << fmt::format( "{:<16} {:>8} {:>12} {:>14} {:>10}\n", "phase", "count", "time (ms)", "bytes", "MB/s" );
+    for ( const char *name : order )
+    {
+        const PhaseTotal &t = totals[ name ];
+        double mb_per_s = t.duration_us ? t.bytes / double( t.duration_us ) : 0;
+        out << fmt::format( "{:<16} {:>8} {:>12.3f} {:>14} {:>10.1f}\n", name, t.count, t.duration_us / 1000.0, t.bytes, mb_per_s );
+    }
+
+    // Slowest sections of phases that run per section
+    for ( const char *name : order )
+    {
+        PhaseTotal &t = totals[ name ];
+        if ( t.count < 2 )
+        {
+            continue;
+        }
+
+        size_t n = std::min< size_t >( 5, t.events.size() );
+        std::partial_sort( t.events.begin(), t.events.begin() + n, t.events.end(),
+                           []( const Event *a, const Event *b ){ return a->duration_us > b->duration_us; } );
+
+        out << fmt::format( "slowest {}:\n", name );
+        for ( size_t i = 0; i < n; ++i )
+        {
+            out << fmt::format( "  {:>12.3f} ms  {:>12} bytes  {}\n", t.events[ i ]->duration_us / 1000.0, t.events[ i ]->bytes, t.events[ i ]->detail );
+        }
+    }
+
+    struct rusage usage;
+    if ( getrusage( RUSAGE_SELF, &usage ) == 0 )
+    {
+        out << fmt::format( "peak rss: {:.1f} MB\n", usage.ru_maxrss / 1024.0 );
+    }
+    out << fmt::format( "allocations: {} ({:.1f} MB)\n", AllocationCount(), AllocationBytes() / 1e6 );
+}
+
+bool WriteChromeTrace( const std::string &file_name )
+{
+    std::lock_guard< std::mutex > lock( g_events_mutex );
+
+    std::ofstream out( file_name );
+    if ( !out )
+    {
+        return false;
+    }
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for ( size_t i = 0; i < g_events.size(); ++i )
+    {
+        const Event &ev = g_events[ i ];
+        out << fmt::format( R"(  {{"name": "{}", "cat": "elf-explorer", "ph": "X", "pid": 1, "tid": {}, "ts": {}, "dur": {}, "args": {{"detail": "{}", "bytes": {}}}}}{})",
+                            ev.name, ev.thread, ev.start_us, ev.duration_us, JsonEscape( ev.detail ), ev.bytes,
+                            i + 1 == g_events.size() ? "\n" : ",\n" );
+    }
+    out << "]}\n";
+    out.close();
+    return !out.fail();
+}
+
+} // namespace stats
+} // namespace elfexplorer
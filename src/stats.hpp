@@ -0,0 +1,100 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__STATS_HPP__
+#define ELFEXPLORER__STATS_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// Phase timing and memory instrumentation, enabled with `--stats`. All hooks
+// are compiled in, and cost a single branch when stats are disabled.
+
+namespace elfexplorer {
+namespace stats {
+
+extern bool g_enabled;
+
+inline bool Enabled()
+{
+    return g_enabled;
+}
+
+// Starts recording phases and counting allocations
+void Enable();
+
+// Times the enclosing scope as one phase, `detail` is usually the section name
+class ScopedPhase
+{
+public:
+    explicit ScopedPhase( const char *name, std::string_view detail = {}, uint64_t bytes = 0 )
+    {
+        if ( Enabled() )
+        {
+            Begin( name, detail, bytes );
+        }
+    }
+
+    ScopedPhase( const ScopedPhase & ) = delete;
+    ScopedPhase& operator=( const ScopedPhase & ) = delete;
+
+    ~ScopedPhase()
+    {
+        if ( m_name )
+        {
+            End();
+        }
+    }
+
+    void SetBytes( uint64_t bytes )
+    {
+        m_bytes = bytes;
+    }
+
+private:
+    void Begin( const char *name, std::string_view detail, uint64_t bytes );
+    void End();
+
+    const char *m_name = nullptr;
+    std::string m_detail;
+    uint64_t m_bytes = 0;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Counting allocator hook, implemented in alloc_counter.cpp
+void CountAllocations( bool enable );
+uint64_t AllocationCount();
+uint64_t AllocationBytes();
+
+// Per phase totals, slowest sections, peak rss and allocations
+void PrintSummary( std::ostream &out );
+
+// Contents of a json string, without the quotes
+std::string JsonEscape( std::string_view s );
+
+// Writes recorded phases in chrome trace_event format (chrome://tracing),
+// false if the file can not be written
+bool WriteChromeTrace( const std::string &file_name );
+
+} // namespace stats
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__STATS_HPP__
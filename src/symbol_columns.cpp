@@ -0,0 +1,422 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#include "symbol_columns.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "elf_layout.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+template < typename T, ByteOrder Order >
+T LoadAt( const unsigned char *p )
+{
+    T v;
+    std::memcpy( &v, p, sizeof( T ) );
+    if constexpr ( Order != HostByteOrder )
+    {
+        v = ByteSwap( v );
+    }
+    return v;
+}
+
+template < ElfClass Class, ByteOrder Order >
+void LoadColumns( const unsigned char *data, size_t count, SymbolColumns &columns )
+{
+    using Layout = ElfLayout< Class >;
+    using Addr = typename Layout::Addr;
+
+    for ( size_t i = 0; i < count; ++i, data += Layout::SymSize )
+    {
+        const uint8_t info = data[ Layout::St_Info ];
+        const uint16_t shndx = LoadAt< uint16_t, Order >( data + Layout::St_Shndx );
+
+        columns.m_binding[ i ] = info >> 4;
+        columns.m_type[ i ] = info & 0xf;
+        columns.m_visibility[ i ] = data[ Layout::St_Other ] & 0x3;
+        columns.m_section_idx[ i ] = shndx >= SHN_LORESERVE ? ReservedSectionIndex( shndx ) : shndx;
+        columns.m_value[ i ] = LoadAt< Addr, Order >( data + Layout::St_Value );
+        columns.m_size[ i ] = LoadAt< Addr, Order >( data + Layout::St_Size );
+        columns.m_name_offset[ i ] = LoadAt< uint32_t, Order >( data + Layout::St_Name );
+    }
+}
+
+template < ElfClass Class >
+void LoadColumns( ByteOrder order, const unsigned char *data, size_t count, SymbolColumns &columns )
+{
+    if ( order == ByteOrder::Little )
+    {
+        LoadColumns< Class, ByteOrder::Little >( data, count, columns );
+    }
+    else
+    {
+        LoadColumns< Class, ByteOrder::Big >( data, count, columns );
+    }
+}
+
+std::string_view SectionContents( const InputBuffer &input, const SectionHeader &sh )
+{
+    ASSERT( sh.m_offset <= input.contents.size() && sh.m_size <= input.contents.size() - sh.m_offset );
+    return std::string_view( reinterpret_cast< const char* >( input.contents.data() ) + sh.m_offset, sh.m_size );
+}
+
+template < typename E, size_t N >
+E ParseEnum( std::string_view term, std::string_view text, const std::string_view ( &names )[ N ] )
+{
+    auto it = std::find( std::begin( names ), std::end( names ), text );
+    if ( it != std::end( names ) && !text.empty() )
+    {
+        return static_cast< E >( it - std::begin( names ) );
+    }
+
+    unsigned value;
+    auto [ end, ec ] = std::from_chars( text.data(), text.data() + text.size(), value );
+    if ( ec != std::errc() || end != text.data() + text.size() || value > 0xff )
+    {
+        throw std::runtime_error( fmt::format( "Invalid value in symbol query: {}", term ) );
+    }
+    return static_cast< E >( value );
+}
+
+uint64_t ParseNumber( std::string_view term, std::string_view text )
+{
+    uint64_t value;
+    auto [ end, ec ] = std::from_chars( text.data(), text.data() + text.size(), value );
+    if ( ec != std::errc() || end != text.data() + text.size() || text.empty() )
+    {
+        throw std::runtime_error( fmt::format( "Invalid number in symbol query: {}", term ) );
+    }
+    return value;
+}
+
+template < typename T, typename Predicate >
+void MatchColumn( std::vector< uint8_t > &match, const std::vector< T > &column, Predicate pred )
+{
+    uint8_t *m = match.data();
+    const T *c = column.data();
+    for ( size_t i = 0, n = match.size(); i < n; ++i )
+    {
+        m[ i ] &= pred( c[ i ] );
+    }
+}
+
+using KeyedRows = std::vector< std::pair< uint64_t, uint32_t > >;
+
+// LSD radix sort a byte of the key at a time, passes over bytes that are the
+// same in every key (e.g. the high bytes of sizes) are skipped. Stable, ties
+// keep their order.
+void RadixSort( KeyedRows &keyed )
+{
+    size_t counts[ 8 ][ 256 ] = {};
+    for ( const auto &k : keyed )
+    {
+        for ( int byte = 0; byte < 8; ++byte )
+        {
+            ++counts[ byte ][ ( k.first >> ( 8 * byte ) ) & 0xff ];
+        }
+    }
+
+    KeyedRows tmp( keyed.size() );
+    for ( int byte = 0; byte < 8; ++byte )
+    {
+        size_t *c = counts[ byte ];
+        if ( std::find( c, c + 256, keyed.size() ) != c + 256 )
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        for ( int digit = 0; digit < 256; ++digit )
+        {
+            offset += std::exchange( c[ digit ], offset );
+        }
+        for ( const auto &k : keyed )
+        {
+            tmp[ c[ ( k.first >> ( 8 * byte ) ) & 0xff ]++ ] = k;
+        }
+        keyed.swap( tmp );
+    }
+}
+
+// Sorts on ( key, index ) pairs, which only reads the key column once
+template < typename T >
+void SortByColumn( const std::vector< T > &column, std::vector< uint32_t > &rows, bool descending, size_t limit )
+{
+    KeyedRows keyed( rows.size() );
+    for ( size_t i = 0; i < rows.size(); ++i )
+    {
+        const uint64_t key = column[ rows[ i ] ];
+        keyed[ i ] = { descending ? ~key : key, rows[ i ] };
+    }
+
+    // Rows are in index order, which the stable radix sort keeps for ties
+    if ( limit < keyed.size() / 64 )
+    {
+        std::partial_sort( keyed.begin(), keyed.begin() + limit, keyed.end() );
+    }
+    else
+    {
+        RadixSort( keyed );
+    }
+
+    for ( size_t i = 0; i < rows.size(); ++i )
+    {
+        rows[ i ] = keyed[ i ].second;
+    }
+}
+
+} // namespace
+
+SymbolColumns SymbolColumns::Load( const InputBuffer &input, const ELF_File &elf, size_t symtab_idx )
+{
+    ASSERT( symtab_idx < elf.m_sections.size() );
+    const SectionHeader &sh = elf.m_sections[ symtab_idx ].m_header;
+    const std::string_view contents = SectionContents( input, sh );
+    const uint64_t sym_size = elf.m_class == ElfClass::ELF64 ? ElfLayout< ElfClass::ELF64 >::SymSize : ElfLayout< ElfClass::ELF32 >::SymSize;
+    ASSERT( sh.m_size % sym_size == 0 );
+    const size_t count = sh.m_size / sym_size;
+
+    SymbolColumns res;
+    res.m_binding.resize( count );
+    res.m_type.resize( count );
+    res.m_visibility.resize( count );
+    res.m_section_idx.resize( count );
+    res.m_value.resize( count );
+    res.m_size.resize( count );
+    res.m_name_offset.resize( count );
+
+    const auto *data = reinterpret_cast< const unsigned char* >( contents.data() );
+    if ( elf.m_class == ElfClass::ELF64 )
+    {
+        LoadColumns< ElfClass::ELF64 >( elf.m_byte_order, data, count, res );
+    }
+    else
+    {
+        LoadColumns< ElfClass::ELF32 >( elf.m_byte_order, data, count, res );
+    }
+
+    ASSERT( sh.m_asso_idx < elf.m_sections.size() );
+    res.m_strtab = SectionContents( input, elf.m_sections[ sh.m_asso_idx ].m_header );
+
+    // Indices that don't fit in 16 bits are in the SHT_SYMTAB_SHNDX section
+    if ( std::find( res.m_section_idx.begin(), res.m_section_idx.end(), ReservedSectionIndex( SHN_XINDEX ) ) != res.m_section_idx.end() )
+    {
+        for ( const Section &sec : elf.m_sections )
+        {
+            if ( sec.m_header.m_type != SectionType::SHT_SYMTAB_SHNDX || sec.m_header.m_asso_idx != symtab_idx )
+            {
+                continue;
+            }
+            const std::string_view indices = SectionContents( input, sec.m_header );
+            ASSERT( indices.size() == count * sizeof( uint32_t ) );
+            const auto *p = reinterpret_cast< const unsigned char* >( indices.data() );
+            for ( size_t i = 0; i < count; ++i )
+            {
+                if ( res.m_section_idx[ i ] == ReservedSectionIndex( SHN_XINDEX ) )
+                {
+                    res.m_section_idx[ i ] = elf.m_byte_order == ByteOrder::Little ? LoadAt< uint32_t, ByteOrder::Little >( p + 4 * i )
+                                                                                  : LoadAt< uint32_t, ByteOrder::Big >( p + 4 * i );
+                }
+            }
+        }
+    }
+
+    return res;
+}
+
+std::string_view SymbolColumns::Name( size_t i ) const
+{
+    const uint32_t offset = m_name_offset[ i ];
+    ASSERT( offset < m_strtab.size() );
+    std::string_view res = m_strtab.substr( offset );
+    return res.substr( 0, res.find( '\0' ) );
+}
+
+SymbolQuery SymbolQuery::Parse( std::string_view text )
+{
+    SymbolQuery res;
+    while ( !text.empty() )
+    {
+        const size_t comma = text.find( ',' );
+        const std::string_view term = text.substr( 0, comma );
+        text = comma == std::string_view::npos ? std::string_view() : text.substr( comma + 1 );
+
+        const size_t eq = term.find( '=' );
+        const std::string_view key = term.substr( 0, eq );
+        const std::string_view value = eq == std::string_view::npos ? std::string_view() : term.substr( eq + 1 );
+
+        if ( key == "bind" && !value.empty() )
+        {
+            res.m_filter.m_binding = ParseEnum< SymbolBinding >( term, value, SymbolBindingNames );
+        }
+        else if ( key == "type" && !value.empty() )
+        {
+            res.m_filter.m_type = ParseEnum< SymbolType >( term, value, SymbolTypeNames );
+        }
+        else if ( key == "vis" && !value.empty() )
+        {
+            res.m_filter.m_visibility = ParseEnum< SymbolVisibility >( term, value, SymbolVisibilityNames );
+        }
+        else if ( term == "defined" || term == "undefined" )
+        {
+            res.m_filter.m_defined = term == "defined";
+        }
+        else if ( key == "min-size" )
+        {
+            res.m_filter.m_min_size = ParseNumber( term, value );
+        }
+        else if ( key == "limit" )
+        {
+            res.m_limit = ParseNumber( term, value );
+        }
+        else if ( key == "sort" )
+        {
+            std::string_view column = value;
+            res.m_descending = !column.empty() && column[ 0 ] == '-';
+            if ( res.m_descending )
+            {
+                column.remove_prefix( 1 );
+            }
+
+            static const std::pair< std::string_view, SymbolSortKey > keys[] = {
+                { "index", SymbolSortKey::Index },
+                { "value", SymbolSortKey::Value },
+                { "size",  SymbolSortKey::Size },
+                { "name",  SymbolSortKey::Name },
+            };
+            auto it = std::find_if( std::begin( keys ), std::end( keys ), [ & ]( const auto &k ) { return k.first == column; } );
+            if ( it == std::end( keys ) )
+            {
+                throw std::runtime_error( fmt::format( "Unknown sort column in symbol query: {}", term ) );
+            }
+            res.m_sort = it->second;
+        }
+        else if ( !term.empty() )
+        {
+            throw std::runtime_error( fmt::format( "Unknown term in symbol query: {}", term ) );
+        }
+    }
+    return res;
+}
+
+std::vector< uint32_t > FilterSymbols( const SymbolColumns &columns, const SymbolFilter &filter )
+{
+    const size_t count = columns.size();
+    std::vector< uint8_t > match( count, 1 );
+
+    if ( filter.m_binding )
+    {
+        const uint8_t binding = static_cast< uint8_t >( *filter.m_binding );
+        MatchColumn( match, columns.m_binding, [ binding ]( uint8_t v ) { return v == binding; } );
+    }
+    if ( filter.m_type )
+    {
+        const uint8_t type = static_cast< uint8_t >( *filter.m_type );
+        MatchColumn( match, columns.m_type, [ type ]( uint8_t v ) { return v == type; } );
+    }
+    if ( filter.m_visibility )
+    {
+        const uint8_t visibility = static_cast< uint8_t >( *filter.m_visibility );
+        MatchColumn( match, columns.m_visibility, [ visibility ]( uint8_t v ) { return v == visibility; } );
+    }
+    if ( filter.m_defined )
+    {
+        const bool defined = *filter.m_defined;
+        MatchColumn( match, columns.m_section_idx, [ defined ]( uint32_t v ) { return ( v != 0 ) == defined; } );
+    }
+    if ( filter.m_min_size != 0 )
+    {
+        const uint64_t min_size = filter.m_min_size;
+        MatchColumn( match, columns.m_size, [ min_size ]( uint64_t v ) { return v >= min_size; } );
+    }
+
+    // Every index is written, only the matching ones are kept by advancing
+    std::vector< uint32_t > rows( count );
+    size_t num_rows = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        rows[ num_rows ] = i;
+        num_rows += match[ i ];
+    }
+    rows.resize( num_rows );
+    return rows;
+}
+
+void SortSymbols( const SymbolColumns &columns, std::vector< uint32_t > &rows, SymbolSortKey key, bool descending, size_t limit )
+{
+    switch ( key )
+    {
+    case SymbolSortKey::Index:
+        if ( descending )
+        {
+            std::reverse( rows.begin(), rows.end() );
+        }
+        return;
+    case SymbolSortKey::Value:
+        SortByColumn( columns.m_value, rows, descending, limit );
+        return;
+    case SymbolSortKey::Size:
+        SortByColumn( columns.m_size, rows, descending, limit );
+        return;
+    case SymbolSortKey::Name:
+        break;
+    }
+
+    auto less = [ & ]( uint32_t a, uint32_t b )
+    {
+        const std::string_view name_a = columns.Name( a );
+        const std::string_view name_b = columns.Name( b );
+        if ( name_a != name_b )
+        {
+            return descending ? name_b < name_a : name_a < name_b;
+        }
+        return a < b;
+    };
+    if ( limit < rows.size() )
+    {
+        std::partial_sort( rows.begin(), rows.begin() + limit, rows.end(), less );
+    }
+    else
+    {
+        std::sort( rows.begin(), rows.end(), less );
+    }
+}
+
+std::vector< uint32_t > RunSymbolQuery( const SymbolColumns &columns, const SymbolQuery &query )
+{
+    std::vector< uint32_t > rows = FilterSymbols( columns, query.m_filter );
+    SortSymbols( columns, rows, query.m_sort, query.m_descending, query.m_limit );
+    if ( rows.size() > query.m_limit )
+    {
+        rows.resize( query.m_limit );
+    }
+    return rows;
+}
+
+} // namespace elfexplorer
@@ -0,0 +1,113 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef ELFEXPLORER__SYMBOL_COLUMNS_HPP__
+#define ELFEXPLORER__SYMBOL_COLUMNS_HPP__
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "elf_structs.hpp"
+#include "input_buffer.hpp"
+
+namespace elfexplorer {
+
+// A symbol table stored by column, one packed array per field, so filtering
+// or sorting on a few fields only reads those instead of every `Symbol`
+// with its name. Names stay in the string table of the input.
+struct SymbolColumns
+{
+    // Reads the symbol table section `symtab_idx` directly from the input,
+    // only the section headers of `elf` are used. Does not mark the input as
+    // read, so it can be used concurrently.
+    static SymbolColumns Load( const InputBuffer &input, const ELF_File &elf, size_t symtab_idx );
+
+    size_t size() const
+    {
+        return m_value.size();
+    }
+
+    std::string_view Name( size_t i ) const;
+
+    std::vector< uint8_t > m_binding;
+    std::vector< uint8_t > m_type;
+    std::vector< uint8_t > m_visibility;
+    std::vector< uint32_t > m_section_idx; // See `ReservedSectionIndex`
+    std::vector< uint64_t > m_value;
+    std::vector< uint64_t > m_size;
+    std::vector< uint32_t > m_name_offset;
+    std::string_view m_strtab;
+};
+
+// Conditions a symbol must all match, the ones not set match any symbol
+struct SymbolFilter
+{
+    std::optional< SymbolBinding > m_binding;
+    std::optional< SymbolType > m_type;
+    std::optional< SymbolVisibility > m_visibility;
+    std::optional< bool > m_defined; // Section index is not SHN_UNDEF
+    uint64_t m_min_size = 0;
+};
+
+enum class SymbolSortKey
+{
+    Index,
+    Value,
+    Size,
+    Name,
+};
+
+struct SymbolQuery
+{
+    // Comma separated terms, e.g. "type=STT_FUNC,defined,sort=-size,limit=100"
+    //
+    //   bind=<STB_*>  type=<STT_*>  vis=<STV_*>  (or their numeric values)
+    //   defined  undefined  min-size=<n>
+    //   sort=[-]( index | value | size | name ), '-' for descending
+    //   limit=<n>
+    //
+    // Throws std::runtime_error for anything else.
+    static SymbolQuery Parse( std::string_view text );
+
+    SymbolFilter m_filter;
+    SymbolSortKey m_sort = SymbolSortKey::Index;
+    bool m_descending = false;
+    size_t m_limit = std::numeric_limits< size_t >::max();
+};
+
+// Indices of the matching symbols in increasing order. One pass per condition
+// over just its column, written branch free so the compiler vectorizes them.
+std::vector< uint32_t > FilterSymbols( const SymbolColumns &columns, const SymbolFilter &filter );
+
+// Permutes `rows`, in increasing order as returned by `FilterSymbols`, to be
+// ordered by the key with ties in index order. Sorts by index permutation:
+// only the key column is read, the rows are not moved. When `limit` is less
+// than the number of rows only that many are sorted to the front, the order
+// of the rest is unspecified.
+void SortSymbols( const SymbolColumns &columns, std::vector< uint32_t > &rows, SymbolSortKey key, bool descending, size_t limit );
+
+// Filters, sorts and truncates to the limit
+std::vector< uint32_t > RunSymbolQuery( const SymbolColumns &columns, const SymbolQuery &query );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__SYMBOL_COLUMNS_HPP__
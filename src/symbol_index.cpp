@@ -0,0 +1,536 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "symbol_index.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "elf_structs.hpp"
+#include "hash.hpp"
+#include "input_buffer.hpp"
+#include "thread_pool.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+constexpr char IndexMagic[ 8 ] = { 'E', 'L', 'F', 'X', 'I', 'D', 'X', '\0' };
+constexpr uint32_t IndexVersion = 1;
+
+static_assert( sizeof( IndexHeader ) == 32 );
+static_assert( sizeof( IndexFile ) == 32 );
+static_assert( sizeof( IndexSymbol ) == 32 );
+
+uint32_t NameHash( std::string_view name )
+{
+    return static_cast< uint32_t >( Hash64( name ) );
+}
+
+size_t AlignUp( size_t size )
+{
+    return ( size + 7 ) & ~size_t( 7 );
+}
+
+// An object found while scanning, with its symbols either taken from the
+// previous index or parsed again
+struct ScannedFile
+{
+    static constexpr uint32_t NotIndexed = UINT32_MAX;
+
+    struct Symbol
+    {
+        uint32_t m_name; // Offset in `m_names`
+        uint32_t m_section_idx;
+        uint64_t m_size;
+        SymbolBinding m_binding;
+        SymbolType m_type;
+    };
+
+    std::string m_path;
+    int64_t m_mtime_ns;
+    uint64_t m_size;
+    uint32_t m_old_idx = NotIndexed;
+
+    std::string m_names;
+    std::vector< Symbol > m_symbols;
+    std::string m_error;
+};
+
+void ParseSymbols( ScannedFile &file )
+{
+    try
+    {
+        InputBuffer input( file.m_path, ReadFile( file.m_path.c_str() ) );
+        ELF_File elf = ELF_File::LoadMetadataFrom( input );
+
+        for ( const Section &sec : elf.m_sections )
+        {
+            const auto *symtab = std::get_if< SymbolTable >( &sec.m_var );
+            if ( !symtab )
+            {
+                continue;
+            }
+
+            // Symbol 0 is the null symbol
+            for ( size_t i = 1; i < symtab->m_symbols.size(); ++i )
+            {
+                const Symbol &s = symtab->m_symbols[ i ];
+                if ( s.m_name.empty() || s.m_type == SymbolType::STT_SECTION || s.m_type == SymbolType::STT_FILE )
+                {
+                    continue;
+                }
+
+                file.m_symbols.push_back( { static_cast< uint32_t >( file.m_names.size() ), s.m_section_idx, s.m_size, s.m_binding, s.m_type } );
+                file.m_names.append( s.m_name );
+                file.m_names.push_back( '\0' );
+            }
+        }
+    }
+    catch ( const std::exception &e )
+    {
+        // Indexed without symbols, so it is not parsed again until it changes
+        file.m_symbols.clear();
+        file.m_error = e.what();
+    }
+}
+
+// Objects under `root`, sorted by path
+std::vector< ScannedFile > ScanTree( const std::string &root )
+{
+    std::vector< ScannedFile > res;
+    for ( std::string &path : FindObjectFiles( root ) )
+    {
+        struct stat st;
+        if ( stat( path.c_str(), &st ) != 0 )
+        {
+            continue;
+        }
+
+        ScannedFile &file = res.emplace_back();
+        file.m_path = std::move( path );
+        file.m_mtime_ns = int64_t( st.st_mtim.tv_sec ) * 1000000000 + st.st_mtim.tv_nsec;
+        file.m_size = st.st_size;
+    }
+    return res;
+}
+
+class IndexWriter
+{
+public:
+    // `old` is the index the reused symbols are taken from, may be null
+    std::string Write( const std::vector< ScannedFile > &files, const SymbolIndex *old )
+    {
+        for ( const ScannedFile &file : files )
+        {
+            const uint32_t file_idx = m_files.size();
+            IndexFile &rec = m_files.emplace_back();
+            rec.m_path = Intern( file.m_path );
+            rec.m_first_symbol = m_symbols.size();
+            rec.m_reserved = 0;
+            rec.m_mtime_ns = file.m_mtime_ns;
+            rec.m_size = file.m_size;
+
+            if ( file.m_old_idx != ScannedFile::NotIndexed )
+            {
+                const IndexFile &old_file = old->Files()[ file.m_old_idx ];
+                for ( uint32_t i = 0; i < old_file.m_num_symbols; ++i )
+                {
+                    IndexSymbol s = old->Symbols()[ old_file.m_first_symbol + i ];
+                    s.m_name = Intern( old->String( s.m_name ) );
+                    s.m_file = file_idx;
+                    m_symbols.push_back( s );
+                }
+            }
+            else
+            {
+                for ( const ScannedFile::Symbol &parsed : file.m_symbols )
+                {
+                    std::string_view name( file.m_names.data() + parsed.m_name );
+
+                    IndexSymbol &s = m_symbols.emplace_back();
+                    s.m_name = Intern( name );
+                    s.m_name_hash = NameHash( name );
+                    s.m_file = file_idx;
+                    s.m_size = parsed.m_size;
+                    s.m_section_idx = parsed.m_section_idx;
+                    s.m_binding = static_cast< uint8_t >( parsed.m_binding );
+                    s.m_type = static_cast< uint8_t >( parsed.m_type );
+                    s.m_reserved = 0;
+                }
+            }
+
+            rec.m_num_symbols = m_symbols.size() - rec.m_first_symbol;
+        }
+        ASSERT( m_symbols.size() < SymbolIndex::NoSymbol );
+
+        // About one symbol per bucket. Chains are built backwards so they are
+        // in file order.
+        size_t num_buckets = 1;
+        while ( num_buckets < m_symbols.size() )
+        {
+            num_buckets *= 2;
+        }
+        std::vector< uint32_t > buckets( num_buckets, SymbolIndex::NoSymbol );
+        for ( size_t i = m_symbols.size(); i-- > 0; )
+        {
+            uint32_t &head = buckets[ m_symbols[ i ].m_name_hash & ( num_buckets - 1 ) ];
+            m_symbols[ i ].m_next = head;
+            head = i;
+        }
+
+        IndexHeader header = {};
+        std::memcpy( header.m_magic, IndexMagic, sizeof( IndexMagic ) );
+        header.m_version = IndexVersion;
+        header.m_num_files = m_files.size();
+        header.m_num_symbols = m_symbols.size();
+        header.m_num_buckets = num_buckets;
+        header.m_strings_size = m_strings.size();
+
+        std::string res;
+        auto append = [ & ]( const void *data, size_t size )
+        {
+            res.append( static_cast< const char* >( data ), size );
+            res.resize( AlignUp( res.size() ) );
+        };
+        append( &header, sizeof( header ) );
+        append( m_files.data(), m_files.size() * sizeof( IndexFile ) );
+        append( m_symbols.data(), m_symbols.size() * sizeof( IndexSymbol ) );
+        append( buckets.data(), buckets.size() * sizeof( uint32_t ) );
+        append( m_strings.data(), m_strings.size() );
+        return res;
+    }
+
+private:
+    // Interned strings are viewed from the scanned files and the old index,
+    // which outlive the writer
+    uint32_t Intern( std::string_view s )
+    {
+        auto [ it, inserted ] = m_offsets.try_emplace( s, m_strings.size() );
+        if ( inserted )
+        {
+            ASSERT( m_strings.size() + s.size() < UINT32_MAX );
+            m_strings.append( s );
+            m_strings.push_back( '\0' );
+        }
+        return it->second;
+    }
+
+    std::vector< IndexFile > m_files;
+    std::vector< IndexSymbol > m_symbols;
+    std::string m_strings;
+    std::unordered_map< std::string_view, uint32_t, StringHash > m_offsets;
+};
+
+int Scan( const IndexOptions &options )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::optional< SymbolIndex > old;
+    if ( access( options.m_index_file.c_str(), F_OK ) == 0 )
+    {
+        try
+        {
+            old.emplace( SymbolIndex::Open( options.m_index_file ) );
+        }
+        catch ( const std::exception &e )
+        {
+            std::cerr << fmt::format( "{}: {}, creating it again\n", options.m_index_file, e.what() );
+        }
+    }
+
+    std::vector< ScannedFile > files = ScanTree( options.m_scan_dir );
+
+    // Unchanged objects keep their symbols
+    size_t num_removed = old ? old->Header().m_num_files : 0;
+    if ( old )
+    {
+        std::unordered_map< std::string_view, uint32_t, StringHash > old_files;
+        for ( uint32_t i = 0; i < old->Header().m_num_files; ++i )
+        {
+            old_files.emplace( old->String( old->Files()[ i ].m_path ), i );
+        }
+        for ( ScannedFile &file : files )
+        {
+            auto it = old_files.find( file.m_path );
+            if ( it == old_files.end() )
+            {
+                continue;
+            }
+            --num_removed;
+            if ( old->Files()[ it->second ].m_mtime_ns == file.m_mtime_ns && old->Files()[ it->second ].m_size == file.m_size )
+            {
+                file.m_old_idx = it->second;
+            }
+        }
+    }
+
+    size_t num_parsed = 0;
+    {
+        ThreadPool pool( options.m_num_threads ? options.m_num_threads : std::thread::hardware_concurrency() );
+        for ( ScannedFile &file : files )
+        {
+            if ( file.m_old_idx == ScannedFile::NotIndexed )
+            {
+                pool.Submit( [ &file ] { ParseSymbols( file ); } );
+                ++num_parsed;
+            }
+        }
+    }
+
+    for ( const ScannedFile &file : files )
+    {
+        if ( !file.m_error.empty() )
+        {
+            std::cerr << fmt::format( "{}: {}\n", file.m_path, file.m_error );
+        }
+    }
+
+    std::string contents = IndexWriter().Write( files, old ? &*old : nullptr );
+    old.reset();
+    WriteFileAtomically( options.m_index_file, contents );
+
+    const auto &header = *reinterpret_cast< const IndexHeader* >( contents.data() );
+    std::cerr << fmt::format( "{}: {} objects ({} parsed, {} removed), {} symbols, {} bytes in {:.1f} ms\n",
+                              options.m_index_file, header.m_num_files, num_parsed, num_removed, header.m_num_symbols, contents.size(), MillisecondsSince( start ) );
+    return 0;
+}
+
+void PrintSymbol( fmt::memory_buffer &out, const SymbolIndex &index, const IndexSymbol &s )
+{
+    fmt::format_to( fmt::appender( out ), "{}: {} {}",
+                    index.String( index.Files()[ s.m_file ].m_path ),
+                    EnumText( static_cast< SymbolBinding >( s.m_binding ) ), EnumText( static_cast< SymbolType >( s.m_type ) ) );
+    if ( s.IsDefined() )
+    {
+        fmt::format_to( fmt::appender( out ), " section {} size {}", FileSectionIndex( s.m_section_idx ), s.m_size );
+    }
+    out.push_back( '\n' );
+}
+
+// Names with a weak definition that are defined by more than one object
+void PrintMultipleWeak( fmt::memory_buffer &out, const SymbolIndex &index )
+{
+    auto is_global_definition = []( const IndexSymbol &s )
+    {
+        return s.IsDefined() && static_cast< SymbolBinding >( s.m_binding ) != SymbolBinding::STB_LOCAL;
+    };
+
+    // Names are deduplicated, so equal names have equal offsets
+    std::vector< const IndexSymbol* > weak;
+    const IndexSymbol *symbols = index.Symbols();
+    for ( uint32_t i = 0; i < index.Header().m_num_symbols; ++i )
+    {
+        if ( symbols[ i ].IsDefined() && static_cast< SymbolBinding >( symbols[ i ].m_binding ) == SymbolBinding::STB_WEAK )
+        {
+            weak.push_back( &symbols[ i ] );
+        }
+    }
+    std::sort( weak.begin(), weak.end(), []( const IndexSymbol *a, const IndexSymbol *b ) { return a->m_name < b->m_name; } );
+    weak.erase( std::unique( weak.begin(), weak.end(), []( const IndexSymbol *a, const IndexSymbol *b ) { return a->m_name == b->m_name; } ), weak.end() );
+
+    std::vector< std::pair< std::string_view, std::vector< const IndexSymbol* > > > res;
+    for ( const IndexSymbol *s : weak )
+    {
+        std::string_view name = index.String( s->m_name );
+        std::vector< const IndexSymbol* > providers = index.Find( name );
+        providers.erase( std::remove_if( providers.begin(), providers.end(), [ & ]( const IndexSymbol *p ) { return !is_global_definition( *p ); } ), providers.end() );
+
+        auto different_file = [ & ]( const IndexSymbol *p ) { return p->m_file != providers.front()->m_file; };
+        if ( std::any_of( providers.begin(), providers.end(), different_file ) )
+        {
+            res.emplace_back( name, std::move( providers ) );
+        }
+    }
+    std::sort( res.begin(), res.end(), []( const auto &a, const auto &b ) { return a.first < b.first; } );
+
+    for ( const auto &[ name, providers ] : res )
+    {
+        fmt::format_to( fmt::appender( out ), "{}\n", name );
+        for ( const IndexSymbol *s : providers )
+        {
+            out.append( std::string_view( "  " ) );
+            PrintSymbol( out, index, *s );
+        }
+    }
+}
+
+} // namespace
+
+SymbolIndex SymbolIndex::Open( const std::string &path )
+{
+    SymbolIndex res;
+
+    int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        throw std::runtime_error( fmt::format( "Can not open {}: {}", path, std::strerror( errno ) ) );
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size < static_cast< off_t >( sizeof( IndexHeader ) ) )
+    {
+        close( fd );
+        throw std::runtime_error( "Not a symbol index" );
+    }
+
+    res.m_mapping_size = st.st_size;
+    res.m_mapping = mmap( nullptr, res.m_mapping_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( res.m_mapping == MAP_FAILED )
+    {
+        res.m_mapping = nullptr;
+        throw std::runtime_error( fmt::format( "Can not map {}: {}", path, std::strerror( errno ) ) );
+    }
+
+    const char *data = static_cast< const char* >( res.m_mapping );
+    res.m_header = reinterpret_cast< const IndexHeader* >( data );
+    const IndexHeader &h = *res.m_header;
+    if ( std::memcmp( h.m_magic, IndexMagic, sizeof( IndexMagic ) ) != 0 || h.m_version != IndexVersion )
+    {
+        throw std::runtime_error( "Not a symbol index, or of another version" );
+    }
+
+    size_t offset = AlignUp( sizeof( IndexHeader ) );
+    res.m_files = reinterpret_cast< const IndexFile* >( data + offset );
+    offset = AlignUp( offset + size_t( h.m_num_files ) * sizeof( IndexFile ) );
+    res.m_symbols = reinterpret_cast< const IndexSymbol* >( data + offset );
+    offset = AlignUp( offset + size_t( h.m_num_symbols ) * sizeof( IndexSymbol ) );
+    res.m_buckets = reinterpret_cast< const uint32_t* >( data + offset );
+    offset = AlignUp( offset + size_t( h.m_num_buckets ) * sizeof( uint32_t ) );
+    res.m_strings = data + offset;
+
+    ASSERT( h.m_num_buckets != 0 && ( h.m_num_buckets & ( h.m_num_buckets - 1 ) ) == 0 );
+    ASSERT( offset <= res.m_mapping_size && h.m_strings_size <= res.m_mapping_size - offset );
+    ASSERT( h.m_strings_size == 0 || res.m_strings[ h.m_strings_size - 1 ] == '\0' );
+
+    // Everything the lookups and the rescan follow, so a damaged index is
+    // rejected (and recreated by --scan) instead of read out of bounds
+    for ( uint32_t i = 0; i < h.m_num_files; ++i )
+    {
+        const IndexFile &f = res.m_files[ i ];
+        ASSERT( f.m_path < h.m_strings_size );
+        ASSERT( f.m_first_symbol <= h.m_num_symbols && f.m_num_symbols <= h.m_num_symbols - f.m_first_symbol );
+    }
+    for ( uint32_t i = 0; i < h.m_num_symbols; ++i )
+    {
+        const IndexSymbol &s = res.m_symbols[ i ];
+        ASSERT( s.m_name < h.m_strings_size );
+        ASSERT( s.m_file < h.m_num_files );
+        // Chains only go forward, which also keeps them from looping
+        ASSERT( s.m_next == NoSymbol || ( s.m_next > i && s.m_next < h.m_num_symbols ) );
+    }
+    for ( uint32_t i = 0; i < h.m_num_buckets; ++i )
+    {
+        ASSERT( res.m_buckets[ i ] == NoSymbol || res.m_buckets[ i ] < h.m_num_symbols );
+    }
+    return res;
+}
+
+SymbolIndex::SymbolIndex( SymbolIndex &&other )
+    : m_mapping( std::exchange( other.m_mapping, nullptr ) )
+    , m_mapping_size( other.m_mapping_size )
+    , m_header( other.m_header )
+    , m_files( other.m_files )
+    , m_symbols( other.m_symbols )
+    , m_buckets( other.m_buckets )
+    , m_strings( other.m_strings )
+{
+}
+
+SymbolIndex::~SymbolIndex()
+{
+    if ( m_mapping )
+    {
+        munmap( m_mapping, m_mapping_size );
+    }
+}
+
+std::vector< const IndexSymbol* > SymbolIndex::Find( std::string_view name ) const
+{
+    std::vector< const IndexSymbol* > res;
+
+    const uint32_t hash = NameHash( name );
+    for ( uint32_t i = m_buckets[ hash & ( m_header->m_num_buckets - 1 ) ]; i != NoSymbol; i = m_symbols[ i ].m_next )
+    {
+        ASSERT( i < m_header->m_num_symbols );
+        const IndexSymbol &s = m_symbols[ i ];
+        if ( s.m_name_hash == hash && String( s.m_name ) == name )
+        {
+            res.push_back( &s );
+        }
+    }
+    return res;
+}
+
+int RunIndex( const IndexOptions &options )
+{
+    if ( !options.m_scan_dir.empty() )
+    {
+        return Scan( options );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::optional< SymbolIndex > opened;
+    try
+    {
+        opened.emplace( SymbolIndex::Open( options.m_index_file ) );
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << fmt::format( "{}: {}, recreate it with --scan\n", options.m_index_file, e.what() );
+        return 1;
+    }
+    const SymbolIndex &index = *opened;
+
+    fmt::memory_buffer out;
+    if ( options.m_multiple_weak )
+    {
+        PrintMultipleWeak( out, index );
+    }
+    else
+    {
+        const bool defined = !options.m_defined.empty();
+        for ( const IndexSymbol *s : index.Find( defined ? options.m_defined : options.m_referenced ) )
+        {
+            if ( s->IsDefined() == defined )
+            {
+                PrintSymbol( out, index, *s );
+            }
+        }
+    }
+
+    std::cout.write( out.data(), out.size() );
+    std::cerr << fmt::format( "{} objects, {} symbols searched in {:.1f} ms\n", index.Header().m_num_files, index.Header().m_num_symbols, MillisecondsSince( start ) );
+    return 0;
+}
+
+} // namespace elfexplorer
@@ -0,0 +1,135 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__SYMBOL_INDEX_HPP__
+#define ELFEXPLORER__SYMBOL_INDEX_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace elfexplorer {
+
+// On-disk index of the symbols of every object in a directory tree. The file
+// is used in place (mmap) and is laid out as
+//
+//   IndexHeader
+//   IndexFile[ num_files ]      Sorted by path
+//   IndexSymbol[ num_symbols ]  Grouped by file
+//   uint32_t[ num_buckets ]     Heads of the per name hash chains
+//   char[ strings_size ]        Names and paths, nul terminated, deduplicated
+//
+// in host byte order. Undefined symbols are kept too, as references.
+
+struct IndexHeader
+{
+    char m_magic[ 8 ];
+    uint32_t m_version;
+    uint32_t m_num_files;
+    uint32_t m_num_symbols;
+    uint32_t m_num_buckets; // Power of two
+    uint64_t m_strings_size;
+};
+
+struct IndexFile
+{
+    uint32_t m_path;
+    uint32_t m_first_symbol;
+    uint32_t m_num_symbols;
+    uint32_t m_reserved;
+    int64_t m_mtime_ns;
+    uint64_t m_size;
+};
+
+struct IndexSymbol
+{
+    uint32_t m_name;
+    uint32_t m_name_hash;
+    uint32_t m_file;
+    uint32_t m_next; // Next symbol in the hash chain, NoSymbol at the end
+    uint64_t m_size;
+    uint32_t m_section_idx; // 0 if undefined
+    uint8_t m_binding;
+    uint8_t m_type;
+    uint16_t m_reserved;
+
+    bool IsDefined() const
+    {
+        return m_section_idx != 0;
+    }
+};
+
+class SymbolIndex
+{
+public:
+    static constexpr uint32_t NoSymbol = UINT32_MAX;
+
+    // Throws if the file is not a valid index
+    static SymbolIndex Open( const std::string &path );
+
+    SymbolIndex( SymbolIndex &&other );
+    SymbolIndex& operator=( SymbolIndex && ) = delete;
+    ~SymbolIndex();
+
+    // All symbols named `name`, in file order
+    std::vector< const IndexSymbol* > Find( std::string_view name ) const;
+
+    const IndexHeader& Header() const { return *m_header; }
+    const IndexFile* Files() const { return m_files; }
+    const IndexSymbol* Symbols() const { return m_symbols; }
+
+    std::string_view String( uint32_t offset ) const
+    {
+        return std::string_view( m_strings + offset );
+    }
+
+private:
+    SymbolIndex() = default;
+
+    void *m_mapping = nullptr;
+    size_t m_mapping_size = 0;
+
+    const IndexHeader *m_header = nullptr;
+    const IndexFile *m_files = nullptr;
+    const IndexSymbol *m_symbols = nullptr;
+    const uint32_t *m_buckets = nullptr;
+    const char *m_strings = nullptr;
+};
+
+struct IndexOptions
+{
+    std::string m_index_file;
+
+    // One of these
+    std::string m_scan_dir;        // Create or update the index
+    std::string m_defined;         // Print the definitions of a symbol
+    std::string m_referenced;      // Print the objects referencing a symbol
+    bool m_multiple_weak = false;  // Print weak symbols defined by more than one object
+
+    size_t m_num_threads = 0;      // For scanning, number of cores if 0
+};
+
+// Runs one of the index commands, printing results to stdout. Returns non zero
+// on failure.
+int RunIndex( const IndexOptions &options );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__SYMBOL_INDEX_HPP__
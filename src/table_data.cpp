@@ -0,0 +1,441 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "table_data.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "disasm_rows.hpp"
+#include "eh_frame.hpp"
+#include "stats.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+// Rows are added one value per column at a time, `Finish` lays the columns
+// out as described in table_data.hpp
+class TableBuilder
+{
+public:
+    size_t AddColumn( TableColumnKind kind, std::string_view title )
+    {
+        m_columns.push_back( Column{ kind, String( title ), {} } );
+        return m_columns.size() - 1;
+    }
+
+    void Reserve( size_t num_rows )
+    {
+        for ( Column &c : m_columns )
+        {
+            c.m_values.reserve( num_rows * Width( c.m_kind ) );
+        }
+    }
+
+    template < typename T >
+    void Push( size_t column, T value )
+    {
+        Column &c = m_columns[ column ];
+        ASSERT( sizeof( T ) == Width( c.m_kind ) );
+        const size_t end = c.m_values.size();
+        c.m_values.resize( end + sizeof( T ) );
+        std::memcpy( c.m_values.data() + end, &value, sizeof( T ) );
+    }
+
+    uint32_t String( std::string_view s )
+    {
+        ASSERT( m_strings.size() + s.size() < UINT32_MAX );
+        uint32_t offset = m_strings.size();
+        m_strings.append( s );
+        m_strings.push_back( '\0' );
+        return offset;
+    }
+
+    // Stored once for all the rows using it, for names of enum values and
+    // instructions that repeat a lot
+    uint32_t SharedString( std::string_view s )
+    {
+        m_key.assign( s );
+        auto it = m_shared.find( m_key );
+        if ( it != m_shared.end() )
+        {
+            return it->second;
+        }
+        uint32_t offset = String( s );
+        m_shared.emplace( m_key, offset );
+        return offset;
+    }
+
+    void Finish( std::string &out ) const
+    {
+        const size_t num_rows = m_columns.empty() ? 0 : m_columns[ 0 ].m_values.size() / Width( m_columns[ 0 ].m_kind );
+
+        std::vector< uint32_t > header = { 0, uint32_t( num_rows ), uint32_t( m_columns.size() ), 0 };
+        size_t size = Align( ( header.size() + 4 * m_columns.size() ) * sizeof( uint32_t ) );
+        for ( const Column &c : m_columns )
+        {
+            ASSERT( c.m_values.size() == num_rows * Width( c.m_kind ) );
+            header.insert( header.end(), { uint32_t( c.m_kind ), c.m_title, uint32_t( size ), 0 } );
+            size = Align( size + c.m_values.size() );
+        }
+        header[ 3 ] = size;
+        size += m_strings.size();
+        ASSERT( size < UINT32_MAX );
+        header[ 0 ] = size;
+
+        out.assign( size, '\0' );
+        std::memcpy( out.data(), header.data(), header.size() * sizeof( uint32_t ) );
+        for ( size_t i = 0; i < m_columns.size(); ++i )
+        {
+            const auto &values = m_columns[ i ].m_values;
+            std::copy( values.begin(), values.end(), out.begin() + header[ 4 + 4 * i + 2 ] );
+        }
+        std::copy( m_strings.begin(), m_strings.end(), out.begin() + header[ 3 ] );
+    }
+
+private:
+    struct Column
+    {
+        TableColumnKind m_kind;
+        uint32_t m_title;
+        std::vector< unsigned char > m_values;
+    };
+
+    static size_t Width( TableColumnKind kind )
+    {
+        switch ( kind )
+        {
+        case TableColumnKind::Uint64:
+        case TableColumnKind::Int64:
+        case TableColumnKind::Offset:
+            return 8;
+        default:
+            return 4;
+        }
+    }
+
+    static size_t Align( size_t offset )
+    {
+        return ( offset + 7 ) & ~size_t( 7 );
+    }
+
+    std::vector< Column > m_columns;
+    std::string m_strings;
+    std::unordered_map< std::string, uint32_t > m_shared;
+    std::string m_key;
+};
+
+// Names of the values of an enum column, each looked up in the shared
+// strings once
+template < typename E >
+class EnumStrings
+{
+public:
+    explicit EnumStrings( TableBuilder &table )
+        : m_table( table )
+    {
+        m_offsets.fill( UINT32_MAX );
+    }
+
+    uint32_t operator()( E v )
+    {
+        const uint64_t idx = static_cast< uint64_t >( v );
+        if ( idx >= m_offsets.size() )
+        {
+            return Lookup( v );
+        }
+        if ( m_offsets[ idx ] == UINT32_MAX )
+        {
+            m_offsets[ idx ] = Lookup( v );
+        }
+        return m_offsets[ idx ];
+    }
+
+private:
+    uint32_t Lookup( E v )
+    {
+        std::string_view name = EnumName( v );
+        if ( name.empty() )
+        {
+            return m_table.SharedString( fmt::format( "{}", static_cast< uint64_t >( v ) ) );
+        }
+        return m_table.SharedString( name );
+    }
+
+    TableBuilder &m_table;
+    std::array< uint32_t, 256 > m_offsets;
+};
+
+void EncodeSymbols( TableBuilder &table, const SymbolTable &symtab, size_t symtab_idx, const ReferenceIndex *references )
+{
+    const size_t index = table.AddColumn( TableColumnKind::SymbolIndex, "Symbol" );
+    const size_t name = table.AddColumn( TableColumnKind::Text, "Name" );
+    const size_t binding = table.AddColumn( TableColumnKind::Enum, "Bind" );
+    const size_t type = table.AddColumn( TableColumnKind::Enum, "Type" );
+    const size_t visibility = table.AddColumn( TableColumnKind::Enum, "Visibility" );
+    const size_t section = table.AddColumn( TableColumnKind::Uint32, "Section Idx" );
+    const size_t value = table.AddColumn( TableColumnKind::Uint64, "Value" );
+    const size_t size = table.AddColumn( TableColumnKind::Uint64, "Size" );
+    const size_t refs = references ? table.AddColumn( TableColumnKind::Uint32, "Refs" ) : 0;
+    table.Reserve( symtab.m_symbols.size() );
+
+    EnumStrings< SymbolBinding > binding_names( table );
+    EnumStrings< SymbolType > type_names( table );
+    EnumStrings< SymbolVisibility > visibility_names( table );
+
+    for ( size_t i = 0; i < symtab.m_symbols.size(); ++i )
+    {
+        const Symbol &s = symtab.m_symbols[ i ];
+        table.Push< uint32_t >( index, i );
+        table.Push< uint32_t >( name, table.String( s.m_name ) );
+        table.Push< uint32_t >( binding, binding_names( s.m_binding ) );
+        table.Push< uint32_t >( type, type_names( s.m_type ) );
+        table.Push< uint32_t >( visibility, visibility_names( s.m_visibility ) );
+        table.Push< uint32_t >( section, FileSectionIndex( s.m_section_idx ) );
+        table.Push< uint64_t >( value, s.m_value );
+        table.Push< uint64_t >( size, s.m_size );
+        if ( references )
+        {
+            table.Push< uint32_t >( refs, references->ToSymbol( symtab_idx, i ).size() );
+        }
+    }
+}
+
+void EncodeRelocations( TableBuilder &table, const RelocationEntries &reloc, const SymbolTable &symtab, Machine machine )
+{
+    const size_t index = table.AddColumn( TableColumnKind::Uint32, "Relocation Entry" );
+    const size_t offset = table.AddColumn( TableColumnKind::Uint64, "Offset" );
+    const size_t symbol = table.AddColumn( TableColumnKind::Text, "Sym" );
+    const size_t type = table.AddColumn( TableColumnKind::Enum, "Type" );
+    const size_t addend = reloc.m_has_addends ? table.AddColumn( TableColumnKind::Int64, "Addend" ) : 0;
+    table.Reserve( reloc.m_entries.size() );
+
+    // Relocation types are machine specific, only x86-64 ones are known by
+    // name
+    EnumStrings< X64RelocationType > type_names( table );
+    auto type_name = [ & ]( X64RelocationType t )
+    {
+        return machine == Machine::EM_X86_64 ? type_names( t ) : table.SharedString( fmt::format( "{}", static_cast< uint32_t >( t ) ) );
+    };
+
+    // Most symbols are referred to more than once
+    std::vector< uint32_t > symbol_names( symtab.m_symbols.size(), UINT32_MAX );
+    for ( size_t i = 0; i < reloc.m_entries.size(); ++i )
+    {
+        const RelocationEntry &e = reloc.m_entries[ i ];
+        ASSERT( e.m_symbol < symtab.m_symbols.size() );
+        if ( symbol_names[ e.m_symbol ] == UINT32_MAX )
+        {
+            symbol_names[ e.m_symbol ] = table.String( symtab.m_symbols[ e.m_symbol ].m_name );
+        }
+
+        table.Push< uint32_t >( index, i );
+        table.Push< uint64_t >( offset, e.m_offset );
+        table.Push< uint32_t >( symbol, symbol_names[ e.m_symbol ] );
+        table.Push< uint32_t >( type, type_name( e.m_type ) );
+        if ( reloc.m_has_addends )
+        {
+            table.Push< int64_t >( addend, e.m_addend );
+        }
+    }
+}
+
+// Same rows as the disassembly in the html, the relocated bytes of an
+// instruction are followed by the relocation in the bytes column. The source
+// column is only set where the line changes.
+void EncodeDisassembly( TableBuilder &table, std::string_view code, FunctionIndex::Slice< FunctionIndex::Relocation > relocations,
+                        FunctionIndex::Slice< LineTable::Row > lines, const LineTable *line_table )
+{
+    const size_t offset_column = table.AddColumn( TableColumnKind::Offset, "Offset" );
+    const size_t bytes_column = table.AddColumn( TableColumnKind::Text, "Bytes" );
+    const size_t insn_column = table.AddColumn( TableColumnKind::Text, "Instruction" );
+    const bool has_lines = lines.begin() != lines.end();
+    const size_t source_column = has_lines ? table.AddColumn( TableColumnKind::Text, "Source" ) : 0;
+
+    std::string bytes;
+    std::string text;
+    ForEachDisasmRow( code, 0, code.size(), relocations, { nullptr, nullptr }, lines, [ & ]( const DisasmRow &row )
+    {
+        bytes.clear();
+        row.ForEachByte(
+            [ & ]( uint64_t i )
+            {
+                fmt::format_to( std::back_inserter( bytes ), "{:02x} ", static_cast< uint8_t >( code[ i ] ) );
+            },
+            []( const FunctionIndex::Relocation & ) {},
+            [ & ]( const FunctionIndex::Relocation &reloc )
+            {
+                const RelocationEntry &e = *reloc.m_entry;
+                fmt::format_to( std::back_inserter( bytes ), "<{} , {} , {}> ", EnumName( e.m_type ), reloc.m_symtab->m_symbols[ e.m_symbol ].m_name, e.m_addend );
+            } );
+
+        text.assign( row.Mnemonic() );
+        if ( row.m_insn.text_size )
+        {
+            text.push_back( ' ' );
+            text.append( row.Operands() );
+        }
+
+        table.Push< uint64_t >( offset_column, row.m_insn.offset );
+        table.Push< uint32_t >( bytes_column, table.String( bytes ) );
+        table.Push< uint32_t >( insn_column, table.SharedString( text ) );
+
+        if ( has_lines )
+        {
+            // The last line starting within the instruction
+            text.clear();
+            if ( row.m_lines.begin() != row.m_lines.end() )
+            {
+                const LineTable::Row &line = row.m_lines.end()[ -1 ];
+                text = fmt::format( "{}:{}", line_table->FileName( line.m_file ), line.m_line );
+            }
+            table.Push< uint32_t >( source_column, table.SharedString( text ) );
+        }
+    } );
+}
+
+// Same rows as the .eh_frame table in the html, CIEs and FDEs in the order of
+// the section with their instructions on one line
+void EncodeEhFrame( TableBuilder &table, const ELF_File &elf, const EhFrame &eh_frame )
+{
+    const size_t offset_column = table.AddColumn( TableColumnKind::Offset, "Offset" );
+    const size_t record_column = table.AddColumn( TableColumnKind::Text, "Record" );
+    const size_t section_column = table.AddColumn( TableColumnKind::Uint32, "Section Idx" );
+    const size_t begin_column = table.AddColumn( TableColumnKind::Uint64, "PC Begin" );
+    const size_t range_column = table.AddColumn( TableColumnKind::Uint64, "PC Range" );
+    const size_t function_column = table.AddColumn( TableColumnKind::Text, "Function" );
+    const size_t insn_column = table.AddColumn( TableColumnKind::Text, "Instructions" );
+
+    const auto &cies = eh_frame.Cies();
+    const auto &fdes = eh_frame.Fdes();
+    table.Reserve( cies.size() + fdes.size() );
+
+    std::string text;
+    auto instructions = [ & ]( const EhFrame::Cie &cie, std::string_view data, uint64_t pc )
+    {
+        text.clear();
+        try
+        {
+            for ( const std::string &line : eh_frame.Instructions( cie, data, pc ) )
+            {
+                text.append( text.empty() ? "" : "; " ).append( line );
+            }
+        }
+        catch ( const std::exception &e )
+        {
+            text = fmt::format( "Can not decode: {}", e.what() );
+        }
+        return table.SharedString( text );
+    };
+
+    size_t cie_idx = 0;
+    size_t fde_idx = 0;
+    while ( cie_idx < cies.size() || fde_idx < fdes.size() )
+    {
+        if ( fde_idx == fdes.size() || ( cie_idx < cies.size() && cies[ cie_idx ].m_offset < fdes[ fde_idx ].m_offset ) )
+        {
+            const EhFrame::Cie &cie = cies[ cie_idx++ ];
+            table.Push< uint64_t >( offset_column, cie.m_offset );
+            table.Push< uint32_t >( record_column, table.SharedString( "CIE" ) );
+            table.Push< uint32_t >( section_column, 0 );
+            table.Push< uint64_t >( begin_column, 0 );
+            table.Push< uint64_t >( range_column, 0 );
+            table.Push< uint32_t >( function_column, table.String( EhFrame::Describe( cie ) ) );
+            table.Push< uint32_t >( insn_column, instructions( cie, cie.m_instructions, 0 ) );
+        }
+        else
+        {
+            const EhFrame::Fde &fde = fdes[ fde_idx++ ];
+            const EhFrame::Function *fn = eh_frame.FunctionOf( fde );
+            std::string_view name;
+            if ( fn )
+            {
+                name = std::get< SymbolTable >( elf.m_sections[ fn->m_symtab_idx ].m_var ).m_symbols[ fn->m_symbol_idx ].m_name;
+            }
+            table.Push< uint64_t >( offset_column, fde.m_offset );
+            table.Push< uint32_t >( record_column, table.SharedString( "FDE" ) );
+            table.Push< uint32_t >( section_column, fde.m_section_idx );
+            table.Push< uint64_t >( begin_column, fde.m_begin );
+            table.Push< uint64_t >( range_column, fde.m_size );
+            table.Push< uint32_t >( function_column, table.String( name ) );
+            table.Push< uint32_t >( insn_column, instructions( eh_frame.CieOf( fde ), fde.m_instructions, fde.m_begin ) );
+        }
+    }
+}
+
+} // namespace
+
+bool EncodeTable( std::string &out, const ELF_File &elf, const FunctionIndex &functions, size_t section_idx, const ReferenceIndex *references )
+{
+    if ( section_idx >= elf.m_sections.size() )
+    {
+        return false;
+    }
+
+    const Section &sec = elf.m_sections[ section_idx ];
+    stats::ScopedPhase phase( "encode_table", sec.m_header.m_name, sec.m_header.m_size );
+
+    TableBuilder table;
+    if ( const auto *symtab = std::get_if< SymbolTable >( &sec.m_var ) )
+    {
+        EncodeSymbols( table, *symtab, section_idx, references );
+    }
+    else if ( const auto *reloc = std::get_if< RelocationEntries >( &sec.m_var ) )
+    {
+        ASSERT( sec.m_header.m_asso_idx < elf.m_sections.size() );
+        const auto *symtab = std::get_if< SymbolTable >( &elf.m_sections[ sec.m_header.m_asso_idx ].m_var );
+        ASSERT( symtab || reloc->m_entries.empty() );
+        static const SymbolTable no_symbols( std::pmr::get_default_resource() );
+        EncodeRelocations( table, *reloc, symtab ? *symtab : no_symbols, elf.m_machine );
+    }
+    else if ( EhFrame::IsEhFrame( elf, section_idx ) )
+    {
+        try
+        {
+            EhFrame eh_frame( elf, section_idx );
+            EncodeEhFrame( table, elf, eh_frame );
+        }
+        catch ( const std::exception & )
+        {
+            return false; // Shown as bytes
+        }
+    }
+    else if ( const auto *code = std::get_if< ProgBitsSection >( &sec.m_var ); code && code->m_is_executable && CanDisassemble( elf.m_machine ) )
+    {
+        EncodeDisassembly( table, code->m_data, functions.Relocations( section_idx, 0, code->m_data.size() ),
+                           functions.SourceLines( section_idx, 0, code->m_data.size() ), functions.Lines() );
+    }
+    else
+    {
+        return false;
+    }
+
+    table.Finish( out );
+    return true;
+}
+
+} // namespace elfexplorer
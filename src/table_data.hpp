@@ -0,0 +1,72 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__TABLE_DATA_HPP__
+#define ELFEXPLORER__TABLE_DATA_HPP__
+
+#include <cstdint>
+#include <string>
+
+#include "elf_structs.hpp"
+#include "function_index.hpp"
+#include "reference_index.hpp"
+
+namespace elfexplorer {
+
+// The rows of a symbol table, relocation table, .eh_frame or disassembly
+// packed by column, for the web ui to render only the rows in view instead of
+// building a dom element per row (see `VirtualTable` in elf-explorer.js). Each
+// column is a plain array that is viewed as a typed array on the js side,
+// strings are offsets into one pool of nul terminated utf-8.
+//
+// Layout, in the byte order of the machine (little endian for the web
+// version), arrays aligned to 8 bytes:
+//
+//   uint32 size              Of the whole table in bytes
+//   uint32 num_rows
+//   uint32 num_columns
+//   uint32 strings_offset
+//   num_columns times:
+//     uint32 kind            `TableColumnKind`
+//     uint32 title           Offset in strings
+//     uint32 values_offset   num_rows values, of the kind's type
+//     uint32 reserved
+//   column values
+//   strings
+enum class TableColumnKind : uint32_t
+{
+    Uint32 = 0,
+    Uint64 = 1,
+    Int64 = 2,
+    Offset = 3,      // uint64, shown zero padded as in the disassembly
+    Text = 4,        // uint32 offset in strings
+    Enum = 5,        // uint32 offset in strings, names with an info popup
+    SymbolIndex = 6, // uint32, shown with the anchor of the symbol
+};
+
+// Sets `out` to the table of the section (binary, in a string so it can be
+// sent as is), returns false if the section has
+// no rows, i.e. it is not a symbol or relocation table, a decodable .eh_frame
+// or code that can be disassembled. `functions` gives the relocations shown in the disassembly.
+// Symbol tables get a column counting the references to each symbol if
+// `references` is given.
+bool EncodeTable( std::string &out, const ELF_File &elf, const FunctionIndex &functions, size_t section_idx, const ReferenceIndex *references = nullptr );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__TABLE_DATA_HPP__
@@ -0,0 +1,104 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__THREAD_POOL_HPP__
+#define ELFEXPLORER__THREAD_POOL_HPP__
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace elfexplorer {
+
+// Fixed number of worker threads running submitted tasks in FIFO order.
+// Destruction waits for the queued tasks to finish.
+class ThreadPool
+{
+public:
+    explicit ThreadPool( size_t num_threads )
+    {
+        for ( size_t i = 0; i < std::max< size_t >( num_threads, 1 ); ++i )
+        {
+            m_threads.emplace_back( [ this ] { WorkerLoop(); } );
+        }
+    }
+
+    ThreadPool( const ThreadPool & ) = delete;
+    ThreadPool& operator=( const ThreadPool & ) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        for ( std::thread &t : m_threads )
+        {
+            t.join();
+        }
+    }
+
+    void Submit( std::function< void() > task )
+    {
+        {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            m_tasks.push_back( std::move( task ) );
+        }
+        m_cv.notify_one();
+    }
+
+    size_t NumThreads() const
+    {
+        return m_threads.size();
+    }
+
+private:
+    void WorkerLoop()
+    {
+        while ( true )
+        {
+            std::function< void() > task;
+            {
+                std::unique_lock< std::mutex > lock( m_mutex );
+                m_cv.wait( lock, [ this ] { return m_stopping || !m_tasks.empty(); } );
+                if ( m_tasks.empty() )
+                {
+                    return;
+                }
+                task = std::move( m_tasks.front() );
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque< std::function< void() > > m_tasks;
+    bool m_stopping = false;
+    std::vector< std::thread > m_threads;
+};
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__THREAD_POOL_HPP__
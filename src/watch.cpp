@@ -0,0 +1,382 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "watch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "debug_line.hpp"
+#include "eh_frame.hpp"
+#include "elf_structs.hpp"
+#include "hash.hpp"
+#include "html_output.hpp"
+#include "input_buffer.hpp"
+#include "stats.hpp"
+
+namespace elfexplorer {
+
+namespace {
+
+bool IsObjectFile( std::string_view name )
+{
+    return name.size() > 2 && name.substr( name.size() - 2 ) == ".o";
+}
+
+uint64_t HeaderHash( const SectionHeader &sh, bool with_offset )
+{
+    uint64_t h = Hash64( sh.m_name );
+    h = HashCombine( h, static_cast< uint64_t >( sh.m_type ) );
+    h = HashCombine( h, static_cast< uint64_t >( sh.m_attrs ) );
+    h = HashCombine( h, sh.m_address );
+    h = HashCombine( h, with_offset ? sh.m_offset : 0 );
+    h = HashCombine( h, sh.m_size );
+    h = HashCombine( h, sh.m_asso_idx );
+    h = HashCombine( h, sh.m_info );
+    h = HashCombine( h, sh.m_addr_align );
+    return HashCombine( h, sh.m_ent_size );
+}
+
+// One key per chunk of `HTMLChunkRenderer`, covering everything the html of
+// the chunk is made of. Besides its own header and contents, a section shows
+// names from the sections it links to: strings of a symbol table, symbols of
+// relocations, relocations, labels and source lines of code, names of group
+// members and the functions and sections .eh_frame records are for. File
+// offsets are only shown in the section header table, so a section moving in
+// the file does not need to be rendered again.
+std::vector< uint64_t > ChunkKeys( const InputBuffer &input, const ELF_File &elf )
+{
+    const auto &sections = elf.m_sections;
+    const size_t num_sections = sections.size();
+
+    std::vector< uint64_t > content( num_sections );
+    for ( size_t i = 0; i < num_sections; ++i )
+    {
+        content[ i ] = Hash64( SectionBytes( input, sections[ i ].m_header ) );
+    }
+
+    // Contents of the linked section and its own link, e.g. the symbol table
+    // and string table used by a relocation section
+    auto linked = [ & ]( size_t idx )
+    {
+        uint64_t h = 0;
+        for ( int depth = 0; depth < 2; ++depth )
+        {
+            idx = sections[ idx ].m_header.m_asso_idx;
+            if ( idx == 0 || idx >= num_sections )
+            {
+                break;
+            }
+            h = HashCombine( h, content[ idx ] );
+        }
+        return h;
+    };
+
+    uint64_t lines = 0;
+    for ( uint32_t idx : LineTable::Dependencies( sections ) )
+    {
+        lines = HashCombine( lines, content[ idx ] );
+    }
+
+    // For sections linking to any other section by name
+    uint64_t names = num_sections;
+    for ( const Section &sec : sections )
+    {
+        names = HashCombine( names, Hash64( sec.m_header.m_name ) );
+    }
+
+    // The relocation sections applying to a section, with their symbols
+    std::vector< uint64_t > relocations( num_sections );
+    for ( size_t i = 1; i < num_sections; ++i )
+    {
+        const SectionHeader &sh = sections[ i ].m_header;
+        if ( ( sh.m_type == SectionType::SHT_RELA || sh.m_type == SectionType::SHT_REL ) && sh.m_info < num_sections )
+        {
+            uint64_t &h = relocations[ sh.m_info ];
+            h = HashCombine( h, HashCombine( content[ i ], linked( i ) ) );
+        }
+    }
+
+    // Symbols of all symbol tables, shown as labels in code
+    uint64_t symbols = 0;
+    for ( size_t i = 1; i < num_sections; ++i )
+    {
+        if ( sections[ i ].m_header.m_type == SectionType::SHT_SYMTAB )
+        {
+            symbols = HashCombine( symbols, HashCombine( content[ i ], linked( i ) ) );
+        }
+    }
+
+    std::vector< uint64_t > res( std::max< size_t >( num_sections, 1 ) );
+
+    res[ 0 ] = num_sections;
+    for ( size_t i = 1; i < num_sections; ++i )
+    {
+        const SectionHeader &sh = sections[ i ].m_header;
+        res[ 0 ] = HashCombine( res[ 0 ], HeaderHash( sh, true ) );
+        if ( sh.m_type == SectionType::SHT_GROUP )
+        {
+            res[ 0 ] = HashCombine( res[ 0 ], linked( i ) ); // Signature symbol
+        }
+    }
+
+    for ( size_t i = 1; i < num_sections; ++i )
+    {
+        const Section &sec = sections[ i ];
+        const SectionHeader &sh = sec.m_header;
+
+        uint64_t h = HashCombine( HeaderHash( sh, false ), i );
+        h = HashCombine( h, content[ i ] );
+        h = HashCombine( h, linked( i ) );
+        if ( sh.m_asso_idx < num_sections )
+        {
+            h = HashCombine( h, Hash64( sections[ sh.m_asso_idx ].m_header.m_name ) );
+        }
+
+        const auto *progbits = std::get_if< ProgBitsSection >( &sec.m_var );
+        if ( progbits && progbits->m_is_executable )
+        {
+            h = HashCombine( h, relocations[ i ] );
+            h = HashCombine( h, symbols );
+            h = HashCombine( h, names );
+            h = HashCombine( h, lines );
+        }
+
+        if ( EhFrame::IsEhFrame( elf, i ) || std::holds_alternative< SymbolSectionIndices >( sec.m_var ) )
+        {
+            h = HashCombine( h, relocations[ i ] );
+            h = HashCombine( h, names );
+        }
+
+        if ( const auto *group = std::get_if< GroupSection >( &sec.m_var ) )
+        {
+            for ( uint32_t member : group->m_section_indices )
+            {
+                if ( member < num_sections )
+                {
+                    h = HashCombine( h, Hash64( sections[ member ].m_header.m_name ) );
+                }
+            }
+        }
+
+        res[ i ] = h;
+    }
+
+    return res;
+}
+
+class Watcher
+{
+public:
+    Watcher( const std::string &dir, const std::string &out_dir )
+        : m_dir( dir )
+        , m_out_dir( out_dir )
+    {
+    }
+
+    void Update( const std::string &name )
+    {
+        try
+        {
+            Render( name );
+        }
+        catch ( const std::exception &e )
+        {
+            // Usually a half written object, the next write brings it back
+            std::cerr << fmt::format( "{}: {}\n", name, e.what() );
+        }
+    }
+
+    void Remove( const std::string &name )
+    {
+        m_files.erase( name );
+        std::remove( OutputFileName( name ).c_str() );
+        std::cerr << fmt::format( "{}: removed\n", name );
+    }
+
+private:
+    // Rendered chunks of one object, and the keys they were rendered for
+    struct RenderedFile
+    {
+        std::vector< uint64_t > m_keys;
+        std::vector< std::string > m_chunks;
+    };
+
+    std::string OutputFileName( const std::string &name ) const
+    {
+        return fmt::format( "{}/{}.html", m_out_dir, name );
+    }
+
+    void Render( const std::string &name )
+    {
+        stats::ScopedPhase phase( "watch_update", name );
+        auto start = std::chrono::steady_clock::now();
+
+        std::string path = fmt::format( "{}/{}", m_dir, name );
+        InputBuffer input( path, ReadFile( path.c_str() ) );
+        ELF_File elf = ELF_File::LoadFrom( input );
+
+        RenderedFile res;
+        res.m_keys = ChunkKeys( input, elf );
+        res.m_chunks.resize( res.m_keys.size() );
+
+        // Nothing is taken from the previous rendering until all changed
+        // chunks are rendered, so it stays intact if rendering fails
+        RenderedFile &prev = m_files[ name ];
+        auto unchanged = [ & ]( size_t i ) { return i < prev.m_keys.size() && prev.m_keys[ i ] == res.m_keys[ i ]; };
+
+        HTMLChunkRenderer renderer( elf );
+        size_t num_rendered = 0;
+        for ( size_t i = 0; i < res.m_keys.size(); ++i )
+        {
+            if ( !unchanged( i ) )
+            {
+                fmt::memory_buffer chunk;
+                renderer.RenderChunk( chunk, i );
+                res.m_chunks[ i ] = fmt::to_string( chunk );
+                ++num_rendered;
+            }
+        }
+        for ( size_t i = 0; i < res.m_keys.size(); ++i )
+        {
+            if ( unchanged( i ) )
+            {
+                res.m_chunks[ i ] = std::move( prev.m_chunks[ i ] );
+            }
+        }
+        prev = std::move( res );
+
+        fmt::memory_buffer html;
+        RenderDocumentHead( html );
+        for ( const std::string &chunk : prev.m_chunks )
+        {
+            html.append( chunk.data(), chunk.data() + chunk.size() );
+        }
+        RenderDocumentTail( html );
+        WriteFileAtomically( OutputFileName( name ), std::string_view( html.data(), html.size() ) );
+
+        std::cerr << fmt::format( "{}: rendered {} of {} chunks in {:.1f} ms\n", name, num_rendered, prev.m_keys.size(), MillisecondsSince( start ) );
+    }
+
+    std::string m_dir;
+    std::string m_out_dir;
+    std::unordered_map< std::string, RenderedFile > m_files;
+};
+
+} // namespace
+
+int RunWatch( const std::string &dir, const std::string &out_dir )
+{
+    int fd = inotify_init1( IN_CLOEXEC );
+    if ( fd < 0 || inotify_add_watch( fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM ) < 0 )
+    {
+        std::cerr << fmt::format( "Can not watch {}: {}\n", dir, std::strerror( errno ) );
+        return 1;
+    }
+
+    Watcher watcher( dir, out_dir );
+
+    // Everything present is rendered once. The watch is already set up, so
+    // objects written meanwhile are not missed.
+    if ( DIR *listing = opendir( dir.c_str() ) )
+    {
+        std::vector< std::string > names;
+        while ( dirent *entry = readdir( listing ) )
+        {
+            if ( IsObjectFile( entry->d_name ) )
+            {
+                names.push_back( entry->d_name );
+            }
+        }
+        closedir( listing );
+
+        std::sort( names.begin(), names.end() );
+        for ( const std::string &name : names )
+        {
+            watcher.Update( name );
+        }
+    }
+
+    // File name to whether it exists, collected until the directory is
+    // quiet for a moment so an object written in several steps is only
+    // rendered once
+    std::map< std::string, bool > pending;
+
+    alignas( inotify_event ) char buf[ 64 * 1024 ];
+    while ( true )
+    {
+        ssize_t len = read( fd, buf, sizeof( buf ) );
+        if ( len < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            std::cerr << fmt::format( "Can not read events: {}\n", std::strerror( errno ) );
+            return 1;
+        }
+
+        for ( char *p = buf; p < buf + len; )
+        {
+            const auto *ev = reinterpret_cast< const inotify_event* >( p );
+            p += sizeof( inotify_event ) + ev->len;
+
+            if ( ev->len == 0 || !IsObjectFile( ev->name ) )
+            {
+                continue;
+            }
+            pending[ ev->name ] = !( ev->mask & ( IN_DELETE | IN_MOVED_FROM ) );
+        }
+
+        pollfd pfd = { fd, POLLIN, 0 };
+        if ( poll( &pfd, 1, 50 ) > 0 )
+        {
+            continue;
+        }
+
+        for ( const auto &[ name, exists ] : pending )
+        {
+            if ( exists )
+            {
+                watcher.Update( name );
+            }
+            else
+            {
+                watcher.Remove( name );
+            }
+        }
+        pending.clear();
+    }
+}
+
+} // namespace elfexplorer
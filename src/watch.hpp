@@ -0,0 +1,34 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of ELF Explorer.
+//
+// ELF Explorer is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ELF Explorer is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef ELFEXPLORER__WATCH_HPP__
+#define ELFEXPLORER__WATCH_HPP__
+
+#include <string>
+
+namespace elfexplorer {
+
+// Renders every `.o` file in `dir` to `<out_dir>/<name>.o.html`, then keeps
+// the output up to date as objects are rewritten (linux inotify). Only the
+// sections whose contents or dependencies changed are re-rendered. Runs
+// until interrupted, returns non zero if the directory can't be watched.
+int RunWatch( const std::string &dir, const std::string &out_dir );
+
+} // namespace elfexplorer
+
+#endif // ELFEXPLORER__WATCH_HPP__
@@ -20,23 +20,299 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <disasm/disasm.h>
 
-void DisasmExecutableSection( unsigned char *object_data, uint64_t size, DisasmCallback cb_fn, void *cb_data )
+#define OUTBUF_SIZE 1024
+
+struct DisasmContext
+{
+    char outbuf[ OUTBUF_SIZE ];
+
+    // Last bytes of a section are copied here so nasm never reads past the
+    // end of the input
+    unsigned char tail[ 2 * INSN_MAX ];
+
+    // Operand text of the current batch
+    char *text;
+    size_t text_size;
+    size_t text_capacity;
+
+    // Interned mnemonics, nul terminated in `names`. Ids are indices into
+    // `name_offsets`, looked up through an open addressing hash table.
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+    uint32_t *name_offsets;
+    size_t num_names;
+    uint16_t *table; // id + 1, 0 for empty slots
+    size_t table_size;
+};
+
+static void* CheckedRealloc( void *p, size_t size )
+{
+    void *res = realloc( p, size );
+    if ( res == NULL )
+    {
+        fprintf( stderr, "Out of memory\n" );
+        abort();
+    }
+    return res;
+}
+
+DisasmContext* DisasmCreateContext( void )
+{
+    DisasmContext *ctx = CheckedRealloc( NULL, sizeof( DisasmContext ) );
+    memset( ctx, 0, sizeof( DisasmContext ) );
+
+    ctx->table_size = 1024;
+    ctx->table = CheckedRealloc( NULL, ctx->table_size * sizeof( uint16_t ) );
+    memset( ctx->table, 0, ctx->table_size * sizeof( uint16_t ) );
+    return ctx;
+}
+
+void DisasmDestroyContext( DisasmContext *ctx )
+{
+    if ( ctx == NULL )
+    {
+        return;
+    }
+    free( ctx->text );
+    free( ctx->names );
+    free( ctx->name_offsets );
+    free( ctx->table );
+    free( ctx );
+}
+
+static uint32_t HashName( const char *s, size_t len )
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for ( size_t i = 0; i < len; ++i )
+    {
+        h = ( h ^ (unsigned char)s[ i ] ) * 16777619u;
+    }
+    return h;
+}
+
+static void InsertIntoTable( DisasmContext *ctx, uint16_t id )
+{
+    const char *name = ctx->names + ctx->name_offsets[ id ];
+    size_t mask = ctx->table_size - 1;
+    size_t slot = HashName( name, strlen( name ) ) & mask;
+    while ( ctx->table[ slot ] != 0 )
+    {
+        slot = ( slot + 1 ) & mask;
+    }
+    ctx->table[ slot ] = id + 1;
+}
+
+static uint16_t InternMnemonic( DisasmContext *ctx, const char *s, size_t len )
+{
+    size_t mask = ctx->table_size - 1;
+    for ( size_t slot = HashName( s, len ) & mask; ctx->table[ slot ] != 0; slot = ( slot + 1 ) & mask )
+    {
+        const char *name = ctx->names + ctx->name_offsets[ ctx->table[ slot ] - 1 ];
+        if ( strncmp( name, s, len ) == 0 && name[ len ] == '\0' )
+        {
+            return ctx->table[ slot ] - 1;
+        }
+    }
+
+    if ( ctx->num_names == 0xfffe )
+    {
+        fprintf( stderr, "Too many distinct mnemonics\n" );
+        abort();
+    }
+
+    if ( ctx->names_size + len + 1 > ctx->names_capacity )
+    {
+        ctx->names_capacity = 2 * ( ctx->names_size + len + 1 );
+        ctx->names = CheckedRealloc( ctx->names, ctx->names_capacity );
+    }
+    ctx->name_offsets = CheckedRealloc( ctx->name_offsets, ( ctx->num_names + 1 ) * sizeof( uint32_t ) );
+    ctx->name_offsets[ ctx->num_names ] = ctx->names_size;
+    memcpy( ctx->names + ctx->names_size, s, len );
+    ctx->names[ ctx->names_size + len ] = '\0';
+    ctx->names_size += len + 1;
+
+    uint16_t id = ctx->num_names++;
+
+    // Keep the table at most half full
+    if ( 2 * ctx->num_names > ctx->table_size )
+    {
+        ctx->table_size *= 2;
+        ctx->table = CheckedRealloc( ctx->table, ctx->table_size * sizeof( uint16_t ) );
+        memset( ctx->table, 0, ctx->table_size * sizeof( uint16_t ) );
+        for ( uint16_t i = 0; i + 1 < ctx->num_names; ++i )
+        {
+            InsertIntoTable( ctx, i );
+        }
+    }
+    InsertIntoTable( ctx, id );
+    return id;
+}
+
+static void AppendText( DisasmContext *ctx, const char *s, size_t len )
+{
+    if ( len == 0 )
+    {
+        return;
+    }
+    if ( ctx->text_size + len > ctx->text_capacity )
+    {
+        ctx->text_capacity = 2 * ( ctx->text_size + len ) + 4096;
+        ctx->text = CheckedRealloc( ctx->text, ctx->text_capacity );
+    }
+    memcpy( ctx->text + ctx->text_size, s, len );
+    ctx->text_size += len;
+}
+
+// Printed before the mnemonic, and kept as part of it
+static int IsPrefix( const char *token, size_t len )
+{
+    static const char *const prefixes[] = {
+        "rep", "repe", "repz", "repne", "repnz", "lock", "bnd", "notrack",
+        "xacquire", "xrelease", "o16", "o32", "o64", "a16", "a32", "a64",
+    };
+    for ( size_t i = 0; i < sizeof( prefixes ) / sizeof( prefixes[ 0 ] ); ++i )
+    {
+        if ( strlen( prefixes[ i ] ) == len && strncmp( token, prefixes[ i ], len ) == 0 )
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int IsBranch( const char *mnemonic, size_t len )
+{
+    return mnemonic[ 0 ] == 'j'
+        || ( len == 4 && strncmp( mnemonic, "call", 4 ) == 0 )
+        || ( len >= 4 && strncmp( mnemonic, "loop", 4 ) == 0 );
+}
+
+// Direct branches are printed as `[short|near] 0x<hex>`
+static int ParseBranchTarget( const char *s, size_t len, uint64_t *target )
+{
+    if ( len > 6 && strncmp( s, "short ", 6 ) == 0 )
+    {
+        s += 6;
+        len -= 6;
+    }
+    else if ( len > 5 && strncmp( s, "near ", 5 ) == 0 )
+    {
+        s += 5;
+        len -= 5;
+    }
+
+    if ( len < 3 || s[ 0 ] != '0' || s[ 1 ] != 'x' )
+    {
+        return 0;
+    }
+
+    uint64_t res = 0;
+    for ( size_t i = 2; i < len; ++i )
+    {
+        char c = s[ i ];
+        if ( c >= '0' && c <= '9' )
+        {
+            res = res * 16 + ( c - '0' );
+        }
+        else if ( c >= 'a' && c <= 'f' )
+        {
+            res = res * 16 + ( c - 'a' + 10 );
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    *target = res;
+    return 1;
+}
+
+size_t DisasmDecodeBatch( DisasmContext *ctx, const unsigned char *data, uint64_t size,
+                          uint64_t begin, uint64_t end,
+                          DisasmInstruction *records, size_t max_records, uint64_t *next_offset )
 {
     iflag_t prefer;
-    int outbuf_size = 2000000;
-    char *outbuf = malloc( outbuf_size );
+    size_t count = 0;
+    uint64_t offset = begin;
 
-    for ( uint64_t offset = 0; offset < size; )
+    if ( end > size )
     {
-        int32_t insn_size = disasm( object_data + offset, INSN_MAX, outbuf, outbuf_size, 64, offset, false, &prefer);
+        end = size;
+    }
+    ctx->text_size = 0;
 
-        cb_fn( offset, insn_size, outbuf, cb_data );
+    while ( offset < end && count < max_records )
+    {
+        const unsigned char *insn = data + offset;
+        if ( size - offset < INSN_MAX )
+        {
+            memset( ctx->tail, 0, sizeof( ctx->tail ) );
+            memcpy( ctx->tail, insn, size - offset );
+            insn = ctx->tail;
+        }
+
+        int32_t insn_size = disasm( insn, INSN_MAX, ctx->outbuf, OUTBUF_SIZE, 64, offset, false, &prefer );
+        if ( insn_size <= 0 || (uint64_t)insn_size > size - offset )
+        {
+            // Not decodable, or cut off by the end of the section and only
+            // decoded thanks to the zero padding, skip a byte like ndisasm does
+            snprintf( ctx->outbuf, OUTBUF_SIZE, "db 0x%02x", insn[ 0 ] );
+            insn_size = 1;
+        }
+
+        // The mnemonic with its prefixes, e.g. `rep stosq` or `bnd jmp`, the
+        // last token is the instruction
+        const char *mnemonic = ctx->outbuf;
+        size_t line_size = strlen( ctx->outbuf );
+        const char *token = ctx->outbuf;
+        const char *space;
+        while ( 1 )
+        {
+            space = memchr( token, ' ', line_size - ( token - ctx->outbuf ) );
+            if ( !space || !IsPrefix( token, space - token ) )
+            {
+                break;
+            }
+            token = space + 1;
+        }
+        size_t mnemonic_size = space ? (size_t)( space - ctx->outbuf ) : line_size;
+        size_t token_size = mnemonic_size - ( token - ctx->outbuf );
+        const char *operands = space ? space + 1 : ctx->outbuf + line_size;
+        size_t operands_size = line_size - ( operands - ctx->outbuf );
+
+        DisasmInstruction *rec = &records[ count++ ];
+        rec->offset = offset;
+        rec->length = insn_size;
+        rec->mnemonic_id = InternMnemonic( ctx, mnemonic, mnemonic_size );
+        rec->text_begin = ctx->text_size;
+        rec->text_size = operands_size;
+        rec->is_branch = token_size != 0 && IsBranch( token, token_size );
+        rec->has_target = rec->is_branch && ParseBranchTarget( operands, operands_size, &rec->branch_target );
+        if ( !rec->has_target )
+        {
+            rec->branch_target = 0;
+        }
+        AppendText( ctx, operands, operands_size );
 
         offset += insn_size;
     }
 
-    free( outbuf );
+    *next_offset = offset;
+    return count;
+}
+
+const char* DisasmMnemonic( const DisasmContext *ctx, uint16_t mnemonic_id )
+{
+    return ctx->names + ctx->name_offsets[ mnemonic_id ];
+}
+
+const char* DisasmText( const DisasmContext *ctx )
+{
+    return ctx->text;
 }
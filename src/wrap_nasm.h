@@ -16,15 +16,44 @@
 // along with ELF Explorer.  If not, see <https://www.gnu.org/licenses/>.
 
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef void ( *DisasmCallback )( int offset, int len, char *instruction_str, void *user_data );
+// Holds the buffers reused across calls, and the interned mnemonics. A
+// context must only be used by one thread at a time.
+typedef struct DisasmContext DisasmContext;
 
-void DisasmExecutableSection( unsigned char *data, uint64_t size, DisasmCallback cb_fn, void *cb_data );
+typedef struct
+{
+    uint64_t offset;
+    uint64_t branch_target; // Only valid if has_target is set
+    uint32_t text_begin;    // Operand text span in DisasmText()
+    uint32_t text_size;
+    uint16_t mnemonic_id;   // See DisasmMnemonic()
+    uint8_t length;
+    uint8_t is_branch;      // Jumps, calls and loops
+    uint8_t has_target;     // Branch target is an immediate address
+} DisasmInstruction;
+
+DisasmContext* DisasmCreateContext( void );
+void DisasmDestroyContext( DisasmContext *ctx );
+
+// Decodes instructions of `data` starting at offset `begin` until `end` is
+// reached or `max_records` are written. Returns number of records, and
+// `*next_offset` is where the next batch should start. Operand text of the
+// records stays valid until the next call.
+size_t DisasmDecodeBatch( DisasmContext *ctx, const unsigned char *data, uint64_t size,
+                          uint64_t begin, uint64_t end,
+                          DisasmInstruction *records, size_t max_records, uint64_t *next_offset );
+
+// Mnemonics include their prefixes, e.g. `rep stosq`. Ids are only
+// meaningful within the context they come from.
+const char* DisasmMnemonic( const DisasmContext *ctx, uint16_t mnemonic_id );
+const char* DisasmText( const DisasmContext *ctx );
 
 #ifdef __cplusplus
 }
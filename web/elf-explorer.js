@@ -32,9 +32,731 @@ function passFileToEmscripten( file ) {
   } );
 }
 
-function replacePageWith( htmlContents ) {
+// Tables with at least this many rows are shown by `VirtualTable`, which only
+// creates the rows in view
+const virtualTableRows = 1000;
+
+// The disassembler is a separate wasm module (disasm.wasm next to
+// object_explorer.js) downloaded the first time the page shows code
+let disassemblerLoaded = null;
+
+function loadDisassembler() {
+  if ( !disassemblerLoaded ) {
+    disassemblerLoaded = new Promise( ( resolve, reject ) => {
+      // The preload plugin compiles it asynchronously, so the c++ side can
+      // dlopen it without blocking the page
+      Module.FS_createPreloadedFile( '/', 'disasm.wasm', `./${ wasmDir }disasm.wasm`, true, false, resolve, reject );
+    } ).then( () => {
+      if ( !Module.ccall( 'load_disassembler', 'boolean', ['string'], ['/disasm.wasm'] ) ) {
+        throw new Error( 'Could not load disasm.wasm' );
+      }
+    } );
+  }
+  return disassemblerLoaded;
+}
+
+// Pulls rendered html from the c++ side one chunk at a time (section header
+// table first, then one chunk per section).
+function htmlChunkStream( addr, len ) {
+  let next = 0;
+  return new ReadableStream( {
+    start( controller ) {
+      Module.ccall( 'open_buffer', null, ['number', 'number', 'number'], [addr, len, virtualTableRows] );
+    },
+    async pull( controller ) {
+      // Chunk i is section i
+      if ( Module.ccall( 'section_needs_disassembler', 'boolean', ['number'], [next] ) ) {
+        await loadDisassembler();
+      }
+      next += 1;
+      let chunk = Module.ccall( 'next_html_chunk', 'string', [], [] );
+      if ( chunk.length == 0 ) {
+        controller.close();
+      } else {
+        controller.enqueue( chunk );
+      }
+    },
+  }, new CountQueuingStrategy( { highWaterMark: 1 } ) );
+}
+
+// Same chunks rendered by `elf_explorer --serve`, for an object given by its
+// path on the machine running the server.
+function serverChunkStream( file ) {
+  let query = 'file=' + encodeURIComponent( file ) + '&compact=1';
+  let next = 0;
+  let numSections = 0;
+  return new ReadableStream( {
+    async start( controller ) {
+      let info = await fetch( `/api/info?${query}` ).then( ( v ) => v.json() );
+      numSections = info.sections;
+    },
+    async pull( controller ) {
+      if ( next != 0 && next >= numSections ) {
+        controller.close();
+        return;
+      }
+      let url = next == 0 ? `/api/headers?${query}` : `/api/section?${query}&idx=${next}&virtual_rows=${virtualTableRows}`;
+      next += 1;
+      controller.enqueue( await fetch( url ).then( ( v ) => v.text() ) );
+    },
+  }, new CountQueuingStrategy( { highWaterMark: 1 } ) );
+}
+
+// Html of the disassembly of the function defined by a symbol, empty if it is
+// not one. Decoded on demand, by the server when the page shows a file from
+// `elf_explorer --serve`.
+async function functionHtml( symtabIdx, symbolIdx ) {
+  if ( serverFile ) {
+    let query = 'file=' + encodeURIComponent( serverFile ) + '&compact=1';
+    let res = await fetch( `/api/function?${query}&section=${symtabIdx}&symbol=${symbolIdx}` );
+    return res.ok ? res.text() : '';
+  }
+  if ( Module.ccall( 'function_needs_disassembler', 'boolean', ['number', 'number'], [symtabIdx, symbolIdx] ) ) {
+    await loadDisassembler();
+  }
+  return Module.ccall( 'disasm_function', 'string', ['number', 'number'], [symtabIdx, symbolIdx] );
+}
+
+// Html of the relocations referring to a symbol, empty if there are none
+async function referencesHtml( symtabIdx, symbolIdx ) {
+  if ( serverFile ) {
+    let query = 'file=' + encodeURIComponent( serverFile ) + '&compact=1';
+    let res = await fetch( `/api/references?${query}&section=${symtabIdx}&symbol=${symbolIdx}` );
+    return res.ok ? res.text() : '';
+  }
+  return Module.ccall( 'symbol_references', 'string', ['number', 'number'], [symtabIdx, symbolIdx] );
+}
+
+// The references to a symbol followed by its disassembly if it is a function
+async function symbolDetailHtml( symtabIdx, symbolIdx, isFunction ) {
+  let [ refs, code ] = await Promise.all( [
+    referencesHtml( symtabIdx, symbolIdx ),
+    isFunction ? functionHtml( symtabIdx, symbolIdx ) : '',
+  ] );
+  return refs + code;
+}
+
+// Clicking the name of a symbol in a symbol table expands what refers to it
+// and, for a function, its disassembly below the row. Clicking again
+// collapses it.
+async function toggleSymbol( ev ) {
+  let cell = ev.target.closest( 'td' );
+  let row = cell && cell.parentElement;
+  if ( !row || cell.cellIndex != 1 || row.cells.length < 4 ) {
+    return;
+  }
+  let isFunction = row.cells[ 3 ].innerText == 'STT_FUNC';
+  // Rows of compact markup are link targets themselves
+  let anchor = row.querySelector( 'a.sticky-anchor' );
+  let name = row.id || ( anchor && anchor.name );
+  let match = name && name.match( /^section-(\d+)-symbol-(\d+)$/ );
+  if ( !match ) {
+    return;
+  }
+
+  // Rows of a virtual table come and go while scrolling, the detail is
+  // shown below the table instead
+  let container = row.closest( '.virtual-table' );
+  if ( container ) {
+    container.virtualTable.toggleDetail( name, () => symbolDetailHtml( Number( match[ 1 ] ), Number( match[ 2 ] ), isFunction ) );
+    return;
+  }
+
+  let next = row.nextElementSibling;
+  if ( next && next.classList.contains( 'symbol-detail' ) ) {
+    next.remove();
+    return;
+  }
+
+  let html = await symbolDetailHtml( Number( match[ 1 ] ), Number( match[ 2 ] ), isFunction );
+  if ( html.length != 0 ) {
+    row.insertAdjacentHTML( 'afterend', `<tr class="symbol-detail"><td colspan="${row.cells.length}">${html}</td></tr>` );
+  }
+}
+
+document.addEventListener( 'click', toggleSymbol );
+
+// Compact markup, see `Markup` in html_output.hpp, has no inline handlers or
+// links, one handler for the page shows the popups of its enum values and
+// links to rows from their first cell
+document.addEventListener( 'click', ( ev ) => {
+  let value = ev.target.closest( 'span.e' );
+  if ( value ) {
+    // The popup is added into the span, the name is its first text
+    let name = value.firstChild.textContent;
+    if ( typeof enum_info != 'undefined' && name in enum_info ) {
+      addPopup( ev, name );
+    }
+    return;
+  }
+
+  let cell = ev.target.closest( 'td' );
+  let row = cell && cell.parentElement;
+  if ( row && row.id && cell.cellIndex == 0 ) {
+    window.location.hash = row.id;
+  }
+} );
+
+// Rows of the table of a section packed by column, see table_data.hpp. Null
+// if the section has no rows.
+async function tableData( sectionIdx ) {
+  if ( serverFile ) {
+    let query = 'file=' + encodeURIComponent( serverFile );
+    let res = await fetch( `/api/table?${query}&section=${sectionIdx}` );
+    return res.ok ? res.arrayBuffer() : null;
+  }
+  if ( Module.ccall( 'section_needs_disassembler', 'boolean', ['number'], [sectionIdx] ) ) {
+    await loadDisassembler();
+  }
+  let addr = Module.ccall( 'table_data', 'number', ['number'], [sectionIdx] );
+  if ( addr == 0 ) {
+    return null;
+  }
+  // Copied out, the c++ side reuses its buffer and growing the wasm memory
+  // would detach views of the heap
+  return HEAPU8.slice( addr, addr + HEAPU32[ addr >> 2 ] ).buffer;
+}
+
+const TableColumnKind = {
+  Uint32: 0,
+  Uint64: 1,
+  Int64: 2,
+  Offset: 3,
+  Text: 4,
+  Enum: 5,
+  SymbolIndex: 6,
+};
+
+const utf8Decoder = new TextDecoder();
+
+// Typed array views of the columns in a buffer from `tableData`
+class TableData {
+  constructor( buffer ) {
+    let header = new Uint32Array( buffer, 0, 4 );
+    this.numRows = header[ 1 ];
+    this.strings = new Uint8Array( buffer, header[ 3 ] );
+    this.columns = [];
+
+    let columns = new Uint32Array( buffer, 16, 4 * header[ 2 ] );
+    for ( let i = 0; i < header[ 2 ]; ++i ) {
+      let kind = columns[ 4 * i ];
+      let offset = columns[ 4 * i + 2 ];
+      let values;
+      if ( kind == TableColumnKind.Int64 ) {
+        values = new BigInt64Array( buffer, offset, this.numRows );
+      } else if ( kind == TableColumnKind.Uint64 || kind == TableColumnKind.Offset ) {
+        values = new BigUint64Array( buffer, offset, this.numRows );
+      } else {
+        values = new Uint32Array( buffer, offset, this.numRows );
+      }
+      this.columns.push( { kind, title: this.string( columns[ 4 * i + 1 ] ), values } );
+    }
+  }
+
+  isText( column ) {
+    let kind = this.columns[ column ].kind;
+    return kind == TableColumnKind.Text || kind == TableColumnKind.Enum;
+  }
+
+  string( offset ) {
+    return utf8Decoder.decode( this.strings.subarray( offset, this.strings.indexOf( 0, offset ) ) );
+  }
+
+  // All the strings with one character per byte, so positions in it are
+  // offsets in `strings`. Decoded once, for searching and sorting.
+  bytes() {
+    if ( !this.bytesString ) {
+      this.bytesString = new TextDecoder( 'latin1' ).decode( this.strings );
+    }
+    return this.bytesString;
+  }
+
+  // Bit set of the offsets of the strings containing `text`, found by
+  // searching all of them at once rather than the string of each row
+  stringsContaining( text ) {
+    let all = this.bytes();
+    let needle = new TextDecoder( 'latin1' ).decode( new TextEncoder().encode( text ) );
+    let found = new Uint32Array( ( all.length >>> 5 ) + 1 );
+    for ( let pos = all.indexOf( needle ); pos >= 0; pos = all.indexOf( needle, pos + 1 ) ) {
+      let begin = all.lastIndexOf( '\0', pos ) + 1;
+      found[ begin >>> 5 ] |= 1 << ( begin & 31 );
+      pos = all.indexOf( '\0', pos );
+    }
+    return found;
+  }
+
+  // The 32 bit words of the values of a numeric column, least significant
+  // first, as the values of row r being `array[ stride * r + index ] ^ xor`.
+  // Lets 64 bit values be compared and sorted without a BigInt per row.
+  numericWords( column ) {
+    let { kind, values } = this.columns[ column ];
+    if ( values instanceof Uint32Array ) {
+      return [ { array: values, stride: 1, index: 0, xor: 0 } ];
+    }
+    let array = new Uint32Array( values.buffer, values.byteOffset, 2 * values.length );
+    return [
+      { array, stride: 2, index: 0, xor: 0 },
+      // Flipping the sign bit orders signed values as unsigned ones
+      { array, stride: 2, index: 1, xor: kind == TableColumnKind.Int64 ? 0x80000000 : 0 },
+    ];
+  }
+
+  // Sorts `rows` by a column, ties keeping their order
+  sortRows( rows, column, descending ) {
+    if ( this.isText( column ) ) {
+      return radixSortRowsByString( rows, this.columns[ column ].values, this.strings, descending );
+    }
+    return radixSortRows( rows, this.numericWords( column ), descending );
+  }
+}
+
+// Stable LSD radix sort of `rows` by 16 bit digits of their keys, see
+// `numericWords`. Digits that are the same for all rows are skipped, e.g. the
+// high words of small values.
+function radixSortRows( rows, words, descending ) {
+  let n = rows.length;
+  let tmp = new Uint32Array( n );
+  let counts = new Uint32Array( 65536 );
+  for ( let { array, stride, index, xor } of words ) {
+    xor = descending ? ~xor : xor;
+    for ( let shift = 0; shift < 32; shift += 16 ) {
+      counts.fill( 0 );
+      for ( let i = 0; i < n; ++i ) {
+        ++counts[ ( ( array[ stride * rows[ i ] + index ] ^ xor ) >>> shift ) & 0xffff ];
+      }
+      if ( counts.includes( n ) ) {
+        continue;
+      }
+      for ( let digit = 0, offset = 0; digit < 65536; ++digit ) {
+        let count = counts[ digit ];
+        counts[ digit ] = offset;
+        offset += count;
+      }
+      for ( let i = 0; i < n; ++i ) {
+        let row = rows[ i ];
+        tmp[ counts[ ( ( array[ stride * row + index ] ^ xor ) >>> shift ) & 0xffff ]++ ] = row;
+      }
+      [ rows, tmp ] = [ tmp, rows ];
+    }
+  }
+  return rows;
+}
+
+// Stable MSD radix sort of `rows` by the strings at `offsets[ row ]` in
+// `strings`, in byte order like the c++ side sorts names. Comparing js
+// strings would need one per row and is several times slower. Buckets are
+// split by the byte at their depth until small enough for an insertion sort.
+function radixSortRowsByString( rows, offsets, strings, descending ) {
+  let flip = descending ? 255 : 0;
+  let compare = ( a, b, depth ) => {
+    for ( let i = offsets[ a ] + depth, j = offsets[ b ] + depth; ; ++i, ++j ) {
+      let x = strings[ i ] ^ flip;
+      let y = strings[ j ] ^ flip;
+      if ( x != y || x == flip ) {
+        return x - y;
+      }
+    }
+  };
+
+  let tmp = new Uint32Array( rows.length );
+  let counts = new Uint32Array( 256 );
+  let buckets = [ [ 0, rows.length, 0 ] ];
+  while ( buckets.length != 0 ) {
+    let [ begin, end, depth ] = buckets.pop();
+    if ( end - begin < 32 ) {
+      for ( let i = begin + 1; i < end; ++i ) {
+        let row = rows[ i ];
+        let j = i;
+        for ( ; j > begin && compare( rows[ j - 1 ], row, depth ) > 0; --j ) {
+          rows[ j ] = rows[ j - 1 ];
+        }
+        rows[ j ] = row;
+      }
+      continue;
+    }
+
+    counts.fill( 0 );
+    for ( let i = begin; i < end; ++i ) {
+      ++counts[ strings[ offsets[ rows[ i ] ] + depth ] ^ flip ];
+    }
+    // Strings that ended (the nul byte) are equal and stay in order
+    if ( counts[ flip ] == end - begin ) {
+      continue;
+    }
+    if ( counts.includes( end - begin ) ) {
+      buckets.push( [ begin, end, depth + 1 ] );
+      continue;
+    }
+
+    for ( let digit = 0, offset = begin; digit < 256; ++digit ) {
+      let count = counts[ digit ];
+      counts[ digit ] = offset;
+      offset += count;
+      if ( count > 1 && digit != flip ) {
+        buckets.push( [ offset - count, offset, depth + 1 ] );
+      }
+    }
+    for ( let i = begin; i < end; ++i ) {
+      let row = rows[ i ];
+      tmp[ counts[ strings[ offsets[ row ] + depth ] ^ flip ]++ ] = row;
+    }
+    rows.set( tmp.subarray( begin, end ), begin );
+  }
+  return rows;
+}
+
+// Shows a `TableData`, creating only the rows in view and a few around them
+// as it is scrolled, so it stays fast with millions of rows. Clicking a
+// column header sorts by it, the filter keeps the rows with the text in a
+// string column or the number in a numeric one.
+class VirtualTable {
+  constructor( container, data ) {
+    this.container = container;
+    this.data = data;
+    this.section = Number( container.dataset.section );
+    this.rowHeight = 22;
+    this.sortColumn = -1;
+    this.descending = false;
+    this.filterText = '';
+    this.detailKey = null;
+    this.renderPending = false;
+
+    let headers = data.columns.map( ( c, i ) =>
+      `<th data-column="${i}"${ data.isText( i ) ? ' class="text-column"' : '' }>${ escapeHtml( c.title ) }</th>` );
+    container.innerHTML = `
+      <div class="virtual-table-toolbar"><input type="search" placeholder="Filter"> <span></span></div>
+      <div class="virtual-table-viewport">
+        <table class="sticky-header" border="1" cellspacing="0" cellpadding="3">
+          <thead><tr>${ headers.join( '' ) }</tr></thead>
+          <tbody></tbody>
+        </table>
+      </div>
+      <div class="virtual-table-detail"></div>
+    `;
+    if ( data.columns.some( ( c ) => c.kind == TableColumnKind.Offset ) ) {
+      container.classList.add( 'virtual-table-code' );
+    }
+    container.virtualTable = this;
+
+    this.viewport = container.querySelector( '.virtual-table-viewport' );
+    this.tbody = container.querySelector( 'tbody' );
+    this.count = container.querySelector( '.virtual-table-toolbar span' );
+    this.detail = container.querySelector( '.virtual-table-detail' );
+
+    this.viewport.addEventListener( 'scroll', () => this.scheduleRender() );
+    container.querySelector( 'thead' ).addEventListener( 'click', ( ev ) => {
+      let th = ev.target.closest( 'th' );
+      if ( th ) {
+        this.sortBy( Number( th.dataset.column ) );
+      }
+    } );
+    let filterTimer = null;
+    container.querySelector( 'input' ).addEventListener( 'input', ( ev ) => {
+      clearTimeout( filterTimer );
+      filterTimer = setTimeout( () => this.filter( ev.target.value ), 200 );
+    } );
+
+    this.update();
+  }
+
+  sortBy( column ) {
+    this.descending = column == this.sortColumn && !this.descending;
+    this.sortColumn = column;
+    this.update();
+  }
+
+  filter( text ) {
+    this.filterText = text;
+    this.update();
+  }
+
+  // Recomputes the shown rows, `order` holding their indices
+  update() {
+    let numRows = this.data.numRows;
+    let rows = new Uint32Array( numRows );
+    let count = 0;
+    if ( this.filterText.length == 0 ) {
+      for ( let row = 0; row < numRows; ++row ) {
+        rows[ count++ ] = row;
+      }
+    } else {
+      let matchers = this.matchers( this.filterText );
+      for ( let row = 0; row < numRows; ++row ) {
+        if ( matchers.some( ( m ) => m( row ) ) ) {
+          rows[ count++ ] = row;
+        }
+      }
+      rows = rows.slice( 0, count );
+    }
+
+    if ( this.sortColumn >= 0 ) {
+      rows = this.data.sortRows( rows, this.sortColumn, this.descending );
+    }
+
+    this.order = rows;
+    this.count.innerText = count == numRows ? `${numRows} rows` : `${count} of ${numRows} rows`;
+    for ( let th of this.container.querySelectorAll( 'th' ) ) {
+      let column = Number( th.dataset.column );
+      th.classList.toggle( 'sorted-ascending', column == this.sortColumn && !this.descending );
+      th.classList.toggle( 'sorted-descending', column == this.sortColumn && this.descending );
+    }
+    this.viewport.scrollTop = 0;
+    this.render();
+  }
+
+  // One function per column telling if a row matches the filter text
+  matchers( text ) {
+    let number = /^-?[0-9]+$/.test( text ) ? BigInt.asUintN( 64, BigInt( text ) ) : null;
+    let found = null;
+    let res = [];
+    this.data.columns.forEach( ( { values }, i ) => {
+      if ( this.data.isText( i ) ) {
+        found = found || this.data.stringsContaining( text );
+        res.push( ( row ) => ( found[ values[ row ] >>> 5 ] >>> ( values[ row ] & 31 ) ) & 1 );
+      } else if ( number !== null ) {
+        let lo = Number( number & 0xffffffffn );
+        let hi = Number( number >> 32n );
+        let [ low, high ] = this.data.numericWords( i );
+        if ( !high ) {
+          res.push( hi == 0 ? ( row ) => values[ row ] == lo : () => false );
+        } else {
+          res.push( ( row ) => low.array[ 2 * row ] == lo && high.array[ 2 * row + 1 ] == hi );
+        }
+      }
+    } );
+    return res;
+  }
+
+  scheduleRender() {
+    if ( !this.renderPending ) {
+      this.renderPending = true;
+      requestAnimationFrame( () => {
+        this.renderPending = false;
+        this.render();
+      } );
+    }
+  }
+
+  // Browsers limit the height of an element, past that the scroll position
+  // is scaled to the rows
+  layout() {
+    const maxHeight = 8000000;
+    let total = this.order.length * this.rowHeight;
+    let height = Math.min( total, maxHeight );
+    let visible = this.viewport.clientHeight;
+    let scale = height > visible ? ( total - visible ) / ( height - visible ) : 1;
+    return { height, scale };
+  }
+
+  render() {
+    const overscan = 10;
+    let { height, scale } = this.layout();
+    let scrollTop = this.viewport.scrollTop;
+    let pos = scrollTop * scale;
+    let first = Math.floor( pos / this.rowHeight );
+    let begin = Math.max( 0, first - overscan );
+    let end = Math.min( this.order.length, Math.ceil( ( pos + this.viewport.clientHeight ) / this.rowHeight ) + overscan );
+
+    // Spacer rows above and below keep the scroll height
+    let above = Math.max( 0, scrollTop - ( pos - first * this.rowHeight ) - ( first - begin ) * this.rowHeight );
+    let below = Math.max( 0, height - above - ( end - begin ) * this.rowHeight );
+    let html = `<tr style="height: ${above}px"></tr>`;
+    for ( let i = begin; i < end; ++i ) {
+      html += this.rowHtml( this.order[ i ] );
+    }
+    html += `<tr style="height: ${below}px"></tr>`;
+    this.tbody.innerHTML = html;
+
+    // Rows are laid out with the page style, measured on the first render
+    if ( end > begin && !this.measured ) {
+      this.measured = true;
+      let measured = this.tbody.rows[ 1 ].getBoundingClientRect().height;
+      if ( measured > 0 && measured != this.rowHeight ) {
+        this.rowHeight = measured;
+        this.render();
+      }
+    }
+  }
+
+  rowHtml( row ) {
+    let cells = this.data.columns.map( ( { kind, values } ) => {
+      let v = values[ row ];
+      switch ( kind ) {
+        case TableColumnKind.SymbolIndex: {
+          return `<td>${v}</td>`;
+        }
+        case TableColumnKind.Offset:
+          return `<td>${ String( v ).padStart( 8, '0' ) }</td>`;
+        case TableColumnKind.Text:
+          return `<td>${ escapeHtml( this.data.string( v ) ) }</td>`;
+        case TableColumnKind.Enum: {
+          let name = this.data.string( v );
+          if ( typeof enum_info != 'undefined' && name in enum_info ) {
+            return `<td class="enum-cell"><span class="e">${name}</span></td>`;
+          }
+          return `<td>${ escapeHtml( name ) }</td>`;
+        }
+        default:
+          return `<td>${v}</td>`;
+      }
+    } );
+    let id = this.data.columns.find( ( { kind } ) => kind == TableColumnKind.SymbolIndex );
+    if ( id ) {
+      return `<tr id="section-${this.section}-symbol-${ id.values[ row ] }">${ cells.join( '' ) }</tr>`;
+    }
+    return `<tr>${ cells.join( '' ) }</tr>`;
+  }
+
+  // Scrolls to the row with the given index, e.g. for a link to a symbol
+  scrollToRow( row ) {
+    let pos = this.order.indexOf( row );
+    if ( pos < 0 ) {
+      return;
+    }
+    let { scale } = this.layout();
+    this.viewport.scrollTop = pos * this.rowHeight / scale;
+    this.container.scrollIntoView();
+    this.render();
+  }
+
+  // Shows `html()` below the table, or hides it if it is the one for `key`
+  async toggleDetail( key, html ) {
+    if ( this.detailKey == key ) {
+      this.detailKey = null;
+      this.detail.innerHTML = '';
+      return;
+    }
+    this.detailKey = key;
+    let content = await html();
+    if ( this.detailKey == key ) {
+      this.detail.innerHTML = content;
+    }
+  }
+}
+
+async function loadVirtualTable( container ) {
+  container.innerText = 'Loading...';
+  let buffer = await tableData( Number( container.dataset.section ) );
+  if ( buffer ) {
+    new VirtualTable( container, new TableData( buffer ) );
+  } else {
+    container.innerText = '';
+  }
+}
+
+// Table data is only loaded once the table is about to be scrolled into view
+const virtualTableObserver = new IntersectionObserver( ( entries, observer ) => {
+  for ( let entry of entries ) {
+    if ( entry.isIntersecting ) {
+      observer.unobserve( entry.target );
+      entry.target.loading = loadVirtualTable( entry.target );
+    }
+  }
+}, { rootMargin: '1000px' } );
+
+function observeVirtualTables( root ) {
+  for ( let container of root.querySelectorAll( '.virtual-table:not([data-observed])' ) ) {
+    container.dataset.observed = '';
+    virtualTableObserver.observe( container );
+  }
+}
+
+// Links to a symbol in a virtual table scroll to its row, which only exists
+// while it is shown
+window.addEventListener( 'hashchange', async () => {
+  let match = window.location.hash.match( /^#section-(\d+)-symbol-(\d+)$/ );
+  let target = window.location.hash.substr( 1 );
+  if ( !match || document.getElementById( target ) || document.getElementsByName( target ).length != 0 ) {
+    return;
+  }
+  let container = document.querySelector( `.virtual-table[data-section="${ match[ 1 ] }"]` );
+  if ( !container ) {
+    return;
+  }
+  if ( !container.loading ) {
+    virtualTableObserver.unobserve( container );
+    container.loading = loadVirtualTable( container );
+  }
+  await container.loading;
+  if ( container.virtualTable ) {
+    container.virtualTable.scrollToRow( Number( match[ 2 ] ) );
+  }
+} );
+
+// Results listed by the name search box
+const searchResultLimit = 200;
+
+// Html links to the sections and symbols whose name contains `text`
+async function searchNames( text ) {
+  if ( serverFile ) {
+    let query = 'file=' + encodeURIComponent( serverFile );
+    let res = await fetch( `/api/search?${query}&q=${ encodeURIComponent( text ) }&limit=${searchResultLimit}` );
+    return res.ok ? res.text() : '';
+  }
+  return Module.ccall( 'search_names', 'string', ['string', 'number'], [text, searchResultLimit] );
+}
+
+function addSearchBox( body ) {
+  body.insertAdjacentHTML( 'afterbegin', `
+    <div class="name-search">
+      <input type="search" placeholder="Search section and symbol names">
+      <div class="name-search-results"></div>
+    </div>
+  ` );
+  let input = body.querySelector( '.name-search input' );
+  let results = body.querySelector( '.name-search-results' );
+
+  input.addEventListener( 'input', async () => {
+    let text = input.value;
+    let html = text.length == 0 ? '' : await searchNames( text );
+    // Answers to earlier keystrokes can arrive late
+    if ( input.value != text ) {
+      return;
+    }
+    results.innerHTML = html;
+    let count = results.childElementCount;
+    if ( text.length != 0 && ( count == 0 || count == searchResultLimit ) ) {
+      results.insertAdjacentHTML( 'afterbegin', `<div class="name-search-note">${ count == 0 ? 'No matches' : `First ${count} matches` }</div>` );
+    }
+  } );
+
+  // Following a link closes the results
+  results.addEventListener( 'click', ( ev ) => {
+    if ( ev.target.closest( 'a' ) ) {
+      results.innerHTML = '';
+    }
+  } );
+}
+
+function nextFrame() {
+  return new Promise( ( resolve ) => requestAnimationFrame( resolve ) );
+}
+
+async function streamPageWith( addr, len ) {
+  await streamPageFrom( htmlChunkStream( addr, len ) );
+}
+
+// Appends chunks as they are rendered, yielding to the browser in between so
+// the first sections are shown while the rest is still being rendered.
+async function streamPageFrom( stream ) {
   window.location = '#';
-  document.getElementsByTagName( 'html' )[0].innerHTML = htmlContents;
+  document.getElementsByTagName( 'html' )[0].innerHTML = `
+    <head><link rel="stylesheet" type="text/css" href="style.css"></head>
+    <body></body>
+  `;
+
+  let body = document.body;
+  addSearchBox( body );
+  let reader = stream.getReader();
+  while ( true ) {
+    let { done, value } = await reader.read();
+    if ( done ) {
+      break;
+    }
+    body.insertAdjacentHTML( 'beforeend', value );
+    observeVirtualTables( body );
+    await nextFrame();
+  }
 }
 
 async function useExampleObject( objPath ) {
@@ -44,8 +766,7 @@ async function useExampleObject( objPath ) {
   console.log( arr );
   emAddr = allocate( arr,  'i8', ALLOC_NORMAL );
   console.log( emAddr, 'emaddr' );
-  htmlContents = Module.ccall( 'run_with_buffer', 'string', ['number', 'number'], [emAddr, arr.length] );
-  replacePageWith( htmlContents );
+  await streamPageWith( emAddr, arr.length );
 }
 
 function escapeHtml(unsafe) {
@@ -133,7 +854,18 @@ function resetToHomePage() {
   `;
 }
 
+// Path of the object on the server, when opened from `elf_explorer --serve`
+var serverFile = null;
+
 window.onload = function() {
+  // Opened as `/?file=<path>` from `elf_explorer --serve`
+  let file = new URLSearchParams( window.location.search ).get( 'file' );
+  if ( file ) {
+    serverFile = file;
+    streamPageFrom( serverChunkStream( file ) );
+    return;
+  }
+
   resetToHomePage();
 
   document.getElementById( 'drop-area' ).addEventListener( 'dragover', ev => {
@@ -157,9 +889,6 @@ window.onload = function() {
       return;
     }
 
-    passFileToEmscripten( item.getAsFile() ).then( ( [addr, len] ) => {
-      var htmlContents = Module.ccall( 'run_with_buffer', 'string', ['number', 'number'], [addr, len] );
-      replacePageWith( htmlContents );
-    } );
+    passFileToEmscripten( item.getAsFile() ).then( ( [addr, len] ) => streamPageWith( addr, len ) );
   });
 };